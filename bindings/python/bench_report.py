@@ -0,0 +1,84 @@
+#!/usr/bin/env python3
+#
+# bench_report.py - Compare the bindings against scraping the markdown report
+#
+# Usage: bench_report.py [--cli PATH] [--repeat N] capture.pcap [...]
+#
+# For each capture, times (a) modbus_parse.read_pcap() and (b) the old
+# workflow: run the CLI with -r and regex-parse the Traffic Summary table
+# of <capture>_analysis.md. Reports frames/second for both.
+#
+# Copyright (C) 2025 Marty
+# SPDX-License-Identifier: GPL-3.0-or-later
+#
+
+import argparse
+import os
+import re
+import subprocess
+import sys
+import time
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import modbus_parse  # noqa: E402
+
+ROW = re.compile(r"^\| (\d+) \| ([^|]+) \| ([\d.]+):(\d+) \| ([\d.]+):(\d+) \| "
+                 r"0x([0-9A-F]{4}) \| 0x([0-9A-F]{2}) \| ([^|]+) \| ([^|]*) \|")
+ADDR = re.compile(r"Addr=(\d+), Qty=(\d+)")
+
+
+def scrape_report(cli, pcap):
+    subprocess.run([cli, "-r", pcap], check=True, stdout=subprocess.DEVNULL)
+    report = os.path.splitext(pcap)[0] + "_analysis.md"
+    rows = []
+    with open(report, encoding="utf-8") as f:
+        for line in f:
+            m = ROW.match(line)
+            if not m:
+                continue
+            addr = ADDR.search(m.group(10))
+            rows.append((m.group(3), int(m.group(4)), m.group(5), int(m.group(6)),
+                         int(m.group(7), 16), int(m.group(8), 16),
+                         int(addr.group(1)) if addr else -1,
+                         int(addr.group(2)) if addr else -1))
+    os.remove(report)
+    return rows
+
+
+def best_of(repeat, fn):
+    best = None
+    result = None
+    for _ in range(repeat):
+        start = time.perf_counter()
+        result = fn()
+        elapsed = time.perf_counter() - start
+        best = elapsed if best is None else min(best, elapsed)
+    return best, result
+
+
+def main():
+    here = os.path.dirname(os.path.abspath(__file__))
+    default_cli = os.path.join(here, "..", "..", "build", "modbus_parser")
+
+    ap = argparse.ArgumentParser(description=__doc__)
+    ap.add_argument("--cli", default=default_cli, help="modbus_parser executable")
+    ap.add_argument("--repeat", type=int, default=5, help="runs per method (best kept)")
+    ap.add_argument("pcaps", nargs="+")
+    args = ap.parse_args()
+
+    print("library %s" % modbus_parse.library_version())
+    print("%-32s %8s %14s %14s %8s" % ("capture", "frames", "bindings f/s", "report f/s",
+                                       "speedup"))
+    for pcap in args.pcaps:
+        t_lib, frames = best_of(args.repeat, lambda: modbus_parse.read_pcap(pcap))
+        t_md, rows = best_of(args.repeat, lambda: scrape_report(args.cli, pcap))
+        if len(rows) != len(frames):
+            print("warning: %s: report has %d rows, bindings %d frames"
+                  % (pcap, len(rows), len(frames)), file=sys.stderr)
+        print("%-32s %8d %14.0f %14.0f %7.1fx"
+              % (os.path.basename(pcap), len(frames), len(frames) / t_lib,
+                 len(rows) / t_md, t_md / t_lib))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,259 @@
+#
+# modbus_parse - Python bindings for the modbus_parse C library
+#
+# Decodes Modbus TCP captures into NumPy column arrays. The arrays are
+# views of the C library's column buffers (see src/modbus_columns.h);
+# nothing is copied row by row and no markdown is involved.
+#
+#   import modbus_parse
+#   frames = modbus_parse.read_pcap("capture.pcap")
+#   frames.function_code, frames.address, frames.timestamp_ns, ...
+#   frames.endpoints[frames.src_id[0]]          # "10.0.0.1" or "fd00::1"
+#
+#   for chunk in modbus_parse.iter_pcap("huge.pcap", chunk_size=1 << 20):
+#       ...
+#
+# Copyright (C) 2025 Marty
+# SPDX-License-Identifier: GPL-3.0-or-later
+#
+
+import ctypes
+import ctypes.util
+import os
+import sys
+
+import numpy as np
+
+__all__ = ["Frames", "ModbusParseError", "COLUMNS", "NO_ADDRESS",
+           "read_pcap", "iter_pcap", "library_version"]
+
+# Marker in the address/quantity columns for frames without an address
+NO_ADDRESS = -1
+
+# Column name -> ctypes element type, in modbus_columns_t field order
+COLUMNS = (
+    ("timestamp_ns", ctypes.c_int64),
+    ("src_id", ctypes.c_uint32),
+    ("src_port", ctypes.c_uint16),
+    ("dst_id", ctypes.c_uint32),
+    ("dst_port", ctypes.c_uint16),
+    ("unit_id", ctypes.c_uint8),
+    ("function_code", ctypes.c_uint8),
+    ("transaction_id", ctypes.c_uint16),
+    ("address", ctypes.c_int32),
+    ("quantity", ctypes.c_int32),
+    ("exception_code", ctypes.c_uint8),
+    ("is_request", ctypes.c_uint8),
+)
+
+_NO_MEMORY = -2
+_DEFAULT_CHUNK = 65536
+
+
+class ModbusParseError(RuntimeError):
+    """Raised when a capture cannot be opened or read."""
+
+
+class _ColumnsStruct(ctypes.Structure):
+    # Mirrors modbus_columns_t; fields are only ever appended on the C side
+    _fields_ = [("count", ctypes.c_size_t), ("capacity", ctypes.c_size_t)] + \
+               [(name, ctypes.POINTER(ctype)) for name, ctype in COLUMNS]
+
+
+def _library_names():
+    if sys.platform == "win32":
+        return ("libmodbus_parse.dll", "modbus_parse.dll")
+    if sys.platform == "darwin":
+        return ("libmodbus_parse.dylib",)
+    return ("libmodbus_parse.so", "libmodbus_parse.so.1")
+
+
+def _load_library():
+    """Locate libmodbus_parse: $MODBUS_PARSE_LIBRARY, the system, then build/."""
+    path = os.environ.get("MODBUS_PARSE_LIBRARY")
+    if path:
+        return ctypes.CDLL(path)
+
+    found = ctypes.util.find_library("modbus_parse")
+    if found:
+        return ctypes.CDLL(found)
+
+    repo = os.path.abspath(os.path.join(os.path.dirname(__file__), "..", "..", ".."))
+    for name in _library_names():
+        candidate = os.path.join(repo, "build", name)
+        if os.path.exists(candidate):
+            return ctypes.CDLL(candidate)
+
+    raise ModbusParseError("libmodbus_parse not found; build it with CMake or set "
+                           "MODBUS_PARSE_LIBRARY to its path")
+
+
+_lib = _load_library()
+
+_lib.modbus_session_open.restype = ctypes.c_void_p
+_lib.modbus_session_open.argtypes = [ctypes.c_char_p, ctypes.c_uint, ctypes.c_char_p,
+                                     ctypes.c_size_t]
+_lib.modbus_session_error.restype = ctypes.c_char_p
+_lib.modbus_session_error.argtypes = [ctypes.c_void_p]
+_lib.modbus_session_close.restype = None
+_lib.modbus_session_close.argtypes = [ctypes.c_void_p]
+_lib.modbus_session_frame_count.restype = ctypes.c_uint64
+_lib.modbus_session_frame_count.argtypes = [ctypes.c_void_p]
+_lib.modbus_session_packet_count.restype = ctypes.c_uint64
+_lib.modbus_session_packet_count.argtypes = [ctypes.c_void_p]
+_lib.modbus_session_endpoint_count.restype = ctypes.c_uint32
+_lib.modbus_session_endpoint_count.argtypes = [ctypes.c_void_p]
+_lib.modbus_session_endpoint_name.restype = ctypes.c_char_p
+_lib.modbus_session_endpoint_name.argtypes = [ctypes.c_void_p, ctypes.c_uint32]
+_lib.modbus_parse_version.restype = ctypes.c_char_p
+_lib.modbus_parse_version.argtypes = []
+
+_lib.modbus_columns_create.restype = ctypes.POINTER(_ColumnsStruct)
+_lib.modbus_columns_create.argtypes = [ctypes.c_size_t]
+_lib.modbus_columns_fill.restype = ctypes.c_int64
+_lib.modbus_columns_fill.argtypes = [ctypes.c_void_p, ctypes.POINTER(_ColumnsStruct),
+                                     ctypes.c_size_t]
+_lib.modbus_columns_destroy.restype = None
+_lib.modbus_columns_destroy.argtypes = [ctypes.POINTER(_ColumnsStruct)]
+
+
+def library_version():
+    """Version string of the loaded C library."""
+    return _lib.modbus_parse_version().decode()
+
+
+class _Columns:
+    """Owns one modbus_columns_t; freed when the last array view is gone."""
+
+    def __init__(self, capacity):
+        self.ptr = _lib.modbus_columns_create(capacity)
+        if not self.ptr:
+            raise MemoryError("modbus_columns_create failed")
+
+    def __del__(self):
+        if getattr(self, "ptr", None):
+            _lib.modbus_columns_destroy(self.ptr)
+            self.ptr = None
+
+    def arrays(self):
+        cols = self.ptr.contents
+        out = {}
+        for name, ctype in COLUMNS:
+            # Wrap the C buffer in place; the ctypes array keeps the owner alive
+            if cols.count:
+                addr = ctypes.cast(getattr(cols, name), ctypes.c_void_p).value
+                buf = (ctype * cols.count).from_address(addr)
+            else:
+                buf = (ctype * 0)()
+            buf._owner = self
+            out[name] = np.frombuffer(buf, dtype=np.dtype(ctype))
+        return out
+
+
+class Frames:
+    """Decoded frames as NumPy columns sharing the C library's memory.
+
+    Columns (one element per frame):
+        timestamp_ns    int64   packet time, nanoseconds since epoch
+        src_id          uint32  source endpoint id (index into endpoints)
+        src_port        uint16  source TCP port
+        dst_id          uint32  destination endpoint id
+        dst_port        uint16  destination TCP port
+        unit_id         uint8   MBAP unit identifier
+        function_code   uint8   function code (0x80+ for exceptions)
+        transaction_id  uint16  MBAP transaction identifier
+        address         int32   start address, or NO_ADDRESS
+        quantity        int32   coils/registers addressed, or NO_ADDRESS
+        exception_code  uint8   exception code, 0 if not an exception
+        is_request      uint8   1 if sent to port 502
+
+    endpoints is a list of address strings (IPv4 or IPv6) indexed by id.
+    Ids are per capture: chunks of one iter_pcap() run share them.
+    """
+
+    def __init__(self, columns, endpoints):
+        self._columns = columns
+        self.endpoints = endpoints
+        self.__dict__.update(columns.arrays())
+
+    def __len__(self):
+        return len(self.timestamp_ns)
+
+    def __repr__(self):
+        return "<modbus_parse.Frames: %d frames>" % len(self)
+
+    def to_dict(self):
+        """Column name -> array mapping (e.g. for pandas.DataFrame)."""
+        return {name: getattr(self, name) for name, _ in COLUMNS}
+
+    def src_ip(self):
+        """Source addresses as strings, one per frame."""
+        return [self.endpoints[i] for i in self.src_id.tolist()]
+
+    def dst_ip(self):
+        """Destination addresses as strings, one per frame."""
+        return [self.endpoints[i] for i in self.dst_id.tolist()]
+
+
+class _Session:
+    def __init__(self, path):
+        err = ctypes.create_string_buffer(256)
+        self.ptr = _lib.modbus_session_open(os.fsencode(path), 0, err, len(err))
+        if not self.ptr:
+            raise ModbusParseError(err.value.decode(errors="replace"))
+        self.endpoints = []
+
+    def close(self):
+        if self.ptr:
+            _lib.modbus_session_close(self.ptr)
+            self.ptr = None
+
+    def __del__(self):
+        self.close()
+
+    def fill(self, columns, max_rows):
+        n = _lib.modbus_columns_fill(self.ptr, columns.ptr, max_rows)
+        if n == _NO_MEMORY:
+            raise MemoryError("modbus_columns_fill: out of memory")
+        if n < 0:
+            raise ModbusParseError(_lib.modbus_session_error(self.ptr).decode(errors="replace"))
+
+        # Only endpoints first seen in this fill need formatting
+        for i in range(len(self.endpoints), _lib.modbus_session_endpoint_count(self.ptr)):
+            self.endpoints.append(_lib.modbus_session_endpoint_name(self.ptr, i).decode())
+        return n
+
+
+def read_pcap(path):
+    """Decode a whole capture into one Frames object.
+
+    Frames that fail to parse are skipped, as in the CLI.
+    """
+    session = _Session(path)
+    try:
+        columns = _Columns(0)
+        session.fill(columns, 0)
+        return Frames(columns, session.endpoints)
+    finally:
+        session.close()
+
+
+def iter_pcap(path, chunk_size=_DEFAULT_CHUNK):
+    """Decode a capture in chunks of at most chunk_size frames.
+
+    Each chunk gets its own C buffer, so arrays from earlier chunks stay
+    valid; memory use stays bounded as long as old chunks are released.
+    """
+    if chunk_size <= 0:
+        raise ValueError("chunk_size must be positive")
+
+    session = _Session(path)
+    try:
+        while True:
+            columns = _Columns(chunk_size)
+            if session.fill(columns, chunk_size) == 0:
+                return
+            yield Frames(columns, session.endpoints)
+    finally:
+        session.close()
+
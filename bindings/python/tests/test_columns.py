@@ -0,0 +1,165 @@
+#
+# test_columns.py - Check the NumPy columns against the CLI's JSON Lines output
+#
+# Usage: python3 -m unittest discover -s bindings/python/tests
+#        (or pytest bindings/python/tests)
+#
+# Decodes the sample captures in build/ with read_pcap() and iter_pcap()
+# and compares every column with `modbus_parser -q --jsonl` on the same
+# capture. Also checks that chunked and whole-file reads agree and that
+# the arrays are views of the C column buffers, not copies.
+#
+# $MODBUS_PARSER_CLI selects the executable (default build/modbus_parser);
+# the library is found as described in bindings/python/README.md.
+#
+# Copyright (C) 2025 Marty
+# SPDX-License-Identifier: GPL-3.0-or-later
+#
+
+import ctypes
+import json
+import os
+import subprocess
+import sys
+import tempfile
+import unittest
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+REPO = os.path.abspath(os.path.join(HERE, "..", "..", ".."))
+sys.path.insert(0, os.path.dirname(HERE))
+
+try:
+    import numpy as np
+except ImportError:
+    raise unittest.SkipTest("NumPy not installed")
+
+import modbus_parse  # noqa: E402
+
+CLI = os.environ.get("MODBUS_PARSER_CLI", os.path.join(REPO, "build", "modbus_parser"))
+CAPTURES = ("Modbus.pcap", "MODBUS-TestDataPart2.pcap")
+
+# Chunk sizes that split both captures unevenly, plus one larger than either
+CHUNK_SIZES = (1, 7, 64, 100000)
+
+
+def cli_frames(pcap):
+    """Frames written by the CLI with --jsonl, as a list of dicts."""
+    with tempfile.TemporaryDirectory() as tmp:
+        out = os.path.join(tmp, "frames.jsonl")
+        subprocess.run([CLI, "-q", "--jsonl", out, pcap], check=True,
+                       stdout=subprocess.DEVNULL, env=dict(os.environ, TZ="UTC"))
+        with open(out, encoding="utf-8") as f:
+            return [json.loads(line) for line in f]
+
+
+def expected_range(row):
+    """(address, quantity) the columns must hold for a CLI row, or None.
+
+    The CLI shows the first two data words of function codes 1-6, 15 and
+    16; the columns hold the addressed range (modbus_get_address_range()).
+    They agree except that single writes (5, 6) address one item, read
+    responses carry a byte count rather than a range, and the CLI shows
+    nothing for 0x16/0x17 requests, which are left unchecked.
+    """
+    fc = row["function_code"]
+    if "address" in row:
+        if fc in (0x05, 0x06):
+            return row["address"], 1
+        if fc <= 0x04 and not row["request"]:
+            return modbus_parse.NO_ADDRESS, modbus_parse.NO_ADDRESS
+        return row["address"], row["quantity"]
+    if fc in (0x16, 0x17) and row["request"]:
+        return None
+    return modbus_parse.NO_ADDRESS, modbus_parse.NO_ADDRESS
+
+
+def concat_chunks(chunks):
+    """Column name -> concatenation of that column over all chunks."""
+    return {name: np.concatenate([getattr(c, name) for c in chunks])
+            for name, _ in modbus_parse.COLUMNS}
+
+
+class ColumnsTest(unittest.TestCase):
+
+    @classmethod
+    def setUpClass(cls):
+        if not os.access(CLI, os.X_OK):
+            raise unittest.SkipTest("modbus_parser not found at %s" % CLI)
+        cls.pcaps = [os.path.join(REPO, "build", name) for name in CAPTURES]
+        missing = [p for p in cls.pcaps if not os.path.exists(p)]
+        if missing:
+            raise unittest.SkipTest("sample captures missing: %s" % ", ".join(missing))
+        cls.expected = {pcap: cli_frames(pcap) for pcap in cls.pcaps}
+
+    def assert_matches_cli(self, pcap, columns, endpoints):
+        rows = self.expected[pcap]
+        self.assertEqual(len(columns["timestamp_ns"]), len(rows))
+
+        def col(key, default=None):
+            return [row.get(key, default) for row in rows]
+
+        np.testing.assert_array_equal(columns["timestamp_ns"], col("timestamp_ns"))
+        np.testing.assert_array_equal(columns["unit_id"], col("unit_id"))
+        np.testing.assert_array_equal(columns["function_code"], col("function_code"))
+        np.testing.assert_array_equal(columns["transaction_id"], col("transaction_id"))
+        ranges = [expected_range(row) for row in rows]
+        checked = np.array([r is not None for r in ranges], dtype=bool)
+        np.testing.assert_array_equal(columns["address"][checked],
+                                      [r[0] for r in ranges if r is not None])
+        np.testing.assert_array_equal(columns["quantity"][checked],
+                                      [r[1] for r in ranges if r is not None])
+        np.testing.assert_array_equal(columns["exception_code"], col("exception_code", 0))
+        np.testing.assert_array_equal(columns["src_port"], col("src_port"))
+        np.testing.assert_array_equal(columns["dst_port"], col("dst_port"))
+        np.testing.assert_array_equal(columns["is_request"], [int(r) for r in col("request")])
+        self.assertEqual([endpoints[i] for i in columns["src_id"].tolist()], col("src"))
+        self.assertEqual([endpoints[i] for i in columns["dst_id"].tolist()], col("dst"))
+
+    def test_read_pcap_matches_cli(self):
+        for pcap in self.pcaps:
+            with self.subTest(pcap=os.path.basename(pcap)):
+                frames = modbus_parse.read_pcap(pcap)
+                self.assertGreater(len(frames), 0)
+                self.assert_matches_cli(pcap, frames.to_dict(), frames.endpoints)
+
+    def test_iter_pcap_matches_cli(self):
+        for pcap in self.pcaps:
+            for chunk_size in CHUNK_SIZES:
+                with self.subTest(pcap=os.path.basename(pcap), chunk_size=chunk_size):
+                    chunks = list(modbus_parse.iter_pcap(pcap, chunk_size=chunk_size))
+                    self.assertTrue(all(0 < len(c) <= chunk_size for c in chunks))
+                    self.assert_matches_cli(pcap, concat_chunks(chunks), chunks[-1].endpoints)
+
+    def test_chunked_equals_whole_file(self):
+        for pcap in self.pcaps:
+            whole = modbus_parse.read_pcap(pcap)
+            for chunk_size in CHUNK_SIZES:
+                with self.subTest(pcap=os.path.basename(pcap), chunk_size=chunk_size):
+                    chunks = list(modbus_parse.iter_pcap(pcap, chunk_size=chunk_size))
+                    joined = concat_chunks(chunks)
+                    for name, _ in modbus_parse.COLUMNS:
+                        np.testing.assert_array_equal(joined[name], getattr(whole, name),
+                                                      err_msg=name)
+                    self.assertEqual(chunks[-1].endpoints, whole.endpoints)
+
+    def test_arrays_share_c_memory(self):
+        frames = modbus_parse.read_pcap(self.pcaps[0])
+        cols = frames._columns.ptr.contents
+        for name, ctype in modbus_parse.COLUMNS:
+            with self.subTest(column=name):
+                arr = getattr(frames, name)
+                self.assertFalse(arr.flags.owndata)
+                self.assertIsInstance(arr.base, ctypes.Array)
+                self.assertIs(arr.base._owner, frames._columns)
+                self.assertEqual(arr.dtype, np.dtype(ctype))
+                addr = ctypes.cast(getattr(cols, name), ctypes.c_void_p).value
+                self.assertEqual(arr.ctypes.data, addr)
+
+    def test_arrays_outlive_frames(self):
+        arr = modbus_parse.read_pcap(self.pcaps[0]).function_code
+        expected = [row["function_code"] for row in self.expected[self.pcaps[0]]]
+        np.testing.assert_array_equal(arr, expected)
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,77 @@
+# PGOBuild.cmake - Two-stage profile-guided build, run by the "pgo" target
+#
+# 1. Configure PGO_BINARY_DIR with MODBUS_PGO=GENERATE and build
+# 2. Run the instrumented binary over CAPTURES in every analysis mode
+# 3. Reconfigure the same tree with MODBUS_PGO=USE and rebuild
+#
+# The same tree is reused so GCC finds the .gcda files under the object
+# paths it recorded. Inputs (-D): SOURCE_DIR, PGO_BINARY_DIR, GENERATOR,
+# C_COMPILER, C_COMPILER_ID, NATIVE, PCAP_INCLUDE_DIR, PCAP_LIBRARY and
+# CAPTURES ('|'-separated).
+#
+# Copyright (C) 2025 Marty
+# SPDX-License-Identifier: GPL-3.0-or-later
+
+cmake_minimum_required(VERSION 3.20)
+
+set(profile_dir ${PGO_BINARY_DIR}/profile)
+set(training_dir ${PGO_BINARY_DIR}/training)
+string(REPLACE "|" ";" captures "${CAPTURES}")
+
+if(NOT captures)
+    message(FATAL_ERROR "PGO: no training captures")
+endif()
+
+set(configure_args
+    -S ${SOURCE_DIR} -B ${PGO_BINARY_DIR} -G ${GENERATOR}
+    -DCMAKE_C_COMPILER=${C_COMPILER}
+    -DCMAKE_BUILD_TYPE=Release
+    -DMODBUS_NATIVE=${NATIVE}
+    -DMODBUS_PGO_DIR=${profile_dir})
+if(PCAP_INCLUDE_DIR AND PCAP_LIBRARY)
+    list(APPEND configure_args -DPCAP_INCLUDE_DIR=${PCAP_INCLUDE_DIR}
+                               -DPCAP_LIBRARY=${PCAP_LIBRARY})
+endif()
+
+function(pgo_run)
+    execute_process(COMMAND ${ARGN} RESULT_VARIABLE rc)
+    if(NOT rc EQUAL 0)
+        message(FATAL_ERROR "PGO: command failed (${rc}): ${ARGN}")
+    endif()
+endfunction()
+
+function(pgo_build stage)
+    message(STATUS "PGO: ${stage} build")
+    pgo_run(${CMAKE_COMMAND} ${configure_args} -DMODBUS_PGO=${stage})
+    pgo_run(${CMAKE_COMMAND} --build ${PGO_BINARY_DIR} --target modbus_parser)
+endfunction()
+
+# Stage 1: instrumented binary, fresh profile
+file(REMOVE_RECURSE ${profile_dir} ${training_dir})
+pgo_build(GENERATE)
+
+# Training: copies keep reports and models out of the source tree
+file(MAKE_DIRECTORY ${training_dir})
+set(exe ${PGO_BINARY_DIR}/modbus_parser${CMAKE_EXECUTABLE_SUFFIX})
+foreach(capture ${captures})
+    get_filename_component(name ${capture} NAME)
+    set(copy ${training_dir}/${name})
+    file(COPY_FILE ${capture} ${copy})
+    message(STATUS "PGO: training on ${name}")
+    foreach(mode "" "-v" "-r")
+        execute_process(COMMAND ${exe} ${mode} ${copy} OUTPUT_QUIET ERROR_QUIET)
+    endforeach()
+    execute_process(COMMAND ${exe} --learn ${copy}.model ${copy} OUTPUT_QUIET ERROR_QUIET)
+    execute_process(COMMAND ${exe} --baseline ${copy}.model ${copy} OUTPUT_QUIET ERROR_QUIET)
+endforeach()
+
+# Clang writes raw profiles that must be merged first
+if(C_COMPILER_ID MATCHES "Clang")
+    find_program(LLVM_PROFDATA NAMES llvm-profdata REQUIRED)
+    file(GLOB raw_profiles ${profile_dir}/*.profraw)
+    pgo_run(${LLVM_PROFDATA} merge -output=${profile_dir}/default.profdata ${raw_profiles})
+endif()
+
+# Stage 2: optimised binary
+pgo_build(USE)
+message(STATUS "PGO: built ${exe}")
@@ -0,0 +1,84 @@
+/*
+ * fuzz_parse.c - libFuzzer harness for modbus_parse_frame_checked()
+ *
+ * Feeds every input to the strict parser twice: once as a complete
+ * segment (wire length = captured length) and once as a capture clipped
+ * by snaplen (wire length twice the captured length). Beyond memory
+ * errors caught by AddressSanitizer, the harness aborts when a result
+ * breaks the parser's contract:
+ *
+ * - the class is outside modbus_parse_error_t
+ * - a complete segment is reported as snaplen-clipped
+ * - a failure leaves data allocated
+ * - an accepted ADU does not fit in the input, disagrees with its MBAP
+ *   length, or its data is not a copy of the bytes after the header
+ *
+ * Built by the modbus_parse_fuzz target (-DMODBUS_FUZZ=ON, Clang):
+ *
+ *   modbus_parse_fuzz -max_len=300 corpus/
+ *
+ * Copyright (C) 2025 Marty
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "modbus_parser.h"
+
+
+/* MBAP header and function code precede the data field */
+#define FUZZ_DATA_OFFSET 8
+
+
+/*
+ * check_parse() - Parse one input and abort if the result is inconsistent
+ */
+
+static void check_parse(const uint8_t *data, uint32_t size, uint32_t wire_len) {
+    modbus_tcp_frame_t frame;
+    modbus_parse_error_t result = modbus_parse_frame_checked(data, size, wire_len, &frame);
+
+    if ((unsigned)result >= MODBUS_PARSE_ERROR_COUNT) {
+        abort();
+    }
+    if (result == MODBUS_PARSE_SNAPLEN_CLIPPED && wire_len == size) {
+        abort();
+    }
+    if (result != MODBUS_PARSE_OK) {
+        if (frame.data != NULL || frame.data_length != 0) {
+            abort();
+        }
+        return;
+    }
+
+    if (size < FUZZ_DATA_OFFSET || frame.mbap.protocol_id != 0 ||
+        frame.data_length != frame.mbap.length - 2 ||
+        (uint32_t)FUZZ_DATA_OFFSET + frame.data_length > size ||
+        frame.function_code != data[FUZZ_DATA_OFFSET - 1] ||
+        (frame.data_length > 0 &&
+         (frame.data == NULL ||
+          memcmp(frame.data, data + FUZZ_DATA_OFFSET, frame.data_length) != 0))) {
+        abort();
+    }
+    modbus_free_frame(&frame);
+}
+
+
+/**
+ * LLVMFuzzerTestOneInput() - libFuzzer entry point
+ * @data: Input bytes, used as a captured TCP payload
+ * @size: Bytes at @data
+ *
+ * Return: 0 (the input is always kept if it adds coverage)
+ */
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    if (size > UINT32_MAX / 2) {
+        return 0;
+    }
+    check_parse(data, (uint32_t)size, (uint32_t)size);
+    check_parse(data, (uint32_t)size, (uint32_t)size * 2);
+    return 0;
+}
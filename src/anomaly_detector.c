@@ -0,0 +1,616 @@
+/*
+ * anomaly_detector.c - Streaming per-source anomaly detection
+ *
+ * Implements the sliding-window detector declared in anomaly_detector.h.
+ *
+ * Per frame:
+ * 1. Find (or claim) the master's slot in the source table
+ * 2. Rotate its bucket ring up to the frame's time slice, subtracting
+ *    expired buckets from the running sums (at most WINDOW_BUCKETS steps)
+ * 3. Account the frame in the head bucket
+ * 4. Recompute the four windowed metrics and record raise/clear events
+ *
+ * Distinct function codes and addresses are unions of the per-bucket
+ * bitmaps; addresses are estimated by linear counting.
+ *
+ * Copyright (C) 2025 Marty
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+
+#include "anomaly_detector.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "colors.h"
+
+#ifdef _WIN32
+    #include <winsock2.h>  //Windows: For ntohs (network to host short)
+#else
+    #include <arpa/inet.h>  // *nix: For ntohs (network to host short)
+#endif
+
+
+/* Modbus TCP server port, used to tell requests from responses */
+#define ANOMALY_MODBUS_PORT 502
+
+/* Length of the whole window, for expiry and in seconds for the rates */
+#define ANOMALY_WINDOW_NS (ANOMALY_WINDOW_BUCKETS * ANOMALY_BUCKET_NS)
+#define ANOMALY_WINDOW_SECONDS (ANOMALY_WINDOW_NS / 1e9)
+
+
+/**
+ * anomaly_default_config() - Fill in the default thresholds
+ * @config: Configuration to initialise
+ */
+
+void anomaly_default_config(anomaly_config_t *config) {
+    config->raise[ANOMALY_REQUEST_RATE] = 50.0;
+    config->raise[ANOMALY_EXCEPTION_RATE] = 50.0;
+    config->raise[ANOMALY_FUNCTION_SPREAD] = 8.0;
+    config->raise[ANOMALY_ADDRESS_SPREAD] = 200.0;
+    config->clear_ratio = 0.8;
+    config->min_requests = 10;
+}
+
+
+/**
+ * anomaly_detector_init() - Allocate and reset a detector
+ * @det: Detector to initialise
+ * @config: Thresholds (NULL for defaults)
+ *
+ * Return: true on success, false on allocation failure
+ */
+
+bool anomaly_detector_init(anomaly_detector_t *det, const anomaly_config_t *config) {
+    memset(det, 0, sizeof(*det));
+
+    if (config) {
+        det->config = *config;
+    } else {
+        anomaly_default_config(&det->config);
+    }
+
+    det->sources = calloc(ANOMALY_MAX_SOURCES, sizeof(anomaly_source_t));
+    if (det->sources == NULL) {
+        printf("Error: Memory allocation failed\n");
+        return false;
+    }
+
+    return true;
+}
+
+
+/**
+ * anomaly_get_kind_name() - Get human-readable name for an alert kind
+ * @kind: Alert kind
+ *
+ * Return: Static string (never NULL)
+ */
+
+const char* anomaly_get_kind_name(anomaly_kind_t kind) {
+    switch (kind) {
+        case ANOMALY_REQUEST_RATE:    return "Request Rate";
+        case ANOMALY_EXCEPTION_RATE:  return "Exception Rate";
+        case ANOMALY_FUNCTION_SPREAD: return "Function Spread";
+        case ANOMALY_ADDRESS_SPREAD:  return "Address Spread";
+        default:                      return "Unknown";
+    }
+}
+
+
+/*
+ * hash_id() - Spread a dense endpoint id over the source table
+ */
+
+static uint32_t hash_id(endpoint_id_t id) {
+    return (id * 2654435761u) >> 10;
+}
+
+
+/*
+ * hash_address() - Spread a 16-bit register address over the bitmap
+ */
+
+static uint32_t hash_address(uint16_t address) {
+    uint32_t h = (uint32_t)address * 2654435761u;
+    return (h >> 16) % ANOMALY_ADDRESS_BITS;
+}
+
+
+/*
+ * bucket_of() - Absolute bucket index of a timestamp (rounds down)
+ */
+
+static inline int64_t bucket_of(int64_t timestamp_ns) {
+    int64_t bucket = timestamp_ns / ANOMALY_BUCKET_NS;
+    return timestamp_ns % ANOMALY_BUCKET_NS < 0 ? bucket - 1 : bucket;
+}
+
+
+/*
+ * record_event() - Append an alert transition to the event log
+ */
+
+static void record_event(anomaly_detector_t *det, const anomaly_source_t *src,
+                         anomaly_kind_t kind, bool raised, double value, int64_t timestamp_ns) {
+    if (raised) {
+        det->raised_total[kind]++;
+    }
+
+    if (det->event_count >= ANOMALY_MAX_EVENTS) {
+        det->events_dropped++;
+        return;
+    }
+
+    anomaly_event_t *ev = &det->events[det->event_count++];
+    ev->timestamp_ns = timestamp_ns;
+    ev->source = src->source;
+    ev->kind = kind;
+    ev->raised = raised;
+    ev->value = value;
+}
+
+
+/*
+ * expire_source() - Clear every active alert on a source whose window
+ * has fully drained. The clear is stamped one window after last_seen.
+ */
+
+static void expire_source(anomaly_detector_t *det, anomaly_source_t *src) {
+    int64_t clear_time = src->last_seen_ns + ANOMALY_WINDOW_NS;
+
+    for (int k = 0; k < ANOMALY_KIND_COUNT; k++) {
+        if (src->active[k]) {
+            src->active[k] = false;
+            record_event(det, src, (anomaly_kind_t)k, false, 0.0, clear_time);
+        }
+    }
+}
+
+
+/*
+ * find_source() - Locate or claim the table slot for a master
+ *
+ * Linear probing over at most ANOMALY_MAX_PROBES slots. Slots are never
+ * emptied once used, so a lookup only stops early at a never-used slot;
+ * an expired source's slot can be recycled for a new key.
+ *
+ * Return: Slot pointer, or NULL if the probe window is saturated
+ */
+
+static anomaly_source_t* find_source(anomaly_detector_t *det, endpoint_id_t id,
+                                     const endpoint_t *source, int64_t timestamp_ns) {
+    uint32_t mask = ANOMALY_MAX_SOURCES - 1;
+    uint32_t idx = hash_id(id) & mask;
+    anomaly_source_t *reusable = NULL;
+
+    for (uint32_t probe = 0; probe < ANOMALY_MAX_PROBES; probe++) {
+        anomaly_source_t *slot = &det->sources[(idx + probe) & mask];
+
+        if (!slot->used) {
+            if (reusable == NULL) {
+                reusable = slot;
+            }
+            break;
+        }
+
+        if (slot->id == id) {
+            return slot;
+        }
+
+        if (reusable == NULL && timestamp_ns - slot->last_seen_ns > ANOMALY_WINDOW_NS) {
+            reusable = slot;
+        }
+    }
+
+    if (reusable == NULL) {
+        return NULL;
+    }
+
+    if (reusable->used) {
+        expire_source(det, reusable);
+    }
+
+    memset(reusable, 0, sizeof(*reusable));
+    reusable->used = true;
+    reusable->id = id;
+    reusable->source = *source;
+    reusable->head_slot = bucket_of(timestamp_ns);
+    reusable->last_seen_ns = timestamp_ns;
+    return reusable;
+}
+
+
+/*
+ * rotate_window() - Advance a source's ring to the given time slice
+ *
+ * Each step retires the oldest bucket and subtracts it from the running
+ * sums. Gaps longer than the window drain everything in one pass.
+ */
+
+static void rotate_window(anomaly_detector_t *det, anomaly_source_t *src, int64_t slot) {
+    if (slot <= src->head_slot) {
+        return;  // Same slice, or out-of-order frame charged to the head
+    }
+
+    int64_t steps = slot - src->head_slot;
+    if (steps >= ANOMALY_WINDOW_BUCKETS) {
+        expire_source(det, src);
+        memset(src->buckets, 0, sizeof(src->buckets));
+        src->window_requests = 0;
+        src->window_exceptions = 0;
+        src->head_slot = slot;
+        return;
+    }
+
+    for (int64_t i = 0; i < steps; i++) {
+        src->head_slot++;
+        anomaly_bucket_t *b = &src->buckets[src->head_slot % ANOMALY_WINDOW_BUCKETS];
+        src->window_requests -= b->requests;
+        src->window_exceptions -= b->exceptions;
+        memset(b, 0, sizeof(*b));
+    }
+}
+
+
+/*
+ * window_function_spread() - Distinct request function codes in window
+ */
+
+static uint32_t window_function_spread(const anomaly_source_t *src) {
+    uint64_t bits[2] = {0, 0};
+
+    for (int i = 0; i < ANOMALY_WINDOW_BUCKETS; i++) {
+        bits[0] |= src->buckets[i].function_bits[0];
+        bits[1] |= src->buckets[i].function_bits[1];
+    }
+
+    return (uint32_t)(__builtin_popcountll(bits[0]) + __builtin_popcountll(bits[1]));
+}
+
+
+/*
+ * window_address_spread() - Linear-counting estimate of distinct addresses
+ */
+
+static double window_address_spread(const anomaly_source_t *src) {
+    uint64_t bits[ANOMALY_ADDRESS_BITS / 64] = {0};
+    uint32_t set = 0;
+
+    for (int i = 0; i < ANOMALY_WINDOW_BUCKETS; i++) {
+        for (int w = 0; w < ANOMALY_ADDRESS_BITS / 64; w++) {
+            bits[w] |= src->buckets[i].address_bits[w];
+        }
+    }
+    for (int w = 0; w < ANOMALY_ADDRESS_BITS / 64; w++) {
+        set += (uint32_t)__builtin_popcountll(bits[w]);
+    }
+
+    if (set >= ANOMALY_ADDRESS_BITS) {
+        set = ANOMALY_ADDRESS_BITS - 1;  // Saturated: report the ceiling
+    }
+
+    double zero_fraction = (double)(ANOMALY_ADDRESS_BITS - set) / ANOMALY_ADDRESS_BITS;
+    return -(double)ANOMALY_ADDRESS_BITS * log(zero_fraction);
+}
+
+
+/*
+ * request_address() - Extract the start address of a request, if any
+ *
+ * Return: true if the function carries a start address in data[0..1]
+ */
+
+static bool request_address(const modbus_tcp_frame_t *frame, uint16_t *address) {
+    if (frame->data_length < 2) {
+        return false;
+    }
+
+    switch (frame->function_code) {
+        case 0x01: case 0x02: case 0x03: case 0x04:
+        case 0x05: case 0x06: case 0x0F: case 0x10:
+        case 0x16: case 0x17:
+            *address = ntohs(*(uint16_t*)&frame->data[0]);
+            return true;
+        default:
+            return false;
+    }
+}
+
+
+/*
+ * evaluate_alerts() - Compare windowed metrics with thresholds
+ */
+
+static void evaluate_alerts(anomaly_detector_t *det, anomaly_source_t *src,
+                            int64_t timestamp_ns) {
+    const anomaly_config_t *cfg = &det->config;
+    double value[ANOMALY_KIND_COUNT];
+
+    value[ANOMALY_REQUEST_RATE] = (double)src->window_requests / ANOMALY_WINDOW_SECONDS;
+    value[ANOMALY_EXCEPTION_RATE] = 0.0;
+    if (src->window_requests >= cfg->min_requests) {
+        value[ANOMALY_EXCEPTION_RATE] =
+            (double)src->window_exceptions / (double)src->window_requests * 100.0;
+    }
+    value[ANOMALY_FUNCTION_SPREAD] = (double)window_function_spread(src);
+    value[ANOMALY_ADDRESS_SPREAD] = window_address_spread(src);
+
+    for (int k = 0; k < ANOMALY_KIND_COUNT; k++) {
+        if (!src->active[k] && value[k] >= cfg->raise[k]) {
+            src->active[k] = true;
+            record_event(det, src, (anomaly_kind_t)k, true, value[k], timestamp_ns);
+        } else if (src->active[k] && value[k] < cfg->raise[k] * cfg->clear_ratio) {
+            src->active[k] = false;
+            record_event(det, src, (anomaly_kind_t)k, false, value[k], timestamp_ns);
+        }
+    }
+}
+
+
+/**
+ * anomaly_detector_update() - Account one frame
+ * @det: Detector
+ * @frame: Parsed frame
+ * @src_addr: Source address
+ * @src_id: Interned source id
+ * @src_port: Source TCP port
+ * @dst_addr: Destination address
+ * @dst_id: Interned destination id
+ * @timestamp_ns: Frame timestamp (nanoseconds since epoch)
+ *
+ * Responses (sent from port 502) are charged to the destination master,
+ * requests to their source. Runs in constant time.
+ */
+
+void anomaly_detector_update(anomaly_detector_t *det, const modbus_tcp_frame_t *frame,
+                             const endpoint_t *src_addr, endpoint_id_t src_id, uint16_t src_port,
+                             const endpoint_t *dst_addr, endpoint_id_t dst_id,
+                             int64_t timestamp_ns) {
+    bool is_response = (src_port == ANOMALY_MODBUS_PORT);
+
+    if (timestamp_ns > det->latest_ns) {
+        det->latest_ns = timestamp_ns;
+    }
+
+    anomaly_source_t *src = is_response ? find_source(det, dst_id, dst_addr, timestamp_ns)
+                                        : find_source(det, src_id, src_addr, timestamp_ns);
+    if (src == NULL) {
+        det->sources_dropped++;
+        return;
+    }
+
+    rotate_window(det, src, bucket_of(timestamp_ns));
+    src->last_seen_ns = timestamp_ns;
+
+    anomaly_bucket_t *b = &src->buckets[src->head_slot % ANOMALY_WINDOW_BUCKETS];
+
+    if (is_response) {
+        if (frame->function_code & 0x80) {
+            b->exceptions++;
+            src->window_exceptions++;
+        }
+    } else {
+        uint8_t base_code = frame->function_code & 0x7F;
+        b->requests++;
+        src->window_requests++;
+        b->function_bits[base_code >> 6] |= 1ULL << (base_code & 63);
+
+        uint16_t address;
+        if (request_address(frame, &address)) {
+            uint32_t bit = hash_address(address);
+            b->address_bits[bit >> 6] |= 1ULL << (bit & 63);
+        }
+    }
+
+    evaluate_alerts(det, src, timestamp_ns);
+}
+
+
+/*
+ * format_time() - Format timestamp as HH:MM:SS.microseconds
+ */
+
+static void format_time(int64_t timestamp_ns, char *buf, size_t len) {
+    time_t sec = (time_t)(timestamp_ns / 1000000000);
+    struct tm *tm_info = localtime(&sec);
+    int microsec = (int)(timestamp_ns % 1000000000 / 1000);
+    snprintf(buf, len, "%02d:%02d:%02d.%06d",
+             tm_info->tm_hour, tm_info->tm_min, tm_info->tm_sec, microsec);
+}
+
+
+/*
+ * count_active() - Alerts still raised across all sources
+ */
+
+static uint32_t count_active(const anomaly_detector_t *det) {
+    uint32_t active = 0;
+
+    for (uint32_t i = 0; i < ANOMALY_MAX_SOURCES; i++) {
+        for (int k = 0; k < ANOMALY_KIND_COUNT; k++) {
+            if (det->sources[i].active[k]) {
+                active++;
+            }
+        }
+    }
+    return active;
+}
+
+
+/*
+ * count_live() - Sources seen within one window of the newest frame
+ */
+
+static uint32_t count_live(const anomaly_detector_t *det) {
+    uint32_t live = 0;
+
+    for (uint32_t i = 0; i < ANOMALY_MAX_SOURCES; i++) {
+        const anomaly_source_t *src = &det->sources[i];
+        if (src->used && det->latest_ns - src->last_seen_ns <= ANOMALY_WINDOW_NS) {
+            live++;
+        }
+    }
+    return live;
+}
+
+
+/**
+ * anomaly_display_summary() - Print alert log and totals to stdout
+ * @det: Detector
+ */
+
+void anomaly_display_summary(const anomaly_detector_t *det) {
+    printf("\n%sSliding-Window Alerts (%.0fs window, per master):%s\n",
+           COLOR_WHITE, ANOMALY_WINDOW_SECONDS, COLOR_RESET);
+    printf("  Sources in window:   %u\n", count_live(det));
+
+    if (det->event_count == 0) {
+        printf("  %s[✓] No windowed thresholds crossed%s\n", COLOR_GREEN, COLOR_RESET);
+        return;
+    }
+
+    for (uint32_t i = 0; i < det->event_count; i++) {
+        const anomaly_event_t *ev = &det->events[i];
+        char time_str[20];
+        char source[ENDPOINT_STR_LEN];
+        format_time(ev->timestamp_ns, time_str, sizeof(time_str));
+        endpoint_format(&ev->source, source, sizeof(source));
+
+        if (ev->raised) {
+            printf("  %s%s%s %s[!] RAISED%s  %-16s %-16s %.1f\n",
+                   COLOR_GRAY, time_str, COLOR_RESET, COLOR_YELLOW, COLOR_RESET,
+                   source, anomaly_get_kind_name(ev->kind), ev->value);
+        } else {
+            printf("  %s%s%s %s[✓] CLEARED%s %-16s %-16s\n",
+                   COLOR_GRAY, time_str, COLOR_RESET, COLOR_GREEN, COLOR_RESET,
+                   source, anomaly_get_kind_name(ev->kind));
+        }
+    }
+
+    if (det->events_dropped > 0) {
+        printf("  ... %u further transitions not logged\n", det->events_dropped);
+    }
+    if (det->sources_dropped > 0) {
+        printf("  %s[!] Source table saturated%s - %u frames not tracked\n",
+               COLOR_YELLOW, COLOR_RESET, det->sources_dropped);
+    }
+    printf("  Still active at end: %u\n", count_active(det));
+}
+
+
+/**
+ * anomaly_write_report() - Append alert section to markdown report
+ * @det: Detector
+ * @f: Open report file (no-op if NULL)
+ */
+
+void anomaly_write_report(const anomaly_detector_t *det, FILE *f) {
+    if (!f) return;
+
+    fprintf(f, "\n### Sliding-Window Alerts\n\n");
+    fprintf(f, "- **Window:** %.0f seconds per master\n", ANOMALY_WINDOW_SECONDS);
+    fprintf(f, "- **Sources in window:** %u\n", count_live(det));
+    fprintf(f, "- **Still active at end:** %u\n\n", count_active(det));
+
+    if (det->event_count == 0) {
+        fprintf(f, "- ✅ No windowed thresholds crossed\n");
+        return;
+    }
+
+    fprintf(f, "| Timestamp | Source | Alert | State | Value |\n");
+    fprintf(f, "|-----------|--------|-------|-------|-------|\n");
+
+    for (uint32_t i = 0; i < det->event_count; i++) {
+        const anomaly_event_t *ev = &det->events[i];
+        char time_str[20];
+        char source[ENDPOINT_STR_LEN];
+        format_time(ev->timestamp_ns, time_str, sizeof(time_str));
+        endpoint_format(&ev->source, source, sizeof(source));
+
+        fprintf(f, "| %s | %s | %s | %s | %.1f |\n", time_str, source,
+                anomaly_get_kind_name(ev->kind), ev->raised ? "⚠️ raised" : "cleared",
+                ev->value);
+    }
+
+    if (det->events_dropped > 0) {
+        fprintf(f, "\n*%u further transitions not logged*\n", det->events_dropped);
+    }
+}
+
+
+/**
+ * anomaly_detector_save() - Write detector state to a checkpoint
+ * @det: Detector
+ * @f: Open binary file
+ *
+ * Layout: the detector struct, the number of occupied slots, then
+ * (slot index, anomaly_source_t) per occupied slot.
+ *
+ * Return: false on write error
+ */
+
+bool anomaly_detector_save(const anomaly_detector_t *det, FILE *f) {
+    anomaly_detector_t head = *det;
+    uint32_t used = 0;
+
+    head.sources = NULL;
+    for (uint32_t i = 0; i < ANOMALY_MAX_SOURCES; i++) {
+        used += det->sources[i].used;
+    }
+    if (fwrite(&head, sizeof(head), 1, f) != 1 || fwrite(&used, sizeof(used), 1, f) != 1) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < ANOMALY_MAX_SOURCES; i++) {
+        if (!det->sources[i].used) continue;
+        if (fwrite(&i, sizeof(i), 1, f) != 1 ||
+            fwrite(&det->sources[i], sizeof(anomaly_source_t), 1, f) != 1) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/**
+ * anomaly_detector_restore() - Load state written by anomaly_detector_save()
+ * @det: Detector from anomaly_detector_init()
+ * @f: Open binary file
+ *
+ * Return: false on a short or inconsistent checkpoint
+ */
+
+bool anomaly_detector_restore(anomaly_detector_t *det, FILE *f) {
+    anomaly_source_t *sources = det->sources;
+    uint32_t used;
+
+    if (fread(det, sizeof(*det), 1, f) != 1 || fread(&used, sizeof(used), 1, f) != 1) {
+        det->sources = sources;
+        return false;
+    }
+    det->sources = sources;
+    memset(sources, 0, ANOMALY_MAX_SOURCES * sizeof(anomaly_source_t));
+
+    for (uint32_t n = 0; n < used; n++) {
+        uint32_t i;
+        if (fread(&i, sizeof(i), 1, f) != 1 || i >= ANOMALY_MAX_SOURCES ||
+            fread(&sources[i], sizeof(anomaly_source_t), 1, f) != 1) {
+            return false;
+        }
+    }
+    return det->event_count <= ANOMALY_MAX_EVENTS;
+}
+
+
+/**
+ * anomaly_detector_free() - Release the source table
+ * @det: Detector
+ */
+
+void anomaly_detector_free(anomaly_detector_t *det) {
+    free(det->sources);
+    det->sources = NULL;
+}
@@ -0,0 +1,264 @@
+/*
+ * anomaly_detector.h - Streaming per-source anomaly detection
+ *
+ * Replaces the capture-wide "sequential probing" and "rapid burst"
+ * heuristics with per-master sliding windows. Each master (the endpoint
+ * talking *to* port 502) owns a ring of one-second buckets holding its
+ * request count, exception count, function code bitmap and a hashed
+ * address bitmap. Sums are maintained incrementally as buckets rotate,
+ * so per-frame cost is O(1) and memory is bounded by the source table.
+ *
+ * Alerts are raised when a windowed metric crosses its threshold and
+ * cleared once it falls back below the clear level (hysteresis), each
+ * transition being recorded with the timestamp of the frame causing it.
+ *
+ * Copyright (C) 2025 Marty
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef ANOMALY_DETECTOR_H
+#define ANOMALY_DETECTOR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "modbus_parser.h"
+#include "endpoint.h"
+
+
+/* Number of buckets in each source's sliding window */
+#define ANOMALY_WINDOW_BUCKETS 10
+
+/* Width of one bucket in nanoseconds */
+#define ANOMALY_BUCKET_NS 1000000000LL
+
+/* Source table capacity (power of two) */
+#define ANOMALY_MAX_SOURCES 1024
+
+/* Maximum probes before a new source is dropped */
+#define ANOMALY_MAX_PROBES 16
+
+/* Bits in the per-bucket hashed address bitmap (linear counting) */
+#define ANOMALY_ADDRESS_BITS 512
+
+/* Maximum alert transitions kept in the event log */
+#define ANOMALY_MAX_EVENTS 256
+
+
+/**
+ * enum anomaly_kind_t - Windowed metrics that can raise an alert
+ */
+
+typedef enum {
+    ANOMALY_REQUEST_RATE,       // Requests per second over the window
+    ANOMALY_EXCEPTION_RATE,     // Exception responses / requests (%)
+    ANOMALY_FUNCTION_SPREAD,    // Distinct function codes in the window
+    ANOMALY_ADDRESS_SPREAD,     // Distinct addresses in the window (est.)
+    ANOMALY_KIND_COUNT
+} anomaly_kind_t;
+
+
+/**
+ * struct anomaly_config_t - Detector thresholds
+ * @raise: Per-kind level at or above which an alert is raised
+ * @clear_ratio: Fraction of @raise below which an active alert clears
+ * @min_requests: Minimum requests in window before exception rate counts
+ */
+
+typedef struct {
+    double raise[ANOMALY_KIND_COUNT];
+    double clear_ratio;
+    uint32_t min_requests;
+} anomaly_config_t;
+
+
+/**
+ * struct anomaly_bucket_t - One time slice of a source window
+ * @requests: Requests sent by the source in this slice
+ * @exceptions: Exception responses returned to the source
+ * @function_bits: Bitmap of request function codes (0x00-0x7F used)
+ * @address_bits: Hashed bitmap of request start addresses
+ */
+
+typedef struct {
+    uint32_t requests;
+    uint32_t exceptions;
+    uint64_t function_bits[2];
+    uint64_t address_bits[ANOMALY_ADDRESS_BITS / 64];
+} anomaly_bucket_t;
+
+
+/**
+ * struct anomaly_source_t - Sliding window state for one master
+ * @used: Slot has held a source
+ * @id: Interned master endpoint id (table key)
+ * @source: Master address, for output
+ * @head_slot: Absolute bucket index of the newest bucket
+ * @last_seen_ns: Timestamp of the last frame for this source (ns)
+ * @window_requests: Running sum of requests across all buckets
+ * @window_exceptions: Running sum of exceptions across all buckets
+ * @active: Per-kind alert state
+ * @buckets: Ring of time slices indexed by head_slot % ANOMALY_WINDOW_BUCKETS
+ */
+
+typedef struct {
+    bool used;
+    endpoint_id_t id;
+    endpoint_t source;
+    int64_t head_slot;
+    int64_t last_seen_ns;
+    uint32_t window_requests;
+    uint32_t window_exceptions;
+    bool active[ANOMALY_KIND_COUNT];
+    anomaly_bucket_t buckets[ANOMALY_WINDOW_BUCKETS];
+} anomaly_source_t;
+
+
+/**
+ * struct anomaly_event_t - One alert transition
+ * @timestamp_ns: Frame timestamp at which the transition happened (ns)
+ * @source: Master address
+ * @kind: Metric that crossed its threshold
+ * @raised: true when raised, false when cleared
+ * @value: Metric value at the transition
+ */
+
+typedef struct {
+    int64_t timestamp_ns;
+    endpoint_t source;
+    anomaly_kind_t kind;
+    bool raised;
+    double value;
+} anomaly_event_t;
+
+
+/**
+ * struct anomaly_detector_t - Detector state
+ * @config: Thresholds in use
+ * @sources: Open-addressed source table (ANOMALY_MAX_SOURCES entries)
+ * @latest_ns: Timestamp of the newest frame seen (ns), for source expiry
+ * @sources_dropped: Frames ignored because the table was saturated
+ * @events: Alert transition log
+ * @event_count: Entries used in @events
+ * @events_dropped: Transitions not logged because @events was full
+ * @raised_total: Per-kind count of alerts raised
+ * @currently_active: Alerts still active at the end of the capture
+ */
+
+typedef struct {
+    anomaly_config_t config;
+    anomaly_source_t *sources;
+    int64_t latest_ns;
+    uint32_t sources_dropped;
+    anomaly_event_t events[ANOMALY_MAX_EVENTS];
+    uint32_t event_count;
+    uint32_t events_dropped;
+    uint32_t raised_total[ANOMALY_KIND_COUNT];
+    uint32_t currently_active;
+} anomaly_detector_t;
+
+
+/**
+ * anomaly_default_config() - Fill in the default thresholds
+ * @config: Configuration to initialise
+ *
+ * Defaults: 50 requests/s, 50% exceptions (after 10 requests),
+ * 8 distinct function codes and 200 distinct addresses per window.
+ * Alerts clear below 80% of the raise level.
+ */
+
+void anomaly_default_config(anomaly_config_t *config);
+
+
+/**
+ * anomaly_detector_init() - Allocate and reset a detector
+ * @det: Detector to initialise
+ * @config: Thresholds (NULL for defaults)
+ *
+ * Return: true on success, false on allocation failure
+ */
+
+bool anomaly_detector_init(anomaly_detector_t *det, const anomaly_config_t *config);
+
+
+/**
+ * anomaly_detector_update() - Account one frame
+ * @det: Detector
+ * @frame: Parsed frame
+ * @src_addr: Source address
+ * @src_id: Interned source id
+ * @src_port: Source TCP port
+ * @dst_addr: Destination address
+ * @dst_id: Interned destination id
+ * @timestamp_ns: Frame timestamp (nanoseconds since epoch)
+ *
+ * Frames sent from port 502 are responses and are charged to their
+ * destination (the master); all others are requests charged to their
+ * source. Sources are keyed by endpoint id. Runs in constant time.
+ */
+
+void anomaly_detector_update(anomaly_detector_t *det, const modbus_tcp_frame_t *frame,
+                             const endpoint_t *src_addr, endpoint_id_t src_id, uint16_t src_port,
+                             const endpoint_t *dst_addr, endpoint_id_t dst_id,
+                             int64_t timestamp_ns);
+
+
+/**
+ * anomaly_get_kind_name() - Get human-readable name for an alert kind
+ * @kind: Alert kind
+ *
+ * Return: Static string (never NULL)
+ */
+
+const char* anomaly_get_kind_name(anomaly_kind_t kind);
+
+
+/**
+ * anomaly_display_summary() - Print alert log and totals to stdout
+ * @det: Detector
+ */
+
+void anomaly_display_summary(const anomaly_detector_t *det);
+
+
+/**
+ * anomaly_write_report() - Append alert section to markdown report
+ * @det: Detector
+ * @f: Open report file (no-op if NULL)
+ */
+
+void anomaly_write_report(const anomaly_detector_t *det, FILE *f);
+
+
+/**
+ * anomaly_detector_save() - Write detector state to a checkpoint
+ * @det: Detector
+ * @f: Open binary file
+ *
+ * Only occupied source slots are written.
+ *
+ * Return: false on write error
+ */
+
+bool anomaly_detector_save(const anomaly_detector_t *det, FILE *f);
+
+
+/**
+ * anomaly_detector_restore() - Load state written by anomaly_detector_save()
+ * @det: Detector from anomaly_detector_init()
+ * @f: Open binary file
+ *
+ * Return: false on a short or inconsistent checkpoint
+ */
+
+bool anomaly_detector_restore(anomaly_detector_t *det, FILE *f);
+
+
+/**
+ * anomaly_detector_free() - Release the source table
+ * @det: Detector
+ */
+
+void anomaly_detector_free(anomaly_detector_t *det);
+
+#endif /* ANOMALY_DETECTOR_H */
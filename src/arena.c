@@ -0,0 +1,161 @@
+/*
+ * arena.c - Bump allocator with batch reset
+ *
+ * Batch chunks form a list that arena_reset() rewinds in place, so the
+ * same chunks are bumped again by every batch.
+ *
+ * Copyright (C) 2025 Marty
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+
+
+/**
+ * struct arena_chunk - One block of arena memory
+ * @next: Next chunk in the batch list
+ * @data: First usable byte, ARENA_ALIGN-aligned
+ * @capacity: Usable bytes at @data
+ * @used: Bytes handed out in the current batch
+ */
+
+struct arena_chunk {
+    arena_chunk_t *next;
+    uint8_t *data;
+    size_t capacity;
+    size_t used;
+};
+
+
+/*
+ * align_up() - Round a size up to ARENA_ALIGN
+ */
+
+static inline size_t align_up(size_t size) {
+    return (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+
+/*
+ * chunk_new() - Take a chunk of @capacity usable bytes from the heap
+ */
+
+static arena_chunk_t *chunk_new(arena_t *arena, size_t capacity) {
+    arena_chunk_t *chunk = malloc(sizeof(arena_chunk_t) + capacity + ARENA_ALIGN - 1);
+    if (!chunk) {
+        return NULL;
+    }
+
+    uintptr_t start = (uintptr_t)(chunk + 1);
+    chunk->data = (uint8_t *)((start + ARENA_ALIGN - 1) & ~(uintptr_t)(ARENA_ALIGN - 1));
+    chunk->capacity = capacity;
+    chunk->used = 0;
+    chunk->next = NULL;
+
+    arena->stats.heap_calls++;
+    arena->stats.heap_bytes += capacity;
+    return chunk;
+}
+
+
+/**
+ * arena_init() - Start an empty arena
+ * @arena: Arena
+ */
+
+void arena_init(arena_t *arena) {
+    memset(arena, 0, sizeof(*arena));
+}
+
+
+/**
+ * arena_alloc() - Allocate batch memory
+ * @arena: Arena
+ * @size: Bytes (0 returns a valid unique pointer)
+ *
+ * Bumps the current chunk, then moves on to chunks kept from earlier
+ * batches; a new chunk is only taken when none of them has room.
+ *
+ * Return: ARENA_ALIGN-aligned memory, or NULL if out of memory
+ */
+
+void *arena_alloc(arena_t *arena, size_t size) {
+    size = align_up(size ? size : 1);
+
+    arena_chunk_t *chunk = arena->current ? arena->current : arena->chunks;
+    while (chunk && chunk->capacity - chunk->used < size) {
+        chunk = chunk->next;
+    }
+
+    if (!chunk) {
+        chunk = chunk_new(arena, size > ARENA_CHUNK_SIZE ? size : ARENA_CHUNK_SIZE);
+        if (!chunk) {
+            return NULL;
+        }
+        // Insert after the current chunk so rewound chunks stay ahead
+        if (arena->current) {
+            chunk->next = arena->current->next;
+            arena->current->next = chunk;
+        } else {
+            chunk->next = arena->chunks;
+            arena->chunks = chunk;
+        }
+    }
+    arena->current = chunk;
+
+    void *ptr = chunk->data + chunk->used;
+    chunk->used += size;
+
+    arena->stats.allocations++;
+    arena->stats.batch_bytes += size;
+    if (arena->stats.batch_bytes > arena->stats.peak_batch_bytes) {
+        arena->stats.peak_batch_bytes = arena->stats.batch_bytes;
+    }
+    return ptr;
+}
+
+
+/**
+ * arena_reset() - End the batch: release all arena_alloc() memory
+ * @arena: Arena
+ */
+
+void arena_reset(arena_t *arena) {
+    for (arena_chunk_t *chunk = arena->chunks; chunk; chunk = chunk->next) {
+        chunk->used = 0;
+    }
+    arena->current = NULL;
+    arena->stats.batch_bytes = 0;
+    arena->stats.resets++;
+}
+
+
+/**
+ * arena_stats() - Allocation counters
+ * @arena: Arena
+ *
+ * Return: Counters owned by @arena
+ */
+
+const arena_stats_t *arena_stats(const arena_t *arena) {
+    return &arena->stats;
+}
+
+
+/**
+ * arena_free() - Release all memory of the arena
+ * @arena: Arena (left empty and reusable)
+ */
+
+void arena_free(arena_t *arena) {
+    arena_chunk_t *chunk, *next;
+
+    for (chunk = arena->chunks; chunk; chunk = next) {
+        next = chunk->next;
+        free(chunk);
+    }
+    arena_init(arena);
+}
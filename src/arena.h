@@ -0,0 +1,125 @@
+/*
+ * arena.h - Bump allocator with batch reset
+ *
+ * Frame data that has to outlive a callback (transaction matching,
+ * reassembly, columnar batches, deferred report writing) would otherwise
+ * cost one malloc()/free() pair per frame. An arena hands out memory
+ * from large chunks instead:
+ *
+ * - arena_alloc() bumps a pointer; arena_reset() ends the batch and
+ *   rewinds, keeping the chunks, so once the largest batch has been seen
+ *   no further heap calls are made
+ *
+ * An arena is not thread-safe; use one per thread.
+ *
+ * Copyright (C) 2025 Marty
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+
+/* Bytes per chunk; larger requests get a chunk of their own */
+#define ARENA_CHUNK_SIZE (64u << 10)
+
+/* Alignment of every allocation */
+#define ARENA_ALIGN 16
+
+
+/**
+ * struct arena_stats_t - Allocation counters of an arena
+ * @allocations: arena_alloc() calls
+ * @resets: arena_reset() calls (batches completed)
+ * @heap_calls: malloc() calls made by the arena (chunks); stays flat in
+ *              steady state
+ * @heap_bytes: Bytes currently held from the heap
+ * @batch_bytes: Bytes allocated in the current batch
+ * @peak_batch_bytes: Largest batch so far
+ */
+
+typedef struct {
+    uint64_t allocations;
+    uint64_t resets;
+    uint64_t heap_calls;
+    uint64_t heap_bytes;
+    uint64_t batch_bytes;
+    uint64_t peak_batch_bytes;
+} arena_stats_t;
+
+
+/* One block of arena memory (see arena.c) */
+typedef struct arena_chunk arena_chunk_t;
+
+
+/**
+ * struct arena_t - Arena state
+ * @chunks: Batch chunks in allocation order
+ * @current: Chunk being bumped (NULL before the first allocation)
+ * @stats: Counters
+ *
+ * Zero-initialised (or arena_init()) is an empty, valid arena.
+ */
+
+typedef struct {
+    arena_chunk_t *chunks;
+    arena_chunk_t *current;
+    arena_stats_t stats;
+} arena_t;
+
+
+/**
+ * arena_init() - Start an empty arena
+ * @arena: Arena
+ *
+ * No memory is taken until the first allocation.
+ */
+
+void arena_init(arena_t *arena);
+
+
+/**
+ * arena_alloc() - Allocate batch memory
+ * @arena: Arena
+ * @size: Bytes (0 returns a valid unique pointer)
+ *
+ * Valid until the next arena_reset() or arena_free().
+ *
+ * Return: ARENA_ALIGN-aligned memory, or NULL if out of memory
+ */
+
+void *arena_alloc(arena_t *arena, size_t size);
+
+
+/**
+ * arena_reset() - End the batch: release all arena_alloc() memory
+ * @arena: Arena
+ *
+ * Chunks are kept for the next batch.
+ */
+
+void arena_reset(arena_t *arena);
+
+
+/**
+ * arena_stats() - Allocation counters
+ * @arena: Arena
+ *
+ * Return: Counters owned by @arena
+ */
+
+const arena_stats_t *arena_stats(const arena_t *arena);
+
+
+/**
+ * arena_free() - Release all memory of the arena
+ * @arena: Arena (left empty and reusable)
+ */
+
+void arena_free(arena_t *arena);
+
+#endif /* ARENA_H */
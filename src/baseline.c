@@ -0,0 +1,1098 @@
+/*
+ * baseline.c - Learned "normal traffic" model and deviation checking
+ *
+ * Learn mode collects tuple hashes in an open-addressed set and keeps a
+ * window counter per (master, slave) pair; baseline_finish() sorts both
+ * and writes them with a radix directory and Bloom filter (see
+ * baseline.h for the layout). Check mode maps that file and queries it
+ * in place.
+ *
+ * Copyright (C) 2025 Marty
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+
+#include "baseline.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "colors.h"
+
+#ifdef _WIN32
+    #include <winsock2.h>  //Windows: For ntohs (network to host short)
+#else
+    #include <arpa/inet.h>  // *nix: For ntohs (network to host short)
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+
+/* Modbus TCP server port, used to tell requests from responses */
+#define BASELINE_MODBUS_PORT 502
+
+/* Block value used for requests without an address range */
+#define BASELINE_BLOCK_NONE 0xFFFF
+
+/* Target entries per radix directory bucket */
+#define BASELINE_BUCKET_TARGET 2
+
+/* Initial slots of the learn set and live pair table */
+#define BASELINE_INITIAL_SLOTS 64
+
+/* Findings shown on stdout (the report lists all) */
+#define BASELINE_SUMMARY_ROWS 20
+
+
+/*
+ * mix64() - splitmix64 finaliser
+ */
+
+static uint64_t mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+
+/*
+ * pair_key() - Order-dependent hash of (master, slave), never 0
+ */
+
+static uint64_t pair_key(const endpoint_t *master, const endpoint_t *slave) {
+    uint64_t h = mix64(endpoint_hash(master) + 0x9e3779b97f4a7c15ULL * endpoint_hash(slave));
+    return h ? h : 1;
+}
+
+
+/*
+ * tuple_hash() - Hash of (pair, unit, function, block), never 0
+ */
+
+static uint64_t tuple_hash(uint64_t pair, uint8_t unit_id, uint8_t function_code,
+                           uint16_t block) {
+    uint64_t packed = ((uint64_t)unit_id << 32) | ((uint64_t)function_code << 16) | block;
+    uint64_t h = mix64(pair ^ mix64(packed + 0x9e3779b97f4a7c15ULL));
+    return h ? h : 1;
+}
+
+
+/*
+ * compare_u64() - qsort comparator for uint64_t
+ */
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+
+/*
+ * compare_pair() - qsort comparator for baseline_pair_t by key
+ */
+
+static int compare_pair(const void *a, const void *b) {
+    return compare_u64(&((const baseline_pair_t*)a)->key, &((const baseline_pair_t*)b)->key);
+}
+
+
+/*
+ * align8() - Round a file offset up to a multiple of 8
+ */
+
+static uint64_t align8(uint64_t v) {
+    return (v + 7) & ~(uint64_t)7;
+}
+
+
+/*
+ * format_time() - Format timestamp as HH:MM:SS.microseconds
+ */
+
+static void format_time(int64_t timestamp_ns, char *buf, size_t len) {
+    time_t sec = (time_t)(timestamp_ns / 1000000000);
+    struct tm *tm_info = localtime(&sec);
+    int microsec = (int)(timestamp_ns % 1000000000 / 1000);
+    snprintf(buf, len, "%02d:%02d:%02d.%06d",
+             tm_info->tm_hour, tm_info->tm_min, tm_info->tm_sec, microsec);
+}
+
+
+/*
+ * floor_div() - Division rounding towards negative infinity
+ */
+
+static int64_t floor_div(int64_t a, int64_t b) {
+    int64_t q = a / b;
+    if ((a % b) != 0 && ((a < 0) != (b < 0))) {
+        q--;
+    }
+    return q;
+}
+
+
+/*
+ * learn_insert() - Add a tuple hash to the learn set, growing at 50% load
+ */
+
+static bool learn_insert(baseline_t *bl, uint64_t h) {
+    if ((bl->learned_count + 1) * 2 > bl->learned_capacity) {
+        uint64_t capacity = bl->learned_capacity * 2;
+        uint64_t *slots = calloc(capacity, sizeof(uint64_t));
+        if (!slots) {
+            return false;
+        }
+        for (uint64_t i = 0; i < bl->learned_capacity; i++) {
+            uint64_t v = bl->learned[i];
+            if (v == 0) continue;
+            uint64_t j = v & (capacity - 1);
+            while (slots[j] != 0) {
+                j = (j + 1) & (capacity - 1);
+            }
+            slots[j] = v;
+        }
+        free(bl->learned);
+        bl->learned = slots;
+        bl->learned_capacity = capacity;
+    }
+
+    uint64_t mask = bl->learned_capacity - 1;
+    uint64_t j = h & mask;
+    while (bl->learned[j] != 0) {
+        if (bl->learned[j] == h) {
+            return true;
+        }
+        j = (j + 1) & mask;
+    }
+    bl->learned[j] = h;
+    bl->learned_count++;
+    return true;
+}
+
+
+/*
+ * bloom_probe() - Bit index of probe @i (double hashing)
+ */
+
+static uint64_t bloom_probe(uint64_t h, uint32_t i, uint64_t bits) {
+    uint64_t h2 = mix64(h) | 1;
+    return (h + i * h2) & (bits - 1);
+}
+
+
+/*
+ * model_contains() - Bloom pre-check, then directory bucket lookup
+ */
+
+static bool model_contains(const baseline_t *bl, uint64_t h) {
+    const baseline_file_header_t *hdr = bl->header;
+
+    for (uint32_t i = 0; i < hdr->bloom_hashes; i++) {
+        uint64_t bit = bloom_probe(h, i, hdr->bloom_bits);
+        if (!(bl->bloom[bit >> 6] & (1ULL << (bit & 63)))) {
+            return false;
+        }
+    }
+
+    uint64_t bucket = hdr->dir_bits ? h >> (64 - hdr->dir_bits) : 0;
+    uint32_t lo = bl->directory[bucket];
+    uint32_t hi = bl->directory[bucket + 1];
+    // The directory is not scanned at load; a damaged bucket is a miss
+    if (lo > hi || hi > hdr->tuple_count) {
+        return false;
+    }
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (bl->tuples[mid] == h) {
+            return true;
+        }
+        if (bl->tuples[mid] < h) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return false;
+}
+
+
+/*
+ * model_find_pair() - Binary search the learned envelopes
+ */
+
+static const baseline_pair_t *model_find_pair(const baseline_t *bl, uint64_t key) {
+    uint64_t lo = 0;
+    uint64_t hi = bl->header->pair_count;
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (bl->pairs[mid].key == key) {
+            return &bl->pairs[mid];
+        }
+        if (bl->pairs[mid].key < key) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return NULL;
+}
+
+
+/*
+ * finding_slot() - Index slot of (kind, key): its finding or the empty slot to use
+ */
+
+static uint16_t *finding_slot(baseline_t *bl, baseline_finding_kind_t kind, uint64_t key) {
+    uint32_t mask = BASELINE_FINDING_SLOTS - 1;
+    uint32_t j = (uint32_t)mix64(key + kind) & mask;
+
+    while (bl->finding_index[j] != 0) {
+        const baseline_finding_t *f = &bl->findings[bl->finding_index[j] - 1];
+        if (f->kind == kind && f->key == key) {
+            break;
+        }
+        j = (j + 1) & mask;
+    }
+    return &bl->finding_index[j];
+}
+
+
+/*
+ * record_finding() - Add or update a distinct deviation
+ */
+
+static baseline_finding_t *record_finding(baseline_t *bl, baseline_finding_kind_t kind,
+                                          uint64_t key, int64_t timestamp_ns,
+                                          const endpoint_t *master, const endpoint_t *slave) {
+    uint16_t *slot = finding_slot(bl, kind, key);
+    if (*slot != 0) {
+        baseline_finding_t *f = &bl->findings[*slot - 1];
+        f->occurrences++;
+        return f;
+    }
+
+    if (bl->finding_count >= BASELINE_MAX_FINDINGS) {
+        bl->findings_dropped++;
+        return NULL;
+    }
+
+    *slot = (uint16_t)(bl->finding_count + 1);
+    baseline_finding_t *f = &bl->findings[bl->finding_count++];
+    memset(f, 0, sizeof(*f));
+    f->kind = kind;
+    f->key = key;
+    f->first_time_ns = timestamp_ns;
+    f->occurrences = 1;
+    f->block_start = BASELINE_BLOCK_NONE;
+    f->master = *master;
+    f->slave = *slave;
+    return f;
+}
+
+
+/*
+ * close_window() - Account one complete window of @count requests
+ */
+
+static void close_window(baseline_t *bl, baseline_live_pair_t *p, uint32_t count,
+                         int64_t timestamp_ns) {
+    if (bl->learning) {
+        if (p->windows == 0 || count < p->min_per_window) {
+            p->min_per_window = count;
+        }
+        if (count > p->max_per_window) {
+            p->max_per_window = count;
+        }
+        p->windows++;
+        return;
+    }
+
+    if (!p->learned || p->learned->windows == 0) {
+        return;
+    }
+
+    double high = p->learned->max_per_window * (1.0 + BASELINE_RATE_TOLERANCE);
+    double low = p->learned->min_per_window * (1.0 - BASELINE_RATE_TOLERANCE);
+    baseline_finding_kind_t kind;
+    if (count > high) {
+        kind = BASELINE_RATE_HIGH;
+    } else if (count < low) {
+        kind = BASELINE_RATE_LOW;
+    } else {
+        return;
+    }
+
+    bl->rate_excursions++;
+    baseline_finding_t *f = record_finding(bl, kind, p->key, timestamp_ns, &p->master, &p->slave);
+    if (!f) {
+        return;
+    }
+    if (f->occurrences == 1 ||
+        (kind == BASELINE_RATE_HIGH ? count > f->observed : count < f->observed)) {
+        f->observed = count;
+    }
+    f->expected_min = p->learned->min_per_window;
+    f->expected_max = p->learned->max_per_window;
+}
+
+
+/*
+ * live_grow() - Double the live pair table
+ */
+
+static bool live_grow(baseline_t *bl) {
+    uint32_t capacity = bl->live_capacity ? bl->live_capacity * 2 : BASELINE_INITIAL_SLOTS;
+    baseline_live_pair_t *slots = calloc(capacity, sizeof(baseline_live_pair_t));
+    if (!slots) {
+        return false;
+    }
+    for (uint32_t i = 0; i < bl->live_capacity; i++) {
+        if (bl->live[i].key == 0) continue;
+        uint32_t j = (uint32_t)bl->live[i].key & (capacity - 1);
+        while (slots[j].key != 0) {
+            j = (j + 1) & (capacity - 1);
+        }
+        slots[j] = bl->live[i];
+    }
+    free(bl->live);
+    bl->live = slots;
+    bl->live_capacity = capacity;
+    return true;
+}
+
+
+/*
+ * live_lookup() - Find or create the live counter for a pair
+ */
+
+static baseline_live_pair_t *live_lookup(baseline_t *bl, uint64_t key, const endpoint_t *master,
+                                         const endpoint_t *slave, int64_t window) {
+    if ((bl->live_count + 1) * 2 > bl->live_capacity && !live_grow(bl)) {
+        return NULL;
+    }
+
+    uint32_t mask = bl->live_capacity - 1;
+    uint32_t j = (uint32_t)key & mask;
+    while (bl->live[j].key != 0) {
+        if (bl->live[j].key == key) {
+            return &bl->live[j];
+        }
+        j = (j + 1) & mask;
+    }
+
+    baseline_live_pair_t *p = &bl->live[j];
+    p->key = key;
+    p->master = *master;
+    p->slave = *slave;
+    p->window_start = window;
+    p->partial = true;
+    p->learned = bl->learning ? NULL : model_find_pair(bl, key);
+    bl->live_count++;
+    return p;
+}
+
+
+/**
+ * baseline_init_learn() - Start learning a new model
+ * @bl: State to initialise
+ * @path: Model file written by baseline_finish()
+ *
+ * Return: true on success, false on allocation failure
+ */
+
+bool baseline_init_learn(baseline_t *bl, const char *path) {
+    memset(bl, 0, sizeof(*bl));
+    bl->learning = true;
+    bl->path = path;
+    bl->learned_capacity = BASELINE_INITIAL_SLOTS;
+    bl->learned = calloc(bl->learned_capacity, sizeof(uint64_t));
+    if (!bl->learned || !live_grow(bl)) {
+        printf("Error: Could not allocate baseline tables\n");
+        baseline_free(bl);
+        return false;
+    }
+    return true;
+}
+
+
+/**
+ * baseline_load() - Map an existing model for checking
+ * @bl: State to initialise
+ * @path: Model file produced by learn mode
+ * @verify: Also check every directory bucket (O(2^dir_bits))
+ *
+ * Validates the header and array bounds, then points the arrays into
+ * the read-only mapping. Without @verify the load does not touch the
+ * arrays, so it takes the same time for any model size; each lookup
+ * bounds-checks the bucket it reaches instead.
+ *
+ * Return: true on success, false if the file is missing or malformed
+ */
+
+bool baseline_load(baseline_t *bl, const char *path, bool verify) {
+    memset(bl, 0, sizeof(*bl));
+    bl->path = path;
+
+#ifdef _WIN32
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        printf("Error: Could not open baseline %s\n", path);
+        return false;
+    }
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    if (size <= 0) {
+        fclose(fp);
+        printf("Error: Baseline %s is empty\n", path);
+        return false;
+    }
+    bl->mapping = malloc((size_t)size);
+    if (!bl->mapping || fread(bl->mapping, 1, (size_t)size, fp) != (size_t)size) {
+        fclose(fp);
+        free(bl->mapping);
+        bl->mapping = NULL;
+        printf("Error: Could not read baseline %s\n", path);
+        return false;
+    }
+    fclose(fp);
+    bl->mapping_size = (size_t)size;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        printf("Error: Could not open baseline %s\n", path);
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        printf("Error: Baseline %s is empty\n", path);
+        return false;
+    }
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        printf("Error: Could not map baseline %s\n", path);
+        return false;
+    }
+    bl->mapping = map;
+    bl->mapping_size = (size_t)st.st_size;
+#endif
+
+    const uint8_t *base = bl->mapping;
+    uint64_t size64 = bl->mapping_size;
+    const baseline_file_header_t *hdr = (const baseline_file_header_t*)base;
+
+    bool valid = size64 >= sizeof(*hdr) &&
+                 memcmp(hdr->magic, BASELINE_MAGIC, sizeof(BASELINE_MAGIC)) == 0 &&
+                 hdr->version == BASELINE_VERSION &&
+                 hdr->dir_bits <= 30 &&
+                 hdr->bloom_hashes > 0 && hdr->bloom_hashes <= 32 &&
+                 hdr->bloom_bits >= 64 && (hdr->bloom_bits & (hdr->bloom_bits - 1)) == 0 &&
+                 hdr->tuple_count <= size64 / sizeof(uint64_t) &&
+                 hdr->pair_count <= size64 / sizeof(baseline_pair_t) &&
+                 hdr->bloom_bits / 8 <= size64;
+    if (valid) {
+        uint64_t dir_len = ((1ULL << hdr->dir_bits) + 1) * sizeof(uint32_t);
+        valid = hdr->tuple_offset % 8 == 0 && hdr->dir_offset % 8 == 0 &&
+                hdr->bloom_offset % 8 == 0 && hdr->pair_offset % 8 == 0 &&
+                hdr->tuple_offset <= size64 &&
+                hdr->tuple_count * sizeof(uint64_t) <= size64 - hdr->tuple_offset &&
+                hdr->dir_offset <= size64 && dir_len <= size64 - hdr->dir_offset &&
+                hdr->bloom_offset <= size64 && hdr->bloom_bits / 8 <= size64 - hdr->bloom_offset &&
+                hdr->pair_offset <= size64 &&
+                hdr->pair_count * sizeof(baseline_pair_t) <= size64 - hdr->pair_offset;
+    }
+    if (valid) {
+        const uint32_t *dir = (const uint32_t*)(base + hdr->dir_offset);
+        valid = dir[0] == 0 && dir[1ULL << hdr->dir_bits] == hdr->tuple_count;
+        // Lookups check their own bucket; the full scan is only on request
+        for (uint64_t b = 0; verify && valid && b < (1ULL << hdr->dir_bits); b++) {
+            valid = dir[b] <= dir[b + 1];
+        }
+    }
+    if (!valid && size64 >= sizeof(*hdr) &&
+        memcmp(hdr->magic, BASELINE_MAGIC, sizeof(BASELINE_MAGIC)) == 0 &&
+        hdr->version != BASELINE_VERSION) {
+        printf("Error: %s is a version %u baseline model (expected %u), relearn it\n",
+               path, (unsigned)hdr->version, BASELINE_VERSION);
+        baseline_free(bl);
+        return false;
+    }
+    if (!valid) {
+        printf("Error: %s is not a valid baseline model\n", path);
+        baseline_free(bl);
+        return false;
+    }
+
+    bl->header = hdr;
+    bl->tuples = (const uint64_t*)(base + hdr->tuple_offset);
+    bl->directory = (const uint32_t*)(base + hdr->dir_offset);
+    bl->bloom = (const uint64_t*)(base + hdr->bloom_offset);
+    bl->pairs = (const baseline_pair_t*)(base + hdr->pair_offset);
+
+    if (!live_grow(bl)) {
+        printf("Error: Could not allocate baseline tables\n");
+        baseline_free(bl);
+        return false;
+    }
+    return true;
+}
+
+
+/**
+ * baseline_update() - Learn or check one frame
+ * @bl: State
+ * @frame: Parsed frame
+ * @src: Source address
+ * @src_port: Source TCP port
+ * @dst: Destination address
+ * @timestamp_ns: Frame timestamp in nanoseconds since the epoch
+ *
+ * Only requests (frames not sent from port 502) are considered.
+ *
+ * Return: true if the frame deviates from the model (check mode)
+ */
+
+bool baseline_update(baseline_t *bl, const modbus_tcp_frame_t *frame,
+                     const endpoint_t *src, uint16_t src_port,
+                     const endpoint_t *dst, int64_t timestamp_ns) {
+    if (src_port == BASELINE_MODBUS_PORT) {
+        return false;
+    }
+
+    if (bl->frames == 0) {
+        bl->first_time_ns = timestamp_ns;
+    }
+    bl->frames++;
+    bl->last_time_ns = timestamp_ns;
+
+    // Rate envelope: close windows the pair has moved past
+    uint64_t key = pair_key(src, dst);
+    int64_t window = floor_div(timestamp_ns, BASELINE_WINDOW_SECONDS * 1000000000LL) *
+                     BASELINE_WINDOW_SECONDS;
+    baseline_live_pair_t *p = live_lookup(bl, key, src, dst, window);
+    if (p) {
+        if (window > p->window_start) {
+            if (!p->partial) {
+                close_window(bl, p, p->count, window * 1000000000);
+            }
+            if (window > p->window_start + BASELINE_WINDOW_SECONDS) {
+                // Pair was silent for at least one full window
+                close_window(bl, p, 0, window * 1000000000);
+            }
+            p->window_start = window;
+            p->count = 0;
+            p->partial = false;
+        }
+        p->count++;
+    }
+
+    // Tuples: one per address block touched
+    uint16_t address = 0;
+    uint16_t quantity = 0;
+    uint32_t first = BASELINE_BLOCK_NONE;
+    uint32_t last = BASELINE_BLOCK_NONE;
+    if (modbus_get_address_range(frame, true, &address, &quantity)) {
+        uint32_t end = (uint32_t)address + (quantity ? quantity : 1) - 1;
+        if (end > 0xFFFF) end = 0xFFFF;
+        first = address >> BASELINE_BLOCK_SHIFT;
+        last = end >> BASELINE_BLOCK_SHIFT;
+    }
+
+    if (bl->learning) {
+        for (uint32_t b = first; b <= last; b++) {
+            uint64_t hash = tuple_hash(key, frame->mbap.unit_id, frame->function_code,
+                                       (uint16_t)b);
+            if (!learn_insert(bl, hash)) {
+                printf("Warning: Baseline table allocation failed\n");
+                break;
+            }
+        }
+        return false;
+    }
+
+    if (p && !p->learned) {
+        bl->unseen_frames++;
+        record_finding(bl, BASELINE_UNSEEN_PAIR, key, timestamp_ns, src, dst);
+        return true;
+    }
+
+    bool deviates = false;
+    for (uint32_t b = first; b <= last; b++) {
+        uint64_t h = tuple_hash(key, frame->mbap.unit_id, frame->function_code, (uint16_t)b);
+        if (model_contains(bl, h)) {
+            continue;
+        }
+        deviates = true;
+        baseline_finding_t *f = record_finding(bl, BASELINE_UNSEEN_TUPLE, h, timestamp_ns,
+                                               src, dst);
+        if (f) {
+            f->unit_id = frame->mbap.unit_id;
+            f->function_code = frame->function_code;
+            f->block_start = b == BASELINE_BLOCK_NONE ?
+                             BASELINE_BLOCK_NONE : (uint16_t)(b << BASELINE_BLOCK_SHIFT);
+        }
+    }
+    if (deviates) {
+        bl->unseen_frames++;
+    }
+    return deviates;
+}
+
+
+/*
+ * write_model() - Serialise the learned tables to bl->path
+ */
+
+static bool write_model(const baseline_t *bl) {
+    uint64_t n = bl->learned_count;
+    uint64_t *tuples = malloc((n ? n : 1) * sizeof(uint64_t));
+    baseline_pair_t *pairs = malloc((bl->live_count ? bl->live_count : 1) *
+                                    sizeof(baseline_pair_t));
+    if (!tuples || !pairs) {
+        free(tuples);
+        free(pairs);
+        printf("Error: Could not allocate baseline model\n");
+        return false;
+    }
+
+    uint64_t k = 0;
+    for (uint64_t i = 0; i < bl->learned_capacity; i++) {
+        if (bl->learned[i] != 0) {
+            tuples[k++] = bl->learned[i];
+        }
+    }
+    qsort(tuples, n, sizeof(uint64_t), compare_u64);
+
+    uint64_t pair_count = 0;
+    for (uint32_t i = 0; i < bl->live_capacity; i++) {
+        const baseline_live_pair_t *p = &bl->live[i];
+        if (p->key == 0) continue;
+        pairs[pair_count].key = p->key;
+        pairs[pair_count].min_per_window = p->min_per_window;
+        pairs[pair_count].max_per_window = p->max_per_window;
+        pairs[pair_count].windows = p->windows;
+        pair_count++;
+    }
+    qsort(pairs, pair_count, sizeof(baseline_pair_t), compare_pair);
+
+    // Directory: ~BASELINE_BUCKET_TARGET tuples per bucket
+    uint32_t dir_bits = 0;
+    while (dir_bits < 24 && ((uint64_t)BASELINE_BUCKET_TARGET << (dir_bits + 1)) <= n) {
+        dir_bits++;
+    }
+    uint64_t buckets = 1ULL << dir_bits;
+    uint32_t *directory = malloc((buckets + 1) * sizeof(uint32_t));
+
+    uint64_t bloom_bits = 64;
+    while (bloom_bits < n * BASELINE_BLOOM_BITS_PER_TUPLE) {
+        bloom_bits *= 2;
+    }
+    uint64_t *bloom = calloc(bloom_bits / 64, sizeof(uint64_t));
+
+    if (!directory || !bloom) {
+        free(tuples);
+        free(pairs);
+        free(directory);
+        free(bloom);
+        printf("Error: Could not allocate baseline model\n");
+        return false;
+    }
+
+    uint64_t t = 0;
+    for (uint64_t b = 0; b < buckets; b++) {
+        directory[b] = (uint32_t)t;
+        while (t < n && (dir_bits ? tuples[t] >> (64 - dir_bits) : 0) == b) {
+            t++;
+        }
+    }
+    directory[buckets] = (uint32_t)n;
+
+    for (uint64_t i = 0; i < n; i++) {
+        for (uint32_t j = 0; j < BASELINE_BLOOM_HASHES; j++) {
+            uint64_t bit = bloom_probe(tuples[i], j, bloom_bits);
+            bloom[bit >> 6] |= 1ULL << (bit & 63);
+        }
+    }
+
+    baseline_file_header_t hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, BASELINE_MAGIC, sizeof(BASELINE_MAGIC));
+    hdr.version = BASELINE_VERSION;
+    hdr.window_seconds = BASELINE_WINDOW_SECONDS;
+    hdr.tuple_count = n;
+    hdr.tuple_offset = align8(sizeof(hdr));
+    hdr.dir_bits = dir_bits;
+    hdr.bloom_hashes = BASELINE_BLOOM_HASHES;
+    hdr.dir_offset = align8(hdr.tuple_offset + n * sizeof(uint64_t));
+    hdr.bloom_bits = bloom_bits;
+    hdr.bloom_offset = align8(hdr.dir_offset + (buckets + 1) * sizeof(uint32_t));
+    hdr.pair_count = pair_count;
+    hdr.pair_offset = align8(hdr.bloom_offset + bloom_bits / 8);
+    hdr.frames_learned = bl->frames;
+    hdr.first_time_ns = bl->first_time_ns;
+    hdr.last_time_ns = bl->last_time_ns;
+
+    static const uint8_t zeros[8] = {0};
+    bool ok = false;
+    FILE *fp = fopen(bl->path, "wb");
+    if (fp) {
+        uint64_t dir_end = hdr.dir_offset + (buckets + 1) * sizeof(uint32_t);
+        ok = fwrite(&hdr, sizeof(hdr), 1, fp) == 1 &&
+             fwrite(zeros, 1, hdr.tuple_offset - sizeof(hdr), fp) ==
+                 hdr.tuple_offset - sizeof(hdr) &&
+             fwrite(tuples, sizeof(uint64_t), n, fp) == n &&
+             fwrite(zeros, 1, hdr.dir_offset - (hdr.tuple_offset + n * sizeof(uint64_t)), fp) ==
+                 hdr.dir_offset - (hdr.tuple_offset + n * sizeof(uint64_t)) &&
+             fwrite(directory, sizeof(uint32_t), buckets + 1, fp) == buckets + 1 &&
+             fwrite(zeros, 1, hdr.bloom_offset - dir_end, fp) == hdr.bloom_offset - dir_end &&
+             fwrite(bloom, sizeof(uint64_t), bloom_bits / 64, fp) == bloom_bits / 64 &&
+             fwrite(pairs, sizeof(baseline_pair_t), pair_count, fp) == pair_count;
+        ok = (fclose(fp) == 0) && ok;
+    }
+    if (!ok) {
+        printf("Error: Could not write baseline %s\n", bl->path);
+    }
+
+    free(tuples);
+    free(pairs);
+    free(directory);
+    free(bloom);
+    return ok;
+}
+
+
+/**
+ * baseline_finish() - Close open windows; in learn mode write the model
+ * @bl: State
+ *
+ * The last window of every pair is partial and therefore discarded.
+ *
+ * Return: false if the model could not be written
+ */
+
+bool baseline_finish(baseline_t *bl) {
+    if (!bl->learning) {
+        return true;
+    }
+    return write_model(bl);
+}
+
+
+/*
+ * get_finding_name() - Display name of a finding kind
+ */
+
+static const char *get_finding_name(baseline_finding_kind_t kind) {
+    switch (kind) {
+        case BASELINE_UNSEEN_TUPLE: return "Unseen Tuple";
+        case BASELINE_UNSEEN_PAIR:  return "Unseen Pair";
+        case BASELINE_RATE_HIGH:    return "Rate High";
+        case BASELINE_RATE_LOW:     return "Rate Low";
+        default:                    return "Unknown";
+    }
+}
+
+
+/*
+ * format_detail() - Kind-specific finding detail
+ */
+
+static void format_detail(const baseline_finding_t *f, char *buf, size_t len) {
+    switch (f->kind) {
+        case BASELINE_UNSEEN_TUPLE:
+            if (f->block_start == BASELINE_BLOCK_NONE) {
+                snprintf(buf, len, "unit %u fc 0x%02X", f->unit_id, f->function_code);
+            } else {
+                snprintf(buf, len, "unit %u fc 0x%02X addr %u-%u", f->unit_id, f->function_code,
+                         f->block_start, f->block_start + (1u << BASELINE_BLOCK_SHIFT) - 1);
+            }
+            break;
+        case BASELINE_RATE_HIGH:
+        case BASELINE_RATE_LOW:
+            snprintf(buf, len, "%u req/window (learned %u-%u)",
+                     f->observed, f->expected_min, f->expected_max);
+            break;
+        default:
+            snprintf(buf, len, "-");
+            break;
+    }
+}
+
+
+/**
+ * baseline_display_summary() - Print learn or check results to stdout
+ * @bl: State
+ */
+
+void baseline_display_summary(const baseline_t *bl) {
+    if (bl->learning) {
+        printf("\n%sBaseline Learned (%s):%s\n", COLOR_WHITE, bl->path, COLOR_RESET);
+        printf("  Requests learned:    %llu\n", (unsigned long long)bl->frames);
+        printf("  Distinct tuples:     %llu\n", (unsigned long long)bl->learned_count);
+        printf("  Master/slave pairs:  %u (%ds rate windows)\n",
+               bl->live_count, BASELINE_WINDOW_SECONDS);
+        return;
+    }
+
+    const baseline_file_header_t *hdr = bl->header;
+    printf("\n%sBaseline Check (%s):%s\n", COLOR_WHITE, bl->path, COLOR_RESET);
+    printf("  Model:               %llu tuples, %llu pairs, %llu requests learned\n",
+           (unsigned long long)hdr->tuple_count, (unsigned long long)hdr->pair_count,
+           (unsigned long long)hdr->frames_learned);
+    printf("  Requests checked:    %llu\n", (unsigned long long)bl->frames);
+
+    if (bl->finding_count == 0) {
+        printf("  %s[✓] Traffic matches the baseline%s\n", COLOR_GREEN, COLOR_RESET);
+        return;
+    }
+
+    printf("  %s[!] Requests outside the model: %llu%s\n",
+           COLOR_YELLOW, (unsigned long long)bl->unseen_frames, COLOR_RESET);
+    printf("  %s[!] Rate excursions: %llu windows%s\n",
+           COLOR_YELLOW, (unsigned long long)bl->rate_excursions, COLOR_RESET);
+
+    for (uint32_t i = 0; i < bl->finding_count && i < BASELINE_SUMMARY_ROWS; i++) {
+        const baseline_finding_t *f = &bl->findings[i];
+        char time_str[20];
+        char detail[64];
+        char master[ENDPOINT_STR_LEN], slave[ENDPOINT_STR_LEN];
+        format_time(f->first_time_ns, time_str, sizeof(time_str));
+        format_detail(f, detail, sizeof(detail));
+        endpoint_format(&f->master, master, sizeof(master));
+        endpoint_format(&f->slave, slave, sizeof(slave));
+        printf("  %s%s%s %-12s %s%-15s%s -> %s%-15s%s %s (x%llu)\n",
+               COLOR_GRAY, time_str, COLOR_RESET, get_finding_name(f->kind),
+               COLOR_CYAN, master, COLOR_RESET, COLOR_CYAN, slave, COLOR_RESET,
+               detail, (unsigned long long)f->occurrences);
+    }
+    if (bl->finding_count > BASELINE_SUMMARY_ROWS) {
+        printf("  ... %u more findings (see report)\n", bl->finding_count - BASELINE_SUMMARY_ROWS);
+    }
+    if (bl->findings_dropped > 0) {
+        printf("  ... %u further findings not kept\n", bl->findings_dropped);
+    }
+}
+
+
+/**
+ * baseline_write_report() - Append learn or check results to report
+ * @bl: State
+ * @f: Open report file (no-op if NULL)
+ */
+
+void baseline_write_report(const baseline_t *bl, FILE *f) {
+    if (!f) return;
+
+    if (bl->learning) {
+        fprintf(f, "\n### Baseline Learned\n\n");
+        fprintf(f, "- **Model file:** %s\n", bl->path);
+        fprintf(f, "- **Requests learned:** %llu\n", (unsigned long long)bl->frames);
+        fprintf(f, "- **Distinct tuples:** %llu\n", (unsigned long long)bl->learned_count);
+        fprintf(f, "- **Master/slave pairs:** %u (%ds rate windows)\n",
+                bl->live_count, BASELINE_WINDOW_SECONDS);
+        return;
+    }
+
+    fprintf(f, "\n### Baseline Deviations\n\n");
+    fprintf(f, "- **Model file:** %s (%llu tuples, %llu pairs)\n", bl->path,
+            (unsigned long long)bl->header->tuple_count,
+            (unsigned long long)bl->header->pair_count);
+    fprintf(f, "- **Requests checked:** %llu\n", (unsigned long long)bl->frames);
+    fprintf(f, "- **Requests outside the model:** %llu\n", (unsigned long long)bl->unseen_frames);
+    fprintf(f, "- **Rate excursions:** %llu windows (tolerance ±%.0f%%)\n\n",
+            (unsigned long long)bl->rate_excursions, BASELINE_RATE_TOLERANCE * 100.0);
+
+    if (bl->finding_count == 0) {
+        fprintf(f, "No deviations from the baseline.\n");
+        return;
+    }
+
+    fprintf(f, "| First Seen | Finding | Master | Slave | Detail | Count |\n");
+    fprintf(f, "|------------|---------|--------|-------|--------|-------|\n");
+    for (uint32_t i = 0; i < bl->finding_count; i++) {
+        const baseline_finding_t *bf = &bl->findings[i];
+        char time_str[20];
+        char detail[64];
+        char master[ENDPOINT_STR_LEN], slave[ENDPOINT_STR_LEN];
+        format_time(bf->first_time_ns, time_str, sizeof(time_str));
+        format_detail(bf, detail, sizeof(detail));
+        endpoint_format(&bf->master, master, sizeof(master));
+        endpoint_format(&bf->slave, slave, sizeof(slave));
+        fprintf(f, "| %s | %s | %s | %s | %s | %llu |\n", time_str, get_finding_name(bf->kind),
+                master, slave, detail, (unsigned long long)bf->occurrences);
+    }
+    if (bl->findings_dropped > 0) {
+        fprintf(f, "\n*%u further findings not kept.*\n", bl->findings_dropped);
+    }
+}
+
+
+/**
+ * struct baseline_snapshot_t - Fixed part of a baseline checkpoint
+ */
+
+typedef struct {
+    uint8_t learning;
+    uint64_t model_tuples;
+    uint64_t model_pairs;
+    uint64_t learned_count;
+    uint32_t live_count;
+    uint32_t live_capacity;
+    uint64_t frames;
+    int64_t first_time_ns;
+    int64_t last_time_ns;
+    uint64_t unseen_frames;
+    uint64_t rate_excursions;
+    uint32_t finding_count;
+    uint32_t findings_dropped;
+} baseline_snapshot_t;
+
+
+/**
+ * baseline_save() - Write learn or check progress to a checkpoint
+ * @bl: State
+ * @f: Open binary file
+ *
+ * Layout: baseline_snapshot_t, the learned tuple hashes, then
+ * (slot, pair) per live pair and the findings.
+ *
+ * Return: false on write error
+ */
+
+bool baseline_save(const baseline_t *bl, FILE *f) {
+    baseline_snapshot_t snap;
+
+    memset(&snap, 0, sizeof(snap));
+    snap.learning = bl->learning;
+    snap.model_tuples = bl->header ? bl->header->tuple_count : 0;
+    snap.model_pairs = bl->header ? bl->header->pair_count : 0;
+    snap.learned_count = bl->learned_count;
+    snap.live_count = bl->live_count;
+    snap.live_capacity = bl->live_capacity;
+    snap.frames = bl->frames;
+    snap.first_time_ns = bl->first_time_ns;
+    snap.last_time_ns = bl->last_time_ns;
+    snap.unseen_frames = bl->unseen_frames;
+    snap.rate_excursions = bl->rate_excursions;
+    snap.finding_count = bl->finding_count;
+    snap.findings_dropped = bl->findings_dropped;
+    if (fwrite(&snap, sizeof(snap), 1, f) != 1) {
+        return false;
+    }
+
+    for (uint64_t i = 0; i < bl->learned_capacity; i++) {
+        if (bl->learned[i] != 0 && fwrite(&bl->learned[i], sizeof(uint64_t), 1, f) != 1) {
+            return false;
+        }
+    }
+
+    for (uint32_t i = 0; i < bl->live_capacity; i++) {
+        if (bl->live[i].key == 0) continue;
+        baseline_live_pair_t p = bl->live[i];
+        p.learned = NULL;
+        if (fwrite(&i, sizeof(i), 1, f) != 1 || fwrite(&p, sizeof(p), 1, f) != 1) {
+            return false;
+        }
+    }
+
+    return bl->finding_count == 0 ||
+           fwrite(bl->findings, sizeof(baseline_finding_t), bl->finding_count, f)
+               == bl->finding_count;
+}
+
+
+/**
+ * baseline_restore() - Load progress written by baseline_save()
+ * @bl: State in the same mode (and model) as the checkpoint
+ * @f: Open binary file
+ *
+ * Learned hashes are re-inserted and live pairs re-linked to the
+ * model's envelopes, so no pointer is taken from the file.
+ *
+ * Return: false on a short checkpoint or a mode/model mismatch
+ */
+
+bool baseline_restore(baseline_t *bl, FILE *f) {
+    baseline_snapshot_t snap;
+
+    if (fread(&snap, sizeof(snap), 1, f) != 1 ||
+        snap.learning != bl->learning ||
+        snap.model_tuples != (bl->header ? bl->header->tuple_count : 0) ||
+        snap.model_pairs != (bl->header ? bl->header->pair_count : 0) ||
+        snap.finding_count > BASELINE_MAX_FINDINGS ||
+        snap.live_capacity == 0 || (snap.live_capacity & (snap.live_capacity - 1)) != 0 ||
+        snap.live_count > snap.live_capacity / 2) {
+        return false;
+    }
+
+    for (uint64_t n = 0; n < snap.learned_count; n++) {
+        uint64_t h;
+        if (fread(&h, sizeof(h), 1, f) != 1 || h == 0 || !learn_insert(bl, h)) {
+            return false;
+        }
+    }
+
+    while (bl->live_capacity < snap.live_capacity) {
+        if (!live_grow(bl)) {
+            return false;
+        }
+    }
+    if (bl->live_capacity != snap.live_capacity) {
+        return false;
+    }
+    for (uint32_t n = 0; n < snap.live_count; n++) {
+        uint32_t i;
+        if (fread(&i, sizeof(i), 1, f) != 1 || i >= bl->live_capacity ||
+            fread(&bl->live[i], sizeof(baseline_live_pair_t), 1, f) != 1) {
+            return false;
+        }
+        bl->live[i].learned = bl->learning ? NULL : model_find_pair(bl, bl->live[i].key);
+    }
+    bl->live_count = snap.live_count;
+
+    if (snap.finding_count > 0 &&
+        fread(bl->findings, sizeof(baseline_finding_t), snap.finding_count, f)
+            != snap.finding_count) {
+        return false;
+    }
+    bl->finding_count = snap.finding_count;
+    for (uint32_t i = 0; i < bl->finding_count; i++) {
+        *finding_slot(bl, bl->findings[i].kind, bl->findings[i].key) = (uint16_t)(i + 1);
+    }
+    bl->findings_dropped = snap.findings_dropped;
+    bl->frames = snap.frames;
+    bl->first_time_ns = snap.first_time_ns;
+    bl->last_time_ns = snap.last_time_ns;
+    bl->unseen_frames = snap.unseen_frames;
+    bl->rate_excursions = snap.rate_excursions;
+    return true;
+}
+
+
+/**
+ * baseline_free() - Release tables and unmap the model
+ * @bl: State
+ */
+
+void baseline_free(baseline_t *bl) {
+    free(bl->learned);
+    free(bl->live);
+    if (bl->mapping) {
+#ifdef _WIN32
+        free(bl->mapping);
+#else
+        munmap(bl->mapping, bl->mapping_size);
+#endif
+    }
+    bl->learned = NULL;
+    bl->live = NULL;
+    bl->mapping = NULL;
+    bl->header = NULL;
+}
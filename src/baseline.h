@@ -0,0 +1,353 @@
+/*
+ * baseline.h - Learned "normal traffic" model and deviation checking
+ *
+ * Learn mode records every (master, slave, unit, function, address block)
+ * tuple seen in requests, plus a per-(master, slave) envelope of requests
+ * per window, and writes them to a compact binary model:
+ *
+ *   baseline_file_header_t
+ *   uint64_t tuples[tuple_count]         sorted tuple hashes
+ *   uint32_t directory[(1 << dir_bits) + 1]  radix index into tuples
+ *   uint64_t bloom[bloom_bits / 64]       Bloom filter over tuples
+ *   baseline_pair_t pairs[pair_count]     sorted by pair key
+ *
+ * Check mode maps the file read-only and uses the arrays in place; there
+ * is no parse step, and only the buckets lookups reach are checked. Per
+ * frame, the Bloom filter rejects unseen tuples in O(1) and the radix
+ * directory narrows confirmation to a bucket of a few entries. Rate
+ * envelopes are compared once per closed window.
+ *
+ * Copyright (C) 2025 Marty
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef BASELINE_H
+#define BASELINE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include "modbus_parser.h"
+#include "endpoint.h"
+
+
+/* File magic and format version (other versions must be relearned) */
+#define BASELINE_MAGIC "MBBASE1"
+#define BASELINE_VERSION 3
+
+/* Registers per address block (log2) */
+#define BASELINE_BLOCK_SHIFT 6
+
+/* Rate envelope window length in seconds */
+#define BASELINE_WINDOW_SECONDS 10
+
+/* Bloom filter bits per learned tuple and number of probes (~1% FP) */
+#define BASELINE_BLOOM_BITS_PER_TUPLE 10
+#define BASELINE_BLOOM_HASHES 7
+
+/* Tolerance applied to the learned envelope before flagging (fraction) */
+#define BASELINE_RATE_TOLERANCE 0.25
+
+/* Distinct deviations kept for reporting */
+#define BASELINE_MAX_FINDINGS 256
+
+/* Hash index slots over the findings (power of two, at most half full) */
+#define BASELINE_FINDING_SLOTS 512
+
+
+/**
+ * struct baseline_file_header_t - On-disk model header
+ * @magic: BASELINE_MAGIC, NUL padded
+ * @version: BASELINE_VERSION
+ * @window_seconds: Rate envelope window used when learning
+ * @tuple_count: Entries in the sorted tuple array
+ * @tuple_offset: File offset of the tuple array
+ * @dir_bits: log2 of directory buckets
+ * @bloom_hashes: Bloom probes per tuple
+ * @dir_offset: File offset of the radix directory
+ * @bloom_bits: Bloom filter size in bits (power of two)
+ * @bloom_offset: File offset of the Bloom filter
+ * @pair_count: Entries in the rate envelope array
+ * @pair_offset: File offset of the rate envelope array
+ * @frames_learned: Requests seen while learning
+ * @first_time_ns: Timestamp of the first learned frame (ns since the epoch)
+ * @last_time_ns: Timestamp of the last learned frame (ns since the epoch)
+ *
+ * All offsets are 8-byte aligned so arrays can be used straight from
+ * the mapping. Integers are in host byte order.
+ */
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t window_seconds;
+    uint64_t tuple_count;
+    uint64_t tuple_offset;
+    uint32_t dir_bits;
+    uint32_t bloom_hashes;
+    uint64_t dir_offset;
+    uint64_t bloom_bits;
+    uint64_t bloom_offset;
+    uint64_t pair_count;
+    uint64_t pair_offset;
+    uint64_t frames_learned;
+    int64_t first_time_ns;
+    int64_t last_time_ns;
+} baseline_file_header_t;
+
+
+/**
+ * struct baseline_pair_t - Learned request-rate envelope
+ * @key: Hash of (master, slave)
+ * @min_per_window: Fewest requests in a complete window
+ * @max_per_window: Most requests in a complete window
+ * @windows: Complete windows observed
+ */
+
+typedef struct {
+    uint64_t key;
+    uint32_t min_per_window;
+    uint32_t max_per_window;
+    uint64_t windows;
+} baseline_pair_t;
+
+
+/**
+ * struct baseline_live_pair_t - Per-pair window counter during a run
+ * @key: Hash of (master, slave), 0 = empty slot
+ * @master: Master address
+ * @slave: Slave address
+ * @window_start: Start of the open window (seconds since epoch)
+ * @count: Requests in the open window
+ * @partial: Open window began mid-window (first window of the pair)
+ * @learned: Check mode: envelope from the model, NULL if pair unseen
+ * @min_per_window: Learn mode: fewest requests in a complete window
+ * @max_per_window: Learn mode: most requests in a complete window
+ * @windows: Learn mode: complete windows observed
+ */
+
+typedef struct {
+    uint64_t key;
+    endpoint_t master;
+    endpoint_t slave;
+    int64_t window_start;
+    uint32_t count;
+    bool partial;
+    const baseline_pair_t *learned;
+    uint32_t min_per_window;
+    uint32_t max_per_window;
+    uint64_t windows;
+} baseline_live_pair_t;
+
+
+/**
+ * enum baseline_finding_kind_t - Kind of deviation from the model
+ */
+
+typedef enum {
+    BASELINE_UNSEEN_TUPLE,      // Tuple not present in the model
+    BASELINE_UNSEEN_PAIR,       // Master/slave pair never learned
+    BASELINE_RATE_HIGH,         // Window above learned maximum
+    BASELINE_RATE_LOW           // Window below learned minimum
+} baseline_finding_kind_t;
+
+
+/**
+ * struct baseline_finding_t - One distinct deviation
+ * @kind: Deviation kind
+ * @key: Tuple or pair hash (deduplication key)
+ * @first_time_ns: Timestamp first seen (ns since the epoch)
+ * @occurrences: Frames or windows affected
+ * @master: Master address
+ * @slave: Slave address
+ * @unit_id: Unit ID (tuples only)
+ * @function_code: Function code (tuples only)
+ * @block_start: First address of the block (tuples only, 0xFFFF = none)
+ * @observed: Requests in the window (rate findings)
+ * @expected_min: Learned minimum (rate findings)
+ * @expected_max: Learned maximum (rate findings)
+ */
+
+typedef struct {
+    baseline_finding_kind_t kind;
+    uint64_t key;
+    int64_t first_time_ns;
+    uint64_t occurrences;
+    endpoint_t master;
+    endpoint_t slave;
+    uint8_t unit_id;
+    uint8_t function_code;
+    uint16_t block_start;
+    uint32_t observed;
+    uint32_t expected_min;
+    uint32_t expected_max;
+} baseline_finding_t;
+
+
+/**
+ * struct baseline_t - Learn or check state
+ * @learning: true in learn mode, false in check mode
+ * @path: Model file path
+ * @learned: Learn mode: open-addressed set of tuple hashes (0 = empty)
+ * @learned_count: Learn mode: entries in @learned
+ * @learned_capacity: Learn mode: slots in @learned (power of two)
+ * @mapping: Check mode: start of the mapped model
+ * @mapping_size: Check mode: bytes mapped
+ * @header: Check mode: model header inside @mapping
+ * @tuples: Check mode: sorted tuple hashes inside @mapping
+ * @directory: Check mode: radix directory inside @mapping
+ * @bloom: Check mode: Bloom filter inside @mapping
+ * @pairs: Check mode: rate envelopes inside @mapping
+ * @live: Per-pair window counters for this run
+ * @live_count: Entries used in @live
+ * @live_capacity: Slots in @live (power of two)
+ * @frames: Requests processed
+ * @first_time_ns: Timestamp of the first request (ns since the epoch)
+ * @last_time_ns: Timestamp of the last request (ns since the epoch)
+ * @unseen_frames: Check mode: requests with a tuple not in the model
+ * @rate_excursions: Check mode: windows outside the envelope
+ * @findings: Check mode: distinct deviations
+ * @finding_count: Entries used in @findings
+ * @finding_index: Check mode: open-addressed index into @findings by
+ *                 (kind, key); slot value i + 1 is @findings[i], 0 = empty
+ * @findings_dropped: Distinct deviations not kept
+ */
+
+typedef struct {
+    bool learning;
+    const char *path;
+
+    uint64_t *learned;
+    uint64_t learned_count;
+    uint64_t learned_capacity;
+
+    void *mapping;
+    size_t mapping_size;
+    const baseline_file_header_t *header;
+    const uint64_t *tuples;
+    const uint32_t *directory;
+    const uint64_t *bloom;
+    const baseline_pair_t *pairs;
+
+    baseline_live_pair_t *live;
+    uint32_t live_count;
+    uint32_t live_capacity;
+
+    uint64_t frames;
+    int64_t first_time_ns;
+    int64_t last_time_ns;
+    uint64_t unseen_frames;
+    uint64_t rate_excursions;
+    baseline_finding_t findings[BASELINE_MAX_FINDINGS];
+    uint32_t finding_count;
+    uint16_t finding_index[BASELINE_FINDING_SLOTS];
+    uint32_t findings_dropped;
+} baseline_t;
+
+
+/**
+ * baseline_init_learn() - Start learning a new model
+ * @bl: State to initialise
+ * @path: Model file written by baseline_finish()
+ *
+ * Return: true on success, false on allocation failure
+ */
+
+bool baseline_init_learn(baseline_t *bl, const char *path);
+
+
+/**
+ * baseline_load() - Map an existing model for checking
+ * @bl: State to initialise
+ * @path: Model file produced by learn mode
+ * @verify: Also check every directory bucket (O(2^dir_bits))
+ *
+ * Validates the header and array bounds, then points the arrays into
+ * the read-only mapping. Without @verify the load does not touch the
+ * arrays, so it takes the same time for any model size; each lookup
+ * bounds-checks the bucket it reaches instead.
+ *
+ * Return: true on success, false if the file is missing or malformed
+ */
+
+bool baseline_load(baseline_t *bl, const char *path, bool verify);
+
+
+/**
+ * baseline_update() - Learn or check one frame
+ * @bl: State
+ * @frame: Parsed frame
+ * @src: Source address
+ * @src_port: Source TCP port
+ * @dst: Destination address
+ * @timestamp_ns: Frame timestamp in nanoseconds since the epoch
+ *
+ * Only requests (frames not sent from port 502) are considered.
+ *
+ * Return: true if the frame deviates from the model (check mode)
+ */
+
+bool baseline_update(baseline_t *bl, const modbus_tcp_frame_t *frame,
+                     const endpoint_t *src, uint16_t src_port,
+                     const endpoint_t *dst, int64_t timestamp_ns);
+
+
+/**
+ * baseline_finish() - Close open windows; in learn mode write the model
+ * @bl: State
+ *
+ * Return: false if the model could not be written
+ */
+
+bool baseline_finish(baseline_t *bl);
+
+
+/**
+ * baseline_display_summary() - Print learn or check results to stdout
+ * @bl: State
+ */
+
+void baseline_display_summary(const baseline_t *bl);
+
+
+/**
+ * baseline_write_report() - Append learn or check results to report
+ * @bl: State
+ * @f: Open report file (no-op if NULL)
+ */
+
+void baseline_write_report(const baseline_t *bl, FILE *f);
+
+
+/**
+ * baseline_save() - Write learn or check progress to a checkpoint
+ * @bl: State
+ * @f: Open binary file
+ *
+ * Return: false on write error
+ */
+
+bool baseline_save(const baseline_t *bl, FILE *f);
+
+
+/**
+ * baseline_restore() - Load progress written by baseline_save()
+ * @bl: State from baseline_init_learn() or baseline_load() in the same
+ *      mode (and, for checking, with the same model)
+ * @f: Open binary file
+ *
+ * Return: false on a short checkpoint or a mode/model mismatch
+ */
+
+bool baseline_restore(baseline_t *bl, FILE *f);
+
+
+/**
+ * baseline_free() - Release tables and unmap the model
+ * @bl: State
+ */
+
+void baseline_free(baseline_t *bl);
+
+#endif /* BASELINE_H */
@@ -0,0 +1,706 @@
+/*
+ * capture_input.c - Pipelined decompression of compressed captures
+ *
+ * A decompression thread reads the file in CAPTURE_READ_SIZE chunks,
+ * decodes into the free slots of a ring and publishes each full slot.
+ * The parser thread reads the ring through a custom stdio stream, so
+ * libpcap sees an ordinary capture. Only slot hand-over takes the lock;
+ * the bytes inside a slot are owned by one side at a time.
+ *
+ * Copyright (C) 2025 Marty
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+
+#ifndef _GNU_SOURCE
+    #define _GNU_SOURCE // fopencookie()
+#endif
+
+#include "capture_input.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#ifndef _WIN32
+    #define CAPTURE_HAVE_PIPELINE 1
+    #include <errno.h>
+    #include <pthread.h>
+    #include <time.h>
+    #include <sys/types.h>
+#endif
+
+#ifdef MODBUS_HAVE_ZLIB
+    #include <zlib.h>
+#endif
+#ifdef MODBUS_HAVE_ZSTD
+    #include <zstd.h>
+#endif
+#ifdef MODBUS_HAVE_LZ4
+    #include <lz4frame.h>
+#endif
+
+
+/* Leading bytes of each format */
+static const uint8_t gzip_magic[] = { 0x1f, 0x8b };
+static const uint8_t zstd_magic[] = { 0x28, 0xb5, 0x2f, 0xfd };
+static const uint8_t lz4_magic[] = { 0x04, 0x22, 0x4d, 0x18 };
+
+
+/**
+ * capture_detect() - Detect the compression format of a capture file
+ * @filename: Path to the capture
+ *
+ * Return: Format, CAPTURE_PLAIN if not compressed or not a regular file
+ */
+
+capture_compression_t capture_detect(const char *filename) {
+    struct stat st;
+    uint8_t magic[4];
+
+    if (stat(filename, &st) != 0 || !S_ISREG(st.st_mode)) {
+        return CAPTURE_PLAIN;
+    }
+
+    FILE *f = fopen(filename, "rb");
+    if (!f) {
+        return CAPTURE_PLAIN;
+    }
+    size_t n = fread(magic, 1, sizeof(magic), f);
+    fclose(f);
+
+    if (n >= sizeof(gzip_magic) && memcmp(magic, gzip_magic, sizeof(gzip_magic)) == 0) {
+        return CAPTURE_GZIP;
+    }
+    if (n == sizeof(magic) && memcmp(magic, zstd_magic, sizeof(zstd_magic)) == 0) {
+        return CAPTURE_ZSTD;
+    }
+    if (n == sizeof(magic) && memcmp(magic, lz4_magic, sizeof(lz4_magic)) == 0) {
+        return CAPTURE_LZ4;
+    }
+    return CAPTURE_PLAIN;
+}
+
+
+/**
+ * capture_compression_name() - Short name of a format
+ * @compression: Format
+ *
+ * Return: "gzip", "zstd", "lz4" or "none"
+ */
+
+const char *capture_compression_name(capture_compression_t compression) {
+    switch (compression) {
+        case CAPTURE_GZIP: return "gzip";
+        case CAPTURE_ZSTD: return "zstd";
+        case CAPTURE_LZ4:  return "lz4";
+        default:           return "none";
+    }
+}
+
+
+#ifdef CAPTURE_HAVE_PIPELINE
+
+/**
+ * struct ring_slot_t - One buffer of decompressed data
+ * @data: CAPTURE_SLOT_SIZE bytes
+ * @length: Valid bytes once published
+ */
+
+typedef struct {
+    uint8_t *data;
+    size_t length;
+} ring_slot_t;
+
+
+/**
+ * struct capture_input - Decompression thread, ring and stream
+ * @source: Compressed file (decompression thread only)
+ * @stream: Stream handed to libpcap (NULL once closed)
+ * @compression: Format being decoded
+ * @gz: zlib state (CAPTURE_GZIP)
+ * @zs: Zstandard state (CAPTURE_ZSTD)
+ * @lz: LZ4 frame state (CAPTURE_LZ4)
+ * @in: Compressed read buffer
+ * @in_len: Valid bytes in @in
+ * @in_pos: Bytes of @in consumed by the codec
+ * @in_eof: The file has been read to the end
+ * @at_boundary: The codec ended a member/frame and holds no pending output
+ * @slots: Ring buffers
+ * @fill_index: Next slot the decompression thread fills
+ * @read_index: Slot the parser reads
+ * @read_pos: Bytes of the read slot already consumed
+ * @reading: The parser holds @read_index
+ * @full_count: Published slots not yet released by the parser
+ * @done: The decompression thread has published its last slot
+ * @stop: Close requested; the decompression thread must exit
+ * @lock: Protects the hand-over fields and @stats
+ * @slot_full: Signalled when a slot is published or @done is set
+ * @slot_free: Signalled when a slot is released or @stop is set
+ * @thread: Decompression thread
+ * @started: Start of the pipeline (monotonic seconds)
+ * @work: Decompression thread counters, folded into @stats per slot
+ * @stats: Per-stage timing
+ * @error: Decompression error message
+ */
+
+struct capture_input {
+    FILE *source;
+    FILE *stream;
+    capture_compression_t compression;
+#ifdef MODBUS_HAVE_ZLIB
+    z_stream gz;
+#endif
+#ifdef MODBUS_HAVE_ZSTD
+    ZSTD_DStream *zs;
+#endif
+#ifdef MODBUS_HAVE_LZ4
+    LZ4F_dctx *lz;
+#endif
+    uint8_t *in;
+    size_t in_len;
+    size_t in_pos;
+    bool in_eof;
+    bool at_boundary;
+
+    ring_slot_t slots[CAPTURE_RING_SLOTS];
+    uint32_t fill_index;
+    uint32_t read_index;
+    size_t read_pos;
+    bool reading;
+    uint32_t full_count;
+    bool done;
+    bool stop;
+    pthread_mutex_t lock;
+    pthread_cond_t slot_full;
+    pthread_cond_t slot_free;
+    pthread_t thread;
+
+    double started;
+    capture_input_stats_t work;
+    capture_input_stats_t stats;
+    char error[256];
+};
+
+
+/*
+ * now_seconds() - Monotonic clock in seconds
+ */
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/*
+ * codec_init() / codec_free() - Create and destroy the decoder state
+ */
+
+static bool codec_init(capture_input_t *input) {
+    switch (input->compression) {
+#ifdef MODBUS_HAVE_ZLIB
+        case CAPTURE_GZIP:
+            // 16 + MAX_WBITS: gzip wrapper only
+            return inflateInit2(&input->gz, 16 + MAX_WBITS) == Z_OK;
+#endif
+#ifdef MODBUS_HAVE_ZSTD
+        case CAPTURE_ZSTD:
+            input->zs = ZSTD_createDStream();
+            return input->zs && !ZSTD_isError(ZSTD_initDStream(input->zs));
+#endif
+#ifdef MODBUS_HAVE_LZ4
+        case CAPTURE_LZ4:
+            return !LZ4F_isError(LZ4F_createDecompressionContext(&input->lz, LZ4F_VERSION));
+#endif
+        default:
+            return false;
+    }
+}
+
+static void codec_free(capture_input_t *input) {
+    switch (input->compression) {
+#ifdef MODBUS_HAVE_ZLIB
+        case CAPTURE_GZIP:
+            inflateEnd(&input->gz);
+            break;
+#endif
+#ifdef MODBUS_HAVE_ZSTD
+        case CAPTURE_ZSTD:
+            ZSTD_freeDStream(input->zs);
+            break;
+#endif
+#ifdef MODBUS_HAVE_LZ4
+        case CAPTURE_LZ4:
+            LZ4F_freeDecompressionContext(input->lz);
+            break;
+#endif
+        default:
+            break;
+    }
+}
+
+
+/*
+ * codec_step() - Decode pending input into @out
+ * @input: Input with @in_pos < @in_len, or at end of file with output
+ *         possibly still pending in the decoder
+ * @out: Output buffer
+ * @capacity: Size of @out
+ * @produced: Output bytes written
+ *
+ * Sets @at_boundary when a gzip member or zstd/lz4 frame has been fully
+ * decoded, and clears it while one is in progress.
+ *
+ * Return: false on corrupt input
+ */
+
+static bool codec_step(capture_input_t *input, uint8_t *out, size_t capacity, size_t *produced) {
+    const uint8_t *src = input->in + input->in_pos;
+    size_t available = input->in_len - input->in_pos;
+
+    switch (input->compression) {
+#ifdef MODBUS_HAVE_ZLIB
+        case CAPTURE_GZIP: {
+            input->gz.next_in = (Bytef *)src;
+            input->gz.avail_in = (uInt)available;
+            input->gz.next_out = out;
+            input->gz.avail_out = (uInt)capacity;
+            int ret = inflate(&input->gz, Z_NO_FLUSH);
+            *produced = capacity - input->gz.avail_out;
+            input->in_pos += available - input->gz.avail_in;
+            if (ret == Z_STREAM_END) {
+                // Concatenated members (e.g. appended with cat) follow
+                input->at_boundary = true;
+                return inflateReset(&input->gz) == Z_OK;
+            }
+            input->at_boundary = false;
+            if (ret == Z_BUF_ERROR) {
+                // No progress possible; fill_slot() decides if truncated
+                return true;
+            }
+            if (ret != Z_OK) {
+                snprintf(input->error, sizeof(input->error), "gzip: %s",
+                         input->gz.msg ? input->gz.msg : "corrupt data");
+                return false;
+            }
+            return true;
+        }
+#endif
+#ifdef MODBUS_HAVE_ZSTD
+        case CAPTURE_ZSTD: {
+            ZSTD_inBuffer zin = { src, available, 0 };
+            ZSTD_outBuffer zout = { out, capacity, 0 };
+            size_t ret = ZSTD_decompressStream(input->zs, &zout, &zin);
+            *produced = zout.pos;
+            input->in_pos += zin.pos;
+            if (ZSTD_isError(ret)) {
+                snprintf(input->error, sizeof(input->error), "zstd: %s",
+                         ZSTD_getErrorName(ret));
+                return false;
+            }
+            input->at_boundary = (ret == 0);
+            return true;
+        }
+#endif
+#ifdef MODBUS_HAVE_LZ4
+        case CAPTURE_LZ4: {
+            size_t out_size = capacity;
+            size_t in_size = available;
+            size_t ret = LZ4F_decompress(input->lz, out, &out_size, src, &in_size, NULL);
+            *produced = out_size;
+            input->in_pos += in_size;
+            if (LZ4F_isError(ret)) {
+                snprintf(input->error, sizeof(input->error), "lz4: %s",
+                         LZ4F_getErrorName(ret));
+                return false;
+            }
+            input->at_boundary = (ret == 0);
+            return true;
+        }
+#endif
+        default:
+            (void)src;
+            (void)available;
+            (void)out;
+            (void)capacity;
+            *produced = 0;
+            return false;
+    }
+}
+
+
+/*
+ * fill_slot() - Decode into one slot until it is full or the input ends
+ *
+ * Return: 1 if the slot is full, 0 at a clean end of input, -1 on error
+ */
+
+static int fill_slot(capture_input_t *input, ring_slot_t *slot) {
+    slot->length = 0;
+
+    while (slot->length < CAPTURE_SLOT_SIZE) {
+        if (input->in_pos == input->in_len && !input->in_eof) {
+            double t0 = now_seconds();
+            input->in_len = fread(input->in, 1, CAPTURE_READ_SIZE, input->source);
+            input->in_pos = 0;
+            input->work.read_seconds += now_seconds() - t0;
+            input->work.compressed_bytes += input->in_len;
+            if (input->in_len < CAPTURE_READ_SIZE) {
+                if (ferror(input->source)) {
+                    snprintf(input->error, sizeof(input->error), "read error");
+                    return -1;
+                }
+                input->in_eof = true;
+            }
+        }
+        if (input->in_pos == input->in_len && input->in_eof && input->at_boundary) {
+            return 0;
+        }
+
+        size_t produced = 0;
+        double t0 = now_seconds();
+        bool ok = codec_step(input, slot->data + slot->length,
+                             CAPTURE_SLOT_SIZE - slot->length, &produced);
+        input->work.decompress_seconds += now_seconds() - t0;
+        if (!ok) {
+            if (input->error[0] == '\0') {
+                snprintf(input->error, sizeof(input->error), "%s: corrupt data",
+                         capture_compression_name(input->compression));
+            }
+            return -1;
+        }
+        slot->length += produced;
+        input->work.decompressed_bytes += produced;
+
+        // Nothing left to feed and nothing more came out
+        if (produced == 0 && input->in_pos == input->in_len && input->in_eof) {
+            if (input->at_boundary) {
+                return 0;
+            }
+            snprintf(input->error, sizeof(input->error), "%s: truncated file",
+                     capture_compression_name(input->compression));
+            return -1;
+        }
+    }
+    return 1;
+}
+
+
+/*
+ * decompress_thread() - Fill free slots until the input ends or close
+ */
+
+static void *decompress_thread(void *arg) {
+    capture_input_t *input = arg;
+    int status = 1;
+
+    while (status > 0) {
+        pthread_mutex_lock(&input->lock);
+        double t0 = now_seconds();
+        while (input->full_count == CAPTURE_RING_SLOTS && !input->stop) {
+            pthread_cond_wait(&input->slot_free, &input->lock);
+        }
+        input->stats.producer_wait_seconds += now_seconds() - t0;
+        if (input->stop) {
+            pthread_mutex_unlock(&input->lock);
+            break;
+        }
+        ring_slot_t *slot = &input->slots[input->fill_index];
+        pthread_mutex_unlock(&input->lock);
+
+        status = fill_slot(input, slot);
+
+        pthread_mutex_lock(&input->lock);
+        input->fill_index = (input->fill_index + 1) % CAPTURE_RING_SLOTS;
+        input->full_count++;
+        input->done = status <= 0;
+        input->stats.compressed_bytes = input->work.compressed_bytes;
+        input->stats.decompressed_bytes = input->work.decompressed_bytes;
+        input->stats.read_seconds = input->work.read_seconds;
+        input->stats.decompress_seconds = input->work.decompress_seconds;
+        pthread_cond_signal(&input->slot_full);
+        pthread_mutex_unlock(&input->lock);
+    }
+    return NULL;
+}
+
+
+/*
+ * stream_read() - stdio read callback: copy from published slots
+ */
+
+static ssize_t stream_read(void *cookie, char *buf, size_t size) {
+    capture_input_t *input = cookie;
+    size_t copied = 0;
+
+    while (copied < size) {
+        if (!input->reading) {
+            pthread_mutex_lock(&input->lock);
+            double t0 = now_seconds();
+            while (input->full_count == 0 && !input->done) {
+                pthread_cond_wait(&input->slot_full, &input->lock);
+            }
+            input->stats.consumer_wait_seconds += now_seconds() - t0;
+            bool empty = input->full_count == 0;
+            pthread_mutex_unlock(&input->lock);
+            if (empty) {
+                break;
+            }
+            input->reading = true;
+            input->read_pos = 0;
+        }
+
+        ring_slot_t *slot = &input->slots[input->read_index];
+        size_t n = slot->length - input->read_pos;
+        if (n > size - copied) {
+            n = size - copied;
+        }
+        memcpy(buf + copied, slot->data + input->read_pos, n);
+        copied += n;
+        input->read_pos += n;
+
+        if (input->read_pos == slot->length) {
+            pthread_mutex_lock(&input->lock);
+            input->read_index = (input->read_index + 1) % CAPTURE_RING_SLOTS;
+            input->full_count--;
+            input->reading = false;
+            pthread_cond_signal(&input->slot_free);
+            pthread_mutex_unlock(&input->lock);
+        }
+    }
+
+    if (copied == 0 && input->error[0] != '\0') {
+        errno = EIO;
+        return -1;
+    }
+    return (ssize_t)copied;
+}
+
+
+/*
+ * stream_close() - stdio close callback; the input outlives its stream
+ */
+
+static int stream_close(void *cookie) {
+    capture_input_t *input = cookie;
+    input->stream = NULL;
+    return 0;
+}
+
+
+#if defined(__APPLE__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__)
+
+static int stream_read_bsd(void *cookie, char *buf, int size) {
+    return (int)stream_read(cookie, buf, (size_t)size);
+}
+
+static FILE *open_stream(capture_input_t *input) {
+    return funopen(input, stream_read_bsd, NULL, NULL, stream_close);
+}
+
+#else
+
+static FILE *open_stream(capture_input_t *input) {
+    cookie_io_functions_t io = { .read = stream_read, .close = stream_close };
+    return fopencookie(input, "rb", io);
+}
+
+#endif
+
+
+/*
+ * input_free() - Release everything but the thread
+ */
+
+static void input_free(capture_input_t *input, bool codec_ready) {
+    if (codec_ready) {
+        codec_free(input);
+    }
+    for (int i = 0; i < CAPTURE_RING_SLOTS; i++) {
+        free(input->slots[i].data);
+    }
+    free(input->in);
+    if (input->source) {
+        fclose(input->source);
+    }
+    free(input);
+}
+
+
+/**
+ * capture_input_open() - Start decompressing a capture on its own thread
+ * @filename: Path to the capture
+ * @compression: Format from capture_detect()
+ * @errbuf: Output error message on failure (may be NULL)
+ * @errlen: Size of @errbuf
+ *
+ * Return: Input, or NULL on failure
+ */
+
+capture_input_t *capture_input_open(const char *filename, capture_compression_t compression,
+                                    char *errbuf, size_t errlen) {
+    capture_input_t *input = calloc(1, sizeof(capture_input_t));
+    if (!input) {
+        if (errbuf) snprintf(errbuf, errlen, "out of memory");
+        return NULL;
+    }
+    input->compression = compression;
+    input->stats.compression = compression;
+
+    input->source = fopen(filename, "rb");
+    if (!input->source) {
+        if (errbuf) snprintf(errbuf, errlen, "%s: cannot open", filename);
+        input_free(input, false);
+        return NULL;
+    }
+
+    if (!codec_init(input)) {
+        if (errbuf) snprintf(errbuf, errlen,
+                             "%s: %s-compressed captures are not supported by this build",
+                             filename, capture_compression_name(compression));
+        input_free(input, false);
+        return NULL;
+    }
+
+    input->in = malloc(CAPTURE_READ_SIZE);
+    bool ok = input->in != NULL;
+    for (int i = 0; ok && i < CAPTURE_RING_SLOTS; i++) {
+        input->slots[i].data = malloc(CAPTURE_SLOT_SIZE);
+        ok = input->slots[i].data != NULL;
+    }
+    if (!ok) {
+        if (errbuf) snprintf(errbuf, errlen, "out of memory");
+        input_free(input, true);
+        return NULL;
+    }
+
+    // Buffered: libpcap reads each record header and body separately, and
+    // an unbuffered cookie stream would turn every one into a callback
+    input->stream = open_stream(input);
+    if (!input->stream) {
+        if (errbuf) snprintf(errbuf, errlen, "%s: cannot create stream", filename);
+        input_free(input, true);
+        return NULL;
+    }
+    setvbuf(input->stream, NULL, _IOFBF, CAPTURE_STREAM_BUFFER);
+
+    pthread_mutex_init(&input->lock, NULL);
+    pthread_cond_init(&input->slot_full, NULL);
+    pthread_cond_init(&input->slot_free, NULL);
+    input->started = now_seconds();
+    if (pthread_create(&input->thread, NULL, decompress_thread, input) != 0) {
+        if (errbuf) snprintf(errbuf, errlen, "cannot start decompression thread");
+        fclose(input->stream);
+        pthread_mutex_destroy(&input->lock);
+        pthread_cond_destroy(&input->slot_full);
+        pthread_cond_destroy(&input->slot_free);
+        input_free(input, true);
+        return NULL;
+    }
+    return input;
+}
+
+
+/**
+ * capture_input_stream() - Decompressed data as a stdio stream
+ * @input: Input
+ *
+ * Return: Stream
+ */
+
+FILE *capture_input_stream(capture_input_t *input) {
+    return input->stream;
+}
+
+
+/**
+ * capture_input_error() - Decompression error, if any
+ * @input: Input
+ *
+ * Return: Error message ("" if none)
+ */
+
+const char *capture_input_error(capture_input_t *input) {
+    pthread_mutex_lock(&input->lock);
+    bool done = input->done;
+    pthread_mutex_unlock(&input->lock);
+    // Written by the decompression thread before it sets @done
+    return done ? input->error : "";
+}
+
+
+/**
+ * capture_input_stats() - Per-stage timing so far
+ * @input: Input
+ * @stats: Output statistics
+ */
+
+void capture_input_stats(capture_input_t *input, capture_input_stats_t *stats) {
+    pthread_mutex_lock(&input->lock);
+    *stats = input->stats;
+    pthread_mutex_unlock(&input->lock);
+    stats->elapsed_seconds = now_seconds() - input->started;
+}
+
+
+/**
+ * capture_input_close() - Stop the decompression thread and free the input
+ * @input: Input (NULL is ignored)
+ */
+
+void capture_input_close(capture_input_t *input) {
+    if (!input) return;
+
+    if (input->stream) {
+        fclose(input->stream);
+    }
+
+    pthread_mutex_lock(&input->lock);
+    input->stop = true;
+    pthread_cond_signal(&input->slot_free);
+    pthread_mutex_unlock(&input->lock);
+    pthread_join(input->thread, NULL);
+
+    pthread_mutex_destroy(&input->lock);
+    pthread_cond_destroy(&input->slot_full);
+    pthread_cond_destroy(&input->slot_free);
+    input_free(input, true);
+}
+
+#else /* !CAPTURE_HAVE_PIPELINE */
+
+/* Windows: no custom stdio streams, so compressed captures are refused */
+
+struct capture_input {
+    int unused;
+};
+
+capture_input_t *capture_input_open(const char *filename, capture_compression_t compression,
+                                    char *errbuf, size_t errlen) {
+    if (errbuf) snprintf(errbuf, errlen,
+                         "%s: %s-compressed captures are not supported on this platform",
+                         filename, capture_compression_name(compression));
+    return NULL;
+}
+
+FILE *capture_input_stream(capture_input_t *input) {
+    (void)input;
+    return NULL;
+}
+
+const char *capture_input_error(capture_input_t *input) {
+    (void)input;
+    return "";
+}
+
+void capture_input_stats(capture_input_t *input, capture_input_stats_t *stats) {
+    (void)input;
+    memset(stats, 0, sizeof(*stats));
+}
+
+void capture_input_close(capture_input_t *input) {
+    (void)input;
+}
+
+#endif /* CAPTURE_HAVE_PIPELINE */
@@ -0,0 +1,163 @@
+/*
+ * capture_input.h - Pipelined decompression of compressed captures
+ *
+ * Archived captures are often stored as .pcap.gz, .pcap.zst or
+ * .pcap.lz4. Rather than decompressing them to scratch disk first, the
+ * reader detects the format by magic and streams it through a
+ * decompression thread into a ring of large buffers; libpcap reads the
+ * ring through a stdio stream. Reading, decompression and packet
+ * decoding overlap, and each stage is timed so the bottleneck shows.
+ *
+ * Codecs are optional at build time (MODBUS_HAVE_ZLIB, MODBUS_HAVE_ZSTD,
+ * MODBUS_HAVE_LZ4). The pipeline needs a custom stdio stream
+ * (fopencookie() or funopen()), so it is not available on Windows.
+ *
+ * Copyright (C) 2025 Marty
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef CAPTURE_INPUT_H
+#define CAPTURE_INPUT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+
+/* Ring geometry: slots of decompressed data between the two threads */
+#define CAPTURE_RING_SLOTS 4
+#define CAPTURE_SLOT_SIZE (4u << 20)
+
+/* Compressed bytes read from disk per read call */
+#define CAPTURE_READ_SIZE (1u << 20)
+
+/* stdio buffer of the stream libpcap reads (bytes copied per ring read) */
+#define CAPTURE_STREAM_BUFFER (64u << 10)
+
+
+/**
+ * enum capture_compression_t - Compression format of a capture file
+ * @CAPTURE_PLAIN: Not compressed (handed to libpcap directly)
+ * @CAPTURE_GZIP: gzip, including concatenated members
+ * @CAPTURE_ZSTD: Zstandard, including concatenated frames
+ * @CAPTURE_LZ4: LZ4 frame format, including concatenated frames
+ */
+
+typedef enum {
+    CAPTURE_PLAIN = 0,
+    CAPTURE_GZIP,
+    CAPTURE_ZSTD,
+    CAPTURE_LZ4
+} capture_compression_t;
+
+
+/**
+ * struct capture_input_stats_t - Per-stage timing of a compressed input
+ * @compression: Detected format
+ * @compressed_bytes: Bytes read from disk
+ * @decompressed_bytes: Bytes produced into the ring
+ * @read_seconds: Decompression thread time spent reading the file
+ * @decompress_seconds: Decompression thread time spent in the codec
+ * @producer_wait_seconds: Decompression thread time waiting for a free
+ *                         slot (the parser is slower)
+ * @consumer_wait_seconds: Parser time waiting for a full slot
+ *                         (decompression is slower)
+ * @elapsed_seconds: Wall time since the input was opened
+ */
+
+typedef struct {
+    capture_compression_t compression;
+    uint64_t compressed_bytes;
+    uint64_t decompressed_bytes;
+    double read_seconds;
+    double decompress_seconds;
+    double producer_wait_seconds;
+    double consumer_wait_seconds;
+    double elapsed_seconds;
+} capture_input_stats_t;
+
+
+/* Opaque pipelined input (see capture_input_open()) */
+typedef struct capture_input capture_input_t;
+
+
+/**
+ * capture_detect() - Detect the compression format of a capture file
+ * @filename: Path to the capture
+ *
+ * Only regular files are inspected, so a pipe is never consumed.
+ *
+ * Return: Format, CAPTURE_PLAIN if not compressed or not a regular file
+ */
+
+capture_compression_t capture_detect(const char *filename);
+
+
+/**
+ * capture_compression_name() - Short name of a format
+ * @compression: Format
+ *
+ * Return: "gzip", "zstd", "lz4" or "none"
+ */
+
+const char *capture_compression_name(capture_compression_t compression);
+
+
+/**
+ * capture_input_open() - Start decompressing a capture on its own thread
+ * @filename: Path to the capture
+ * @compression: Format from capture_detect() (not CAPTURE_PLAIN)
+ * @errbuf: Output error message on failure (may be NULL)
+ * @errlen: Size of @errbuf
+ *
+ * Return: Input, or NULL if the file cannot be opened or this build
+ *         lacks the codec or the pipeline
+ */
+
+capture_input_t *capture_input_open(const char *filename, capture_compression_t compression,
+                                    char *errbuf, size_t errlen);
+
+
+/**
+ * capture_input_stream() - Decompressed data as a stdio stream
+ * @input: Input
+ *
+ * The stream is read-only and not seekable. Closing it (for example
+ * through pcap_close()) does not release @input.
+ *
+ * Return: Stream, owned by the caller once handed to libpcap
+ */
+
+FILE *capture_input_stream(capture_input_t *input);
+
+
+/**
+ * capture_input_error() - Decompression error, if any
+ * @input: Input
+ *
+ * Return: Error message ("" if none)
+ */
+
+const char *capture_input_error(capture_input_t *input);
+
+
+/**
+ * capture_input_stats() - Per-stage timing so far
+ * @input: Input
+ * @stats: Output statistics
+ */
+
+void capture_input_stats(capture_input_t *input, capture_input_stats_t *stats);
+
+
+/**
+ * capture_input_close() - Stop the decompression thread and free the input
+ * @input: Input (NULL is ignored)
+ *
+ * Closes the stream too if the caller has not.
+ */
+
+void capture_input_close(capture_input_t *input);
+
+#endif /* CAPTURE_INPUT_H */
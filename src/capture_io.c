@@ -0,0 +1,634 @@
+/*
+ * capture_io.c - Block readers behind the native pcap record parser
+ *
+ * mmap maps the whole capture once. uring keeps queue_depth sequential
+ * reads in flight: block k of the file lives in slot k % depth, and a
+ * slot is resubmitted for block k + depth as soon as the parser moves
+ * past it, so the read-ahead window slides with the parser. io_uring is
+ * driven through its raw system calls (no liburing dependency).
+ *
+ * Copyright (C) 2025 Marty
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+
+#ifndef _GNU_SOURCE
+    #define _GNU_SOURCE // MAP_POPULATE, posix_fadvise()
+#endif
+
+#include "capture_io.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+    #include <errno.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+#endif
+
+#if defined(__linux__) && defined(MODBUS_HAVE_IO_URING)
+    #define CAPTURE_HAVE_URING 1
+    #include <linux/io_uring.h>
+    #include <sys/syscall.h>
+    #include <sys/uio.h>
+#endif
+
+
+/* Slot index meaning "no block handed out" */
+#define SLOT_NONE UINT32_MAX
+
+
+#ifdef CAPTURE_HAVE_URING
+
+/**
+ * struct uring_t - Mapped submission and completion rings
+ * @fd: io_uring file descriptor (-1 if not set up)
+ * @sq_head: Kernel-owned submission head
+ * @sq_tail: Submission tail (ours)
+ * @sq_mask: Submission index mask
+ * @sq_array: Submission index array
+ * @cq_head: Completion head (ours)
+ * @cq_tail: Kernel-owned completion tail
+ * @cq_mask: Completion index mask
+ * @sqes: Submission entries
+ * @cqes: Completion entries
+ * @sq_ring: Submission ring mapping
+ * @sq_ring_len: Size of @sq_ring
+ * @cq_ring: Completion ring mapping (== @sq_ring with a single mmap)
+ * @cq_ring_len: Size of @cq_ring
+ * @sqes_len: Size of @sqes mapping
+ * @to_submit: Entries queued since the last io_uring_enter()
+ */
+
+typedef struct {
+    int fd;
+    uint32_t *sq_head;
+    uint32_t *sq_tail;
+    uint32_t *sq_mask;
+    uint32_t *sq_array;
+    uint32_t *cq_head;
+    uint32_t *cq_tail;
+    uint32_t *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ring;
+    size_t sq_ring_len;
+    void *cq_ring;
+    size_t cq_ring_len;
+    size_t sqes_len;
+    uint32_t to_submit;
+} uring_t;
+
+
+/**
+ * struct uring_slot_t - One registered buffer and the block it holds
+ * @data: buffer_size bytes (registered as buffer index == slot index)
+ * @offset: File offset of the block
+ * @length: Block length (0 = no block: past end of file)
+ * @filled: Bytes read so far (short reads are resubmitted)
+ * @pending: A read is in flight
+ */
+
+typedef struct {
+    uint8_t *data;
+    int64_t offset;
+    uint32_t length;
+    uint32_t filled;
+    bool pending;
+} uring_slot_t;
+
+#endif /* CAPTURE_HAVE_URING */
+
+
+/**
+ * struct capture_io - Open capture and backend state
+ * @backend: PCAP_IO_MMAP or PCAP_IO_URING
+ * @fd: Capture file descriptor
+ * @size: File size at open
+ * @map: mmap: whole-file mapping (NULL for an empty file)
+ * @map_pos: mmap: offset of the next block
+ * @ring: uring: rings
+ * @slots: uring: one per queue entry
+ * @buffers: uring: backing memory of all slots
+ * @depth: uring: reads kept in flight
+ * @buffer_size: uring: bytes per read
+ * @fixed: uring: buffers are registered (READ_FIXED), else plain READ
+ * @next_offset: uring: offset of the next block to submit
+ * @head: uring: slot holding the next block to return
+ * @current: uring: slot handed out by the last call (SLOT_NONE if none)
+ * @in_flight: uring: reads submitted and not completed
+ * @error: Last error message
+ */
+
+struct capture_io {
+    pcap_io_backend_t backend;
+    int fd;
+    int64_t size;
+    uint8_t *map;
+    int64_t map_pos;
+#ifdef CAPTURE_HAVE_URING
+    uring_t ring;
+    uring_slot_t *slots;
+    uint8_t *buffers;
+    uint32_t depth;
+    uint32_t buffer_size;
+    bool fixed;
+    int64_t next_offset;
+    uint32_t head;
+    uint32_t current;
+    uint32_t in_flight;
+#endif
+    char error[256];
+};
+
+
+#ifdef CAPTURE_HAVE_URING
+
+/*
+ * Raw io_uring system calls
+ */
+
+static int uring_setup(uint32_t entries, struct io_uring_params *params) {
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uring_enter(int fd, uint32_t to_submit, uint32_t min_complete, uint32_t flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int uring_register(int fd, uint32_t opcode, const void *arg, uint32_t count) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, count);
+}
+
+
+/*
+ * uring_init() - Create the ring and map its queues
+ */
+
+static bool uring_init(uring_t *ring, uint32_t entries) {
+    struct io_uring_params params;
+
+    memset(&params, 0, sizeof(params));
+    ring->fd = uring_setup(entries, &params);
+    if (ring->fd < 0) {
+        return false;
+    }
+
+    ring->sq_ring_len = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    ring->cq_ring_len = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_ring_len > ring->sq_ring_len) {
+            ring->sq_ring_len = ring->cq_ring_len;
+        }
+        ring->cq_ring_len = ring->sq_ring_len;
+    }
+
+    ring->sq_ring = mmap(NULL, ring->sq_ring_len, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ring == MAP_FAILED) {
+        ring->sq_ring = NULL;
+        return false;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_ring = ring->sq_ring;
+    } else {
+        ring->cq_ring = mmap(NULL, ring->cq_ring_len, PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ring == MAP_FAILED) {
+            ring->cq_ring = NULL;
+            return false;
+        }
+    }
+
+    ring->sqes_len = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        ring->sqes = NULL;
+        return false;
+    }
+
+    uint8_t *sq = ring->sq_ring;
+    uint8_t *cq = ring->cq_ring;
+    ring->sq_head = (uint32_t *)(sq + params.sq_off.head);
+    ring->sq_tail = (uint32_t *)(sq + params.sq_off.tail);
+    ring->sq_mask = (uint32_t *)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (uint32_t *)(sq + params.sq_off.array);
+    ring->cq_head = (uint32_t *)(cq + params.cq_off.head);
+    ring->cq_tail = (uint32_t *)(cq + params.cq_off.tail);
+    ring->cq_mask = (uint32_t *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+    return true;
+}
+
+
+/*
+ * uring_free() - Unmap the queues and close the ring
+ */
+
+static void uring_free(uring_t *ring) {
+    if (ring->sqes) munmap(ring->sqes, ring->sqes_len);
+    if (ring->cq_ring && ring->cq_ring != ring->sq_ring) munmap(ring->cq_ring, ring->cq_ring_len);
+    if (ring->sq_ring) munmap(ring->sq_ring, ring->sq_ring_len);
+    if (ring->fd >= 0) close(ring->fd);
+}
+
+
+/*
+ * queue_read() - Queue the unread part of a slot's block
+ */
+
+static void queue_read(capture_io_t *io, uint32_t index) {
+    uring_t *ring = &io->ring;
+    uring_slot_t *slot = &io->slots[index];
+    uint32_t tail = *ring->sq_tail;
+    uint32_t sq_index = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[sq_index];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = io->fixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+    sqe->fd = io->fd;
+    sqe->addr = (uint64_t)(uintptr_t)(slot->data + slot->filled);
+    sqe->len = slot->length - slot->filled;
+    sqe->off = (uint64_t)(slot->offset + slot->filled);
+    sqe->buf_index = (uint16_t)index;
+    sqe->user_data = index;
+    ring->sq_array[sq_index] = sq_index;
+
+    // The entry must be visible before the kernel sees the new tail
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ring->to_submit++;
+    slot->pending = true;
+    io->in_flight++;
+}
+
+
+/*
+ * submit_block() - Assign the next block of the file to a slot
+ */
+
+static void submit_block(capture_io_t *io, uint32_t index) {
+    uring_slot_t *slot = &io->slots[index];
+
+    slot->offset = io->next_offset;
+    slot->filled = 0;
+    slot->length = 0;
+    if (io->next_offset >= io->size) {
+        return;  // Past the end: the slot stays empty
+    }
+
+    int64_t remaining = io->size - io->next_offset;
+    slot->length = remaining < io->buffer_size ? (uint32_t)remaining : io->buffer_size;
+    io->next_offset += slot->length;
+    queue_read(io, index);
+}
+
+
+/*
+ * reap() - Submit queued reads and process completions
+ * @wait: Block until at least one completion arrives
+ * @requeue: Resubmit short reads (false while draining)
+ *
+ * Return: false on an I/O error
+ */
+
+static bool reap(capture_io_t *io, bool wait, bool requeue) {
+    uring_t *ring = &io->ring;
+
+    int ret = uring_enter(ring->fd, ring->to_submit, wait ? 1 : 0,
+                          wait ? IORING_ENTER_GETEVENTS : 0);
+    if (ret < 0 && errno != EINTR && errno != EAGAIN) {
+        snprintf(io->error, sizeof(io->error), "io_uring_enter: %s", strerror(errno));
+        return false;
+    }
+    if (ret > 0) {
+        ring->to_submit -= (uint32_t)ret < ring->to_submit ? (uint32_t)ret : ring->to_submit;
+    }
+
+    uint32_t head = *ring->cq_head;
+    uint32_t tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+    bool ok = true;
+
+    for (; head != tail; head++) {
+        const struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+        uring_slot_t *slot = &io->slots[cqe->user_data];
+
+        slot->pending = false;
+        io->in_flight--;
+        if (!requeue) {
+            continue;
+        }
+        if (cqe->res == -EAGAIN || cqe->res == -EINTR) {
+            queue_read(io, (uint32_t)cqe->user_data);
+        } else if (cqe->res < 0) {
+            snprintf(io->error, sizeof(io->error), "read at offset %lld: %s",
+                     (long long)(slot->offset + slot->filled), strerror(-cqe->res));
+            ok = false;
+        } else if (cqe->res == 0) {
+            snprintf(io->error, sizeof(io->error), "capture shrank while reading");
+            ok = false;
+        } else {
+            slot->filled += (uint32_t)cqe->res;
+            if (slot->filled < slot->length) {
+                queue_read(io, (uint32_t)cqe->user_data);  // Short read
+            }
+        }
+    }
+    __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+    return ok;
+}
+
+
+/*
+ * uring_start() - Fill the read-ahead window from @offset
+ */
+
+static bool uring_start(capture_io_t *io, int64_t offset) {
+    io->next_offset = offset;
+    io->head = 0;
+    io->current = SLOT_NONE;
+    for (uint32_t i = 0; i < io->depth; i++) {
+        submit_block(io, i);
+    }
+    return reap(io, false, true);
+}
+
+
+/*
+ * uring_open() - Ring, buffers and initial reads for the uring backend
+ */
+
+static bool uring_open(capture_io_t *io, const pcap_reader_options_t *options) {
+    io->depth = options->queue_depth ? options->queue_depth : PCAP_URING_DEFAULT_DEPTH;
+    io->buffer_size = options->buffer_size ? options->buffer_size : PCAP_URING_DEFAULT_BUFFER;
+    io->ring.fd = -1;
+
+    if (io->depth > PCAP_URING_MAX_DEPTH || io->buffer_size < PCAP_URING_MIN_BUFFER) {
+        snprintf(io->error, sizeof(io->error),
+                 "io_uring queue depth must be 1-%d and buffers at least %d bytes",
+                 PCAP_URING_MAX_DEPTH, PCAP_URING_MIN_BUFFER);
+        return false;
+    }
+    if (!uring_init(&io->ring, io->depth)) {
+        snprintf(io->error, sizeof(io->error), "io_uring unavailable: %s", strerror(errno));
+        return false;
+    }
+
+    io->slots = calloc(io->depth, sizeof(uring_slot_t));
+    struct iovec *iov = calloc(io->depth, sizeof(struct iovec));
+    if (!io->slots || !iov ||
+        posix_memalign((void **)&io->buffers, 4096, (size_t)io->depth * io->buffer_size) != 0) {
+        io->buffers = NULL;
+        free(iov);
+        snprintf(io->error, sizeof(io->error), "out of memory");
+        return false;
+    }
+    for (uint32_t i = 0; i < io->depth; i++) {
+        io->slots[i].data = io->buffers + (size_t)i * io->buffer_size;
+        iov[i].iov_base = io->slots[i].data;
+        iov[i].iov_len = io->buffer_size;
+    }
+
+    // Registration can fail under a low RLIMIT_MEMLOCK; plain reads still work
+    io->fixed = uring_register(io->ring.fd, IORING_REGISTER_BUFFERS, iov, io->depth) == 0;
+    free(iov);
+
+    posix_fadvise(io->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    return uring_start(io, 0);
+}
+
+
+/*
+ * uring_next_block() - Recycle the previous slot and wait for the next
+ */
+
+static int uring_next_block(capture_io_t *io, const uint8_t **data, size_t *length) {
+    if (io->current != SLOT_NONE) {
+        submit_block(io, io->current);
+        io->current = SLOT_NONE;
+        io->head = (io->head + 1) % io->depth;
+    }
+
+    uring_slot_t *slot = &io->slots[io->head];
+    if (slot->length == 0) {
+        return 0;
+    }
+    while (slot->pending || slot->filled < slot->length) {
+        if (!reap(io, slot->pending, true)) {
+            return -1;
+        }
+    }
+
+    io->current = io->head;
+    *data = slot->data;
+    *length = slot->length;
+    return 1;
+}
+
+
+/*
+ * uring_seek() - Drain in-flight reads and restart the window
+ */
+
+static bool uring_seek(capture_io_t *io, int64_t offset) {
+    while (io->in_flight > 0) {
+        if (!reap(io, true, false)) {
+            return false;
+        }
+    }
+    return uring_start(io, offset);
+}
+
+
+/*
+ * uring_close() - Drain reads, then release ring and buffers
+ */
+
+static void uring_close(capture_io_t *io) {
+    if (io->ring.fd >= 0) {
+        while (io->in_flight > 0 && reap(io, true, false)) {
+        }
+    }
+    uring_free(&io->ring);
+    free(io->slots);
+    free(io->buffers);
+}
+
+#endif /* CAPTURE_HAVE_URING */
+
+
+#ifndef _WIN32
+
+/**
+ * capture_io_open() - Open a capture with a block backend
+ * @filename: Path to the capture
+ * @options: Backend and uring geometry
+ * @errbuf: Output error message on failure (may be NULL)
+ * @errlen: Size of @errbuf
+ *
+ * Return: Reader, or NULL on failure
+ */
+
+capture_io_t *capture_io_open(const char *filename, const pcap_reader_options_t *options,
+                              char *errbuf, size_t errlen) {
+    struct stat st;
+
+    capture_io_t *io = calloc(1, sizeof(capture_io_t));
+    if (!io) {
+        if (errbuf) snprintf(errbuf, errlen, "out of memory");
+        return NULL;
+    }
+    io->backend = options->backend;
+
+    io->fd = open(filename, O_RDONLY);
+    if (io->fd < 0 || fstat(io->fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        if (errbuf) snprintf(errbuf, errlen, "%s: cannot open as a regular file for the %s backend",
+                             filename, pcap_io_backend_name(options->backend));
+        if (io->fd >= 0) close(io->fd);
+        free(io);
+        return NULL;
+    }
+    io->size = (int64_t)st.st_size;
+
+    bool ok;
+    if (io->backend == PCAP_IO_MMAP) {
+        ok = true;
+        if (io->size > 0) {
+            void *map = mmap(NULL, (size_t)io->size, PROT_READ, MAP_PRIVATE, io->fd, 0);
+            if (map == MAP_FAILED) {
+                snprintf(io->error, sizeof(io->error), "mmap: %s", strerror(errno));
+                ok = false;
+            } else {
+                io->map = map;
+                madvise(io->map, (size_t)io->size, MADV_SEQUENTIAL);
+            }
+        }
+    } else {
+#ifdef CAPTURE_HAVE_URING
+        ok = uring_open(io, options);
+#else
+        snprintf(io->error, sizeof(io->error), "io_uring is not supported by this build");
+        ok = false;
+#endif
+    }
+
+    if (!ok) {
+        if (errbuf) snprintf(errbuf, errlen, "%s: %s", filename, io->error);
+        capture_io_close(io);
+        return NULL;
+    }
+    return io;
+}
+
+
+/**
+ * capture_io_next_block() - Next contiguous piece of the file
+ * @io: Reader
+ * @data: Output block start
+ * @length: Output block length
+ *
+ * Return: 1 if a block was returned, 0 at end of file, -1 on read error
+ */
+
+int capture_io_next_block(capture_io_t *io, const uint8_t **data, size_t *length) {
+#ifdef CAPTURE_HAVE_URING
+    if (io->backend == PCAP_IO_URING) {
+        return uring_next_block(io, data, length);
+    }
+#endif
+    if (io->map_pos >= io->size) {
+        return 0;
+    }
+    *data = io->map + io->map_pos;
+    *length = (size_t)(io->size - io->map_pos);
+    io->map_pos = io->size;
+    return 1;
+}
+
+
+/**
+ * capture_io_seek() - Restart reading at a file offset
+ * @io: Reader
+ * @offset: Offset of the next block
+ *
+ * Return: false if @offset is past the end of the file
+ */
+
+bool capture_io_seek(capture_io_t *io, int64_t offset) {
+    if (offset < 0 || offset > io->size) {
+        snprintf(io->error, sizeof(io->error), "cannot seek to offset %lld", (long long)offset);
+        return false;
+    }
+#ifdef CAPTURE_HAVE_URING
+    if (io->backend == PCAP_IO_URING) {
+        return uring_seek(io, offset);
+    }
+#endif
+    io->map_pos = offset;
+    return true;
+}
+
+
+/**
+ * capture_io_close() - Close the file and free the reader
+ * @io: Reader (NULL is ignored)
+ */
+
+void capture_io_close(capture_io_t *io) {
+    if (!io) return;
+#ifdef CAPTURE_HAVE_URING
+    if (io->backend == PCAP_IO_URING) {
+        uring_close(io);
+    }
+#endif
+    if (io->map) {
+        munmap(io->map, (size_t)io->size);
+    }
+    close(io->fd);
+    free(io);
+}
+
+#else /* _WIN32 */
+
+/* Windows: libpcap is the only backend */
+
+capture_io_t *capture_io_open(const char *filename, const pcap_reader_options_t *options,
+                              char *errbuf, size_t errlen) {
+    if (errbuf) snprintf(errbuf, errlen, "%s: the %s backend is not available on this platform",
+                         filename, pcap_io_backend_name(options->backend));
+    return NULL;
+}
+
+int capture_io_next_block(capture_io_t *io, const uint8_t **data, size_t *length) {
+    (void)io;
+    (void)data;
+    (void)length;
+    return -1;
+}
+
+bool capture_io_seek(capture_io_t *io, int64_t offset) {
+    (void)io;
+    (void)offset;
+    return false;
+}
+
+void capture_io_close(capture_io_t *io) {
+    (void)io;
+}
+
+#endif /* _WIN32 */
+
+
+/**
+ * capture_io_error() - Last error message
+ * @io: Reader
+ *
+ * Return: Error string ("" if none)
+ */
+
+const char *capture_io_error(const capture_io_t *io) {
+    return io->error;
+}
@@ -0,0 +1,91 @@
+/*
+ * capture_io.h - Block readers behind the native pcap record parser
+ *
+ * The mmap and io_uring backends of pcap_reader do not go through
+ * libpcap: they hand the file to pcap_reader.c as a sequence of
+ * contiguous blocks, and the reader parses classic pcap records out of
+ * them (copying only records that straddle two blocks).
+ *
+ * - mmap: the whole file is one read-only mapping
+ * - uring: queue_depth reads of buffer_size bytes are kept in flight
+ *   into registered buffers (IORING_OP_READ_FIXED), so slow storage is
+ *   read well ahead of the parser
+ *
+ * Internal to libmodbus_parse; not installed.
+ *
+ * Copyright (C) 2025 Marty
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef CAPTURE_IO_H
+#define CAPTURE_IO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "pcap_reader.h"
+
+
+/* Opaque block reader (see capture_io_open()) */
+typedef struct capture_io capture_io_t;
+
+
+/**
+ * capture_io_open() - Open a capture with a block backend
+ * @filename: Path to the capture (a regular file)
+ * @options: Backend (PCAP_IO_MMAP or PCAP_IO_URING) and uring geometry
+ * @errbuf: Output error message on failure (may be NULL)
+ * @errlen: Size of @errbuf
+ *
+ * Return: Reader, or NULL if the file cannot be opened or the backend
+ *         is not available on this system
+ */
+
+capture_io_t *capture_io_open(const char *filename, const pcap_reader_options_t *options,
+                              char *errbuf, size_t errlen);
+
+
+/**
+ * capture_io_next_block() - Next contiguous piece of the file
+ * @io: Reader
+ * @data: Output block start
+ * @length: Output block length (never 0 when 1 is returned)
+ *
+ * The previous block is recycled by this call, so it must no longer be
+ * referenced.
+ *
+ * Return: 1 if a block was returned, 0 at end of file, -1 on read error
+ */
+
+int capture_io_next_block(capture_io_t *io, const uint8_t **data, size_t *length);
+
+
+/**
+ * capture_io_seek() - Restart reading at a file offset
+ * @io: Reader
+ * @offset: Offset of the next block
+ *
+ * Return: false if @offset is past the end of the file
+ */
+
+bool capture_io_seek(capture_io_t *io, int64_t offset);
+
+
+/**
+ * capture_io_error() - Last error message
+ * @io: Reader
+ *
+ * Return: Error string ("" if none)
+ */
+
+const char *capture_io_error(const capture_io_t *io);
+
+
+/**
+ * capture_io_close() - Close the file and free the reader
+ * @io: Reader (NULL is ignored)
+ */
+
+void capture_io_close(capture_io_t *io);
+
+#endif /* CAPTURE_IO_H */
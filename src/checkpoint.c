@@ -0,0 +1,284 @@
+/*
+ * checkpoint.c - Periodic snapshots for resuming long capture runs
+ *
+ * Container format and scheduling only; the state sections themselves
+ * are written by the modules that own the state.
+ *
+ * Copyright (C) 2025 Marty
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+
+#include "checkpoint.h"
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+    #include <io.h>      // Windows: _commit
+#else
+    #include <unistd.h>  // *nix: fsync
+#endif
+
+
+/* Longest accepted option text */
+#define CHECKPOINT_MAX_CONFIG 4096
+
+
+/*
+ * capture_identity() - Size and modification time of the capture
+ */
+
+static bool capture_identity(const char *capture, uint64_t *size, int64_t *mtime) {
+    struct stat st;
+
+    if (stat(capture, &st) != 0) {
+        return false;
+    }
+    *size = (uint64_t)st.st_size;
+    *mtime = (int64_t)st.st_mtime;
+    return true;
+}
+
+
+/**
+ * checkpoint_parse_interval() - Parse a --checkpoint-every value
+ * @text: "512M"-style byte size or "30s"-style duration
+ * @policy: Policy to update
+ *
+ * Return: false if @text is not a positive size or duration
+ */
+
+bool checkpoint_parse_interval(const char *text, checkpoint_policy_t *policy) {
+    char *end;
+    unsigned long long value = strtoull(text, &end, 10);
+
+    if (end == text || value == 0) {
+        return false;
+    }
+
+    switch (tolower((unsigned char)*end)) {
+        case '\0': policy->every_bytes = value; break;
+        case 'k':  policy->every_bytes = value << 10; break;
+        case 'm':  policy->every_bytes = value << 20; break;
+        case 'g':  policy->every_bytes = value << 30; break;
+        case 's':  policy->every_seconds = (uint32_t)value; break;
+        case 'h':  policy->every_seconds = (uint32_t)(value * 3600); break;
+        default:   return false;
+    }
+    // 'm' is megabytes; minutes are spelled "min"
+    if (strcmp(end, "min") == 0) {
+        policy->every_bytes = 0;
+        policy->every_seconds = (uint32_t)(value * 60);
+    } else if (end[0] != '\0' && end[1] != '\0') {
+        return false;
+    }
+
+    if (policy->every_bytes) {
+        policy->every_seconds = 0;
+    }
+    return true;
+}
+
+
+/**
+ * checkpoint_policy_start() - Arm the interval from the current position
+ * @policy: Policy
+ * @session: Session about to be run
+ *
+ * Return: false if the capture cannot seek (a pipe), so cannot resume
+ */
+
+bool checkpoint_policy_start(checkpoint_policy_t *policy, const modbus_session_t *session) {
+    int64_t offset = modbus_session_offset(session);
+
+    if (offset < 0) {
+        return false;
+    }
+    if (policy->every_bytes == 0 && policy->every_seconds == 0) {
+        policy->every_seconds = CHECKPOINT_DEFAULT_SECONDS;
+    }
+    policy->next_offset = offset + (int64_t)policy->every_bytes;
+    policy->next_time = time(NULL) + policy->every_seconds;
+    policy->countdown = CHECKPOINT_CHECK_RECORDS;
+    return true;
+}
+
+
+/**
+ * checkpoint_due() - Check whether a checkpoint should be written now
+ * @policy: Policy
+ * @session: Running session
+ *
+ * Return: true if a checkpoint is due
+ */
+
+bool checkpoint_due(checkpoint_policy_t *policy, const modbus_session_t *session) {
+    if (--policy->countdown > 0) {
+        return false;
+    }
+    policy->countdown = CHECKPOINT_CHECK_RECORDS;
+
+    if (policy->every_bytes) {
+        int64_t offset = modbus_session_offset(session);
+        if (offset < policy->next_offset) {
+            return false;
+        }
+        policy->next_offset = offset + (int64_t)policy->every_bytes;
+        return true;
+    }
+
+    time_t now = time(NULL);
+    if (now < policy->next_time) {
+        return false;
+    }
+    policy->next_time = now + policy->every_seconds;
+    return true;
+}
+
+
+/**
+ * checkpoint_create() - Start writing a checkpoint
+ * @path: Final checkpoint path
+ * @capture: Capture file being processed
+ * @config: Option text that must match on resume
+ * @layout: State layout size of the caller
+ *
+ * Return: File positioned after the header, or NULL on error
+ */
+
+FILE *checkpoint_create(const char *path, const char *capture, const char *config,
+                        uint32_t layout) {
+    checkpoint_header_t hdr;
+    char tmp_path[1024];
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+    hdr.version = CHECKPOINT_VERSION;
+    hdr.layout = layout;
+    hdr.config_length = (uint32_t)strlen(config);
+    if (!capture_identity(capture, &hdr.capture_size, &hdr.capture_mtime)) {
+        printf("Error: Could not stat capture %s for checkpoint\n", capture);
+        return NULL;
+    }
+
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    FILE *f = fopen(tmp_path, "wb");
+    if (!f) {
+        printf("Error: Could not create checkpoint %s\n", tmp_path);
+        return NULL;
+    }
+    if (fwrite(&hdr, sizeof(hdr), 1, f) != 1 ||
+        fwrite(config, 1, hdr.config_length, f) != hdr.config_length) {
+        printf("Error: Could not write checkpoint %s\n", tmp_path);
+        fclose(f);
+        remove(tmp_path);
+        return NULL;
+    }
+    return f;
+}
+
+
+/**
+ * checkpoint_commit() - Finish a checkpoint and move it into place
+ * @f: File from checkpoint_create(), closed by this call
+ * @path: Final checkpoint path
+ *
+ * The data is synced before the rename, so a checkpoint that exists
+ * under @path is always complete.
+ *
+ * Return: false if the file could not be completed
+ */
+
+bool checkpoint_commit(FILE *f, const char *path) {
+    char tmp_path[1024];
+    bool ok;
+
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    ok = fwrite(CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC), 1, f) == 1 && fflush(f) == 0;
+#ifdef _WIN32
+    ok = ok && _commit(_fileno(f)) == 0;
+#else
+    ok = ok && fsync(fileno(f)) == 0;
+#endif
+    ok = (fclose(f) == 0) && ok;
+
+#ifdef _WIN32
+    // rename() does not replace an existing file on Windows
+    if (ok) remove(path);
+#endif
+    if (!ok || rename(tmp_path, path) != 0) {
+        printf("Error: Could not write checkpoint %s\n", path);
+        remove(tmp_path);
+        return false;
+    }
+    return true;
+}
+
+
+/**
+ * checkpoint_open() - Open a checkpoint for resuming
+ * @path: Checkpoint path
+ * @capture: Capture file to be processed
+ * @config: Option text of this run
+ * @layout: State layout size of the caller
+ *
+ * Return: File positioned at the first state section, or NULL on error
+ */
+
+FILE *checkpoint_open(const char *path, const char *capture, const char *config,
+                      uint32_t layout) {
+    checkpoint_header_t hdr;
+    char saved[CHECKPOINT_MAX_CONFIG + 1];
+    uint64_t size;
+    int64_t mtime;
+
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        printf("Error: Could not open checkpoint %s\n", path);
+        return NULL;
+    }
+
+    if (fread(&hdr, sizeof(hdr), 1, f) != 1 ||
+        memcmp(hdr.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC)) != 0 ||
+        hdr.version != CHECKPOINT_VERSION || hdr.config_length > CHECKPOINT_MAX_CONFIG ||
+        fread(saved, 1, hdr.config_length, f) != hdr.config_length) {
+        printf("Error: %s is not a valid checkpoint\n", path);
+        fclose(f);
+        return NULL;
+    }
+    saved[hdr.config_length] = '\0';
+
+    if (hdr.layout != layout) {
+        printf("Error: Checkpoint %s was written by a different build\n", path);
+    } else if (!capture_identity(capture, &size, &mtime) ||
+               size != hdr.capture_size || mtime != hdr.capture_mtime) {
+        printf("Error: Capture %s changed since checkpoint %s was written\n", capture, path);
+    } else if (strcmp(saved, config) != 0) {
+        printf("Error: Options differ from the checkpointed run\n");
+        printf("  checkpoint: %s\n  this run:   %s\n", saved, config);
+    } else {
+        return f;
+    }
+    fclose(f);
+    return NULL;
+}
+
+
+/**
+ * checkpoint_close() - Check the end marker and close
+ * @f: File from checkpoint_open()
+ *
+ * Return: true if every section was consumed exactly
+ */
+
+bool checkpoint_close(FILE *f) {
+    char marker[sizeof(CHECKPOINT_MAGIC)];
+    bool ok = fread(marker, sizeof(marker), 1, f) == 1 &&
+              memcmp(marker, CHECKPOINT_MAGIC, sizeof(marker)) == 0 &&
+              fgetc(f) == EOF;
+
+    fclose(f);
+    return ok;
+}
@@ -0,0 +1,169 @@
+/*
+ * checkpoint.h - Periodic snapshots for resuming long capture runs
+ *
+ * A checkpoint is one binary file: a header identifying the capture and
+ * the options of the run, the state sections written by each module's
+ * *_save() function in a fixed order, and a trailing end marker. It is
+ * written to "<path>.tmp" and renamed over <path> once complete, so a
+ * crash while checkpointing leaves the previous checkpoint intact.
+ *
+ * Snapshots are in host byte order and tied to the build that wrote
+ * them (the header records the context layout size).
+ *
+ * Copyright (C) 2025 Marty
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <time.h>
+#include "modbus_session.h"
+
+
+/* File magic (also the end marker) and format version */
+#define CHECKPOINT_MAGIC "MBCKPT1"
+#define CHECKPOINT_VERSION 2
+
+/* Interval used when --checkpoint is given without --checkpoint-every */
+#define CHECKPOINT_DEFAULT_SECONDS 60
+
+/* Records between two interval checks (keeps clock and ftell calls rare) */
+#define CHECKPOINT_CHECK_RECORDS 1024
+
+
+/**
+ * struct checkpoint_header_t - Checkpoint file header
+ * @magic: CHECKPOINT_MAGIC, NUL padded
+ * @version: CHECKPOINT_VERSION
+ * @layout: Caller's state layout size (rejects snapshots of other builds)
+ * @capture_size: Size of the capture file when the run started
+ * @capture_mtime: Modification time of the capture file
+ * @config_length: Bytes of option text following the header
+ */
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t layout;
+    uint64_t capture_size;
+    int64_t capture_mtime;
+    uint32_t config_length;
+} checkpoint_header_t;
+
+
+/**
+ * struct checkpoint_policy_t - When to write the next checkpoint
+ * @path: Checkpoint file (NULL = checkpointing disabled)
+ * @every_bytes: Capture bytes between checkpoints (0 = use @every_seconds)
+ * @every_seconds: Wall-clock seconds between checkpoints
+ * @next_offset: Capture offset that triggers the next byte checkpoint
+ * @next_time: Time that triggers the next timed checkpoint
+ * @countdown: Records left before the interval is checked again
+ */
+
+typedef struct {
+    const char *path;
+    uint64_t every_bytes;
+    uint32_t every_seconds;
+    int64_t next_offset;
+    time_t next_time;
+    uint32_t countdown;
+} checkpoint_policy_t;
+
+
+/**
+ * checkpoint_parse_interval() - Parse a --checkpoint-every value
+ * @text: Byte size with optional K/M/G suffix ("512M"), or a duration
+ *        with an s/min/h suffix ("30s", "5min")
+ * @policy: Policy to update
+ *
+ * Return: false if @text is not a positive size or duration
+ */
+
+bool checkpoint_parse_interval(const char *text, checkpoint_policy_t *policy);
+
+
+/**
+ * checkpoint_policy_start() - Arm the interval from the current position
+ * @policy: Policy
+ * @session: Session about to be run (possibly just restored)
+ *
+ * Return: false if the capture cannot seek (a pipe), so cannot resume
+ */
+
+bool checkpoint_policy_start(checkpoint_policy_t *policy, const modbus_session_t *session);
+
+
+/**
+ * checkpoint_due() - Check whether a checkpoint should be written now
+ * @policy: Policy
+ * @session: Running session
+ *
+ * Cheap on most calls: the clock or file offset is only consulted every
+ * CHECKPOINT_CHECK_RECORDS records. Re-arms the interval when it
+ * returns true.
+ *
+ * Return: true if a checkpoint is due
+ */
+
+bool checkpoint_due(checkpoint_policy_t *policy, const modbus_session_t *session);
+
+
+/**
+ * checkpoint_create() - Start writing a checkpoint
+ * @path: Final checkpoint path (data goes to "<path>.tmp" first)
+ * @capture: Capture file being processed
+ * @config: Option text that must match on resume
+ * @layout: State layout size of the caller
+ *
+ * Return: File positioned after the header, or NULL on error (printed)
+ */
+
+FILE *checkpoint_create(const char *path, const char *capture, const char *config,
+                        uint32_t layout);
+
+
+/**
+ * checkpoint_commit() - Finish a checkpoint and move it into place
+ * @f: File from checkpoint_create(), closed by this call
+ * @path: Final checkpoint path
+ *
+ * Return: false if the file could not be completed (previous checkpoint
+ *         is kept)
+ */
+
+bool checkpoint_commit(FILE *f, const char *path);
+
+
+/**
+ * checkpoint_open() - Open a checkpoint for resuming
+ * @path: Checkpoint path
+ * @capture: Capture file to be processed
+ * @config: Option text of this run
+ * @layout: State layout size of the caller
+ *
+ * Rejects checkpoints of another build, another capture (size or
+ * modification time changed) or other options.
+ *
+ * Return: File positioned at the first state section, or NULL on error
+ *         (printed)
+ */
+
+FILE *checkpoint_open(const char *path, const char *capture, const char *config,
+                      uint32_t layout);
+
+
+/**
+ * checkpoint_close() - Check the end marker and close
+ * @f: File from checkpoint_open()
+ *
+ * Return: true if every section was consumed exactly
+ */
+
+bool checkpoint_close(FILE *f);
+
+#endif /* CHECKPOINT_H */
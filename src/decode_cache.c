@@ -0,0 +1,353 @@
+/*
+ * decode_cache.c - Memoised frame summaries for repeated poll frames
+ *
+ * Implements the cache declared in decode_cache.h. The key is hashed
+ * eight bytes at a time; entries keep the full key, so a hash collision
+ * is a miss rather than a wrong summary.
+ *
+ * Copyright (C) 2025 Marty
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+
+#include "decode_cache.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "colors.h"
+
+
+/* Counters in a checkpoint, in decode_cache_t order */
+#define DECODE_CACHE_COUNTERS 8
+
+
+/**
+ * decode_cache_init() - Allocate an empty cache
+ * @cache: Cache
+ * @entries: Capacity, rounded down to a power of two (at least DECODE_CACHE_WAYS)
+ *
+ * Return: false on allocation failure
+ */
+
+bool decode_cache_init(decode_cache_t *cache, uint32_t entries) {
+    uint32_t buckets = 1;
+
+    memset(cache, 0, sizeof(*cache));
+    while ((uint64_t)buckets * 2 * DECODE_CACHE_WAYS <= entries) {
+        buckets *= 2;
+    }
+
+    cache->buckets = calloc(buckets, sizeof(decode_cache_bucket_t));
+    if (cache->buckets == NULL) {
+        return false;
+    }
+    for (uint32_t i = 0; i < buckets; i++) {
+        atomic_flag_clear(&cache->buckets[i].lock);
+    }
+    cache->mask = buckets - 1;
+    return true;
+}
+
+
+/*
+ * hash_frame() - Hash of unit id, function code and PDU data
+ *
+ * The transaction id is left out on purpose: it is the only field that
+ * changes between polls.
+ */
+
+static uint32_t hash_frame(const modbus_tcp_frame_t *frame) {
+    uint64_t h = 0x9e3779b97f4a7c15ULL ^
+                 ((uint64_t)frame->mbap.unit_id << 24 | (uint64_t)frame->function_code << 16 |
+                  frame->data_length);
+    uint16_t i = 0;
+
+    for (; i + 8 <= frame->data_length; i += 8) {
+        uint64_t word;
+        memcpy(&word, frame->data + i, sizeof(word));
+        h = (h ^ word) * 0xff51afd7ed558ccdULL;
+        h ^= h >> 32;
+    }
+    if (i < frame->data_length) {
+        uint64_t word = 0;
+        memcpy(&word, frame->data + i, frame->data_length - i);
+        h = (h ^ word) * 0xff51afd7ed558ccdULL;
+    }
+    h ^= h >> 29;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    return (uint32_t)(h >> 32);
+}
+
+
+/*
+ * entry_matches() - Whether an entry holds @frame
+ */
+
+static bool entry_matches(const decode_cache_entry_t *entry, const modbus_tcp_frame_t *frame,
+                          uint32_t hash) {
+    return entry->used && entry->hash == hash && entry->unit_id == frame->mbap.unit_id &&
+           entry->function_code == frame->function_code &&
+           entry->data_length == frame->data_length &&
+           memcmp(entry->data, frame->data, frame->data_length) == 0;
+}
+
+
+/*
+ * lock_bucket() - Spin until the bucket is ours
+ *
+ * Critical sections are a key compare and one memo copy.
+ */
+
+static void lock_bucket(decode_cache_bucket_t *bucket) {
+    while (atomic_flag_test_and_set_explicit(&bucket->lock, memory_order_acquire)) {
+    }
+}
+
+
+/*
+ * unlock_bucket() - Release a bucket taken by lock_bucket()
+ */
+
+static void unlock_bucket(decode_cache_bucket_t *bucket) {
+    atomic_flag_clear_explicit(&bucket->lock, memory_order_release);
+}
+
+
+/**
+ * decode_cache_lookup() - Find the memo of a frame
+ * @cache: Cache
+ * @frame: Parsed frame (transaction id ignored)
+ * @memo: Output, copied out of the cache
+ *
+ * Return: true on a hit
+ */
+
+bool decode_cache_lookup(decode_cache_t *cache, const modbus_tcp_frame_t *frame,
+                         decode_memo_t *memo) {
+    atomic_fetch_add_explicit(&cache->lookups, 1, memory_order_relaxed);
+    if (frame->data_length > DECODE_CACHE_MAX_PDU) {
+        atomic_fetch_add_explicit(&cache->uncacheable, 1, memory_order_relaxed);
+        return false;
+    }
+
+    uint32_t hash = hash_frame(frame);
+    decode_cache_bucket_t *bucket = &cache->buckets[hash & cache->mask];
+    bool hit = false;
+
+    lock_bucket(bucket);
+    for (int way = 0; way < DECODE_CACHE_WAYS; way++) {
+        if (entry_matches(&bucket->ways[way], frame, hash)) {
+            *memo = bucket->ways[way].memo;
+            bucket->victim = (uint8_t)((way + 1) % DECODE_CACHE_WAYS);
+            hit = true;
+            break;
+        }
+    }
+    unlock_bucket(bucket);
+
+    if (hit) {
+        atomic_fetch_add_explicit(&cache->hits, 1, memory_order_relaxed);
+    }
+    return hit;
+}
+
+
+/**
+ * decode_cache_store() - Remember the memo of a frame
+ * @cache: Cache
+ * @frame: Parsed frame (no-op if its PDU is too long)
+ * @memo: Memo with the sinks' fields and the rule verdict
+ *
+ * Replaces the entry of the same frame, or the bucket's older entry.
+ */
+
+void decode_cache_store(decode_cache_t *cache, const modbus_tcp_frame_t *frame,
+                        const decode_memo_t *memo) {
+    if (frame->data_length > DECODE_CACHE_MAX_PDU) {
+        return;
+    }
+
+    uint32_t hash = hash_frame(frame);
+    decode_cache_bucket_t *bucket = &cache->buckets[hash & cache->mask];
+
+    lock_bucket(bucket);
+    int way = bucket->victim;
+    for (int i = 0; i < DECODE_CACHE_WAYS; i++) {
+        if (entry_matches(&bucket->ways[i], frame, hash)) {
+            way = i;
+            break;
+        }
+    }
+
+    decode_cache_entry_t *entry = &bucket->ways[way];
+    entry->used = true;
+    entry->unit_id = frame->mbap.unit_id;
+    entry->function_code = frame->function_code;
+    entry->data_length = frame->data_length;
+    entry->hash = hash;
+    if (frame->data_length > 0) {
+        memcpy(entry->data, frame->data, frame->data_length);
+    }
+    entry->memo = *memo;
+    bucket->victim = (uint8_t)((way + 1) % DECODE_CACHE_WAYS);
+    unlock_bucket(bucket);
+}
+
+
+/**
+ * decode_cache_count_verdict() - Count a hit whose rule verdict was reused
+ * @cache: Cache
+ */
+
+void decode_cache_count_verdict(decode_cache_t *cache) {
+    atomic_fetch_add_explicit(&cache->verdict_hits, 1, memory_order_relaxed);
+}
+
+
+/*
+ * now_ns() - Current time in nanoseconds, never 0
+ */
+
+static int64_t now_ns(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec + 1;
+}
+
+
+/**
+ * decode_cache_sampled() - Whether to time the frame being looked up
+ * @cache: Cache
+ *
+ * Return: Start time in nanoseconds, or 0 if this lookup is not timed
+ */
+
+int64_t decode_cache_sampled(decode_cache_t *cache) {
+    uint64_t n = atomic_load_explicit(&cache->lookups, memory_order_relaxed);
+
+    // Scramble the count: polling repeats with a fixed period, and a plain
+    // stride would keep timing the same few frames of each cycle
+    n *= 0x9e3779b97f4a7c15ULL;
+    return (n >> 40) % DECODE_CACHE_SAMPLE_EVERY == 0 ? now_ns() : 0;
+}
+
+
+/**
+ * decode_cache_account() - Record the time taken to describe a frame
+ * @cache: Cache
+ * @start_ns: Value returned by decode_cache_sampled() (no-op if 0)
+ * @hit: Whether both summary and rule verdict came from the cache
+ */
+
+void decode_cache_account(decode_cache_t *cache, int64_t start_ns, bool hit) {
+    if (start_ns == 0) {
+        return;
+    }
+
+    int64_t elapsed = now_ns() - start_ns;
+    if (elapsed < 0) {
+        return;
+    }
+    atomic_fetch_add_explicit(hit ? &cache->hit_samples : &cache->miss_samples, 1,
+                              memory_order_relaxed);
+    atomic_fetch_add_explicit(hit ? &cache->hit_ns : &cache->miss_ns, (uint64_t)elapsed,
+                              memory_order_relaxed);
+}
+
+
+/**
+ * decode_cache_display_summary() - Print hit rate and time saved
+ * @cache: Cache (no output if nothing was looked up)
+ */
+
+void decode_cache_display_summary(const decode_cache_t *cache) {
+    uint64_t lookups = atomic_load(&cache->lookups);
+    uint64_t hits = atomic_load(&cache->hits);
+    uint64_t verdicts = atomic_load(&cache->verdict_hits);
+    uint64_t uncacheable = atomic_load(&cache->uncacheable);
+    uint64_t hit_samples = atomic_load(&cache->hit_samples);
+    uint64_t miss_samples = atomic_load(&cache->miss_samples);
+
+    if (lookups == 0) {
+        return;
+    }
+
+    printf("\n%sDecode Cache (%u entries):%s\n", COLOR_WHITE,
+           (cache->mask + 1) * DECODE_CACHE_WAYS, COLOR_RESET);
+    printf("  Hit rate:            %.1f%% (%llu of %llu frames, %llu with rule verdict reused)\n",
+           (double)hits * 100.0 / lookups, (unsigned long long)hits,
+           (unsigned long long)lookups, (unsigned long long)verdicts);
+    if (uncacheable > 0) {
+        printf("  Not cacheable:       %llu frames (PDU over %d bytes)\n",
+               (unsigned long long)uncacheable, DECODE_CACHE_MAX_PDU);
+    }
+    if (hit_samples == 0 || miss_samples == 0) {
+        return;
+    }
+
+    double hit_mean = (double)atomic_load(&cache->hit_ns) / hit_samples;
+    double miss_mean = (double)atomic_load(&cache->miss_ns) / miss_samples;
+    double saved_ms = miss_mean > hit_mean ? (miss_mean - hit_mean) * verdicts / 1e6 : 0.0;
+    printf("  Time per frame:      %.0f ns cached, %.0f ns decoded (1 in %d timed)\n",
+           hit_mean, miss_mean, DECODE_CACHE_SAMPLE_EVERY);
+    printf("  Time saved:          ~%.1f ms\n", saved_ms);
+}
+
+
+/**
+ * decode_cache_save() - Write the cache counters to a checkpoint
+ * @cache: Cache
+ * @f: Open binary file
+ *
+ * Only the counters are written; the entries are refilled by the resumed
+ * run's first repeats.
+ *
+ * Return: false on write error
+ */
+
+bool decode_cache_save(const decode_cache_t *cache, FILE *f) {
+    uint64_t counters[DECODE_CACHE_COUNTERS] = {
+        atomic_load(&cache->lookups), atomic_load(&cache->hits),
+        atomic_load(&cache->verdict_hits), atomic_load(&cache->uncacheable),
+        atomic_load(&cache->hit_samples), atomic_load(&cache->hit_ns),
+        atomic_load(&cache->miss_samples), atomic_load(&cache->miss_ns),
+    };
+    return fwrite(counters, sizeof(counters), 1, f) == 1;
+}
+
+
+/**
+ * decode_cache_restore() - Load counters written by decode_cache_save()
+ * @cache: Cache
+ * @f: Open binary file
+ *
+ * Return: false on a short checkpoint
+ */
+
+bool decode_cache_restore(decode_cache_t *cache, FILE *f) {
+    uint64_t counters[DECODE_CACHE_COUNTERS];
+
+    if (fread(counters, sizeof(counters), 1, f) != 1) {
+        return false;
+    }
+    atomic_store(&cache->lookups, counters[0]);
+    atomic_store(&cache->hits, counters[1]);
+    atomic_store(&cache->verdict_hits, counters[2]);
+    atomic_store(&cache->uncacheable, counters[3]);
+    atomic_store(&cache->hit_samples, counters[4]);
+    atomic_store(&cache->hit_ns, counters[5]);
+    atomic_store(&cache->miss_samples, counters[6]);
+    atomic_store(&cache->miss_ns, counters[7]);
+    return true;
+}
+
+
+/**
+ * decode_cache_free() - Release the buckets
+ * @cache: Cache
+ */
+
+void decode_cache_free(decode_cache_t *cache) {
+    free(cache->buckets);
+    cache->buckets = NULL;
+}
@@ -0,0 +1,240 @@
+/*
+ * decode_cache.h - Memoised frame summaries for repeated poll frames
+ *
+ * In steady-state SCADA traffic most requests, and many responses, are
+ * byte-for-byte repeats apart from the MBAP transaction id. The cache
+ * maps (unit id, function code, PDU bytes) to the sink_summary_t built
+ * for the first such frame (names, address/quantity, details text) and
+ * the rule verdict, so repeats skip sink_summarise() and, when sender,
+ * receiver and direction also match, rule_engine_match().
+ *
+ * The cache is a fixed array of two-way buckets chosen by a hash of the
+ * key; a miss replaces the older way. Each bucket has its own spin lock
+ * and the counters are atomic, so one cache can be shared by several
+ * decoding threads. Frames with a PDU longer than DECODE_CACHE_MAX_PDU
+ * bytes are not cached.
+ *
+ * One lookup in DECODE_CACHE_SAMPLE_EVERY is timed, so the summary can
+ * estimate the time saved: fully reused frames x (mean time of a decoded
+ * frame - mean time of a fully reused one).
+ *
+ * Copyright (C) 2025 Marty
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef DECODE_CACHE_H
+#define DECODE_CACHE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdatomic.h>
+#include "output_sink.h"
+
+
+/* Entries when --decode-cache is not given */
+#define DECODE_CACHE_DEFAULT_ENTRIES 2048
+
+/* Largest accepted --decode-cache value */
+#define DECODE_CACHE_MAX_ENTRIES (1u << 20)
+
+/* Entries per bucket */
+#define DECODE_CACHE_WAYS 2
+
+/* Longest PDU data (after the function code) that is cached */
+#define DECODE_CACHE_MAX_PDU 64
+
+/* Lookups per timed lookup (power of two) */
+#define DECODE_CACHE_SAMPLE_EVERY 64
+
+
+/**
+ * struct decode_memo_t - Cached result of decoding one frame
+ * @summary: Frame fields the sinks read (sink_set_t.fields)
+ * @rules: Rule verdict for @src_id, @dst_id and @is_request
+ * @rules_valid: @rules holds every hit and may be replayed
+ * @is_request: Direction the verdict was computed for
+ * @src_id: Sender the verdict was computed for
+ * @dst_id: Receiver the verdict was computed for
+ */
+
+typedef struct {
+    sink_summary_t summary;
+    sink_rule_hits_t rules;
+    bool rules_valid;
+    bool is_request;
+    endpoint_id_t src_id;
+    endpoint_id_t dst_id;
+} decode_memo_t;
+
+
+/**
+ * struct decode_cache_entry_t - One cached frame
+ * @used: Entry holds a frame
+ * @unit_id: Key: MBAP unit id
+ * @function_code: Key: function code
+ * @data_length: Key: PDU data length
+ * @hash: Hash of the key
+ * @data: Key: PDU data bytes
+ * @memo: Value
+ */
+
+typedef struct {
+    bool used;
+    uint8_t unit_id;
+    uint8_t function_code;
+    uint16_t data_length;
+    uint32_t hash;
+    uint8_t data[DECODE_CACHE_MAX_PDU];
+    decode_memo_t memo;
+} decode_cache_entry_t;
+
+
+/**
+ * struct decode_cache_bucket_t - Entries sharing one hash slot
+ * @lock: Held while an entry is read or written
+ * @victim: Way replaced by the next miss
+ * @ways: Entries
+ */
+
+typedef struct {
+    atomic_flag lock;
+    uint8_t victim;
+    decode_cache_entry_t ways[DECODE_CACHE_WAYS];
+} decode_cache_bucket_t;
+
+
+/**
+ * struct decode_cache_t - Bounded shared decode cache
+ * @buckets: Bucket array (@mask + 1 buckets)
+ * @mask: Bucket count - 1 (power of two)
+ * @lookups: Frames looked up
+ * @hits: Lookups that found the frame
+ * @verdict_hits: Hits whose rule verdict was reused
+ * @uncacheable: Frames with a PDU too long to cache
+ * @hit_samples: Timed hits
+ * @hit_ns: Total time of the timed hits
+ * @miss_samples: Timed misses
+ * @miss_ns: Total time of the timed misses
+ */
+
+typedef struct {
+    decode_cache_bucket_t *buckets;
+    uint32_t mask;
+    _Atomic uint64_t lookups;
+    _Atomic uint64_t hits;
+    _Atomic uint64_t verdict_hits;
+    _Atomic uint64_t uncacheable;
+    _Atomic uint64_t hit_samples;
+    _Atomic uint64_t hit_ns;
+    _Atomic uint64_t miss_samples;
+    _Atomic uint64_t miss_ns;
+} decode_cache_t;
+
+
+/**
+ * decode_cache_init() - Allocate an empty cache
+ * @cache: Cache
+ * @entries: Capacity, rounded down to a power of two (at least DECODE_CACHE_WAYS)
+ *
+ * Return: false on allocation failure
+ */
+
+bool decode_cache_init(decode_cache_t *cache, uint32_t entries);
+
+
+/**
+ * decode_cache_lookup() - Find the memo of a frame
+ * @cache: Cache
+ * @frame: Parsed frame (transaction id ignored)
+ * @memo: Output, copied out of the cache
+ *
+ * Return: true on a hit
+ */
+
+bool decode_cache_lookup(decode_cache_t *cache, const modbus_tcp_frame_t *frame,
+                         decode_memo_t *memo);
+
+
+/**
+ * decode_cache_store() - Remember the memo of a frame
+ * @cache: Cache
+ * @frame: Parsed frame (no-op if its PDU is too long)
+ * @memo: Memo with the sinks' fields and the rule verdict
+ *
+ * Replaces the entry of the same frame, or the bucket's older entry.
+ */
+
+void decode_cache_store(decode_cache_t *cache, const modbus_tcp_frame_t *frame,
+                        const decode_memo_t *memo);
+
+
+/**
+ * decode_cache_count_verdict() - Count a hit whose rule verdict was reused
+ * @cache: Cache
+ */
+
+void decode_cache_count_verdict(decode_cache_t *cache);
+
+
+/**
+ * decode_cache_sampled() - Whether to time the frame being looked up
+ * @cache: Cache
+ *
+ * Return: Start time in nanoseconds, or 0 if this lookup is not timed
+ */
+
+int64_t decode_cache_sampled(decode_cache_t *cache);
+
+
+/**
+ * decode_cache_account() - Record the time taken to describe a frame
+ * @cache: Cache
+ * @start_ns: Value returned by decode_cache_sampled() (no-op if 0)
+ * @hit: Whether both summary and rule verdict came from the cache
+ */
+
+void decode_cache_account(decode_cache_t *cache, int64_t start_ns, bool hit);
+
+
+/**
+ * decode_cache_display_summary() - Print hit rate and time saved
+ * @cache: Cache (no output if nothing was looked up)
+ */
+
+void decode_cache_display_summary(const decode_cache_t *cache);
+
+
+/**
+ * decode_cache_save() - Write the cache counters to a checkpoint
+ * @cache: Cache
+ * @f: Open binary file
+ *
+ * Only the counters are written; the entries are refilled by the resumed
+ * run's first repeats.
+ *
+ * Return: false on write error
+ */
+
+bool decode_cache_save(const decode_cache_t *cache, FILE *f);
+
+
+/**
+ * decode_cache_restore() - Load counters written by decode_cache_save()
+ * @cache: Cache
+ * @f: Open binary file
+ *
+ * Return: false on a short checkpoint
+ */
+
+bool decode_cache_restore(decode_cache_t *cache, FILE *f);
+
+
+/**
+ * decode_cache_free() - Release the buckets
+ * @cache: Cache
+ */
+
+void decode_cache_free(decode_cache_t *cache);
+
+#endif /* DECODE_CACHE_H */
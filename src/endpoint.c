@@ -0,0 +1,312 @@
+/*
+ * endpoint.c - IPv4/IPv6 endpoint addresses and interning (modbus_parse library)
+ *
+ * Copyright (C) 2025 Marty
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+
+#include "endpoint.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/* Initial ids and index slots of a new table */
+#define ENDPOINT_INITIAL_CAPACITY 64
+
+
+/*
+ * mix64() - Finaliser spreading all input bits over the output
+ */
+
+static inline uint64_t mix64(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+
+/**
+ * endpoint_from_ipv4() - Build an IPv4 endpoint
+ * @ep: Output endpoint
+ * @addr: Address in host byte order
+ */
+
+void endpoint_from_ipv4(endpoint_t *ep, uint32_t addr) {
+    memset(ep, 0, sizeof(*ep));
+    ep->family = ENDPOINT_IPV4;
+    ep->addr[0] = (uint8_t)(addr >> 24);
+    ep->addr[1] = (uint8_t)(addr >> 16);
+    ep->addr[2] = (uint8_t)(addr >> 8);
+    ep->addr[3] = (uint8_t)addr;
+}
+
+
+/**
+ * endpoint_from_ipv6() - Build an IPv6 endpoint
+ * @ep: Output endpoint
+ * @addr: 16 address bytes in network byte order
+ */
+
+void endpoint_from_ipv6(endpoint_t *ep, const uint8_t *addr) {
+    ep->family = ENDPOINT_IPV6;
+    memcpy(ep->addr, addr, ENDPOINT_ADDR_LEN);
+}
+
+
+/**
+ * endpoint_ipv4() - IPv4 address of an endpoint
+ * @ep: Endpoint
+ *
+ * Return: Address in host byte order, 0 if @ep is not IPv4
+ */
+
+uint32_t endpoint_ipv4(const endpoint_t *ep) {
+    if (ep->family != ENDPOINT_IPV4) {
+        return 0;
+    }
+    return ((uint32_t)ep->addr[0] << 24) | ((uint32_t)ep->addr[1] << 16) |
+           ((uint32_t)ep->addr[2] << 8) | ep->addr[3];
+}
+
+
+/**
+ * endpoint_equal() - Compare two endpoints
+ * @a: First endpoint
+ * @b: Second endpoint
+ *
+ * Return: true if family and address match
+ */
+
+bool endpoint_equal(const endpoint_t *a, const endpoint_t *b) {
+    return a->family == b->family && memcmp(a->addr, b->addr, ENDPOINT_ADDR_LEN) == 0;
+}
+
+
+/**
+ * endpoint_hash() - 64-bit hash of an endpoint
+ * @ep: Endpoint
+ *
+ * Return: Hash value (stable across runs)
+ */
+
+uint64_t endpoint_hash(const endpoint_t *ep) {
+    uint64_t hi = 0, lo = 0;
+
+    for (int i = 0; i < 8; i++) {
+        hi = (hi << 8) | ep->addr[i];
+        lo = (lo << 8) | ep->addr[8 + i];
+    }
+    return mix64(mix64(hi ^ ep->family) ^ lo);
+}
+
+
+/**
+ * endpoint_format() - Format an endpoint as text
+ * @ep: Endpoint
+ * @buf: Output buffer
+ * @len: Size of @buf
+ */
+
+void endpoint_format(const endpoint_t *ep, char *buf, size_t len) {
+    if (ep->family == ENDPOINT_IPV4) {
+        snprintf(buf, len, "%u.%u.%u.%u", ep->addr[0], ep->addr[1], ep->addr[2], ep->addr[3]);
+        return;
+    }
+    if (ep->family != ENDPOINT_IPV6) {
+        snprintf(buf, len, "-");
+        return;
+    }
+
+    // IPv4-mapped addresses keep the dotted tail (RFC 5952 section 5)
+    static const uint8_t mapped_prefix[12] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff };
+    if (memcmp(ep->addr, mapped_prefix, sizeof(mapped_prefix)) == 0) {
+        snprintf(buf, len, "::ffff:%u.%u.%u.%u",
+                 ep->addr[12], ep->addr[13], ep->addr[14], ep->addr[15]);
+        return;
+    }
+
+    uint16_t words[8];
+    int best_start = -1, best_len = 0;
+
+    for (int i = 0; i < 8; i++) {
+        words[i] = (uint16_t)((ep->addr[2 * i] << 8) | ep->addr[2 * i + 1]);
+    }
+
+    // Longest run of two or more zero words (first one wins a tie)
+    for (int i = 0; i < 8; ) {
+        int j = i;
+        while (j < 8 && words[j] == 0) {
+            j++;
+        }
+        if (j - i > best_len && j - i >= 2) {
+            best_start = i;
+            best_len = j - i;
+        }
+        i = (j == i) ? i + 1 : j;
+    }
+
+    char tmp[ENDPOINT_STR_LEN];
+    size_t pos = 0;
+
+    for (int i = 0; i < 8; i++) {
+        if (i == best_start) {
+            tmp[pos++] = ':';
+            if (i == 0) {
+                tmp[pos++] = ':';
+            }
+            i += best_len - 1;
+            continue;
+        }
+        pos += (size_t)snprintf(tmp + pos, sizeof(tmp) - pos, "%x%s", words[i], i < 7 ? ":" : "");
+    }
+    tmp[pos] = '\0';
+    snprintf(buf, len, "%s", tmp);
+}
+
+
+/*
+ * table_grow() - Double id storage and rebuild the index at 2x ids
+ */
+
+static bool table_grow(endpoint_table_t *t) {
+    uint32_t capacity = t->capacity ? t->capacity * 2 : ENDPOINT_INITIAL_CAPACITY;
+    uint32_t slot_count = capacity * 2;
+
+    endpoint_t *addrs = realloc(t->addrs, capacity * sizeof(endpoint_t));
+    if (!addrs) {
+        return false;
+    }
+    t->addrs = addrs;
+
+    char (*names)[ENDPOINT_STR_LEN] = realloc(t->names, capacity * sizeof(*names));
+    if (!names) {
+        return false;
+    }
+    memset(names + t->capacity, 0, (capacity - t->capacity) * sizeof(*names));
+    t->names = names;
+
+    uint32_t *slots = calloc(slot_count, sizeof(uint32_t));
+    if (!slots) {
+        return false;
+    }
+
+    for (uint32_t id = 0; id < t->count; id++) {
+        uint32_t idx = (uint32_t)endpoint_hash(&t->addrs[id]) & (slot_count - 1);
+        while (slots[idx] != 0) {
+            idx = (idx + 1) & (slot_count - 1);
+        }
+        slots[idx] = id + 1;
+    }
+
+    free(t->slots);
+    t->slots = slots;
+    t->slot_mask = slot_count - 1;
+    t->capacity = capacity;
+    return true;
+}
+
+
+/**
+ * endpoint_table_init() - Allocate an empty interning table
+ * @table: Table to initialise
+ *
+ * Return: true on success, false on allocation failure
+ */
+
+bool endpoint_table_init(endpoint_table_t *table) {
+    memset(table, 0, sizeof(*table));
+    if (!table_grow(table)) {
+        endpoint_table_free(table);
+        return false;
+    }
+    return true;
+}
+
+
+/**
+ * endpoint_intern() - Id of an address, adding it if new
+ * @table: Table
+ * @ep: Address
+ *
+ * The index is kept at most half full, so probes stay short.
+ *
+ * Return: Id, or ENDPOINT_ID_NONE if the table could not grow
+ */
+
+endpoint_id_t endpoint_intern(endpoint_table_t *table, const endpoint_t *ep) {
+    uint32_t idx = (uint32_t)endpoint_hash(ep) & table->slot_mask;
+
+    while (table->slots[idx] != 0) {
+        endpoint_id_t id = table->slots[idx] - 1;
+        if (endpoint_equal(&table->addrs[id], ep)) {
+            return id;
+        }
+        idx = (idx + 1) & table->slot_mask;
+    }
+
+    if (table->count == table->capacity) {
+        if (table->count >= ENDPOINT_ID_NONE / 4 || !table_grow(table)) {
+            return ENDPOINT_ID_NONE;
+        }
+        // Slot positions changed with the index size
+        idx = (uint32_t)endpoint_hash(ep) & table->slot_mask;
+        while (table->slots[idx] != 0) {
+            idx = (idx + 1) & table->slot_mask;
+        }
+    }
+
+    endpoint_id_t id = table->count++;
+    table->addrs[id] = *ep;
+    table->slots[idx] = id + 1;
+    return id;
+}
+
+
+/**
+ * endpoint_table_get() - Address of an id
+ * @table: Table
+ * @id: Id from endpoint_intern()
+ *
+ * Return: Address, or NULL for an unknown id
+ */
+
+const endpoint_t *endpoint_table_get(const endpoint_table_t *table, endpoint_id_t id) {
+    return id < table->count ? &table->addrs[id] : NULL;
+}
+
+
+/**
+ * endpoint_table_name() - Text of an id, formatted once and cached
+ * @table: Table
+ * @id: Id from endpoint_intern()
+ *
+ * Return: Formatted address ("-" for an unknown id)
+ */
+
+const char *endpoint_table_name(endpoint_table_t *table, endpoint_id_t id) {
+    if (id >= table->count) {
+        return "-";
+    }
+    if (table->names[id][0] == '\0') {
+        endpoint_format(&table->addrs[id], table->names[id], ENDPOINT_STR_LEN);
+    }
+    return table->names[id];
+}
+
+
+/**
+ * endpoint_table_free() - Release table memory
+ * @table: Table
+ */
+
+void endpoint_table_free(endpoint_table_t *table) {
+    free(table->addrs);
+    free(table->names);
+    free(table->slots);
+    memset(table, 0, sizeof(*table));
+}
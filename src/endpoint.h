@@ -0,0 +1,198 @@
+/*
+ * endpoint.h - IPv4/IPv6 endpoint addresses and interning (modbus_parse library)
+ *
+ * Addresses travel through the pipeline as a fixed 16-byte buffer with a
+ * family tag, so IPv4 and IPv6 share one code path. A session interns
+ * every address it sees into a small integer id; per-frame tables key
+ * on the id and text is produced only when something is printed.
+ *
+ * Copyright (C) 2025 Marty
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef ENDPOINT_H
+#define ENDPOINT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+
+/* Address bytes stored per endpoint (IPv6 size; IPv4 uses the first 4) */
+#define ENDPOINT_ADDR_LEN 16
+
+/* Buffer size for a formatted address (INET6_ADDRSTRLEN) */
+#define ENDPOINT_STR_LEN 46
+
+/* Id returned when an address could not be interned */
+#define ENDPOINT_ID_NONE UINT32_MAX
+
+
+/**
+ * enum endpoint_family_t - Address family tag
+ * @ENDPOINT_NONE: Unset
+ * @ENDPOINT_IPV4: IPv4, network byte order in addr[0..3]
+ * @ENDPOINT_IPV6: IPv6, network byte order in addr[0..15]
+ */
+
+typedef enum {
+    ENDPOINT_NONE = 0,
+    ENDPOINT_IPV4 = 4,
+    ENDPOINT_IPV6 = 6
+} endpoint_family_t;
+
+
+/**
+ * struct endpoint_t - Network address with family tag
+ * @family: endpoint_family_t value
+ * @addr: Address bytes, unused bytes zero
+ */
+
+typedef struct {
+    uint8_t family;
+    uint8_t addr[ENDPOINT_ADDR_LEN];
+} endpoint_t;
+
+
+/* Interned endpoint id, dense from 0 within one table */
+typedef uint32_t endpoint_id_t;
+
+
+/**
+ * struct endpoint_table_t - Address interning table
+ * @addrs: Address per id
+ * @names: Formatted address per id ("" until first requested)
+ * @count: Ids handed out
+ * @capacity: Entries allocated in @addrs and @names
+ * @slots: Open-addressed index of id + 1 (0 = empty)
+ * @slot_mask: Slot count - 1 (power of two)
+ */
+
+typedef struct {
+    endpoint_t *addrs;
+    char (*names)[ENDPOINT_STR_LEN];
+    uint32_t count;
+    uint32_t capacity;
+    uint32_t *slots;
+    uint32_t slot_mask;
+} endpoint_table_t;
+
+
+/**
+ * endpoint_from_ipv4() - Build an IPv4 endpoint
+ * @ep: Output endpoint
+ * @addr: Address in host byte order
+ */
+
+void endpoint_from_ipv4(endpoint_t *ep, uint32_t addr);
+
+
+/**
+ * endpoint_from_ipv6() - Build an IPv6 endpoint
+ * @ep: Output endpoint
+ * @addr: 16 address bytes in network byte order
+ */
+
+void endpoint_from_ipv6(endpoint_t *ep, const uint8_t *addr);
+
+
+/**
+ * endpoint_ipv4() - IPv4 address of an endpoint
+ * @ep: Endpoint
+ *
+ * Return: Address in host byte order, 0 if @ep is not IPv4
+ */
+
+uint32_t endpoint_ipv4(const endpoint_t *ep);
+
+
+/**
+ * endpoint_equal() - Compare two endpoints
+ * @a: First endpoint
+ * @b: Second endpoint
+ *
+ * Return: true if family and address match
+ */
+
+bool endpoint_equal(const endpoint_t *a, const endpoint_t *b);
+
+
+/**
+ * endpoint_hash() - 64-bit hash of an endpoint
+ * @ep: Endpoint
+ *
+ * Depends only on the address, so it is stable across runs and may be
+ * persisted (unlike ids, which depend on arrival order).
+ *
+ * Return: Hash value
+ */
+
+uint64_t endpoint_hash(const endpoint_t *ep);
+
+
+/**
+ * endpoint_format() - Format an endpoint as text
+ * @ep: Endpoint
+ * @buf: Output buffer (ENDPOINT_STR_LEN bytes always suffice)
+ * @len: Size of @buf
+ *
+ * IPv4 is dotted quad; IPv6 follows RFC 5952 (lower case, longest zero
+ * run compressed, IPv4-mapped as ::ffff:a.b.c.d). An unset endpoint
+ * formats as "-".
+ */
+
+void endpoint_format(const endpoint_t *ep, char *buf, size_t len);
+
+
+/**
+ * endpoint_table_init() - Allocate an empty interning table
+ * @table: Table to initialise
+ *
+ * Return: true on success, false on allocation failure
+ */
+
+bool endpoint_table_init(endpoint_table_t *table);
+
+
+/**
+ * endpoint_intern() - Id of an address, adding it if new
+ * @table: Table
+ * @ep: Address
+ *
+ * Return: Id, or ENDPOINT_ID_NONE if the table could not grow
+ */
+
+endpoint_id_t endpoint_intern(endpoint_table_t *table, const endpoint_t *ep);
+
+
+/**
+ * endpoint_table_get() - Address of an id
+ * @table: Table
+ * @id: Id from endpoint_intern()
+ *
+ * Return: Address, or NULL for an unknown id
+ */
+
+const endpoint_t *endpoint_table_get(const endpoint_table_t *table, endpoint_id_t id);
+
+
+/**
+ * endpoint_table_name() - Text of an id, formatted once and cached
+ * @table: Table
+ * @id: Id from endpoint_intern()
+ *
+ * Return: Formatted address ("-" for an unknown id); valid until the
+ *         table is freed
+ */
+
+const char *endpoint_table_name(endpoint_table_t *table, endpoint_id_t id);
+
+
+/**
+ * endpoint_table_free() - Release table memory
+ * @table: Table
+ */
+
+void endpoint_table_free(endpoint_table_t *table);
+
+#endif /* ENDPOINT_H */
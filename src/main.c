@@ -11,7 +11,7 @@
  * - Markdown report generation
  * - Color-coded terminal output
  *
- * Usage: modbus-parser [options] <pcap_file>
+ * Usage: modbus-parser [options] <pcap_file> [pcap_file...]
  *
  * Copyright (C) 2025 Marty
  * SPDX-License-Identifier: GPL-3.0-or-later
@@ -22,17 +22,49 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
-#include "pcap_reader.h"
-#include "modbus_parser.h"
+#include "modbus_session.h"
+#include "modbus_output.h"
+#include "pccc_parser.h"
+#include "pccc_output.h"
+#include "anomaly_detector.h"
+#include "poll_cycle.h"
+#include "sketch.h"
+#include "rule_engine.h"
+#include "baseline.h"
+#include "checkpoint.h"
+#include "output_sink.h"
+#include "decode_cache.h"
+#include "metrics.h"
+#include "timeseries.h"
+#include "sample_estimate.h"
 #include "colors.h"
 
 
 /**
  * struct process_context - Processing context passed to frame callback
  * @mode: Display format (table or verbose)
+ * @summary_only: No per-frame terminal output (--summary-only)
  * @frame_count: Total frames successfully parsed
  * @functon_counts: Per-function-code usage counters
  * @attack_stats: Security analysis accumulator
+ * @detector: Per-master sliding-window anomaly detector
+ * @polls: Poll cycle statistics per request signature
+ * @sketches: Memory-bounded cardinality and heavy-hitter sketches
+ * @rules: Compiled detection rules (rule_count == 0 if none loaded)
+ * @baseline: Learned model being built or checked against
+ * @baseline_enabled: true if --learn or --baseline was given
+ * @timeseries: Per-second counts with minute and hour rollups
+ * @pccc: EtherNet/IP and PCCC counters, filled by the reader's handler
+ * @enip_enabled: true if --enip was given
+ * @sample_mode: Clusters tracked in @sample_clusters: PCAP_SAMPLE_FLOWS,
+ *               PCAP_SAMPLE_TIME, or PCAP_SAMPLE_NONE for none
+ * @sample_clusters: Frames per kept flow or second
+ * @session: Decoding session (resolves endpoint ids to text)
+ * @sinks: Per-frame outputs (terminal, report rows, --jsonl, --binary)
+ * @metrics: Counter shard of this thread (NULL = no --metrics-*)
+ * @checkpoint: When to snapshot this context (path NULL = never)
+ * @checkpoint_config: Options a resumed run must repeat
+ * @filename: Capture being processed
  *
  * Aggregates state across all processed frames including display mode,
  * frame counters, function code statistics, and security analysis.
@@ -40,74 +72,292 @@
 
 typedef struct {
     display_mode_t mode;
+    bool summary_only;
     uint32_t frame_count;
     uint32_t function_counts[256]; // Count occurences of each function code.
     attack_stats_t attack_stats; // Attack detection statistics.
+    anomaly_detector_t detector; // Windowed per-source alerts.
+    poll_detector_t polls; // Polling cycles and jitter.
+    sketch_stats_t sketches; // Approximate distinct counts / heavy hitters.
+    rule_engine_t rules; // Site-specific detection rules.
+    baseline_t baseline; // Learned allow-model (learn or check).
+    bool baseline_enabled;
+    timeseries_t timeseries; // Traffic over capture time.
+    pccc_analysis_stats_t pccc; // Port 44818, decoded in the same pass.
+    bool enip_enabled;
+    pcap_sample_mode_t sample_mode;
+    sample_clusters_t sample_clusters; // Clustering of a flow or time sample.
+    modbus_session_t *session;
+    sink_set_t sinks; // Decode-once fan-out of every frame.
+    decode_cache_t decode_cache; // Summaries of repeated frames.
+    bool decode_cache_enabled;
+    metrics_shard_t *metrics; // Prometheus counters.
+    checkpoint_policy_t checkpoint; // Periodic snapshots for --resume.
+    const char *checkpoint_config;
+    const char *filename;
 } process_context_t;
 
 
+/**
+ * struct context_snapshot_t - Counters of process_context_t in a checkpoint
+ * @frame_count: Frames processed
+ * @function_counts: Per-function-code usage counters
+ * @attack_stats: Security statistics (report_file is not meaningful)
+ * @report_position: Report bytes written (0 if no report)
+ */
+
+typedef struct {
+    uint32_t frame_count;
+    uint32_t function_counts[256];
+    attack_stats_t attack_stats;
+    int64_t report_position;
+} context_snapshot_t;
+
+
+/*
+ * save_checkpoint() - Snapshot every module after the current record
+ *
+ * Sections are written in a fixed order that resume_checkpoint() reads
+ * back. A capture that cannot seek disables checkpointing for the run.
+ */
+
+static void save_checkpoint(process_context_t *ctx) {
+    context_snapshot_t snap;
+
+    sink_set_batch(&ctx->sinks);
+    memset(&snap, 0, sizeof(snap));
+    snap.frame_count = ctx->frame_count;
+    memcpy(snap.function_counts, ctx->function_counts, sizeof(snap.function_counts));
+    snap.attack_stats = ctx->attack_stats;
+    snap.attack_stats.report_file = NULL;
+    snap.report_position = modbus_report_position(&ctx->attack_stats);
+
+    FILE *f = checkpoint_create(ctx->checkpoint.path, ctx->filename, ctx->checkpoint_config,
+                                sizeof(process_context_t));
+    if (!f) {
+        return;
+    }
+
+    bool seekable = modbus_session_save(ctx->session, f);
+    bool ok = seekable && snap.report_position >= 0 &&
+              fwrite(&snap, sizeof(snap), 1, f) == 1 &&
+              anomaly_detector_save(&ctx->detector, f) &&
+              poll_detector_save(&ctx->polls, f) &&
+              sketch_stats_save(&ctx->sketches, f) &&
+              rule_engine_save(&ctx->rules, f) &&
+              timeseries_save(&ctx->timeseries, f) &&
+              decode_cache_save(&ctx->decode_cache, f) &&
+              (ctx->sample_mode == PCAP_SAMPLE_NONE ||
+               sample_clusters_save(&ctx->sample_clusters, f)) &&
+              (!ctx->baseline_enabled || baseline_save(&ctx->baseline, f)) &&
+              (!ctx->enip_enabled || fwrite(&ctx->pccc, sizeof(ctx->pccc), 1, f) == 1);
+    if (!ok) {
+        // Discard the partial file; the previous checkpoint stays valid
+        char tmp_path[1024];
+        fclose(f);
+        snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", ctx->checkpoint.path);
+        remove(tmp_path);
+        if (!seekable) {
+            printf("Warning: Capture is not seekable, checkpointing disabled\n");
+            ctx->checkpoint.path = NULL;
+        } else {
+            printf("Warning: Could not write checkpoint %s\n", ctx->checkpoint.path);
+        }
+        return;
+    }
+    checkpoint_commit(f, ctx->checkpoint.path);
+}
+
+
+/*
+ * resume_checkpoint() - Restore every module from a checkpoint
+ *
+ * The report file of this run is kept and reopened at the saved length.
+ */
+
+static bool resume_checkpoint(process_context_t *ctx, const char *path, bool *report) {
+    context_snapshot_t snap;
+
+    FILE *f = checkpoint_open(path, ctx->filename, ctx->checkpoint_config,
+                              sizeof(process_context_t));
+    if (!f) {
+        return false;
+    }
+
+    if (!modbus_session_restore(ctx->session, f)) {
+        printf("Error: Cannot resume from %s: %s\n", path, modbus_session_error(ctx->session));
+        checkpoint_close(f);
+        return false;
+    }
+
+    bool ok = fread(&snap, sizeof(snap), 1, f) == 1 &&
+              anomaly_detector_restore(&ctx->detector, f) &&
+              poll_detector_restore(&ctx->polls, f) &&
+              sketch_stats_restore(&ctx->sketches, f) &&
+              rule_engine_restore(&ctx->rules, f) &&
+              timeseries_restore(&ctx->timeseries, f) &&
+              decode_cache_restore(&ctx->decode_cache, f) &&
+              (ctx->sample_mode == PCAP_SAMPLE_NONE ||
+               sample_clusters_restore(&ctx->sample_clusters, f)) &&
+              (!ctx->baseline_enabled || baseline_restore(&ctx->baseline, f)) &&
+              (!ctx->enip_enabled || fread(&ctx->pccc, sizeof(ctx->pccc), 1, f) == 1);
+    if (!checkpoint_close(f) || !ok) {
+        printf("Error: Checkpoint %s is damaged or incomplete\n", path);
+        return false;
+    }
+
+    ctx->frame_count = snap.frame_count;
+    memcpy(ctx->function_counts, snap.function_counts, sizeof(ctx->function_counts));
+    ctx->attack_stats = snap.attack_stats;
+    ctx->attack_stats.report_file = NULL;
+    ctx->attack_stats.report_enabled = false;
+
+    if (*report && !modbus_resume_report(&ctx->attack_stats, ctx->filename,
+                                         snap.report_position)) {
+        printf("Warning: Report generation disabled due to file error\n");
+        *report = false;
+    }
+
+    printf("Resuming from checkpoint %s at frame %u\n", path, ctx->frame_count);
+    return true;
+}
+
+
+
+/*
+ * describe_frame() - Summary and rule verdict of a frame for the sinks
+ *
+ * Repeats of a cached frame reuse its summary, and its rule verdict when
+ * sender, receiver and direction match too; the verdict is then replayed
+ * into the rule counters so they stay exact.
+ */
+
+static void describe_frame(process_context_t *ctx, const modbus_record_t *record,
+                           decode_memo_t *memo) {
+    const modbus_tcp_frame_t *frame = &record->frame;
+
+    if (!ctx->decode_cache_enabled) {
+        sink_summarise(frame, ctx->sinks.fields, &memo->summary);
+        memo->rules.hits = rule_engine_match(&ctx->rules, frame, &record->src, &record->dst,
+                                             record->is_request, memo->rules.hit_ids, NULL,
+                                             RULE_MAX_HITS);
+        if (ctx->sinks.fields & SINK_FIELD_RULES) {
+            sink_format_rules(&memo->rules);
+        }
+        return;
+    }
+
+    int64_t start = decode_cache_sampled(&ctx->decode_cache);
+    bool hit = decode_cache_lookup(&ctx->decode_cache, frame, memo);
+    if (!hit) {
+        sink_summarise(frame, ctx->sinks.fields, &memo->summary);
+        memo->rules_valid = false;
+    }
+
+    // ENDPOINT_ID_NONE stands for many addresses, so its verdict is not reused
+    bool verdict = hit && memo->rules_valid && memo->is_request == record->is_request &&
+                   memo->src_id == record->src_id && memo->dst_id == record->dst_id &&
+                   record->src_id != ENDPOINT_ID_NONE && record->dst_id != ENDPOINT_ID_NONE;
+    if (verdict) {
+        rule_engine_replay(&ctx->rules, memo->rules.hit_rules, memo->rules.hits);
+        decode_cache_count_verdict(&ctx->decode_cache);
+    } else {
+        memo->rules.hits = rule_engine_match(&ctx->rules, frame, &record->src, &record->dst,
+                                             record->is_request, memo->rules.hit_ids,
+                                             memo->rules.hit_rules, RULE_MAX_HITS);
+        if (ctx->sinks.fields & SINK_FIELD_RULES) {
+            sink_format_rules(&memo->rules);
+        }
+        memo->rules_valid = memo->rules.hits <= RULE_MAX_HITS;
+        memo->is_request = record->is_request;
+        memo->src_id = record->src_id;
+        memo->dst_id = record->dst_id;
+        decode_cache_store(&ctx->decode_cache, frame, memo);
+    }
+    decode_cache_account(&ctx->decode_cache, start, verdict);
+}
+
 
 /**
- * process_modbus_payload() - Callback function to process each Modbus TCP 
- * payload
- * 
- * @payload: Raw Modbus TCP frame data (MBAP + PDU)
- * @length: Payload length in bytes
- * @src_ip: Source IP address
- * @src_port: Source TCP port
- * @dst_ip: Destination IP address
- * @dst_port: Destination TCP port
- * @timestamp: Frame timestamp (seconds since epoch)
+ * process_record() - Callback invoked for each decoded Modbus TCP payload
+ * @record: Decoded record from modbus_session_run()
  * @user_data: Pointer to process_context_t structure
  *
- * Invoked by pcap_reader for each Modbus TCP frame found in PCAP.
- * 
  * Processing flow:
- * 1. Parse frame via modbus_parse_frame()
- * 2. Display frame (table or verbose mode)
- * 3. Write to report file (if enabled)
- * 4. Update statistics (frame count, function codes, security)
- * 5. Free frame resources
+ * 1. Count the record in the metrics (if exported) and log sampled
+ *    parse failures (verbose mode or --parse-log)
+ * 2. Evaluate detection rules (if loaded)
+ * 3. Pass the frame and its rule hits to the sinks (terminal table or
+ *    verbose, report rows, JSONL, binary); it is summarised once for all
+ * 4. Update statistics (frame count, function codes, security,
+ *    sliding-window alerts, baseline learn/check)
+ * 5. Write a checkpoint when one is due (--checkpoint)
+ *
+ * Frame memory belongs to the session and is released on the next
+ * record.
  *
- * Parse failures are silently skipped (verbose mode shows error).
+ * Return: true (always continue)
  */
 
-void process_modbus_payload(const uint8_t *payload, uint32_t length,
-                            const char *src_ip, uint16_t src_port,
-                            const char *dst_ip, uint16_t dst_port,
-                            double timestamp,
-                            void *user_data) {
+bool process_record(const modbus_record_t *record, void *user_data) {
     process_context_t *ctx = (process_context_t*)user_data;
-    modbus_tcp_frame_t frame;
-    
-    // Parse the Modbus TCP frame
-    if (modbus_parse_frame(payload, length, &frame)) {
-        if (ctx->mode == DISPLAY_VERBOSE) {
-            // Verbose mode: full detailed breakdown
-            printf("\n--- Frame %u ---\n", ctx->frame_count + 1);
-            printf("Connection: %s:%u -> %s:%u\n", src_ip, src_port, dst_ip, dst_port);
-            modbus_display_frame(&frame);
-        } else {
-            // Table mode: compact single-line display
-            bool is_first = (ctx->frame_count == 0);
-            modbus_display_frame_table(&frame, src_ip, src_port, dst_ip, dst_port, ctx->frame_count + 1, timestamp, is_first);
+    const modbus_tcp_frame_t *frame = &record->frame;
+    uint16_t src_port = record->src_port;
+    int64_t timestamp_ns = record->timestamp_ns;
+
+    if (ctx->metrics) {
+        metrics_observe(ctx->metrics, record);
+    }
+
+    if (record->error != MODBUS_PARSE_OK) {
+        // Counted by the session; only the sampled ones are printed
+        if (record->log_error) {
+            modbus_log_parse_error(record->error,
+                                   modbus_session_endpoint_name(ctx->session, record->src_id),
+                                   src_port,
+                                   modbus_session_endpoint_name(ctx->session, record->dst_id),
+                                   record->dst_port, timestamp_ns, record->log_suppressed);
         }
-        
-        // Write to report if enabled
-        modbus_write_report_frame(&ctx->attack_stats, &frame, src_ip, src_port, 
-                                  dst_ip, dst_port, ctx->frame_count + 1, timestamp);
-
-        ctx->frame_count++;
-        // Track function code usage
-        ctx->function_counts[frame.function_code]++;
-        // Update attack detection statistics
-        modbus_update_attack_stats(&ctx->attack_stats, &frame, timestamp);
-        modbus_free_frame(&frame);
-    } else {
-        if (ctx->mode == DISPLAY_VERBOSE) {
-            printf("Failed to parse Modbus frame\n\n");
+        if (ctx->checkpoint.path && checkpoint_due(&ctx->checkpoint, ctx->session)) {
+            save_checkpoint(ctx);
         }
+        return true;
+    }
+
+    // Decode and evaluate detection rules once; the result goes to every output
+    decode_memo_t memo;
+    describe_frame(ctx, record, &memo);
+    sink_set_frame(&ctx->sinks, record, ctx->frame_count + 1, &memo.summary, &memo.rules);
+
+    ctx->frame_count++;
+    // Track function code usage
+    ctx->function_counts[frame->function_code]++;
+    // Update attack detection statistics
+    modbus_update_attack_stats(&ctx->attack_stats, frame, timestamp_ns);
+    anomaly_detector_update(&ctx->detector, frame, &record->src, record->src_id, src_port,
+                            &record->dst, record->dst_id, timestamp_ns);
+    poll_detector_update(&ctx->polls, frame, record->is_request, record->src_id, record->dst_id,
+                         timestamp_ns);
+    sketch_stats_update(&ctx->sketches, frame, &record->src, src_port);
+    timeseries_update(&ctx->timeseries, frame, record->is_request, timestamp_ns);
+    if (ctx->sample_mode == PCAP_SAMPLE_FLOWS) {
+        sample_clusters_add(&ctx->sample_clusters,
+                            pcap_sample_flow_key(&record->src, src_port, &record->dst,
+                                                 record->dst_port));
+    } else if (ctx->sample_mode == PCAP_SAMPLE_TIME) {
+        sample_clusters_add(&ctx->sample_clusters,
+                            (uint64_t)(timestamp_ns / 1000000000));
+    }
+    if (ctx->baseline_enabled &&
+        baseline_update(&ctx->baseline, frame, &record->src, src_port, &record->dst,
+                        timestamp_ns) &&
+        ctx->mode == DISPLAY_VERBOSE && !ctx->summary_only) {
+        printf("%sBaseline: request not in learned model%s\n", COLOR_YELLOW, COLOR_RESET);
     }
+    if (ctx->checkpoint.path && checkpoint_due(&ctx->checkpoint, ctx->session)) {
+        save_checkpoint(ctx);
+    }
+    return true;
 }
 
 
@@ -124,16 +374,72 @@ void process_modbus_payload(const uint8_t *payload, uint32_t length,
  */
 
 void print_usage(const char *program_name) {
-    printf("Usage: %s [options] <pcap_file>\n", program_name);
+    printf("Usage: %s [options] <pcap_file> [pcap_file...]\n", program_name);
+    printf("\nSeveral captures of the same traffic (one per tap) are merged by timestamp\n");
+    printf("and frames seen on more than one tap are decoded once.\n");
     printf("\nOptions:\n");
     printf("  -v, --verbose    Display detailed breakdown of each frame\n");
     printf("  -r, --report     Generate markdown analysis report\n");
+    printf("  -q, --summary-only\n");
+    printf("                   Print the summaries only, no per-frame output\n");
+    printf("  --jsonl FILE     Also write every frame to FILE as one JSON object per line\n");
+    printf("  --binary FILE    Also write every frame to FILE as a fixed-size binary record\n");
+    printf("  --timeseries FILE\n");
+    printf("                   Write per-second, per-minute and per-hour counts to FILE (CSV)\n");
+    printf("  --rules FILE     Load site-specific detection rules\n");
+    printf("  --learn FILE     Learn normal traffic and write a baseline model\n");
+    printf("  --baseline FILE  Report traffic that deviates from a baseline model\n");
+    printf("  --verify-baseline\n");
+    printf("                   Check every directory bucket of the model before the run\n");
+    printf("  --enip           Also decode EtherNet/IP and PCCC (TCP/UDP %d) in the same pass\n",
+           PCCC_ENIP_PORT);
+    printf("  --parse-log N    Log at most N parse errors per capture second\n");
+    printf("                   (default %d in verbose mode, 0 otherwise)\n",
+           MODBUS_PARSE_LOG_DEFAULT_RATE);
+    printf("  --sketch-mem KiB Memory budget for approximate statistics (default %d)\n",
+           SKETCH_DEFAULT_BUDGET / 1024);
+    printf("  --decode-cache N Frames remembered for decoding repeats, 0 disables (default %d)\n",
+           DECODE_CACHE_DEFAULT_ENTRIES);
+    printf("  --checkpoint FILE\n");
+    printf("                   Periodically save progress to FILE\n");
+    printf("  --checkpoint-every N\n");
+    printf("                   Checkpoint interval: bytes (512M, 2G) or time (30s, 5min, 1h)\n");
+    printf("                   (default %ds)\n", CHECKPOINT_DEFAULT_SECONDS);
+    printf("  --resume FILE    Continue an interrupted run from its checkpoint\n");
+    printf("  --io-backend NAME\n");
+    printf("                   Capture read path: libpcap (default), mmap or uring\n");
+    printf("  --io-depth N     uring reads kept in flight (default %d)\n",
+           PCAP_URING_DEFAULT_DEPTH);
+    printf("  --io-buffer KiB  uring bytes per read (default %u)\n",
+           PCAP_URING_DEFAULT_BUFFER / 1024);
+    printf("  --sample MODE:N  Decode about 1 in N packets, flows or capture seconds and\n");
+    printf("                   estimate the totals (MODE packets, flows or time)\n");
+    printf("  --merge-window MS\n");
+    printf("                   Drop copies from another tap up to MS apart, 0 keeps them\n");
+    printf("                   (default %d)\n", PCAP_MERGE_DEFAULT_WINDOW_MS);
+    printf("  --metrics-file FILE\n");
+    printf("                   Rewrite FILE with Prometheus metrics while running\n");
+    printf("  --metrics-interval N\n");
+    printf("                   Seconds between metrics file rewrites (default %d)\n",
+           METRICS_DEFAULT_INTERVAL);
+    printf("  --metrics-port N Serve Prometheus metrics on http://127.0.0.1:N/metrics\n");
     printf("  -h, --help       Show this help message\n");
     printf("\nExamples:\n");
     printf("  %s capture.pcap              # Table format (default)\n", program_name);
     printf("  %s -v capture.pcap           # Verbose format\n", program_name);
     printf("  %s -r capture.pcap           # Generate report\n", program_name);
     printf("  %s -v -r capture.pcap        # Verbose + report\n", program_name);
+    printf("  %s --learn base.bin normal.pcap\n", program_name);
+    printf("  %s --baseline base.bin today.pcap\n", program_name);
+    printf("  %s -r --enip plant.pcap\n", program_name);
+    printf("  %s -r --checkpoint week.ckpt week.pcap\n", program_name);
+    printf("  %s -r --resume week.ckpt week.pcap\n", program_name);
+    printf("  %s --io-backend uring --io-depth 32 archive.pcap\n", program_name);
+    printf("  %s -q --jsonl frames.jsonl capture.pcap\n", program_name);
+    printf("  %s -q --metrics-port 9502 week.pcap\n", program_name);
+    printf("  %s -q --timeseries traffic.csv week.pcap\n", program_name);
+    printf("  %s -q --sample flows:100 archive.pcap\n", program_name);
+    printf("  %s -r tap-a.pcap tap-b.pcap tap-c.pcap\n", program_name);
 }
 
 
@@ -171,7 +477,7 @@ void print_color_legend() {
  * 1. Parse command-line arguments (-v, -r, filename)
  * 2. Initialize processing context
  * 3. Open report file (if -r specified)
- * 4. Process PCAP via pcap_process_file()
+ * 4. Decode PCAP via a modbus_parse session (modbus_session_run())
  * 5. Display function code summary
  * 6. Display security analysis
  * 7. Finalize and close report
@@ -182,7 +488,25 @@ void print_color_legend() {
 int main(int argc, char *argv[]) {
     display_mode_t mode = DISPLAY_TABLE;  // Default to table format
     bool generate_report = false;
-    const char *filename = NULL;
+    bool summary_only = false;
+    const char *jsonl_file = NULL;
+    const char *binary_file = NULL;
+    const char *timeseries_file = NULL;
+    size_t sketch_budget = SKETCH_DEFAULT_BUDGET;
+    unsigned long decode_cache_entries = DECODE_CACHE_DEFAULT_ENTRIES;
+    const char *rules_file = NULL;
+    const char *learn_file = NULL;
+    const char *baseline_file = NULL;
+    bool verify_baseline = false;
+    bool enip = false;
+    long parse_log_rate = -1;
+    checkpoint_policy_t checkpoint = {0};
+    const char *resume_file = NULL;
+    pcap_reader_options_t io_options = { .backend = PCAP_IO_LIBPCAP };
+    metrics_export_options_t metrics_options = { .interval = METRICS_DEFAULT_INTERVAL };
+    const char *filenames[PCAP_MERGE_MAX_CAPTURES];
+    uint32_t capture_count = 0;
+    unsigned long merge_window = PCAP_MERGE_DEFAULT_WINDOW_MS;
 
     // Parse command line arguments
     for (int i = 1; i < argc; i++) {
@@ -190,6 +514,99 @@ int main(int argc, char *argv[]) {
             mode = DISPLAY_VERBOSE;
         } else if (strcmp(argv[i], "-r") == 0 || strcmp(argv[i], "--report") == 0) {
             generate_report = true;
+        } else if (strcmp(argv[i], "-q") == 0 || strcmp(argv[i], "--summary-only") == 0) {
+            summary_only = true;
+        } else if (strcmp(argv[i], "--jsonl") == 0 && i + 1 < argc) {
+            jsonl_file = argv[++i];
+        } else if (strcmp(argv[i], "--binary") == 0 && i + 1 < argc) {
+            binary_file = argv[++i];
+        } else if (strcmp(argv[i], "--timeseries") == 0 && i + 1 < argc) {
+            timeseries_file = argv[++i];
+        } else if (strcmp(argv[i], "--rules") == 0 && i + 1 < argc) {
+            rules_file = argv[++i];
+        } else if (strcmp(argv[i], "--learn") == 0 && i + 1 < argc) {
+            learn_file = argv[++i];
+        } else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+            baseline_file = argv[++i];
+        } else if (strcmp(argv[i], "--verify-baseline") == 0) {
+            verify_baseline = true;
+        } else if (strcmp(argv[i], "--enip") == 0) {
+            enip = true;
+        } else if (strcmp(argv[i], "--parse-log") == 0 && i + 1 < argc) {
+            parse_log_rate = strtol(argv[++i], NULL, 10);
+            if (parse_log_rate < 0) {
+                printf("Error: --parse-log must not be negative\n\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--sketch-mem") == 0 && i + 1 < argc) {
+            sketch_budget = (size_t)strtoul(argv[++i], NULL, 10) * 1024;
+            if (sketch_budget < SKETCH_MIN_BUDGET) {
+                printf("Error: --sketch-mem must be at least %d KiB\n\n", SKETCH_MIN_BUDGET / 1024);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--decode-cache") == 0 && i + 1 < argc) {
+            decode_cache_entries = strtoul(argv[++i], NULL, 10);
+            if (decode_cache_entries > DECODE_CACHE_MAX_ENTRIES) {
+                printf("Error: --decode-cache must be 0-%u\n\n", DECODE_CACHE_MAX_ENTRIES);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--checkpoint") == 0 && i + 1 < argc) {
+            checkpoint.path = argv[++i];
+        } else if (strcmp(argv[i], "--checkpoint-every") == 0 && i + 1 < argc) {
+            if (!checkpoint_parse_interval(argv[++i], &checkpoint)) {
+                printf("Error: Invalid --checkpoint-every value: %s\n\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--resume") == 0 && i + 1 < argc) {
+            resume_file = argv[++i];
+        } else if (strcmp(argv[i], "--io-backend") == 0 && i + 1 < argc) {
+            if (!pcap_io_backend_parse(argv[++i], &io_options.backend)) {
+                printf("Error: Unknown --io-backend: %s (libpcap, mmap or uring)\n\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--io-depth") == 0 && i + 1 < argc) {
+            unsigned long depth = strtoul(argv[++i], NULL, 10);
+            if (depth < 1 || depth > PCAP_URING_MAX_DEPTH) {
+                printf("Error: --io-depth must be 1-%d\n\n", PCAP_URING_MAX_DEPTH);
+                return 1;
+            }
+            io_options.queue_depth = (uint32_t)depth;
+        } else if (strcmp(argv[i], "--io-buffer") == 0 && i + 1 < argc) {
+            unsigned long kib = strtoul(argv[++i], NULL, 10);
+            if (kib < PCAP_URING_MIN_BUFFER / 1024 || kib > PCAP_URING_MAX_BUFFER / 1024) {
+                printf("Error: --io-buffer must be %d-%u KiB\n\n", PCAP_URING_MIN_BUFFER / 1024,
+                       PCAP_URING_MAX_BUFFER / 1024);
+                return 1;
+            }
+            io_options.buffer_size = (uint32_t)(kib * 1024);
+        } else if (strcmp(argv[i], "--sample") == 0 && i + 1 < argc) {
+            if (!pcap_sample_parse(argv[++i], &io_options.sample)) {
+                printf("Error: Invalid --sample value: %s (packets:N, flows:N or time:N, "
+                       "N 2-%d)\n\n", argv[i], PCAP_SAMPLE_MAX_RATE);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--merge-window") == 0 && i + 1 < argc) {
+            merge_window = strtoul(argv[++i], NULL, 10);
+            if (merge_window > PCAP_MERGE_MAX_WINDOW_MS) {
+                printf("Error: --merge-window must be 0-%d ms\n\n", PCAP_MERGE_MAX_WINDOW_MS);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--metrics-file") == 0 && i + 1 < argc) {
+            metrics_options.path = argv[++i];
+        } else if (strcmp(argv[i], "--metrics-interval") == 0 && i + 1 < argc) {
+            unsigned long seconds = strtoul(argv[++i], NULL, 10);
+            if (seconds < 1 || seconds > 86400) {
+                printf("Error: --metrics-interval must be 1-86400 seconds\n\n");
+                return 1;
+            }
+            metrics_options.interval = (uint32_t)seconds;
+        } else if (strcmp(argv[i], "--metrics-port") == 0 && i + 1 < argc) {
+            unsigned long port = strtoul(argv[++i], NULL, 10);
+            if (port < 1 || port > 65535) {
+                printf("Error: --metrics-port must be 1-65535\n\n");
+                return 1;
+            }
+            metrics_options.port = (uint16_t)port;
         } else if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
             print_usage(argv[0]);
             return 0;
@@ -197,75 +614,423 @@ int main(int argc, char *argv[]) {
             printf("Unknown option: %s\n\n", argv[i]);
             print_usage(argv[0]);
             return 1;
+        } else if (capture_count == PCAP_MERGE_MAX_CAPTURES) {
+            printf("Error: At most %d PCAP files can be merged\n\n", PCAP_MERGE_MAX_CAPTURES);
+            return 1;
         } else {
-            filename = argv[i];
+            filenames[capture_count++] = argv[i];
         }
     }
 
-    if (filename == NULL) {
+    if (capture_count == 0) {
         printf("Error: No PCAP file specified\n\n");
         print_usage(argv[0]);
         return 1;
     }
 
+    // The checkpoint and report are named after the first capture
+    const char *filename = filenames[0];
+    bool merged = capture_count > 1;
+
+    // A checkpoint holds one file offset; a merge has one per capture
+    if (merged && (checkpoint.path || resume_file)) {
+        printf("Error: --checkpoint and --resume cannot be used with several PCAP files\n\n");
+        return 1;
+    }
+
+    // Payloads go to protocol handlers before copies from other taps are dropped
+    if (merged && enip) {
+        printf("Error: --enip cannot be used with several PCAP files\n\n");
+        return 1;
+    }
+
+    // Shown in place of the file name: all merged captures
+    char sources[1024];
+    snprintf(sources, sizeof(sources), "%s", filename);
+    for (uint32_t i = 1; i < capture_count; i++) {
+        size_t used = strlen(sources);
+        snprintf(sources + used, sizeof(sources) - used, ", %s", filenames[i]);
+    }
+
+    if (learn_file && baseline_file) {
+        printf("Error: --learn and --baseline cannot be combined\n\n");
+        return 1;
+    }
+
+    // A model learned from a sample would flag the traffic it skipped
+    if (learn_file && io_options.sample.mode != PCAP_SAMPLE_NONE) {
+        printf("Error: --learn cannot be combined with --sample\n\n");
+        return 1;
+    }
+
+    // Frame files are rewritten from the start; a resumed run would lose the head
+    if ((jsonl_file || binary_file || timeseries_file) && (checkpoint.path || resume_file)) {
+        printf("Error: --jsonl, --binary and --timeseries cannot be combined with --checkpoint "
+               "or --resume\n\n");
+        return 1;
+    }
+
+    // A resumed run keeps checkpointing to the file it resumed from
+    if (resume_file && !checkpoint.path) {
+        checkpoint.path = resume_file;
+    }
+    if (parse_log_rate < 0) {
+        parse_log_rate = mode == DISPLAY_VERBOSE ? MODBUS_PARSE_LOG_DEFAULT_RATE : 0;
+    }
+
+    // Everything that changes the output must match on resume
+    char checkpoint_config[1536];
+    snprintf(checkpoint_config, sizeof(checkpoint_config),
+             "mode=%d report=%d sketch=%zu parse_log=%ld rules=%s learn=%s baseline=%s "
+             "sample=%d:%u enip=%d decode_cache=%lu",
+             (int)mode, (int)generate_report, sketch_budget, parse_log_rate,
+             rules_file ? rules_file : "-", learn_file ? learn_file : "-",
+             baseline_file ? baseline_file : "-", (int)io_options.sample.mode,
+             io_options.sample.rate, (int)enip, decode_cache_entries);
+
     printf("Modbus TCP Parser\n");
     printf("=================\n\n");
-    printf("Processing PCAP file: %s\n", filename);
-    printf("Mode: %s\n", mode == DISPLAY_VERBOSE ? "Verbose" : "Table");
+    if (merged) {
+        printf("Merging %u PCAP files by timestamp: %s\n", capture_count, sources);
+        if (merge_window > 0) {
+            printf("Duplicate window: %lu ms across taps\n", merge_window);
+        } else {
+            printf("Duplicate window: off, frames seen on several taps are counted once per tap\n");
+        }
+    } else {
+        printf("Processing PCAP file: %s\n", filename);
+    }
+    printf("Mode: %s\n", summary_only ? "Summary only" : mode == DISPLAY_VERBOSE ? "Verbose" : "Table");
+    if (io_options.sample.mode != PCAP_SAMPLE_NONE) {
+        printf("Sampling: 1 in %u %s; function and security counts are estimated, other "
+               "summaries cover the sample only\n", io_options.sample.rate,
+               pcap_sample_name(io_options.sample.mode));
+    }
 
-    if (mode == DISPLAY_TABLE) {
+    if (mode == DISPLAY_TABLE && !summary_only) {
         print_color_legend();
     }
 
     // Create processing context
     process_context_t ctx = {
         .mode = mode,
+        .summary_only = summary_only,
         .frame_count = 0,
         .function_counts = {0},
-        .attack_stats = {0} // Initialise all counts to zero}
+        .attack_stats = {0}, // Initialise all counts to zero}
+        .enip_enabled = enip,
+        .checkpoint = checkpoint,
+        .checkpoint_config = checkpoint_config,
+        .filename = filename
     };
+    if (io_options.sample.mode != PCAP_SAMPLE_NONE) {
+        ctx.attack_stats.sample_rate = io_options.sample.rate;
+    }
+
+    if (!anomaly_detector_init(&ctx.detector, NULL)) {
+        return 1;
+    }
+    if (!poll_detector_init(&ctx.polls)) {
+        anomaly_detector_free(&ctx.detector);
+        return 1;
+    }
+    if (!sketch_stats_init(&ctx.sketches, sketch_budget)) {
+        printf("Error: Could not allocate sketches\n");
+        anomaly_detector_free(&ctx.detector);
+        poll_detector_free(&ctx.polls);
+        return 1;
+    }
+    if (!timeseries_init(&ctx.timeseries) ||
+        (timeseries_file && !timeseries_export(&ctx.timeseries, timeseries_file))) {
+        anomaly_detector_free(&ctx.detector);
+        poll_detector_free(&ctx.polls);
+        sketch_stats_free(&ctx.sketches);
+        timeseries_free(&ctx.timeseries);
+        return 1;
+    }
+    if (rules_file) {
+        if (!rule_engine_load(&ctx.rules, rules_file)) {
+            anomaly_detector_free(&ctx.detector);
+            poll_detector_free(&ctx.polls);
+            sketch_stats_free(&ctx.sketches);
+            timeseries_free(&ctx.timeseries);
+            return 1;
+        }
+        printf("Rules: %u loaded from %s\n", ctx.rules.rule_count, rules_file);
+    }
+    if (learn_file || baseline_file) {
+        bool ok = learn_file ? baseline_init_learn(&ctx.baseline, learn_file)
+                             : baseline_load(&ctx.baseline, baseline_file, verify_baseline);
+        if (!ok) {
+            anomaly_detector_free(&ctx.detector);
+            poll_detector_free(&ctx.polls);
+            sketch_stats_free(&ctx.sketches);
+            timeseries_free(&ctx.timeseries);
+            rule_engine_free(&ctx.rules);
+            return 1;
+        }
+        ctx.baseline_enabled = true;
+        if (baseline_file) {
+            printf("Baseline: %llu tuples loaded from %s\n",
+                   (unsigned long long)ctx.baseline.header->tuple_count, baseline_file);
+        }
+    }
+
+    // Counters for --metrics-file/--metrics-port, filled by process_record()
+    metrics_t metrics;
+    metrics_init(&metrics);
+    if (metrics_options.path || metrics_options.port) {
+        ctx.metrics = metrics_shard_acquire(&metrics);
+        if (!ctx.metrics) {
+            printf("Error: Could not allocate metrics\n");
+        }
+        if (!ctx.metrics || !metrics_export_start(&metrics, &metrics_options)) {
+            metrics_free(&metrics);
+            anomaly_detector_free(&ctx.detector);
+            poll_detector_free(&ctx.polls);
+            sketch_stats_free(&ctx.sketches);
+            timeseries_free(&ctx.timeseries);
+            rule_engine_free(&ctx.rules);
+            baseline_free(&ctx.baseline);
+            return 1;
+        }
+        if (metrics_options.port) {
+            printf("Metrics: http://127.0.0.1:%u/metrics\n", metrics_options.port);
+        }
+    }
     
-        // Open report file if requested
-        if (generate_report) {
+        // Open report file if requested (a resumed run reopens it later)
+        if (generate_report && !resume_file) {
         if (!modbus_open_report(&ctx.attack_stats, filename)) {
             printf("Warning: Report generation disabled due to file error\n");
             generate_report = false;
         } else {
-            modbus_write_report_header(&ctx.attack_stats, filename);
+            modbus_write_report_header(&ctx.attack_stats, sources);
+        }
+    }
+
+
+    // Flow and time samples keep frames in clusters, which widens the intervals
+    if (io_options.sample.mode == PCAP_SAMPLE_FLOWS || io_options.sample.mode == PCAP_SAMPLE_TIME) {
+        if (sample_clusters_init(&ctx.sample_clusters)) {
+            ctx.sample_mode = io_options.sample.mode;
+        } else {
+            printf("Warning: Could not allocate sampling statistics, intervals assume "
+                   "independent frames\n");
         }
     }
 
+    // Open decoding session; failed payloads are returned for logging
+    char errbuf[256];
+    modbus_session_t *session;
+    if (merged) {
+        session = modbus_session_open_merged(filenames, capture_count,
+                                             MODBUS_SESSION_INCLUDE_ERRORS, &io_options,
+                                             (uint32_t)merge_window, errbuf, sizeof(errbuf));
+    } else {
+        session = modbus_session_open_with(filename, MODBUS_SESSION_INCLUDE_ERRORS, &io_options,
+                                           errbuf, sizeof(errbuf));
+    }
+    bool processed = false;
+    if (session == NULL) {
+        printf("Error opening PCAP file: %s\n", errbuf);
+    } else {
+        modbus_parse_errors_init(modbus_session_parse_errors(session), (uint32_t)parse_log_rate);
+        ctx.session = session;
+
+        // One terminal sink, then the file outputs
+        output_sink_t sink;
+        sink_set_init(&ctx.sinks, session);
+        if (summary_only) {
+            sink_init_null(&sink);
+        } else if (mode == DISPLAY_VERBOSE) {
+            sink_init_verbose(&sink);
+        } else {
+            sink_init_table(&sink);
+        }
+        sink_set_add(&ctx.sinks, &sink);
+        if (generate_report) {
+            sink_init_markdown(&sink, &ctx.attack_stats);
+            sink_set_add(&ctx.sinks, &sink);
+        }
+        if (jsonl_file) {
+            sink_init_jsonl(&sink, jsonl_file);
+            sink_set_add(&ctx.sinks, &sink);
+        }
+        if (binary_file) {
+            sink_init_binary(&sink, binary_file);
+            sink_set_add(&ctx.sinks, &sink);
+        }
+
+        // Memoise decoding only when an output shows the decoded PDU; rule
+        // matching alone is cheaper than a lookup and store
+        if (decode_cache_entries > 0 &&
+            (ctx.sinks.fields & (SINK_FIELD_NAMES | SINK_FIELD_DETAILS | SINK_FIELD_RULES))) {
+            ctx.decode_cache_enabled = decode_cache_init(&ctx.decode_cache,
+                                                         (uint32_t)decode_cache_entries);
+            if (!ctx.decode_cache_enabled) {
+                printf("Warning: Could not allocate the decode cache, decoding every frame\n");
+            }
+        }
+
+        // EtherNet/IP is decoded from the same read of the capture
+        bool protocols_added = true;
+        if (ctx.enip_enabled) {
+            pccc_init_analysis_stats(&ctx.pccc);
+            protocols_added =
+                modbus_session_add_protocol(session, PCAP_TRANSPORT_TCP, PCCC_ENIP_PORT,
+                                            pccc_handle_payload, &ctx.pccc) &&
+                modbus_session_add_protocol(session, PCAP_TRANSPORT_UDP, PCCC_ENIP_PORT,
+                                            pccc_handle_payload, &ctx.pccc);
+            if (!protocols_added) {
+                printf("Error: %s\n", modbus_session_error(session));
+            }
+        }
+
+        if (protocols_added && sink_set_begin(&ctx.sinks) &&
+            (!resume_file || resume_checkpoint(&ctx, resume_file, &generate_report))) {
+            printf("Processing PCAP file: %s\n", sources);
+            if (ctx.enip_enabled) {
+                printf("Looking for Modbus TCP traffic (port %d) and EtherNet/IP (port %d)...\n\n",
+                       MODBUS_SESSION_PORT, PCCC_ENIP_PORT);
+            } else {
+                printf("Looking for Modbus TCP traffic (port %d)...\n\n", MODBUS_SESSION_PORT);
+            }
+
+            // Process PCAP file
+            if (ctx.checkpoint.path && !checkpoint_policy_start(&ctx.checkpoint, session)) {
+                printf("Warning: Capture is not seekable, checkpointing disabled\n");
+                ctx.checkpoint.path = NULL;
+            }
+            processed = modbus_session_run(session, process_record, &ctx);
+            if (!processed) {
+                printf("Error reading packet: %s\n", modbus_session_error(session));
+            }
+        }
+    }
 
-    // Process PCAP file
-    if (!pcap_process_file(filename, process_modbus_payload, &ctx)) {
+    if (!processed) {
         printf("Failed to process PCAP file\n");
+        sink_set_end(&ctx.sinks);
+        metrics_free(&metrics);
+        modbus_session_close(session);
+        decode_cache_free(&ctx.decode_cache);
+        anomaly_detector_free(&ctx.detector);
+        poll_detector_free(&ctx.polls);
+        sketch_stats_free(&ctx.sketches);
+        timeseries_free(&ctx.timeseries);
+        rule_engine_free(&ctx.rules);
+        baseline_free(&ctx.baseline);
+        sample_clusters_free(&ctx.sample_clusters);
         return 1;
     }
 
+    sink_set_end(&ctx.sinks);
+    metrics_export_stop(&metrics);
+    if (ctx.baseline_enabled && !baseline_finish(&ctx.baseline)) {
+        printf("Warning: Baseline model was not saved\n");
+    }
+    timeseries_finish(&ctx.timeseries);
+    if (ctx.sample_mode != PCAP_SAMPLE_NONE) {
+        ctx.attack_stats.sample_design_effect =
+            sample_clusters_design_effect(&ctx.sample_clusters);
+        if (ctx.sample_clusters.truncated) {
+            printf("Warning: Too many sampled flows or seconds; design effect is approximate\n");
+        }
+    }
+
     printf("\n%sTotal Modbus frames processed: %u%s\n", COLOR_WHITE, ctx.frame_count, COLOR_RESET);
+    modbus_display_parse_errors(modbus_session_parse_errors(session));
+
+    capture_input_stats_t input_stats;
+    if (modbus_session_input_stats(session, &input_stats)) {
+        modbus_display_input_stats(&input_stats);
+    }
+    pcap_merge_stats_t merge_stats;
+    if (modbus_session_merge_stats(session, &merge_stats)) {
+        modbus_display_merge_stats(&merge_stats, filenames);
+    }
+    if (ctx.decode_cache_enabled) {
+        decode_cache_display_summary(&ctx.decode_cache);
+    }
+    if (mode == DISPLAY_VERBOSE) {
+        modbus_display_memory_stats(arena_stats(modbus_session_arena(session)));
+    }
 
     // Display function code summary
     printf("\n%sFunction Code Summary:%s\n", COLOR_WHITE, COLOR_RESET);
-    printf("%s%-40s %s%s\n", COLOR_WHITE, "Function", "Count", COLOR_RESET);
+    printf("%s%-40s %s%s\n", COLOR_WHITE, "Function",
+           ctx.attack_stats.sample_rate > 1 ? "Estimated Count" : "Count", COLOR_RESET);
     printf("%s--------------------------------------------------------%s\n", COLOR_GRAY, COLOR_RESET);
     
     for (int i = 0; i < 256; i++) {
         if (ctx.function_counts[i] > 0) {
-            printf("%s%-40s %s%u%s\n",
+            char count[64];
+            modbus_format_estimate(count, sizeof(count), ctx.function_counts[i],
+                                   ctx.attack_stats.sample_rate,
+                                   ctx.attack_stats.sample_design_effect);
+            printf("%s%-40s %s%s%s\n",
             COLOR_MAGENTA, modbus_get_function_name(i),
-            COLOR_CYAN, ctx.function_counts[i], COLOR_RESET);
+            COLOR_CYAN, count, COLOR_RESET);
         }
     }
 
     // Display attack detection summary
     modbus_display_attack_summary(&ctx.attack_stats);
+    anomaly_display_summary(&ctx.detector);
+    poll_display_summary(&ctx.polls, session);
+    sketch_display_summary(&ctx.sketches);
+    timeseries_display_summary(&ctx.timeseries);
+    if (rules_file) {
+        rule_display_summary(&ctx.rules);
+    }
+    if (ctx.baseline_enabled) {
+        baseline_display_summary(&ctx.baseline);
+    }
+    if (ctx.enip_enabled) {
+        pccc_display_summary(&ctx.pccc);
+    }
 
         // Finalize report if enabled
     if (generate_report) {
         modbus_write_report_summary(&ctx.attack_stats, ctx.function_counts);
+        modbus_write_report_parse_errors(modbus_session_parse_errors(session),
+                                         ctx.attack_stats.report_file);
+        if (merged) {
+            modbus_write_report_merge_stats(&merge_stats, filenames, ctx.attack_stats.report_file);
+        }
+        anomaly_write_report(&ctx.detector, ctx.attack_stats.report_file);
+        poll_write_report(&ctx.polls, session, ctx.attack_stats.report_file);
+        sketch_write_report(&ctx.sketches, ctx.attack_stats.report_file);
+        timeseries_write_report(&ctx.timeseries, ctx.attack_stats.report_file);
+        if (rules_file) {
+            rule_write_report(&ctx.rules, ctx.attack_stats.report_file);
+        }
+        if (ctx.baseline_enabled) {
+            baseline_write_report(&ctx.baseline, ctx.attack_stats.report_file);
+        }
+        if (ctx.enip_enabled) {
+            pccc_write_report(&ctx.pccc, ctx.attack_stats.report_file);
+        }
         modbus_close_report(&ctx.attack_stats);
         printf("\nReport generation complete.\n");
     }
+
+    // The run is complete; its checkpoint can no longer be resumed
+    if (ctx.checkpoint.path) {
+        remove(ctx.checkpoint.path);
+    }
+
+    anomaly_detector_free(&ctx.detector);
+    poll_detector_free(&ctx.polls);
+    sketch_stats_free(&ctx.sketches);
+    timeseries_free(&ctx.timeseries);
+    rule_engine_free(&ctx.rules);
+    baseline_free(&ctx.baseline);
+    metrics_free(&metrics);
+    modbus_session_close(session);
+    decode_cache_free(&ctx.decode_cache);
+    sample_clusters_free(&ctx.sample_clusters);
     
     return 0;
 }
@@ -0,0 +1,282 @@
+/*
+ * mbap_batch.c - MBAP header validation over batches of payloads
+ *
+ * Both kernels apply the checks of modbus_parse_frame_arena() that
+ * decide MODBUS_PARSE_OK, in the same order of meaning:
+ * - at least MBAP_HEADER_BYTES captured
+ * - protocol id 0
+ * - MBAP length 2-254
+ * - 6 + length within the captured bytes
+ * plus the known-function test of mbap_lanes_t.known. The AVX2 kernel
+ * byte-swaps each header into four big-endian words
+ * (transaction id, protocol id, length, function code | unit id << 8)
+ * and checks four headers per vector, two vectors per step.
+ *
+ * Copyright (C) 2025 Marty
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+
+#include "mbap_batch.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+    #define MBAP_HAVE_AVX2 1
+    #include <immintrin.h>
+#endif
+
+
+/* Bytes of a candidate that are read: MBAP header plus function code */
+#define MBAP_HEADER_BYTES 8
+
+/* MBAP length bounds and the offset it counts from (see modbus_parser.c) */
+#define MBAP_LENGTH_MIN 2
+#define MBAP_LENGTH_MAX 254
+#define MBAP_LENGTH_OFFSET 6
+
+/* Defined function codes: 0x01-0x18 and 0x2B (see modbus_get_function_name()) */
+#define MBAP_FUNCTION_FIRST 0x01
+#define MBAP_FUNCTION_LAST 0x18
+#define MBAP_FUNCTION_EIT 0x2B
+
+
+/*
+ * function_known() - Whether a function code (exception bit ignored) is defined
+ */
+
+static inline bool function_known(uint8_t function_code) {
+    uint8_t function = function_code & 0x7F;
+    return (uint8_t)(function - MBAP_FUNCTION_FIRST) <= MBAP_FUNCTION_LAST - MBAP_FUNCTION_FIRST ||
+           function == MBAP_FUNCTION_EIT;
+}
+
+
+/*
+ * validate_scalar() - Scalar kernel over lanes @first to @count - 1
+ *
+ * Sets the mask bits of valid lanes; the masks must be cleared first.
+ */
+
+static void validate_scalar(const uint8_t *const *payloads, const uint32_t *lengths,
+                            uint32_t first, uint32_t count, mbap_lanes_t *lanes) {
+    for (uint32_t i = first; i < count; i++) {
+        const uint8_t *p = payloads[i];
+        if (lengths[i] < MBAP_HEADER_BYTES) {
+            lanes->transaction_id[i] = 0;
+            lanes->length[i] = 0;
+            lanes->unit_id[i] = 0;
+            lanes->function_code[i] = 0;
+            continue;
+        }
+
+        uint16_t protocol_id = (uint16_t)((p[2] << 8) | p[3]);
+        uint16_t length = (uint16_t)((p[4] << 8) | p[5]);
+        lanes->transaction_id[i] = (uint16_t)((p[0] << 8) | p[1]);
+        lanes->length[i] = length;
+        lanes->unit_id[i] = p[6];
+        lanes->function_code[i] = p[7];
+
+        if (protocol_id == 0 && length >= MBAP_LENGTH_MIN && length <= MBAP_LENGTH_MAX &&
+            MBAP_LENGTH_OFFSET + (uint32_t)length <= lengths[i]) {
+            lanes->valid |= 1ULL << i;
+            if (function_known(p[7])) {
+                lanes->known |= 1ULL << i;
+            }
+        }
+    }
+}
+
+
+/**
+ * mbap_validate_batch_scalar() - mbap_validate_batch() without SIMD
+ * @payloads: Candidate payloads (MBAP header first)
+ * @lengths: Captured bytes of each payload
+ * @count: Candidates (at most MBAP_BATCH_LANES)
+ * @lanes: Output lanes and masks
+ */
+
+void mbap_validate_batch_scalar(const uint8_t *const *payloads, const uint32_t *lengths,
+                                uint32_t count, mbap_lanes_t *lanes) {
+    if (count > MBAP_BATCH_LANES) {
+        count = MBAP_BATCH_LANES;
+    }
+    lanes->valid = 0;
+    lanes->known = 0;
+    validate_scalar(payloads, lengths, 0, count, lanes);
+}
+
+
+#ifdef MBAP_HAVE_AVX2
+
+/*
+ * check_four_avx2() - Load and check the headers of four candidates
+ * @header: Output: each 64-bit lane holds the byte-swapped words
+ *          transaction id, protocol id, length, function code | unit id << 8
+ *
+ * Headers of candidates with at least eight bytes are fetched with one
+ * masked 64-bit gather (base 0, the payload pointers as indices); the
+ * other lanes stay zero and are never read.
+ *
+ * Return: Valid bits in 0-3, known bits in 4-7
+ */
+
+__attribute__((target("avx2")))
+static inline uint32_t check_four_avx2(const uint8_t *const *payloads, const uint32_t *lengths,
+                                       __m256i *header) {
+    // Byte-swap every 16-bit word of each header
+    const __m256i swap = _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+                                          1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+    // Words checked per header: 1 = protocol id, 2 = length; 0 and 3 pass
+    const __m256i word1 = _mm256_set1_epi64x(0x00000000FFFF0000LL);
+    const __m256i word2 = _mm256_set1_epi64x(0x0000FFFF00000000LL);
+    const __m256i pass = _mm256_set1_epi64x((long long)0xFFFF00000000FFFFULL);
+    const __m256i ones = _mm256_set1_epi64x(-1);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i length_min = _mm256_set1_epi16(MBAP_LENGTH_MIN);
+    const __m256i length_max = _mm256_set1_epi16(MBAP_LENGTH_MAX);
+    const __m256i offset = _mm256_set1_epi16(MBAP_LENGTH_OFFSET);
+    const __m128i header_bytes = _mm_set1_epi32(MBAP_HEADER_BYTES - 1);
+    const __m128i max_word = _mm_set1_epi32(0xFFFF);
+    const __m256i function_mask = _mm256_set1_epi16(0x7F);
+    const __m256i function_first = _mm256_set1_epi16(MBAP_FUNCTION_FIRST);
+    const __m256i function_span = _mm256_set1_epi16(MBAP_FUNCTION_LAST - MBAP_FUNCTION_FIRST);
+    const __m256i function_eit = _mm256_set1_epi16(MBAP_FUNCTION_EIT);
+    const __m256i function_pass = _mm256_set1_epi64x((long long)0xFFFFFFFFFFFF0000ULL);
+
+    __m128i caplen = _mm_loadu_si128((const __m128i *)lengths);
+    // Lengths above 0x7FFFFFFF would compare negative; a payload is never that long
+    __m256i readable = _mm256_cvtepi32_epi64(_mm_cmpgt_epi32(caplen, header_bytes));
+    __m256i addresses = _mm256_loadu_si256((const __m256i *)payloads);
+    __m256i raw = _mm256_mask_i64gather_epi64(zero, (const long long *)0, addresses, readable, 1);
+    __m256i words = _mm256_shuffle_epi8(raw, swap);
+
+    // Captured bytes minus the length offset, saturated, in word 2
+    __m256i room = _mm256_cvtepu32_epi64(_mm_min_epu32(caplen, max_word));
+    room = _mm256_subs_epu16(_mm256_slli_epi64(room, 32), offset);
+
+    __m256i protocol_ok = _mm256_cmpeq_epi16(words, zero);
+    __m256i length_ok = _mm256_and_si256(
+        _mm256_cmpeq_epi16(_mm256_max_epu16(words, length_min), words),
+        _mm256_cmpeq_epi16(_mm256_min_epu16(words, length_max), words));
+    length_ok = _mm256_and_si256(length_ok,
+                                 _mm256_cmpeq_epi16(_mm256_max_epu16(words, room), room));
+
+    __m256i checks = _mm256_or_si256(pass, _mm256_or_si256(
+        _mm256_and_si256(protocol_ok, word1), _mm256_and_si256(length_ok, word2)));
+    __m256i valid = _mm256_and_si256(_mm256_cmpeq_epi64(checks, ones), readable);
+
+    // Function code is the low byte of word 3; shifted down, it is checked in word 0
+    __m256i function = _mm256_and_si256(_mm256_srli_epi64(words, 48), function_mask);
+    __m256i index = _mm256_sub_epi16(function, function_first);
+    __m256i known = _mm256_or_si256(
+        _mm256_cmpeq_epi16(_mm256_min_epu16(index, function_span), index),
+        _mm256_cmpeq_epi16(function, function_eit));
+    known = _mm256_cmpeq_epi64(_mm256_or_si256(known, function_pass), ones);
+    known = _mm256_and_si256(known, valid);
+
+    *header = words;
+    return (uint32_t)_mm256_movemask_pd(_mm256_castsi256_pd(valid)) |
+           (uint32_t)_mm256_movemask_pd(_mm256_castsi256_pd(known)) << 4;
+}
+
+
+/*
+ * validate_avx2() - AVX2 kernel
+ *
+ * Eight candidates per step. The two header vectors are transposed into
+ * eight transaction ids, lengths, function codes and unit ids and
+ * stored with four vector stores. A tail of fewer than eight candidates
+ * goes through the scalar kernel, after the upper register halves are
+ * cleared.
+ */
+
+__attribute__((target("avx2")))
+static void validate_avx2(const uint8_t *const *payloads, const uint32_t *lengths, uint32_t count,
+                          mbap_lanes_t *lanes) {
+    // Per 128-bit half: words of header 0 and 1 grouped by field
+    const __m256i group = _mm256_setr_epi8(0, 1, 8, 9, 2, 3, 10, 11, 4, 5, 12, 13, 6, 7, 14, 15,
+                                           0, 1, 8, 9, 2, 3, 10, 11, 4, 5, 12, 13, 6, 7, 14, 15);
+    // Field pairs of both halves side by side: 64 bits per field, four headers
+    const __m256i interleave = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    // Function codes (even bytes) then unit ids (odd bytes)
+    const __m128i split = _mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15);
+    uint64_t valid = 0;
+    uint64_t known = 0;
+    uint32_t base = 0;
+
+    for (; base + 8 <= count; base += 8) {
+        __m256i low, high;
+        uint32_t bits_low = check_four_avx2(&payloads[base], &lengths[base], &low);
+        uint32_t bits_high = check_four_avx2(&payloads[base + 4], &lengths[base + 4], &high);
+
+        valid |= (uint64_t)((bits_low & 0xF) | (bits_high & 0xF) << 4) << base;
+        known |= (uint64_t)((bits_low >> 4) | (bits_high >> 4) << 4) << base;
+
+        // [tx, protocol, length, function|unit] x 4 -> one field x 8 per 128 bits
+        low = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(low, group), interleave);
+        high = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(high, group), interleave);
+        __m256i even = _mm256_unpacklo_epi64(low, high);  // transaction ids | lengths
+        __m256i odd = _mm256_unpackhi_epi64(low, high);   // protocol ids | function|unit
+        __m128i codes = _mm_shuffle_epi8(_mm256_extracti128_si256(odd, 1), split);
+
+        _mm_storeu_si128((__m128i *)&lanes->transaction_id[base], _mm256_castsi256_si128(even));
+        _mm_storeu_si128((__m128i *)&lanes->length[base], _mm256_extracti128_si256(even, 1));
+        _mm_storel_epi64((__m128i *)&lanes->function_code[base], codes);
+        _mm_storel_epi64((__m128i *)&lanes->unit_id[base], _mm_srli_si128(codes, 8));
+    }
+
+    // GCC does not always emit this before the tail call; dirty upper halves slow SSE code
+    _mm256_zeroupper();
+    lanes->valid = valid;
+    lanes->known = known;
+    validate_scalar(payloads, lengths, base, count, lanes);
+}
+
+#endif /* MBAP_HAVE_AVX2 */
+
+
+/*
+ * avx2_available() - Whether the CPU runs the AVX2 kernel
+ */
+
+static bool avx2_available(void) {
+#ifdef MBAP_HAVE_AVX2
+    // The CPU model is read once at startup; this only tests a flag
+    return __builtin_cpu_supports("avx2") != 0;
+#else
+    return false;
+#endif
+}
+
+
+/**
+ * mbap_validate_batch() - Validate the MBAP headers of a batch
+ * @payloads: Candidate payloads (MBAP header first)
+ * @lengths: Captured bytes of each payload
+ * @count: Candidates (at most MBAP_BATCH_LANES)
+ * @lanes: Output lanes and masks
+ */
+
+void mbap_validate_batch(const uint8_t *const *payloads, const uint32_t *lengths, uint32_t count,
+                         mbap_lanes_t *lanes) {
+#ifdef MBAP_HAVE_AVX2
+    if (avx2_available()) {
+        if (count > MBAP_BATCH_LANES) {
+            count = MBAP_BATCH_LANES;
+        }
+        validate_avx2(payloads, lengths, count, lanes);
+        return;
+    }
+#endif
+    mbap_validate_batch_scalar(payloads, lengths, count, lanes);
+}
+
+
+/**
+ * mbap_batch_kernel() - Kernel used by mbap_validate_batch()
+ *
+ * Return: "avx2" or "scalar"
+ */
+
+const char *mbap_batch_kernel(void) {
+    return avx2_available() ? "avx2" : "scalar";
+}
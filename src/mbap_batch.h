@@ -0,0 +1,100 @@
+/*
+ * mbap_batch.h - MBAP header validation over batches of payloads
+ *
+ * modbus_parse_frame_checked() validates one payload at a time with a
+ * chain of branches. For a batch of candidate payloads (for example one
+ * pcap_batch_t) the first eight bytes of every candidate are loaded and
+ * the header checks run on all of them at once: protocol id 0, MBAP
+ * length 2-254, ADU within the captured bytes, and a known function
+ * code. The result is a bitmask of valid candidates plus the decoded
+ * transaction id, length, unit id and function code of each lane, so
+ * port-502 traffic that is not Modbus is rejected in bulk and only the
+ * rejected lanes need the scalar parser to classify the failure.
+ *
+ * On x86-64 with GCC or Clang an AVX2 kernel (four headers per vector,
+ * gathered with one instruction) is selected at run time when the CPU
+ * has AVX2; elsewhere a portable scalar kernel with the same results is
+ * used.
+ *
+ * Part of the modbus_parse library; nothing is printed.
+ *
+ * Copyright (C) 2025 Marty
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef MBAP_BATCH_H
+#define MBAP_BATCH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+/* Candidates per mbap_validate_batch() call (bits in the result masks) */
+#define MBAP_BATCH_LANES 64
+
+
+/**
+ * struct mbap_lanes_t - Decoded headers of up to MBAP_BATCH_LANES candidates
+ * @transaction_id: MBAP transaction id per lane
+ * @length: MBAP length field per lane
+ * @unit_id: MBAP unit id per lane
+ * @function_code: Function code per lane (exception bit kept)
+ * @valid: Bit i set if lane i is a complete, well-formed ADU, i.e. one
+ *         that modbus_parse_frame_checked() accepts
+ * @known: Bit i set if lane i is valid and its function code, without
+ *         the exception bit, is a defined Modbus function
+ *
+ * Lanes of candidates shorter than eight bytes are zero; the other
+ * lanes are decoded whether or not they are valid. Lanes at or beyond
+ * the candidate count are not written.
+ */
+
+typedef struct {
+    uint16_t transaction_id[MBAP_BATCH_LANES];
+    uint16_t length[MBAP_BATCH_LANES];
+    uint8_t unit_id[MBAP_BATCH_LANES];
+    uint8_t function_code[MBAP_BATCH_LANES];
+    uint64_t valid;
+    uint64_t known;
+} mbap_lanes_t;
+
+
+/**
+ * mbap_validate_batch() - Validate the MBAP headers of a batch
+ * @payloads: Candidate payloads (MBAP header first)
+ * @lengths: Captured bytes of each payload
+ * @count: Candidates (at most MBAP_BATCH_LANES)
+ * @lanes: Output lanes and masks
+ *
+ * Uses the fastest kernel the CPU supports (see mbap_batch_kernel()).
+ * Only the first eight bytes of a payload are read, and none of a
+ * payload shorter than that.
+ */
+
+void mbap_validate_batch(const uint8_t *const *payloads, const uint32_t *lengths, uint32_t count,
+                         mbap_lanes_t *lanes);
+
+
+/**
+ * mbap_validate_batch_scalar() - mbap_validate_batch() without SIMD
+ * @payloads: Candidate payloads (MBAP header first)
+ * @lengths: Captured bytes of each payload
+ * @count: Candidates (at most MBAP_BATCH_LANES)
+ * @lanes: Output lanes and masks
+ *
+ * Reference kernel, also used for comparison in benchmarks.
+ */
+
+void mbap_validate_batch_scalar(const uint8_t *const *payloads, const uint32_t *lengths,
+                                uint32_t count, mbap_lanes_t *lanes);
+
+
+/**
+ * mbap_batch_kernel() - Kernel used by mbap_validate_batch()
+ *
+ * Return: "avx2" or "scalar"
+ */
+
+const char *mbap_batch_kernel(void);
+
+#endif /* MBAP_BATCH_H */
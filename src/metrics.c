@@ -0,0 +1,693 @@
+/*
+ * metrics.c - Lock-free counters exposed in Prometheus text format
+ *
+ * Writers own their shard and only do relaxed atomic updates; readers
+ * load every published shard and add them up, so a scrape sees each
+ * counter at some recent value without stopping the decoder. The
+ * exporter is one thread that polls the listening socket and rewrites
+ * the metrics file when its interval has passed.
+ *
+ * Copyright (C) 2025 Marty
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+
+#ifndef _GNU_SOURCE
+    #define _GNU_SOURCE // open_memstream()
+#endif
+
+#include "metrics.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifndef _WIN32
+    #define METRICS_HAVE_EXPORTER 1
+    #include <errno.h>
+    #include <poll.h>
+    #include <pthread.h>
+    #include <unistd.h>
+    #include <sys/socket.h>
+    #include <netinet/in.h>
+    #include <arpa/inet.h>
+#endif
+
+#ifndef MSG_NOSIGNAL
+    #define MSG_NOSIGNAL 0
+#endif
+
+
+/* Latency bucket upper bounds in microseconds */
+static const uint32_t latency_bounds_us[METRICS_LATENCY_BOUNDS] = {
+    500, 1000, 2500, 5000, 10000, 25000, 50000,
+    100000, 250000, 500000, 1000000, 2500000, 5000000
+};
+
+/* Label values of modbus_parse_error_t */
+static const char *const drop_reasons[MODBUS_PARSE_ERROR_COUNT] = {
+    "ok", "truncated", "bad_protocol", "bad_length", "snaplen_clipped",
+    "not_modbus", "no_memory"
+};
+
+
+/*
+ * wall_ns() - Wall-clock time in nanoseconds since the epoch
+ */
+
+static int64_t wall_ns(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+/*
+ * bump() - Relaxed increment of a shard counter
+ */
+
+static inline void bump(_Atomic uint64_t *counter, uint64_t n) {
+    atomic_fetch_add_explicit(counter, n, memory_order_relaxed);
+}
+
+
+/*
+ * load() - Relaxed read of a shard counter
+ */
+
+static inline uint64_t load(_Atomic uint64_t *counter) {
+    return atomic_load_explicit(counter, memory_order_relaxed);
+}
+
+
+/**
+ * metrics_init() - Start an empty registry
+ * @metrics: Registry
+ */
+
+void metrics_init(metrics_t *metrics) {
+    memset(metrics, 0, sizeof(*metrics));
+    metrics->started_ns = wall_ns();
+}
+
+
+/**
+ * metrics_shard_acquire() - Claim a shard for the calling thread
+ * @metrics: Registry
+ *
+ * Return: Shard, or NULL if METRICS_MAX_SHARDS are taken or memory ran out
+ */
+
+metrics_shard_t *metrics_shard_acquire(metrics_t *metrics) {
+    uint32_t index = atomic_fetch_add_explicit(&metrics->shard_count, 1, memory_order_relaxed);
+    if (index >= METRICS_MAX_SHARDS) {
+        return NULL;
+    }
+
+    metrics_shard_t *shard = calloc(1, sizeof(metrics_shard_t));
+    if (!shard) {
+        return NULL;
+    }
+    // Readers skip the slot until the zeroed shard is visible
+    atomic_store_explicit(&metrics->shards[index], shard, memory_order_release);
+    return shard;
+}
+
+
+/*
+ * pending_slot() - Table slot of a client/server/transaction key
+ */
+
+static metrics_pending_t *pending_slot(metrics_shard_t *shard, uint32_t client_id,
+                                       uint32_t server_id, uint16_t client_port,
+                                       uint16_t transaction_id, uint8_t unit_id) {
+    uint64_t key = ((uint64_t)client_id << 32 | server_id) * 0x9E3779B97F4A7C15ull;
+    key ^= ((uint64_t)client_port << 24 | (uint64_t)transaction_id << 8 | unit_id) *
+           0xC2B2AE3D27D4EB4Full;
+    return &shard->pending[(key >> 32) & (METRICS_PENDING_SLOTS - 1)];
+}
+
+
+/*
+ * observe_latency() - Add one request/response time to the histogram
+ */
+
+static void observe_latency(metrics_shard_t *shard, int64_t latency_ns) {
+    uint64_t us = (uint64_t)latency_ns / 1000;
+    int bucket = 0;
+
+    while (bucket < METRICS_LATENCY_BOUNDS && us > latency_bounds_us[bucket]) {
+        bucket++;
+    }
+    bump(&shard->latency[bucket], 1);
+    bump(&shard->latency_sum_ns, (uint64_t)latency_ns);
+}
+
+
+/**
+ * metrics_observe() - Count one record from modbus_session_run()
+ * @shard: Shard of the calling thread
+ * @record: Decoded or failed record
+ *
+ * A request is remembered under its client, server, port, transaction
+ * and unit; the matching response observes the latency. A request whose
+ * slot is reused before the response arrives is forgotten, and the
+ * response is then counted as unmatched.
+ */
+
+void metrics_observe(metrics_shard_t *shard, const modbus_record_t *record) {
+    if (record->error != MODBUS_PARSE_OK) {
+        if (record->error < MODBUS_PARSE_ERROR_COUNT) {
+            bump(&shard->dropped[record->error], 1);
+        }
+        return;
+    }
+
+    const modbus_tcp_frame_t *frame = &record->frame;
+    int direction = record->is_request ? 0 : 1;
+
+    bump(&shard->frames[direction], 1);
+    bump(&shard->bytes[direction], record->length);
+    atomic_store_explicit(&shard->last_frame_ns, record->timestamp_ns, memory_order_relaxed);
+
+    if (frame->function_code & 0x80) {
+        bump(&shard->exceptions[frame->mbap.unit_id][frame->function_code & 0x7F], 1);
+    }
+
+    if (record->is_request) {
+        metrics_pending_t *slot = pending_slot(shard, record->src_id, record->dst_id,
+                                               record->src_port, frame->mbap.transaction_id,
+                                               frame->mbap.unit_id);
+        slot->client_id = record->src_id;
+        slot->server_id = record->dst_id;
+        slot->client_port = record->src_port;
+        slot->transaction_id = frame->mbap.transaction_id;
+        slot->unit_id = frame->mbap.unit_id;
+        slot->timestamp_ns = record->timestamp_ns;
+        slot->used = true;
+        return;
+    }
+
+    metrics_pending_t *slot = pending_slot(shard, record->dst_id, record->src_id,
+                                           record->dst_port, frame->mbap.transaction_id,
+                                           frame->mbap.unit_id);
+    if (slot->used && slot->client_id == record->dst_id && slot->server_id == record->src_id &&
+        slot->client_port == record->dst_port &&
+        slot->transaction_id == frame->mbap.transaction_id &&
+        slot->unit_id == frame->mbap.unit_id && record->timestamp_ns >= slot->timestamp_ns) {
+        observe_latency(shard, record->timestamp_ns - slot->timestamp_ns);
+        slot->used = false;
+    } else {
+        bump(&shard->unmatched, 1);
+    }
+}
+
+
+/*
+ * struct metrics_totals_t - Sum of all shards at one moment
+ */
+
+typedef struct {
+    uint64_t frames[2];
+    uint64_t bytes[2];
+    uint64_t dropped[MODBUS_PARSE_ERROR_COUNT];
+    uint64_t unmatched;
+    uint64_t latency[METRICS_LATENCY_BUCKETS];
+    uint64_t latency_sum_ns;
+    int64_t last_frame_ns;
+    uint64_t exceptions[256][128];
+} metrics_totals_t;
+
+
+/*
+ * sum_shards() - Add up every published shard into @t
+ */
+
+static void sum_shards(metrics_t *metrics, metrics_totals_t *t) {
+    uint32_t count = atomic_load_explicit(&metrics->shard_count, memory_order_relaxed);
+
+    memset(t, 0, sizeof(*t));
+    if (count > METRICS_MAX_SHARDS) {
+        count = METRICS_MAX_SHARDS;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        metrics_shard_t *shard = atomic_load_explicit(&metrics->shards[i], memory_order_acquire);
+        if (!shard) {
+            continue;  // Claimed but not yet published
+        }
+        for (int d = 0; d < 2; d++) {
+            t->frames[d] += load(&shard->frames[d]);
+            t->bytes[d] += load(&shard->bytes[d]);
+        }
+        for (int r = 0; r < MODBUS_PARSE_ERROR_COUNT; r++) {
+            t->dropped[r] += load(&shard->dropped[r]);
+        }
+        t->unmatched += load(&shard->unmatched);
+        for (int b = 0; b < METRICS_LATENCY_BUCKETS; b++) {
+            t->latency[b] += load(&shard->latency[b]);
+        }
+        t->latency_sum_ns += load(&shard->latency_sum_ns);
+        int64_t last = atomic_load_explicit(&shard->last_frame_ns, memory_order_relaxed);
+        if (last > t->last_frame_ns) {
+            t->last_frame_ns = last;
+        }
+        for (int unit = 0; unit < 256; unit++) {
+            for (int function = 0; function < 128; function++) {
+                t->exceptions[unit][function] += load(&shard->exceptions[unit][function]);
+            }
+        }
+    }
+}
+
+
+/*
+ * family() - HELP and TYPE lines of a metric family
+ */
+
+static void family(FILE *f, const char *name, const char *type, const char *help) {
+    fprintf(f, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+
+/**
+ * metrics_write() - Write all metrics in Prometheus text format
+ * @metrics: Registry
+ * @f: Output stream
+ *
+ * Return: false on write error
+ */
+
+bool metrics_write(metrics_t *metrics, FILE *f) {
+    static const char *const directions[2] = { "request", "response" };
+    metrics_totals_t *t = malloc(sizeof(metrics_totals_t));
+    if (!t) {
+        return false;
+    }
+    sum_shards(metrics, t);
+
+    family(f, "modbus_frames_total", "counter", "Decoded Modbus TCP frames.");
+    for (int d = 0; d < 2; d++) {
+        fprintf(f, "modbus_frames_total{direction=\"%s\"} %llu\n", directions[d],
+                (unsigned long long)t->frames[d]);
+    }
+
+    family(f, "modbus_payload_bytes_total", "counter", "Payload bytes of decoded frames.");
+    for (int d = 0; d < 2; d++) {
+        fprintf(f, "modbus_payload_bytes_total{direction=\"%s\"} %llu\n", directions[d],
+                (unsigned long long)t->bytes[d]);
+    }
+
+    family(f, "modbus_dropped_payloads_total", "counter",
+           "Port 502 payloads that failed to decode, by reason.");
+    for (int r = 1; r < MODBUS_PARSE_ERROR_COUNT; r++) {
+        fprintf(f, "modbus_dropped_payloads_total{reason=\"%s\"} %llu\n", drop_reasons[r],
+                (unsigned long long)t->dropped[r]);
+    }
+
+    family(f, "modbus_exceptions_total", "counter",
+           "Exception responses by unit id and function code.");
+    for (int unit = 0; unit < 256; unit++) {
+        for (int function = 0; function < 128; function++) {
+            if (t->exceptions[unit][function] > 0) {
+                fprintf(f, "modbus_exceptions_total{unit=\"%d\",function=\"%d\"} %llu\n",
+                        unit, function, (unsigned long long)t->exceptions[unit][function]);
+            }
+        }
+    }
+
+    family(f, "modbus_response_latency_seconds", "histogram",
+           "Request to response time on the capture clock.");
+    uint64_t cumulative = 0;
+    for (int b = 0; b < METRICS_LATENCY_BOUNDS; b++) {
+        cumulative += t->latency[b];
+        fprintf(f, "modbus_response_latency_seconds_bucket{le=\"%g\"} %llu\n",
+                latency_bounds_us[b] / 1e6, (unsigned long long)cumulative);
+    }
+    cumulative += t->latency[METRICS_LATENCY_BOUNDS];
+    fprintf(f, "modbus_response_latency_seconds_bucket{le=\"+Inf\"} %llu\n",
+            (unsigned long long)cumulative);
+    fprintf(f, "modbus_response_latency_seconds_sum %.9f\n", t->latency_sum_ns / 1e9);
+    fprintf(f, "modbus_response_latency_seconds_count %llu\n", (unsigned long long)cumulative);
+
+    family(f, "modbus_unmatched_responses_total", "counter",
+           "Responses whose request was not seen or no longer tracked.");
+    fprintf(f, "modbus_unmatched_responses_total %llu\n", (unsigned long long)t->unmatched);
+
+    if (t->last_frame_ns > 0) {
+        family(f, "modbus_last_frame_timestamp_seconds", "gauge",
+               "Capture time of the newest decoded frame.");
+        fprintf(f, "modbus_last_frame_timestamp_seconds %.6f\n", t->last_frame_ns / 1e9);
+        family(f, "modbus_processing_lag_seconds", "gauge",
+               "Wall clock minus the capture time of the newest decoded frame.");
+        fprintf(f, "modbus_processing_lag_seconds %.6f\n",
+                (wall_ns() - t->last_frame_ns) / 1e9);
+    }
+
+    family(f, "modbus_parser_start_time_seconds", "gauge", "Time the analysis started.");
+    fprintf(f, "modbus_parser_start_time_seconds %.3f\n", metrics->started_ns / 1e9);
+
+    free(t);
+    return !ferror(f);
+}
+
+
+/**
+ * metrics_write_file() - Atomically replace a file with the metrics
+ * @metrics: Registry
+ * @path: Output file (written as "<path>.tmp", then renamed)
+ *
+ * Scrapers (e.g. the node exporter textfile collector) never see a
+ * partly written file.
+ *
+ * Return: false if the file could not be written
+ */
+
+bool metrics_write_file(metrics_t *metrics, const char *path) {
+    char tmp_path[1024];
+
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    FILE *f = fopen(tmp_path, "w");
+    if (!f) {
+        return false;
+    }
+
+    bool ok = metrics_write(metrics, f);
+    ok = (fclose(f) == 0) && ok;
+#ifdef _WIN32
+    // rename() does not replace an existing file on Windows
+    if (ok) remove(path);
+#endif
+    if (!ok || rename(tmp_path, path) != 0) {
+        remove(tmp_path);
+        return false;
+    }
+    return true;
+}
+
+
+#ifdef METRICS_HAVE_EXPORTER
+
+/* Largest request head read from a client */
+#define EXPORTER_REQUEST_MAX 2048
+
+
+/**
+ * struct metrics_exporter - Exporter thread state
+ * @metrics: Registry being published
+ * @options: File, interval and port
+ * @listen_fd: Listening socket (-1 if no port)
+ * @wake: Pipe written by metrics_export_stop() to end the thread's poll()
+ * @thread: Exporter thread
+ * @file_failed: A file rewrite failed (warned once)
+ */
+
+struct metrics_exporter {
+    metrics_t *metrics;
+    metrics_export_options_t options;
+    int listen_fd;
+    int wake[2];
+    pthread_t thread;
+    bool file_failed;
+};
+
+
+/*
+ * send_all() - Write a whole buffer to a socket
+ */
+
+static bool send_all(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+
+/*
+ * serve_client() - Answer one HTTP request on an accepted connection
+ *
+ * GET /metrics (or /) returns the metrics; anything else is refused.
+ * The connection is closed after the response (HTTP/1.0 style).
+ */
+
+static void serve_client(metrics_exporter_t *exporter, int fd) {
+    char request[EXPORTER_REQUEST_MAX];
+    size_t len = 0;
+    struct timeval timeout = { .tv_sec = 2, .tv_usec = 0 };
+
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    // Read the request head; the body (if any) is ignored
+    while (len < sizeof(request) - 1) {
+        ssize_t n = recv(fd, request + len, sizeof(request) - 1 - len, 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        len += (size_t)n;
+        request[len] = '\0';
+        if (strstr(request, "\r\n\r\n") || strstr(request, "\n\n")) {
+            break;
+        }
+    }
+    request[len] = '\0';
+
+    const char *status = "404 Not Found";
+    if (strncmp(request, "GET ", 4) != 0) {
+        status = "405 Method Not Allowed";
+    } else if (strncmp(request + 4, "/metrics ", 9) == 0 ||
+               strncmp(request + 4, "/metrics?", 9) == 0 ||
+               strncmp(request + 4, "/ ", 2) == 0) {
+        status = "200 OK";
+    }
+
+    char *body = NULL;
+    size_t body_len = 0;
+    FILE *out = open_memstream(&body, &body_len);
+    if (!out) {
+        return;
+    }
+    if (status[0] == '2') {
+        metrics_write(exporter->metrics, out);
+    } else {
+        fprintf(out, "%s\n", status);
+    }
+    if (fclose(out) != 0) {
+        free(body);
+        return;
+    }
+
+    char head[256];
+    int head_len = snprintf(head, sizeof(head),
+                            "HTTP/1.0 %s\r\n"
+                            "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+                            "Content-Length: %zu\r\n"
+                            "Connection: close\r\n\r\n", status, body_len);
+    if (send_all(fd, head, (size_t)head_len)) {
+        send_all(fd, body, body_len);
+    }
+    free(body);
+}
+
+
+/*
+ * exporter_main() - Serve scrapes and rewrite the file until woken to stop
+ *
+ * Sleeps in poll() on the wake pipe and the listening socket until a
+ * client connects, the file is due or metrics_export_stop() is called.
+ */
+
+static void *exporter_main(void *arg) {
+    metrics_exporter_t *exporter = arg;
+    int64_t interval_ns = (int64_t)exporter->options.interval * 1000000000;
+    int64_t next_write = wall_ns() + interval_ns;
+    struct pollfd pfd[2] = {
+        { .fd = exporter->wake[0], .events = POLLIN },
+        { .fd = exporter->listen_fd, .events = POLLIN }  // Ignored when -1
+    };
+
+    for (;;) {
+        int timeout = -1;
+        if (exporter->options.path) {
+            int64_t wait_ns = next_write - wall_ns();
+            timeout = wait_ns > 0 ? (int)((wait_ns + 999999) / 1000000) : 0;
+        }
+
+        if (poll(pfd, 2, timeout) > 0) {
+            if (pfd[0].revents) {
+                break;
+            }
+            if (pfd[1].revents & POLLIN) {
+                int fd = accept(exporter->listen_fd, NULL, NULL);
+                if (fd >= 0) {
+                    serve_client(exporter, fd);
+                    close(fd);
+                }
+            }
+        }
+
+        if (exporter->options.path && wall_ns() >= next_write) {
+            if (!metrics_write_file(exporter->metrics, exporter->options.path) &&
+                !exporter->file_failed) {
+                printf("Warning: Could not write metrics file %s\n", exporter->options.path);
+                exporter->file_failed = true;
+            }
+            next_write = wall_ns() + interval_ns;
+        }
+    }
+    return NULL;
+}
+
+
+/*
+ * listen_loopback() - Listening socket on 127.0.0.1:@port
+ */
+
+static int listen_loopback(uint16_t port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 8) != 0) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    return fd;
+}
+
+
+/**
+ * metrics_export_start() - Start the exporter thread
+ * @metrics: Registry
+ * @options: File and/or port to publish on
+ *
+ * Return: false if the exporter could not be started
+ */
+
+bool metrics_export_start(metrics_t *metrics, const metrics_export_options_t *options) {
+    metrics_exporter_t *exporter = calloc(1, sizeof(metrics_exporter_t));
+    if (!exporter) {
+        printf("Error: Could not allocate metrics exporter\n");
+        return false;
+    }
+    exporter->metrics = metrics;
+    exporter->options = *options;
+    if (exporter->options.interval == 0) {
+        exporter->options.interval = METRICS_DEFAULT_INTERVAL;
+    }
+    exporter->listen_fd = -1;
+
+    if (pipe(exporter->wake) != 0) {
+        printf("Error: Could not create metrics exporter pipe: %s\n", strerror(errno));
+        free(exporter);
+        return false;
+    }
+
+    bool ok = true;
+    if (options->port) {
+        exporter->listen_fd = listen_loopback(options->port);
+        if (exporter->listen_fd < 0) {
+            printf("Error: Could not listen on 127.0.0.1:%u for metrics: %s\n",
+                   options->port, strerror(errno));
+            ok = false;
+        }
+    }
+
+    // Publish an initial file so scrapers find it from the start
+    if (ok && options->path && !metrics_write_file(metrics, options->path)) {
+        printf("Error: Could not write metrics file %s\n", options->path);
+        ok = false;
+    }
+
+    if (ok && pthread_create(&exporter->thread, NULL, exporter_main, exporter) != 0) {
+        printf("Error: Could not start metrics exporter thread\n");
+        ok = false;
+    }
+
+    if (!ok) {
+        if (exporter->listen_fd >= 0) {
+            close(exporter->listen_fd);
+        }
+        close(exporter->wake[0]);
+        close(exporter->wake[1]);
+        free(exporter);
+        return false;
+    }
+    metrics->exporter = exporter;
+    return true;
+}
+
+
+/**
+ * metrics_export_stop() - Stop the exporter, writing the file a last time
+ * @metrics: Registry (no-op if no exporter runs)
+ */
+
+void metrics_export_stop(metrics_t *metrics) {
+    metrics_exporter_t *exporter = metrics->exporter;
+    if (!exporter) return;
+
+    // Closing the write end makes the read end readable (EOF)
+    close(exporter->wake[1]);
+    pthread_join(exporter->thread, NULL);
+    close(exporter->wake[0]);
+    if (exporter->listen_fd >= 0) {
+        close(exporter->listen_fd);
+    }
+    if (exporter->options.path && !metrics_write_file(metrics, exporter->options.path)) {
+        printf("Warning: Could not write metrics file %s\n", exporter->options.path);
+    }
+    free(exporter);
+    metrics->exporter = NULL;
+}
+
+#else
+
+bool metrics_export_start(metrics_t *metrics, const metrics_export_options_t *options) {
+    (void)metrics;
+    (void)options;
+    printf("Error: Metrics export is not supported on this platform\n");
+    return false;
+}
+
+void metrics_export_stop(metrics_t *metrics) {
+    (void)metrics;
+}
+
+#endif /* METRICS_HAVE_EXPORTER */
+
+
+/**
+ * metrics_free() - Stop the exporter and release all shards
+ * @metrics: Registry
+ */
+
+void metrics_free(metrics_t *metrics) {
+    metrics_export_stop(metrics);
+    for (uint32_t i = 0; i < METRICS_MAX_SHARDS; i++) {
+        free(atomic_load(&metrics->shards[i]));
+    }
+    metrics_init(metrics);
+}
@@ -0,0 +1,210 @@
+/*
+ * metrics.h - Lock-free counters exposed in Prometheus text format
+ *
+ * A metrics_t registry holds one shard per updating thread. A thread
+ * claims its shard once with metrics_shard_acquire() and then only does
+ * relaxed atomic increments into it, so the hot path takes no lock and
+ * shares no cache line with other writers. Readers sum the shards when
+ * the metrics are exposed:
+ *
+ * - frames and payload bytes by direction, dropped payloads by parse
+ *   failure class, exception responses by unit and function
+ * - request/response latency histogram (capture time), pairing requests
+ *   by client, server, transaction id and unit in a bounded table
+ * - processing lag: wall clock minus the capture time of the newest frame
+ *
+ * The exporter thread rewrites a file atomically (temporary file and
+ * rename) on an interval and/or serves GET /metrics on a loopback TCP
+ * port. The exporter is not available on Windows.
+ *
+ * Copyright (C) 2025 Marty
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdatomic.h>
+#include "modbus_session.h"
+
+
+/* Threads that can update one registry */
+#define METRICS_MAX_SHARDS 16
+
+/* Latency histogram: upper bounds in microseconds, plus +Inf */
+#define METRICS_LATENCY_BOUNDS 13
+#define METRICS_LATENCY_BUCKETS (METRICS_LATENCY_BOUNDS + 1)
+
+/* Outstanding requests tracked per shard (power of two, oldest overwritten) */
+#define METRICS_PENDING_SLOTS 4096
+
+/* Seconds between metrics file rewrites when --metrics-interval is not given */
+#define METRICS_DEFAULT_INTERVAL 10
+
+
+/**
+ * struct metrics_pending_t - Request waiting for its response
+ * @client_id: Client endpoint id
+ * @server_id: Server endpoint id
+ * @client_port: Client TCP port
+ * @transaction_id: MBAP transaction id
+ * @unit_id: MBAP unit id
+ * @used: Slot holds a request
+ * @timestamp_ns: Capture time of the request
+ */
+
+typedef struct {
+    uint32_t client_id;
+    uint32_t server_id;
+    uint16_t client_port;
+    uint16_t transaction_id;
+    uint8_t unit_id;
+    bool used;
+    int64_t timestamp_ns;
+} metrics_pending_t;
+
+
+/**
+ * struct metrics_shard_t - Counters updated by one thread
+ * @frames: Decoded frames, [0] requests, [1] responses
+ * @bytes: Payload bytes of @frames
+ * @dropped: Payloads that failed to decode, by modbus_parse_error_t
+ * @unmatched: Responses without a tracked request
+ * @latency: Response latency histogram (per bucket, not cumulative)
+ * @latency_sum_ns: Sum of all observed latencies
+ * @last_frame_ns: Capture time of the newest frame (0 = none yet)
+ * @exceptions: Exception responses by unit id and function code
+ * @pending: Outstanding requests; only touched by the owning thread
+ */
+
+typedef struct {
+    _Atomic uint64_t frames[2];
+    _Atomic uint64_t bytes[2];
+    _Atomic uint64_t dropped[MODBUS_PARSE_ERROR_COUNT];
+    _Atomic uint64_t unmatched;
+    _Atomic uint64_t latency[METRICS_LATENCY_BUCKETS];
+    _Atomic uint64_t latency_sum_ns;
+    _Atomic int64_t last_frame_ns;
+    _Atomic uint64_t exceptions[256][128];
+    metrics_pending_t pending[METRICS_PENDING_SLOTS];
+} metrics_shard_t;
+
+
+/**
+ * struct metrics_export_options_t - Where the exporter publishes
+ * @path: File rewritten every @interval seconds (NULL = none)
+ * @interval: Seconds between file rewrites
+ * @port: Loopback HTTP port (0 = none)
+ */
+
+typedef struct {
+    const char *path;
+    uint32_t interval;
+    uint16_t port;
+} metrics_export_options_t;
+
+
+/* Exporter thread state (see metrics.c) */
+typedef struct metrics_exporter metrics_exporter_t;
+
+
+/**
+ * struct metrics_t - Counter registry
+ * @shards: Claimed shards; entries below @shard_count are published
+ * @shard_count: Shards claimed so far
+ * @started_ns: Wall-clock time the registry was created
+ * @exporter: Running exporter (NULL if none)
+ */
+
+typedef struct {
+    metrics_shard_t *_Atomic shards[METRICS_MAX_SHARDS];
+    _Atomic uint32_t shard_count;
+    int64_t started_ns;
+    metrics_exporter_t *exporter;
+} metrics_t;
+
+
+/**
+ * metrics_init() - Start an empty registry
+ * @metrics: Registry
+ */
+
+void metrics_init(metrics_t *metrics);
+
+
+/**
+ * metrics_shard_acquire() - Claim a shard for the calling thread
+ * @metrics: Registry
+ *
+ * Return: Shard, or NULL if METRICS_MAX_SHARDS are taken or memory ran out
+ */
+
+metrics_shard_t *metrics_shard_acquire(metrics_t *metrics);
+
+
+/**
+ * metrics_observe() - Count one record from modbus_session_run()
+ * @shard: Shard of the calling thread
+ * @record: Decoded or failed record
+ */
+
+void metrics_observe(metrics_shard_t *shard, const modbus_record_t *record);
+
+
+/**
+ * metrics_write() - Write all metrics in Prometheus text format
+ * @metrics: Registry
+ * @f: Output stream
+ *
+ * Safe to call while other threads update their shards.
+ *
+ * Return: false on write error
+ */
+
+bool metrics_write(metrics_t *metrics, FILE *f);
+
+
+/**
+ * metrics_write_file() - Atomically replace a file with the metrics
+ * @metrics: Registry
+ * @path: Output file (written as "<path>.tmp", then renamed)
+ *
+ * Return: false if the file could not be written
+ */
+
+bool metrics_write_file(metrics_t *metrics, const char *path);
+
+
+/**
+ * metrics_export_start() - Start the exporter thread
+ * @metrics: Registry
+ * @options: File and/or port to publish on
+ *
+ * The port is bound on 127.0.0.1 before this returns. Prints an error
+ * on failure.
+ *
+ * Return: false if the exporter could not be started
+ */
+
+bool metrics_export_start(metrics_t *metrics, const metrics_export_options_t *options);
+
+
+/**
+ * metrics_export_stop() - Stop the exporter, writing the file a last time
+ * @metrics: Registry (no-op if no exporter runs)
+ */
+
+void metrics_export_stop(metrics_t *metrics);
+
+
+/**
+ * metrics_free() - Stop the exporter and release all shards
+ * @metrics: Registry
+ */
+
+void metrics_free(metrics_t *metrics);
+
+#endif /* METRICS_H */
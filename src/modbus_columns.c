@@ -0,0 +1,165 @@
+/*
+ * modbus_columns.c - Columnar frame export (modbus_parse library)
+ *
+ * Copyright (C) 2025 Marty
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+
+#include "modbus_columns.h"
+#include <stdlib.h>
+
+
+/* Rows allocated when modbus_columns_create() is given 0 */
+#define MODBUS_COLUMNS_DEFAULT_CAPACITY 4096
+
+
+/*
+ * columns_resize() - Reallocate every column to @capacity rows
+ *
+ * On failure the columns that were already resized keep their new size,
+ * which is harmless: capacity is only raised once all of them succeeded.
+ */
+
+static bool columns_resize(modbus_columns_t *c, size_t capacity) {
+#define COLUMNS_RESIZE(field) do { \
+        void *p = realloc(c->field, capacity * sizeof(*c->field)); \
+        if (!p) return false; \
+        c->field = p; \
+    } while (0)
+
+    COLUMNS_RESIZE(timestamp_ns);
+    COLUMNS_RESIZE(src_id);
+    COLUMNS_RESIZE(src_port);
+    COLUMNS_RESIZE(dst_id);
+    COLUMNS_RESIZE(dst_port);
+    COLUMNS_RESIZE(unit_id);
+    COLUMNS_RESIZE(function_code);
+    COLUMNS_RESIZE(transaction_id);
+    COLUMNS_RESIZE(address);
+    COLUMNS_RESIZE(quantity);
+    COLUMNS_RESIZE(exception_code);
+    COLUMNS_RESIZE(is_request);
+
+#undef COLUMNS_RESIZE
+    c->capacity = capacity;
+    return true;
+}
+
+
+/**
+ * modbus_columns_create() - Allocate empty columns
+ * @capacity: Initial rows per column (0 picks a default)
+ *
+ * Return: Columns object, or NULL if out of memory
+ */
+
+modbus_columns_t *modbus_columns_create(size_t capacity) {
+    modbus_columns_t *columns = calloc(1, sizeof(modbus_columns_t));
+    if (!columns) {
+        return NULL;
+    }
+
+    if (!columns_resize(columns, capacity ? capacity : MODBUS_COLUMNS_DEFAULT_CAPACITY)) {
+        modbus_columns_destroy(columns);
+        return NULL;
+    }
+    return columns;
+}
+
+
+/**
+ * modbus_columns_fill() - Append decoded frames from a session
+ * @session: Open session
+ * @columns: Columns to append to
+ * @max_rows: Row limit for this call (0 = to the end of the capture)
+ *
+ * Return: Rows appended (0 at end of capture), -1 on read error,
+ *         MODBUS_COLUMNS_NO_MEMORY if a column could not grow
+ */
+
+int64_t modbus_columns_fill(modbus_session_t *session, modbus_columns_t *columns,
+                            size_t max_rows) {
+    modbus_record_t record;
+    int64_t appended = 0;
+    int result = 0;
+
+    // A bounded chunk is sized up front so the loop never reallocates
+    if (max_rows && columns->count + max_rows > columns->capacity &&
+        !columns_resize(columns, columns->count + max_rows)) {
+        return MODBUS_COLUMNS_NO_MEMORY;
+    }
+
+    while ((max_rows == 0 || (size_t)appended < max_rows) &&
+           (result = modbus_session_next_frame(session, &record)) > 0) {
+        size_t row = columns->count;
+        const modbus_tcp_frame_t *frame = &record.frame;
+        uint16_t address, quantity;
+
+        if (row == columns->capacity && !columns_resize(columns, columns->capacity * 2)) {
+            return MODBUS_COLUMNS_NO_MEMORY;
+        }
+
+        columns->timestamp_ns[row] = record.timestamp_ns;
+        columns->src_id[row] = record.src_id;
+        columns->src_port[row] = record.src_port;
+        columns->dst_id[row] = record.dst_id;
+        columns->dst_port[row] = record.dst_port;
+        columns->unit_id[row] = frame->mbap.unit_id;
+        columns->function_code[row] = frame->function_code;
+        columns->transaction_id[row] = frame->mbap.transaction_id;
+
+        if (modbus_get_address_range(frame, record.is_request, &address, &quantity)) {
+            columns->address[row] = address;
+            columns->quantity[row] = quantity;
+        } else {
+            columns->address[row] = MODBUS_COLUMNS_NO_ADDRESS;
+            columns->quantity[row] = MODBUS_COLUMNS_NO_ADDRESS;
+        }
+
+        columns->exception_code[row] = (frame->function_code >= 0x80 && frame->data_length > 0)
+                                       ? frame->data[0] : 0;
+        columns->is_request[row] = record.is_request;
+
+        columns->count++;
+        appended++;
+    }
+
+    if (result < 0) {
+        return -1;
+    }
+    return appended;
+}
+
+
+/**
+ * modbus_columns_clear() - Drop all rows, keeping the allocation
+ * @columns: Columns
+ */
+
+void modbus_columns_clear(modbus_columns_t *columns) {
+    columns->count = 0;
+}
+
+
+/**
+ * modbus_columns_destroy() - Free the columns and their arrays
+ * @columns: Columns (NULL is ignored)
+ */
+
+void modbus_columns_destroy(modbus_columns_t *columns) {
+    if (!columns) return;
+    free(columns->timestamp_ns);
+    free(columns->src_id);
+    free(columns->src_port);
+    free(columns->dst_id);
+    free(columns->dst_port);
+    free(columns->unit_id);
+    free(columns->function_code);
+    free(columns->transaction_id);
+    free(columns->address);
+    free(columns->quantity);
+    free(columns->exception_code);
+    free(columns->is_request);
+    free(columns);
+}
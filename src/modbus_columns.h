@@ -0,0 +1,112 @@
+/*
+ * modbus_columns.h - Columnar frame export (modbus_parse library)
+ *
+ * Decodes frames from a session into struct-of-arrays buffers, one
+ * contiguous array per field. The arrays are plain C memory owned by the
+ * columns object, so foreign runtimes (the Python bindings in
+ * bindings/python) can wrap them in place instead of copying rows.
+ *
+ * Copyright (C) 2025 Marty
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef MODBUS_COLUMNS_H
+#define MODBUS_COLUMNS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "modbus_session.h"
+
+
+/* Return value of modbus_columns_fill() when a column could not grow */
+#define MODBUS_COLUMNS_NO_MEMORY -2
+
+/* Marker stored in address/quantity for frames without an address */
+#define MODBUS_COLUMNS_NO_ADDRESS -1
+
+
+/**
+ * struct modbus_columns_t - Decoded frames as parallel arrays
+ * @count: Rows filled
+ * @capacity: Rows allocated in every column
+ * @timestamp_ns: Packet timestamp (nanoseconds since epoch)
+ * @src_id: Source endpoint id (see modbus_session_endpoint_name())
+ * @src_port: Source TCP port
+ * @dst_id: Destination endpoint id
+ * @dst_port: Destination TCP port
+ * @unit_id: MBAP unit identifier
+ * @function_code: Function code (0x80+ for exception responses)
+ * @transaction_id: MBAP transaction identifier
+ * @address: Start address, or MODBUS_COLUMNS_NO_ADDRESS
+ * @quantity: Coils/registers addressed, or MODBUS_COLUMNS_NO_ADDRESS
+ * @exception_code: Exception code of exception responses, else 0
+ * @is_request: 1 if sent to port 502, else 0
+ *
+ * The layout is part of the library ABI: bindings mirror it field by
+ * field, so within a major version new columns are only ever appended.
+ */
+
+typedef struct {
+    size_t count;
+    size_t capacity;
+    int64_t *timestamp_ns;
+    uint32_t *src_id;
+    uint16_t *src_port;
+    uint32_t *dst_id;
+    uint16_t *dst_port;
+    uint8_t *unit_id;
+    uint8_t *function_code;
+    uint16_t *transaction_id;
+    int32_t *address;
+    int32_t *quantity;
+    uint8_t *exception_code;
+    uint8_t *is_request;
+} modbus_columns_t;
+
+
+/**
+ * modbus_columns_create() - Allocate empty columns
+ * @capacity: Initial rows per column (0 picks a default)
+ *
+ * Return: Columns object, or NULL if out of memory
+ */
+
+modbus_columns_t *modbus_columns_create(size_t capacity);
+
+
+/**
+ * modbus_columns_fill() - Append decoded frames from a session
+ * @session: Open session
+ * @columns: Columns to append to
+ * @max_rows: Stop after this many rows; 0 reads to the end of the
+ *            capture, growing the columns as needed
+ *
+ * With a non-zero @max_rows the columns are grown at most once, so a
+ * chunked reader keeps a fixed footprint. Frames that fail to parse are
+ * never appended (they are still counted by the session).
+ *
+ * Return: Rows appended (0 at end of capture), -1 on read error (see
+ *         modbus_session_error()), MODBUS_COLUMNS_NO_MEMORY if a column
+ *         could not grow
+ */
+
+int64_t modbus_columns_fill(modbus_session_t *session, modbus_columns_t *columns,
+                            size_t max_rows);
+
+
+/**
+ * modbus_columns_clear() - Drop all rows, keeping the allocation
+ * @columns: Columns
+ */
+
+void modbus_columns_clear(modbus_columns_t *columns);
+
+
+/**
+ * modbus_columns_destroy() - Free the columns and their arrays
+ * @columns: Columns (NULL is ignored)
+ */
+
+void modbus_columns_destroy(modbus_columns_t *columns);
+
+#endif /* MODBUS_COLUMNS_H */
@@ -0,0 +1,768 @@
+/*
+ * modbus_output.c - Terminal display and markdown reports
+ *
+ * Presentation half of the former monolithic parser: verbose frame
+ * display, the security summary, parse error output and the markdown
+ * report (per-frame rows are written by output_sink.c). Used by the
+ * CLI; not part of the modbus_parse library.
+ *
+ * Copyright (C) 2025 Marty
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+
+#include "modbus_output.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include "colors.h"
+
+#ifdef _WIN32
+    #include <io.h>        // Windows: _chsize_s
+#else
+    #include <unistd.h>     // *nix: ftruncate
+#endif
+
+
+/**
+ * modbus_format_host_port() - Format "address:port"
+ * @buf: Output buffer
+ * @len: Size of @buf
+ * @ip: Formatted IPv4 or IPv6 address
+ * @port: TCP port
+ */
+
+void modbus_format_host_port(char *buf, size_t len, const char *ip, uint16_t port) {
+    if (strchr(ip, ':')) {
+        snprintf(buf, len, "[%s]:%u", ip, port);
+    } else {
+        snprintf(buf, len, "%s:%u", ip, port);
+    }
+}
+
+
+/**
+ * modbus_format_estimate() - Format a counter, scaled if it was sampled
+ * @buf: Output buffer
+ * @len: Size of @buf
+ * @count: Count in the sample
+ * @sample_rate: Records kept 1 in N (0 or 1 = not sampled)
+ * @design_effect: Variance factor of clustered sampling (below 1 = 1)
+ *
+ * The interval is the normal approximation; its lower end is never
+ * below the count actually seen.
+ */
+
+void modbus_format_estimate(char *buf, size_t len, uint64_t count, uint32_t sample_rate,
+                            double design_effect) {
+    if (sample_rate <= 1) {
+        snprintf(buf, len, "%llu", (unsigned long long)count);
+        return;
+    }
+
+    double effect = design_effect > 1.0 ? design_effect : 1.0;
+    double estimate = (double)count * sample_rate;
+    double margin = 1.96 * sqrt(estimate * (sample_rate - 1) * effect);
+    double low = estimate - margin > (double)count ? estimate - margin : (double)count;
+    double high = count > 0 ? estimate + margin : 3.0 * sample_rate * effect;
+    snprintf(buf, len, "~%.0f (95%% CI %.0f-%.0f)", estimate, low, high);
+}
+
+
+/**
+ * modbus_log_parse_error() - Print one sampled parse failure
+ * @error: Failure class
+ * @src_ip: Source IP address
+ * @src_port: Source TCP port
+ * @dst_ip: Destination IP address
+ * @dst_port: Destination TCP port
+ * @timestamp_ns: Packet timestamp (nanoseconds since epoch)
+ * @suppressed: Failures dropped by the rate limit since the last line
+ */
+
+void modbus_log_parse_error(modbus_parse_error_t error,
+                            const char *src_ip, uint16_t src_port,
+                            const char *dst_ip, uint16_t dst_port,
+                            int64_t timestamp_ns, uint64_t suppressed) {
+    time_t sec = (time_t)(timestamp_ns / 1000000000);
+    struct tm *tm_info = localtime(&sec);
+    int microsec = (int)(timestamp_ns % 1000000000 / 1000);
+    char time_str[20];
+    char src[64], dst[64];
+    snprintf(time_str, sizeof(time_str), "%02d:%02d:%02d.%06d",
+             tm_info->tm_hour, tm_info->tm_min, tm_info->tm_sec, microsec);
+    modbus_format_host_port(src, sizeof(src), src_ip, src_port);
+    modbus_format_host_port(dst, sizeof(dst), dst_ip, dst_port);
+    printf("%s%s%s %sParse error:%s %s %s -> %s",
+           COLOR_GRAY, time_str, COLOR_RESET, COLOR_YELLOW, COLOR_RESET,
+           modbus_get_parse_error_name(error), src, dst);
+    if (suppressed > 0) {
+        printf(" (%llu suppressed)", (unsigned long long)suppressed);
+    }
+    printf("\n");
+}
+
+
+/**
+ * modbus_display_parse_errors() - Print failure counters to stdout
+ * @errors: Accounting structure
+ *
+ * Prints nothing if no failure was recorded.
+ */
+
+void modbus_display_parse_errors(const modbus_parse_errors_t *errors) {
+    uint64_t total = modbus_parse_errors_total(errors);
+    if (total == 0) {
+        return;
+    }
+
+    printf("\n%sParse Errors: %llu%s\n", COLOR_WHITE, (unsigned long long)total, COLOR_RESET);
+    for (int i = MODBUS_PARSE_OK + 1; i < MODBUS_PARSE_ERROR_COUNT; i++) {
+        if (errors->counts[i] > 0) {
+            printf("  %s%-20s%s %llu\n", COLOR_YELLOW,
+                   modbus_get_parse_error_name((modbus_parse_error_t)i), COLOR_RESET,
+                   (unsigned long long)errors->counts[i]);
+        }
+    }
+}
+
+
+/*
+ * print_stage() - One throughput line of the input summary
+ */
+
+static void print_stage(const char *name, uint64_t bytes, double seconds) {
+    double mib = bytes / (1024.0 * 1024.0);
+    printf("  %s%-12s%s %10.1f MiB in %7.2f s", COLOR_YELLOW, name, COLOR_RESET, mib, seconds);
+    if (seconds > 0) {
+        printf("  (%.1f MiB/s)", mib / seconds);
+    }
+    printf("\n");
+}
+
+
+/**
+ * modbus_display_input_stats() - Print per-stage throughput of a compressed capture
+ * @stats: Pipeline statistics from modbus_session_input_stats()
+ *
+ * The parser's own time is the wall time it did not spend waiting for
+ * the decompression thread. Whichever side waited less is the
+ * bottleneck.
+ */
+
+void modbus_display_input_stats(const capture_input_stats_t *stats) {
+    double parse_seconds = stats->elapsed_seconds - stats->consumer_wait_seconds;
+    const char *bottleneck;
+
+    if (stats->consumer_wait_seconds > stats->producer_wait_seconds) {
+        bottleneck = stats->read_seconds > stats->decompress_seconds ? "disk read" : "decompression";
+    } else {
+        bottleneck = "parser";
+    }
+
+    printf("\n%sCompressed Input (%s):%s\n", COLOR_WHITE,
+           capture_compression_name(stats->compression), COLOR_RESET);
+    print_stage("Read", stats->compressed_bytes, stats->read_seconds);
+    print_stage("Decompress", stats->decompressed_bytes, stats->decompress_seconds);
+    print_stage("Parse", stats->decompressed_bytes, parse_seconds > 0 ? parse_seconds : 0);
+    printf("  %s%-12s%s parser %.2f s for data, decompressor %.2f s for free buffers\n",
+           COLOR_YELLOW, "Waits", COLOR_RESET,
+           stats->consumer_wait_seconds, stats->producer_wait_seconds);
+    printf("  %s%-12s%s %s\n", COLOR_YELLOW, "Bottleneck", COLOR_RESET, bottleneck);
+}
+
+
+/**
+ * modbus_display_merge_stats() - Print what each merged capture contributed
+ * @stats: Counters from modbus_session_merge_stats()
+ * @filenames: Captures, in the order they were merged
+ *
+ * A tap that contributes almost nothing but duplicates is redundant; one
+ * that contributes many payloads and few duplicates sees traffic the
+ * others miss.
+ */
+
+void modbus_display_merge_stats(const pcap_merge_stats_t *stats, const char *const *filenames) {
+    printf("\n%sCapture Merge:%s\n", COLOR_WHITE, COLOR_RESET);
+    for (uint32_t i = 0; i < stats->captures; i++) {
+        printf("  %s%s%s: %llu payloads, %llu duplicates dropped\n", COLOR_CYAN, filenames[i],
+               COLOR_RESET, (unsigned long long)stats->payloads[i],
+               (unsigned long long)stats->duplicates[i]);
+    }
+    if (stats->out_of_order > 0) {
+        printf("  %s%-12s%s %llu payloads older than one already merged\n", COLOR_YELLOW,
+               "Out of order", COLOR_RESET, (unsigned long long)stats->out_of_order);
+    }
+    if (stats->evictions > 0) {
+        printf("  %s%-12s%s %llu window entries replaced early; some duplicates may remain\n",
+               COLOR_YELLOW, "Evictions", COLOR_RESET, (unsigned long long)stats->evictions);
+    }
+}
+
+
+/**
+ * modbus_display_memory_stats() - Print frame allocator instrumentation
+ * @stats: Counters from arena_stats(modbus_session_arena())
+ *
+ * Heap calls stay at a handful of chunks however many frames were
+ * decoded; growth there means per-frame allocation crept back in.
+ */
+
+void modbus_display_memory_stats(const arena_stats_t *stats) {
+    printf("\n%sMemory:%s\n", COLOR_WHITE, COLOR_RESET);
+    printf("  %s%-12s%s %llu allocations in %llu batches, peak %llu bytes per batch\n",
+           COLOR_YELLOW, "Arena", COLOR_RESET, (unsigned long long)stats->allocations,
+           (unsigned long long)stats->resets, (unsigned long long)stats->peak_batch_bytes);
+    printf("  %s%-12s%s %llu (%.1f KiB held)\n", COLOR_YELLOW, "Heap calls", COLOR_RESET,
+           (unsigned long long)stats->heap_calls, stats->heap_bytes / 1024.0);
+}
+
+
+/**
+ * modbus_write_report_parse_errors() - Append failure counters to report
+ * @errors: Accounting structure
+ * @f: Open report file (no-op if NULL)
+ */
+
+void modbus_write_report_parse_errors(const modbus_parse_errors_t *errors, FILE *f) {
+    if (!f) return;
+
+    uint64_t total = modbus_parse_errors_total(errors);
+    fprintf(f, "\n### Parse Errors\n\n");
+    if (total == 0) {
+        fprintf(f, "All payloads on port 502 parsed as Modbus TCP.\n");
+        return;
+    }
+
+    fprintf(f, "| Class | Count |\n");
+    fprintf(f, "|-------|-------|\n");
+    for (int i = MODBUS_PARSE_OK + 1; i < MODBUS_PARSE_ERROR_COUNT; i++) {
+        if (errors->counts[i] > 0) {
+            fprintf(f, "| %s | %llu |\n", modbus_get_parse_error_name((modbus_parse_error_t)i),
+                    (unsigned long long)errors->counts[i]);
+        }
+    }
+    fprintf(f, "| **Total** | **%llu** |\n", (unsigned long long)total);
+}
+
+
+/**
+ * modbus_write_report_merge_stats() - Append the capture merge table to report
+ * @stats: Counters from modbus_session_merge_stats()
+ * @filenames: Captures, in the order they were merged
+ * @f: Open report file (no-op if NULL)
+ */
+
+void modbus_write_report_merge_stats(const pcap_merge_stats_t *stats,
+                                     const char *const *filenames, FILE *f) {
+    if (!f) return;
+
+    fprintf(f, "\n### Capture Merge\n\n");
+    fprintf(f, "| Capture | Payloads | Duplicates Dropped |\n");
+    fprintf(f, "|---------|----------|--------------------|\n");
+    for (uint32_t i = 0; i < stats->captures; i++) {
+        fprintf(f, "| `%s` | %llu | %llu |\n", filenames[i],
+                (unsigned long long)stats->payloads[i], (unsigned long long)stats->duplicates[i]);
+    }
+    if (stats->out_of_order > 0) {
+        fprintf(f, "\n%llu payloads were older than one already merged.\n",
+                (unsigned long long)stats->out_of_order);
+    }
+    if (stats->evictions > 0) {
+        fprintf(f, "\n%llu duplicate window entries were replaced early; some duplicates may "
+                "remain.\n", (unsigned long long)stats->evictions);
+    }
+}
+
+
+/**
+ * modbus_display_frame() - Display detailed verbose frame breakdown
+ * @frame: Parsed frame to display
+ *
+ * Outputs multi-line detailed frame analysis to stdout:
+ * - MBAP header fields (transaction ID, protocol ID, length, unit ID)
+ * - Function code with descriptive name
+ * - Function-specific data decoding
+ *
+ * Function-specific decoding includes:
+ * - 0x03/0x04 (Read Registers): Start address + quantity
+ * - 0x06 (Write Single Register): Address + value
+ * - 0x10 (Write Multiple Registers): Start address + quantity + byte count
+ * - 0x80+ (Exception): Exception code + description
+ * - Others: Hex dump of data
+ *
+ * Suitable for debugging and protocol analysis.
+ * The table sink (output_sink.c) is the compact form for bulk processing.
+ */
+
+void modbus_display_frame(const modbus_tcp_frame_t *frame) {
+    printf("\n=== Modbus TCP Frame ===\n");
+    
+    // MBAP Header
+    printf("\nMBAP Header:\n");
+    printf("  Transaction ID:  0x%04X (%u)\n", 
+           frame->mbap.transaction_id, frame->mbap.transaction_id);
+    printf("  Protocol ID:     0x%04X (Modbus)\n", frame->mbap.protocol_id);
+    printf("  Length:          %u bytes\n", frame->mbap.length);
+    printf("  Unit ID:         0x%02X\n", frame->mbap.unit_id);
+    
+    // PDU
+    printf("\nProtocol Data Unit (PDU):\n");
+    printf("  Function Code:   0x%02X (%s)\n", 
+           frame->function_code, modbus_get_function_name(frame->function_code));
+    
+    // Data
+    if (frame->data_length > 0) {
+        printf("  Data Length:     %u bytes\n", frame->data_length);
+        printf("  Data (hex):      ");
+        for (uint16_t i = 0; i < frame->data_length; i++) {
+            printf("%02X ", frame->data[i]);
+            if ((i + 1) % 16 == 0 && i < frame->data_length - 1) {
+                printf("\n                   ");
+            }
+        }
+        printf("\n");
+    } else {
+        printf("  Data:            (none)\n");
+    }
+    
+    printf("\n========================\n");
+}
+
+
+/*
+ * capture_duration() - Seconds between the first and the last frame
+ */
+
+static double capture_duration(const attack_stats_t *stats) {
+    if (stats->total_frames < 2) {
+        return 0.0;
+    }
+    return (double)(stats->last_packet_ns - stats->first_packet_ns) / 1e9;
+}
+
+
+/*
+ * frame_rate_of() - Average frames per second, scaled up for a sample
+ */
+
+static double frame_rate_of(const attack_stats_t *stats, double duration) {
+    if (duration <= 0.0) {
+        return 0.0;
+    }
+    double rate = (double)stats->total_frames / duration;
+    return stats->sample_rate > 1 ? rate * stats->sample_rate : rate;
+}
+
+
+/**
+ * modbus_display_attack_summary() - Display security analysis to console
+ * @stats: Finalized statistics structure
+ *
+ * Outputs security analysis summary to stdout with ANSI color coding:
+ * - Exception rate analysis
+ * - Threat indicators (capture-wide exception rate, enumeration)
+ * - Timing analysis (duration, average rate)
+ * - Function code coverage
+ *
+ * Threat thresholds:
+ * - Exception rate >70%: Potential scanning or misconfiguration
+ * - More than 10 function codes: Broad enumeration
+ *
+ * Call after processing all frames and calculating final metrics.
+ */
+
+void modbus_display_attack_summary(const attack_stats_t *stats) {
+    bool sampled = stats->sample_rate > 1;
+    double duration = capture_duration(stats);
+    double frame_rate = frame_rate_of(stats, duration);
+    char frames[64];
+    char exceptions[64];
+
+    modbus_format_estimate(frames, sizeof(frames), stats->total_frames, stats->sample_rate,
+                           stats->sample_design_effect);
+    modbus_format_estimate(exceptions, sizeof(exceptions), stats->exception_count,
+                           stats->sample_rate, stats->sample_design_effect);
+
+    printf("\n%s=== Security Analysis ===%s\n", COLOR_WHITE, COLOR_RESET);
+    if (sampled) {
+        printf("%sESTIMATED from a 1-in-%u sample (~ marks a scaled count)%s\n", COLOR_YELLOW,
+               stats->sample_rate, COLOR_RESET);
+        if (stats->sample_design_effect > 1.0) {
+            printf("  Design effect:       %.2f (whole flows or seconds kept; intervals widened)\n",
+                   stats->sample_design_effect);
+        }
+    }
+    
+    // Exception rate analysis
+    printf("\n%sException Rate Analysis:%s\n", COLOR_WHITE, COLOR_RESET);
+    printf("  Total Frames:        %s\n", frames);
+    printf("  Exception Responses: %s%s%s (%.1f%%)\n", 
+           stats->exception_rate > 50.0f ? COLOR_YELLOW : COLOR_GREEN,
+           exceptions, COLOR_RESET, stats->exception_rate);
+    
+    // Threat indicators
+    printf("\n%sThreat Indicators:%s\n", COLOR_WHITE, COLOR_RESET);
+    
+    bool threat_detected = false;
+    
+    // High exception rate
+    if (stats->exception_rate > 70.0f) {
+        printf("  %s[!] HIGH EXCEPTION RATE%s - %.1f%% exceptions (likely scanning)\n",
+               COLOR_YELLOW, COLOR_RESET, stats->exception_rate);
+        threat_detected = true;
+    }
+    
+    // Wide function code coverage
+    if (stats->unique_functions_seen > 10) {
+        printf("  %s[!] BROAD ENUMERATION%s - %u different function codes tested\n",
+               COLOR_YELLOW, COLOR_RESET, stats->unique_functions_seen);
+        threat_detected = true;
+    }
+    
+    if (!threat_detected) {
+        printf("  %s[✓] No obvious scanning patterns detected%s\n", 
+               COLOR_GREEN, COLOR_RESET);
+    }
+
+    // Timing Analysis
+    printf("\n%sTiming Analysis:%s\n", COLOR_WHITE, COLOR_RESET);
+    printf("  Total Duration:      %.2f seconds\n", duration);
+    printf("  Average Frame Rate:  %s%.2f frames/second\n", sampled ? "~" : "",
+           frame_rate);
+    
+    // High rate scanning indicator
+    if (frame_rate > 10.0) {
+        printf("  %s[!] HIGH FRAME RATE%s - %.1f fps (automated scannign likely)\n",
+                COLOR_YELLOW, COLOR_RESET, frame_rate);
+    }
+
+    // Function coverage details
+    printf("\n%sFunction Code Coverage:%s\n", COLOR_WHITE, COLOR_RESET);
+    printf("  Unique functions tested: %u%s\n", stats->unique_functions_seen,
+           sampled ? " (in the sample; rarer codes may be missing)" : "");
+    
+    // List probed functions
+    printf("  Codes observed: ");
+    uint32_t count = 0;
+    for (int i = 0; i < 256; i++) {
+        if (stats->function_codes_seen[i]) {
+            if (count > 0) printf(", ");
+            printf("0x%02X", i);
+            count++;
+            if (count % 10 == 0 && count < stats->unique_functions_seen) {
+                printf("\n                  ");
+            }
+        }
+    }
+    printf("\n");
+}
+
+
+/*
+ * build_report_filename() - "<dir>/<base>_analysis.md" for a capture path
+ */
+
+static void build_report_filename(const char *pcap_filename, char *report_filename) {
+    // Find the last directory separator and last dot
+    const char *last_slash = strrchr(pcap_filename, '/');
+    const char *last_backslash = strrchr(pcap_filename, '\\');
+    const char *filename_start = pcap_filename;
+    
+    // Use whichever separator was found last
+    if (last_slash && last_backslash) {
+        filename_start = (last_slash > last_backslash) ? last_slash + 1 : last_backslash + 1;
+    } else if (last_slash) {
+        filename_start = last_slash + 1;
+    } else if (last_backslash) {
+        filename_start = last_backslash + 1;
+    }
+    
+    // Copy the directory path
+    size_t dir_len = filename_start - pcap_filename;
+    if (dir_len > 0) {
+        strncpy(report_filename, pcap_filename, dir_len);
+        report_filename[dir_len] = '\0';
+    } else {
+        report_filename[0] = '\0';
+    }
+    
+    // Find the extension
+    const char *dot = strrchr(filename_start, '.');
+    size_t base_len = dot ? (size_t)(dot - filename_start) : strlen(filename_start);
+    
+    // Append base filename and new extension
+    strncat(report_filename, filename_start, base_len);
+    strcat(report_filename, "_analysis.md");
+}
+
+
+/**
+ * modbus_open_report() - Open markdown report file for writing
+ * @stats: Statistics structure to initialize
+ * @pcap_filename: Base filename (e.g., "capture.pcap")
+ *
+ * Creates report file with naming convention:
+ * <pcap_filename>_analysis.md
+ *
+ * Initializes report_file handle in stats structure.
+ * Sets report_enabled flag on success.
+ *
+ * Return: true if file opened successfully
+ *         false if file creation failed
+ *
+ * On failure, prints error message and disables reporting.
+ */
+
+bool modbus_open_report(attack_stats_t *stats, const char *pcap_filename) {
+    char report_filename[512];
+
+    build_report_filename(pcap_filename, report_filename);
+
+    // Open file for writing
+    stats->report_file = fopen(report_filename, "w");
+    if (!stats->report_file) {
+        printf("Error: Could not create report file: %s\n", report_filename);
+        return false;
+    }
+    
+    printf("Writing report to: %s\n", report_filename);
+    stats->report_enabled = true;
+    return true;
+}
+
+
+/**
+ * modbus_resume_report() - Reopen a report left by an interrupted run
+ * @stats: Statistics structure to attach the report to
+ * @pcap_filename: Capture the report was named after
+ * @offset: Report length recorded with the checkpoint
+ *
+ * Anything written after the checkpoint is cut off, so the resumed run
+ * appends exactly what an uninterrupted run would have.
+ *
+ * Return: true on success, false if the report is missing or shorter
+ *         than @offset
+ */
+
+bool modbus_resume_report(attack_stats_t *stats, const char *pcap_filename, int64_t offset) {
+    char report_filename[512];
+
+    build_report_filename(pcap_filename, report_filename);
+    stats->report_file = fopen(report_filename, "r+");
+    if (!stats->report_file) {
+        printf("Error: Could not reopen report file: %s\n", report_filename);
+        return false;
+    }
+
+    bool ok = fseek(stats->report_file, 0, SEEK_END) == 0 && ftell(stats->report_file) >= offset;
+#ifdef _WIN32
+    ok = ok && _chsize_s(_fileno(stats->report_file), offset) == 0;
+#else
+    ok = ok && ftruncate(fileno(stats->report_file), (off_t)offset) == 0;
+#endif
+    if (!ok || fseek(stats->report_file, 0, SEEK_END) != 0) {
+        printf("Error: Report file %s does not match the checkpoint\n", report_filename);
+        fclose(stats->report_file);
+        stats->report_file = NULL;
+        return false;
+    }
+
+    printf("Appending to report: %s\n", report_filename);
+    stats->report_enabled = true;
+    return true;
+}
+
+
+/**
+ * modbus_report_position() - Flush the report and return its length
+ * @stats: Statistics structure
+ *
+ * Return: Bytes written so far, 0 if no report is open, -1 on error
+ */
+
+int64_t modbus_report_position(attack_stats_t *stats) {
+    if (!stats->report_enabled || !stats->report_file) return 0;
+    if (fflush(stats->report_file) != 0) return -1;
+    return (int64_t)ftell(stats->report_file);
+}
+
+
+/**
+ * modbus_write_report_header() - Write markdown report header
+ * @stats: Statistics structure with open report file
+ * @pcap_filename: Original PCAP filename for metadata
+ *
+ * Writes:
+ * - Report title ("Modbus TCP Security Analysis Report")
+ * - Generation timestamp
+ * - Source file reference
+ * - Traffic summary table header
+ *
+ * Call once after modbus_open_report() and before writing frames.
+ * No-op if report not enabled.
+ */
+
+void modbus_write_report_header(attack_stats_t *stats, const char *pcap_filename) {
+    if (!stats->report_enabled || !stats->report_file) return;
+    
+    FILE *f = stats->report_file;
+    time_t now = time(NULL);
+    char timestamp[64];
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", localtime(&now));
+    
+    fprintf(f, "# Modbus TCP Security Analysis Report\n\n");
+    fprintf(f, "**Generated:** %s  \n", timestamp);
+    fprintf(f, "**Source File:** `%s`  \n", pcap_filename);
+    if (stats->sample_rate > 1) {
+        fprintf(f, "**Sampling:** 1 in %u; Security Analysis counts are estimates and only "
+                "sampled frames are listed  \n", stats->sample_rate);
+    }
+    fprintf(f, "\n---\n\n");
+    fprintf(f, "## Traffic Summary\n\n");
+    fprintf(f, "| Packet | Timestamp | Source | Destination | Trans ID | Unit | Function | Details | Rules |\n");
+    fprintf(f, "|--------|-----------|--------|-------------|----------|------|----------|---------|-------|\n");
+}
+
+
+/**
+ * modbus_write_report_summary() - Write security analysis section
+ * @stats: Finalized statistics structure
+ * @function_counts: Array of 256 per-function-code counters
+ *
+ * Writes markdown sections:
+ * - Security Analysis header
+ * - Exception rate analysis
+ * - Threat indicators (exception rate, enumeration)
+ * - Timing analysis (duration, frame rate)
+ * - Function code summary table
+ * - Function code coverage
+ *
+ * Calculates and displays:
+ * - Exception rate percentage
+ * - Average frame rate (frames/second)
+ * - Total capture duration
+ * - Threat assessments based on thresholds
+ *
+ * Call once after all frames processed.
+ * No-op if report not enabled.
+ */
+
+void modbus_write_report_summary(attack_stats_t *stats, const uint32_t *function_counts) {
+    if (!stats->report_enabled || !stats->report_file) return;
+    
+    FILE *f = stats->report_file;
+    bool sampled = stats->sample_rate > 1;
+    double duration = capture_duration(stats);
+    double frame_rate = frame_rate_of(stats, duration);
+    char count_text[64];
+    
+    fprintf(f, "\n---\n\n");
+    fprintf(f, "## Security Analysis\n\n");
+    if (sampled) {
+        fprintf(f, "> **Estimated** from a 1-in-%u sample: counts marked ~ are scaled, with "
+                "95%% confidence intervals", stats->sample_rate);
+        if (stats->sample_design_effect > 1.0) {
+            fprintf(f, " widened by a design effect of %.2f", stats->sample_design_effect);
+        }
+        fprintf(f, ".\n\n");
+    }
+   
+    // Exception rate analysis
+    fprintf(f, "### Exception Rate Analysis\n\n");
+    modbus_format_estimate(count_text, sizeof(count_text), stats->total_frames,
+                           stats->sample_rate, stats->sample_design_effect);
+    fprintf(f, "- **Total Frames:** %s\n", count_text);
+    modbus_format_estimate(count_text, sizeof(count_text), stats->exception_count,
+                           stats->sample_rate, stats->sample_design_effect);
+    fprintf(f, "- **Exception Responses:** %s (%.1f%%)\n", 
+            count_text, stats->exception_rate);
+    
+    // Threat indicators
+    fprintf(f, "\n### Threat Indicators\n\n");
+    
+    bool threat_detected = false;
+    
+    if (stats->exception_rate > 70.0f) {
+        fprintf(f, "- ⚠️ **HIGH EXCEPTION RATE** - %.1f%% exceptions (likely scanning)\n",
+                stats->exception_rate);
+        threat_detected = true;
+    }
+    
+    if (stats->unique_functions_seen > 10) {
+        fprintf(f, "- ⚠️ **BROAD ENUMERATION** - %u different function codes tested\n",
+                stats->unique_functions_seen);
+        threat_detected = true;
+    }
+    
+    if (!threat_detected) {
+        fprintf(f, "- ✅ No obvious scanning patterns detected\n");
+    }
+
+    // Timing analysis
+    fprintf(f, "\n### Timing Analysis\n\n");
+    fprintf(f, "- **Total Duration:** %.2f seconds\n", duration);
+    fprintf(f, "- **Average Frame Rate:** %s%.2f frames/second\n\n", sampled ? "~" : "",
+            frame_rate);
+    
+    if (frame_rate > 10.0) {
+        fprintf(f, "- ⚠️ **HIGH FRAME RATE** - %.1f fps (automated scanning likely)\n", 
+                frame_rate);
+    }
+
+    // Function code summary
+    fprintf(f, "\n### Function Code Summary\n\n");
+    fprintf(f, "**Unique functions tested:** %u%s\n\n", stats->unique_functions_seen,
+            sampled ? " (in the sample)" : "");
+    
+    fprintf(f, "| Function Code | Function Name | %s |\n", sampled ? "Estimated Count" : "Count");
+    fprintf(f, "|---------------|---------------|-------|\n");
+    
+    for (int i = 0; i < 256; i++) {
+        if (function_counts[i] > 0) {
+            modbus_format_estimate(count_text, sizeof(count_text), function_counts[i],
+                                   stats->sample_rate, stats->sample_design_effect);
+            fprintf(f, "| 0x%02X | %s | %s |\n", 
+                    i, modbus_get_function_name(i), count_text);
+        }
+    }
+    
+    // Function coverage
+    fprintf(f, "\n### Function Code Coverage\n\n");
+    fprintf(f, "Codes observed: ");
+    
+    uint32_t count = 0;
+    for (int i = 0; i < 256; i++) {
+        if (stats->function_codes_seen[i]) {
+            if (count > 0) fprintf(f, ", ");
+            fprintf(f, "`0x%02X`", i);
+            count++;
+        }
+    }
+    fprintf(f, "\n");
+}
+
+
+/**
+ * modbus_write_report_summary() - Close report file and clean up
+ * @stats: Statistics structure with open report file
+ *
+ * Flushes and closes report file handle.
+ * Sets report_file to NULL.
+ * No-op if report not enabled.
+ *
+ * Call after modbus_write_report_summary() to finalize report.
+ */
+
+void modbus_close_report(attack_stats_t *stats) {
+    if (!stats->report_enabled || !stats->report_file) return;
+    
+    fprintf(stats->report_file, "\n---\n\n");
+    fprintf(stats->report_file, "*Report generated by Modbus TCP Parser*\n");
+    
+    fclose(stats->report_file);
+    stats->report_file = NULL;
+    stats->report_enabled = false;
+}
@@ -0,0 +1,278 @@
+/*
+ * modbus_output.h - Terminal display and markdown reports
+ *
+ * Verbose frame display, security and parse error summaries, and the
+ * markdown report for the command-line tool. Per-frame table and report
+ * rows are written by the sinks of output_sink.h.
+ * Built on the modbus_parse library; library users that do not want
+ * terminal output need not link this module.
+ *
+ * Copyright (C) 2025 Marty
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+
+#ifndef MODBUS_OUTPUT_H
+#define MODBUS_OUTPUT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "modbus_parser.h"
+#include "capture_input.h"
+#include "pcap_reader.h"
+
+
+/**
+ * enum display_mode_t - Display mode selection for frame output
+ *
+ * Controls the verbosity and format of frame display output.
+ */
+
+typedef enum {
+    DISPLAY_TABLE,      // Compact table format
+    DISPLAY_VERBOSE     // Detailed breakdown
+} display_mode_t;
+
+
+
+/**
+ * modbus_display_parse_errors() - Print failure counters to stdout
+ * @errors: Accounting structure
+ *
+ * Prints nothing if no failure was recorded.
+ */
+
+void modbus_display_parse_errors(const modbus_parse_errors_t *errors);
+
+
+/**
+ * modbus_display_input_stats() - Print per-stage throughput of a compressed capture
+ * @stats: Pipeline statistics from modbus_session_input_stats()
+ *
+ * Names the slowest stage: disk read, decompression or the parser.
+ */
+
+void modbus_display_input_stats(const capture_input_stats_t *stats);
+
+
+/**
+ * modbus_display_merge_stats() - Print what each merged capture contributed
+ * @stats: Counters from modbus_session_merge_stats()
+ * @filenames: Captures, in the order they were merged
+ */
+
+void modbus_display_merge_stats(const pcap_merge_stats_t *stats, const char *const *filenames);
+
+
+/**
+ * modbus_display_memory_stats() - Print frame allocator instrumentation
+ * @stats: Counters from arena_stats(modbus_session_arena())
+ *
+ * Shows arena allocation counts, peak bytes and how many heap calls
+ * the allocator made in total.
+ */
+
+void modbus_display_memory_stats(const arena_stats_t *stats);
+
+
+/**
+ * modbus_write_report_parse_errors() - Append failure counters to report
+ * @errors: Accounting structure
+ * @f: Open report file (no-op if NULL)
+ */
+
+void modbus_write_report_parse_errors(const modbus_parse_errors_t *errors, FILE *f);
+
+
+/**
+ * modbus_write_report_merge_stats() - Append the capture merge table to report
+ * @stats: Counters from modbus_session_merge_stats()
+ * @filenames: Captures, in the order they were merged
+ * @f: Open report file (no-op if NULL)
+ */
+
+void modbus_write_report_merge_stats(const pcap_merge_stats_t *stats,
+                                     const char *const *filenames, FILE *f);
+
+
+/**
+ * modbud_display_frame() - Display detailed verbose frame breakdown
+ * @frame: Parsed frame to display
+ *
+ * Outputs multi-line detailed breakdown to stdout including:
+ * - All MBAP header fields
+ * - Function code with name
+ * - Function-specific data decoding
+ *
+ * Function-specific decoding:
+ * - 0x03/0x04 (Read Registers): Start address + quantity
+ * - 0x06 (Write Single): Address + value  
+ * - 0x10 (Write Multiple): Start address + quantity + byte count
+ * - 0x80+ (Exception): Exception code
+ * - Others: Hex dump of data
+ *
+ * Output format suitable for debugging and learning protocol details.
+ * The table sink (output_sink.h) gives a compact one-line form.
+ */
+
+void modbus_display_frame(const modbus_tcp_frame_t *frame);
+
+
+/**
+ * modbus_display_attack_summary() - Display security analysis summary
+ * @stats: Finalised statistics structure
+ * @param2: Description of second parameter
+ *
+ * Outputs human-readable security analysis to stdout including:
+ * - Exception rate (percentage)
+ * - Threat indicators (capture-wide exception rate, enumeration)
+ * - Timing (duration, average rate)
+ * - Function code coverage
+ *
+ * Should be called after modbus_finalize_attack_stats().
+ * Output is suitable for terminal display (uses ANSI colors).
+ */
+
+void modbus_display_attack_summary(const attack_stats_t *stats);
+
+
+/**
+ * modbus_open_report() - Open markdown report file for writing
+ * @stats: Statistics structure to intialise for reporting
+ * @pcap_filename: Base filename for report (e.g., "capture,pcap" -> 
+ * "capture_analysis.md")
+ *
+ * Creates and opens markdown report file with naming convention:
+ * <input_filename>_analysis.md
+ *
+ * Return: true on success, false if file creation failed
+ */
+
+bool modbus_open_report(attack_stats_t *stats, const char *pcap_filename);
+
+
+/**
+ * modbus_resume_report() - Reopen a report left by an interrupted run
+ * @stats: Statistics structure to attach the report to
+ * @pcap_filename: Capture the report was named after
+ * @offset: Report length recorded with the checkpoint
+ *
+ * Truncates the report to @offset and positions for appending; the
+ * header is not written again.
+ *
+ * Return: true on success, false if the report is missing or shorter
+ *         than @offset
+ */
+
+bool modbus_resume_report(attack_stats_t *stats, const char *pcap_filename, int64_t offset);
+
+
+/**
+ * modbus_report_position() - Flush the report and return its length
+ * @stats: Statistics structure
+ *
+ * Return: Bytes written so far, 0 if no report is open, -1 on error
+ */
+
+int64_t modbus_report_position(attack_stats_t *stats);
+
+
+/**
+ * modbus_write_report_header() - Write markdown report header and traffic
+ * table header
+ * @stats: Statistics structure with open report file
+ * @pcap_filename: Original PCAP filename for report metadata
+ *
+ * Writes:
+ * - Report title and metadata (date, source file)
+ * - Traffic summary table header
+ *
+ * Call once after modbus_open_report() before writing frames (the
+ * markdown sink of output_sink.h writes the traffic rows).
+ */
+
+void modbus_write_report_header(attack_stats_t *stats, const char *pcap_filename);
+
+
+/**
+ * modbus_write_report_summary() - Write security analysis section to report
+ * @stats: Finalised statistics structure
+ * @function_counts: Array of 256 counters (perfunction code usage)
+ *
+ * Writes markdown sections:
+ * - Exception rate analysis
+ * - Threat indicators
+ * - Timing analysis
+ * - Function code summary table
+ * - Function code coverage
+ *
+ * Call once after all frames processed and stats finalized.
+ */
+
+void modbus_write_report_summary(attack_stats_t *stats, const uint32_t *function_counts);
+
+
+/**
+ * modbus_close_report() - CLose report file and clean up
+ * @stats: Statistics structure with open report
+ *
+ * Flushes and closes the report file.
+ * Sets report_file to NULL.
+ * No-op if report not enabled.
+ */
+
+void modbus_close_report(attack_stats_t *stats);
+
+/**
+ * modbus_log_parse_error() - Print one sampled parse failure
+ * @error: Failure class
+ * @src_ip: Source IP address
+ * @src_port: Source TCP port
+ * @dst_ip: Destination IP address
+ * @dst_port: Destination TCP port
+ * @timestamp_ns: Packet timestamp (nanoseconds since epoch)
+ * @suppressed: Failures dropped by the rate limit since the last line
+ *
+ * Call when modbus_parse_errors_record() returns true.
+ */
+
+void modbus_log_parse_error(modbus_parse_error_t error,
+                            const char *src_ip, uint16_t src_port,
+                            const char *dst_ip, uint16_t dst_port,
+                            int64_t timestamp_ns, uint64_t suppressed);
+
+
+/**
+ * modbus_format_host_port() - Format "address:port"
+ * @buf: Output buffer
+ * @len: Size of @buf
+ * @ip: Formatted IPv4 or IPv6 address
+ * @port: TCP port
+ *
+ * IPv6 addresses are bracketed ("[2001:db8::1]:502") so the port
+ * separator stays unambiguous.
+ */
+
+void modbus_format_host_port(char *buf, size_t len, const char *ip, uint16_t port);
+
+
+/**
+ * modbus_format_estimate() - Format a counter, scaled if it was sampled
+ * @buf: Output buffer
+ * @len: Size of @buf
+ * @count: Count in the sample
+ * @sample_rate: Records kept 1 in N (0 or 1 = not sampled)
+ * @design_effect: Variance factor of clustered sampling (below 1 = 1)
+ *
+ * Unsampled counts are printed as they are. Sampled ones become
+ * "~estimate (95% CI low-high)": each record is kept with probability
+ * 1/N, so the estimate is count * N with variance count * N * (N - 1),
+ * times @design_effect when whole flows or seconds were kept. A count
+ * of 0 gets the rule-of-three bound 3N, also times @design_effect.
+ */
+
+void modbus_format_estimate(char *buf, size_t len, uint64_t count, uint32_t sample_rate,
+                            double design_effect);
+
+#endif /* MODBUS_OUTPUT_H */
@@ -1,17 +1,17 @@
 /*
  * modbus_parser.h - Modbus TCP protocol parsing and security analysis
  *
- * This module provides comprehensive Modbus TCP frame parsing, display
- * formatting, and security analysis capabilities. Handles MBAP header
- * validation, function code decoding, and threat detection.
+ * This module provides Modbus TCP frame parsing and capture-wide
+ * statistics. Handles MBAP header validation, function code decoding,
+ * parse failure classification and threat statistics. It is part of the
+ * modbus_parse library and never writes to stdout; terminal display and
+ * markdown reports are declared in modbus_output.h.
  *
  * Key features:
  * - MBAP header parsing with validation
  * - All standard function codes (0x01-0x2B)
  * - Exception response handling
- * - Security analysis (scanning, timing, exceptions)
- * - Dual display modes (table/verbose)
- * - Markdown report generation
+ * - Security statistics (timing, exceptions, function coverage)
  * 
  * Copyright (C) 2025 Marty
  * SPDX-License-Identifier: GPL-3.0-or-later
@@ -24,19 +24,7 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <stdio.h>
-
-
-/**
- * enum display_mode_t - Display mode selection for frame output
- *
- * Controls the verbosity and format of frame display output.
- */
-
-typedef enum {
-    DISPLAY_TABLE,      // Compact table format
-    DISPLAY_VERBOSE     // Detailed breakdown
-} display_mode_t;
-
+#include "arena.h"
 
 
 /**
@@ -70,17 +58,19 @@ typedef struct {
  * modbus_tcp_frame_t() - Complete parsed Modbus TCP frame structure
  * @modbus_mbap_header_t: MBAP header (7 bytes)
  * @function_code: Modbus function (0x01-0x7F) or exception (0x80+)
- * @data: Function-specific data (heap allocated, can be NULL)
+ * @data: Function-specific data (heap or arena allocated, can be NULL)
  * @data_length: Length of data field in bytes
  *
  * Contains the MBAP header and Protocol Data Unit (PDU).
  * The data field is dynamically allocated and must be freed
- * via modbus_free_frame() after use.
+ * via modbus_free_frame() after use, unless it came from an arena.
  *
  * Memory management:
  * - Structure itself: typically stack-allocated
- * - data field: heap-allocated by modbus_parse_frame()
- * - Caller must call modbus_free_frame() to release data
+ * - data field: heap-allocated by modbus_parse_frame(), or taken from
+ *   the arena given to modbus_parse_frame_arena()
+ * - Caller must call modbus_free_frame() to release heap data; arena
+ *   data is released by arena_reset()
  */
 
 typedef struct {
@@ -114,27 +104,72 @@ typedef enum {
 } modbus_exception_code_t;
 
 
+/**
+ * enum modbus_parse_error_t - Classified result of modbus_parse_frame_checked()
+ *
+ * Every payload delivered on port 502 ends up in exactly one class.
+ */
+
+typedef enum {
+    MODBUS_PARSE_OK,
+    MODBUS_PARSE_TRUNCATED,         // ADU longer than the TCP segment on the wire
+    MODBUS_PARSE_BAD_PROTOCOL,      // Consistent length but protocol ID != 0
+    MODBUS_PARSE_BAD_LENGTH,        // MBAP length < 2 or > 254
+    MODBUS_PARSE_SNAPLEN_CLIPPED,   // ADU complete on the wire, cut by snaplen
+    MODBUS_PARSE_NOT_MODBUS,        // Port 502 payload that is not Modbus TCP
+    MODBUS_PARSE_NO_MEMORY,         // Data buffer allocation failed
+    MODBUS_PARSE_ERROR_COUNT
+} modbus_parse_error_t;
+
+
+/* Default parse-error log lines per capture second (--parse-log) */
+#define MODBUS_PARSE_LOG_DEFAULT_RATE 10
+
+
+/**
+ * struct modbus_parse_errors_t - Parse failure accounting
+ * @counts: Failures per modbus_parse_error_t class
+ * @log_rate: Log lines allowed per capture second (0 = no log)
+ * @log_second: Capture second of the current log budget
+ * @log_used: Lines logged in @log_second
+ * @log_suppressed: Failures not logged since the last logged line
+ *
+ * Failures only bump counters; the optional log is rate limited per
+ * capture second, so a malformed flood cannot stall processing on
+ * stdout. Suppressed lines are reported with the next logged one.
+ */
+
+typedef struct {
+    uint64_t counts[MODBUS_PARSE_ERROR_COUNT];
+    uint32_t log_rate;
+    int64_t log_second;
+    uint32_t log_used;
+    uint64_t log_suppressed;
+} modbus_parse_errors_t;
+
+
 /**
  * attack_stats_t() - Security analysis statistics accumulator
  * @total_frames: Total frames processed
  * @exception_count: Exception responses seen
  * @unique_functions_seen: Count of unique function codes
- * @sequential_probes: Consecutive sequential function codes
  * @function_codes_seen: Bitmap of observed function codes
- * @last_function_code: Previous function code (for pattern detection)
- * @sequential_pattern_detected: True if scannign pattern identified
  * @exception_rate: Calculated percentage (0.0-100.0)
  * @report_file: Open report file handle (NULL if disabled)
  * @report_enabled: Report generation flag
- * @first_packet_time: Timestamp of first frame (seconds)
- * @last_packet_time: Timestamp of last frame
- * @total_duration: Time span of capture
- * @avg_frame_rate: Frames per second
- * @rapid_burst_count: Frames < 0.1s apart (possible flood)
- *
- * Tracks frame counters, function code usage, timing patterns, and
- * threat indicators across all processed frames. Used to detect
- * reconnaissance, scanning, and anomalous behavior.
+ * @first_packet_ns: Timestamp of first frame (nanoseconds since epoch)
+ * @last_packet_ns: Timestamp of last frame; the duration and average
+ *                  frame rate are derived from the two when shown
+ * @sample_rate: Frames come from a 1-in-N sample of the capture (0 or 1 =
+ *               every frame); the counters stay raw and are scaled to
+ *               estimates when shown (modbus_format_estimate())
+ * @sample_design_effect: Variance factor of flow or time sampling
+ *                        (sample_estimate.h; 0 or 1 = independent frames)
+ *
+ * Tracks capture-wide frame counters, function code usage and timing.
+ * Time-local behaviour (bursts, sequential probing, per-source exception
+ * storms) is tracked per master by the sliding-window detector in
+ * anomaly_detector.h.
  *
  * Initialize with modbus_init_attack_stats(), update per-frame with
  * modbus_update_attack_stats(), and finalize with modbus_finalize_attack_stats
@@ -145,10 +180,7 @@ typedef struct {
     uint32_t total_frames;
     uint32_t exception_count;
     uint32_t unique_functions_seen;
-    uint32_t sequential_probes;
     bool function_codes_seen[256];
-    uint8_t last_function_code;
-    bool sequential_pattern_detected;
     float exception_rate;
         
     // Report generation fields
@@ -156,11 +188,12 @@ typedef struct {
     bool report_enabled;
 
     // Timing analysis
-    double first_packet_time;
-    double last_packet_time;
-    double total_duration;
-    double avg_frame_rate;
-    uint32_t rapid_burst_count;  // Frames within 0.1s of previous
+    int64_t first_packet_ns;
+    int64_t last_packet_ns;
+
+    // Sampling (--sample)
+    uint32_t sample_rate;
+    double sample_design_effect;
 } attack_stats_t;
 
 
@@ -194,6 +227,8 @@ const char* modbus_get_function_name(uint8_t function_code);
  *
  * Parses MBAP header and PDU from raw bytes into structured format.
  * Validates protocol ID (must be 0x0000) and length field.
+ * Wrapper around modbus_parse_frame_checked() for callers that do not
+ * need the failure class; @payload_len is used as the wire length.
  * Allocates memory for frame->data which must be freed via modbus_free_frame().
  *
  * Parsing steps:
@@ -213,230 +248,167 @@ bool modbus_parse_frame(const uint8_t *payload, uint32_t payload_len, modbus_tcp
 
 
 /**
- * modbud_display_frame() - Display detailed verbose frame breakdown
- * @frame: Parsed frame to display
- *
- * Outputs multi-line detailed breakdown to stdout including:
- * - All MBAP header fields
- * - Function code with name
- * - Function-specific data decoding
- *
- * Function-specific decoding:
- * - 0x03/0x04 (Read Registers): Start address + quantity
- * - 0x06 (Write Single): Address + value  
- * - 0x10 (Write Multiple): Start address + quantity + byte count
- * - 0x80+ (Exception): Exception code
- * - Others: Hex dump of data
- *
- * Output format suitable for debugging and learning protocol details.
- * Use modbus_display_frame_table() for compact bulk analysis.
+ * modbus_parse_frame_checked() - Strictly parse and classify a payload
+ * @payload: Captured TCP payload (MBAP header + PDU)
+ * @captured_len: Payload bytes present in the capture
+ * @wire_len: Payload bytes on the wire (from the IP total length)
+ * @frame: Output structure to populate
+ *
+ * Every read is bounded by @captured_len; the MBAP length is validated
+ * before it is used to size the data copy. @wire_len tells a frame cut
+ * by the capture snaplen apart from an ADU that spans TCP segments.
+ * A segment holding several ADUs yields the first one.
+ *
+ * Return: MODBUS_PARSE_OK with @frame populated (free with
+ *         modbus_free_frame()), otherwise the failure class with no
+ *         memory allocated
  */
 
-void modbus_display_frame(const modbus_tcp_frame_t *frame);
+modbus_parse_error_t modbus_parse_frame_checked(const uint8_t *payload, uint32_t captured_len,
+                                                uint32_t wire_len, modbus_tcp_frame_t *frame);
 
 
 /**
- * modbus_free_frame() - Frere memory allocated by modbus_parse_frame()
- * @frame: Frame structure to free (must have been populated by 
- *         modbus_parse_frame())
- *
- * Frees the dynamically allocated data field and zeros pointers.
- * Must be called for every successfully parsed frame.
- * Does not free the frame structure itself (typically stack-allocated).
- *
- * Safe to call:
- * - Multiple times (checks for NULL)
- * - On failed parse (data will be NULL)
- *
- * @warning Do not use frame->data after calling this function
+ * modbus_parse_frame_arena() - modbus_parse_frame_checked() into an arena
+ * @payload: Captured TCP payload (MBAP header + PDU)
+ * @captured_len: Payload bytes present in the capture
+ * @wire_len: Payload bytes on the wire (from the IP total length)
+ * @frame: Output structure to populate
+ * @arena: Allocator for the data field (NULL = malloc())
+ *
+ * With an arena the data lives until arena_reset() and must not be
+ * passed to modbus_free_frame(); no heap call is made per frame.
+ *
+ * Return: MODBUS_PARSE_OK with @frame populated, otherwise the failure
+ *         class with no memory allocated
  */
 
-void modbus_free_frame(modbus_tcp_frame_t *frame);
+modbus_parse_error_t modbus_parse_frame_arena(const uint8_t *payload, uint32_t captured_len,
+                                              uint32_t wire_len, modbus_tcp_frame_t *frame,
+                                              arena_t *arena);
 
 
 /**
- * modbus_display_frame_table() - Display frame in compact table format
- * @frame: Parsed frame to display
- * @src_ip: Source IP address
- * @src_port: Source TCP port
- * @dst_ip: Destination IP address
- * @dst_port: Destination TCP port
- * @packet_number: Sequence number for display (1-based)
- * @timestamp: Packet timestamp (formatted as HH:MM:SS.microseconds)
- * @is_first: If true, prints table header first
- *
- * Outputs single-line table row with color coding:
- * - Cyan: IP addresses
- * - Yellow: Transaction ID
- * - Green: Unit ID
- * - Magenta: Function code
- * - Blue: Data details
- *
- * Call with is_first=true for the first frame only to print header.
- * Subsequent frames should pass is_first=false.
- *
- * Suitable for processing many frames where compact output is needed.
- * Colors use ANSI codes (may not work in all terminals).
+ * modbus_get_parse_error_name() - Display name of a parse failure class
+ * @error: Failure class
+ *
+ * Return: Static string (never NULL)
  */
 
-void modbus_display_frame_table(const modbus_tcp_frame_t *frame,
-                                const char *src_ip, uint16_t src_port,
-                                const char *dst_ip, uint16_t dst_port,
-                                uint32_t packet_number,
-                                double timestamp,
-                                bool is_first);
+const char* modbus_get_parse_error_name(modbus_parse_error_t error);
 
 
 /**
- * modbus_get_exception_name() - Get human-readable exception code name 
- * @exception_code: Modbus exception code (0x01-0x0B)
- * @param2: Description of second parameter
- *
- * Returns descriptive name for standard Modbus exception codes.
- * Used when function_code >= 0x80 indicates an exception response.
- *
- * Return: Static string with exception name (never NULL)
- *         "Unknown Exception" for undefined codes
- *         String must not be freed by caller
+ * modbus_parse_errors_init() - Reset failure accounting
+ * @errors: Accounting structure
+ * @log_rate: Log lines per capture second (0 disables the log)
  */
 
-const char* modbus_get_exception_name(uint8_t exception_code);
+void modbus_parse_errors_init(modbus_parse_errors_t *errors, uint32_t log_rate);
 
 
 /**
- * modbus_update_sttack_stats() - Update security statistics for a frame
- * @stats: Statistics structure to update
- * @frame: Parsed frame to analyse
- * @timestamp: Frame timestamp for timing analysis
+ * modbus_parse_errors_record() - Count one failure and apply the log budget
+ * @errors: Accounting structure
+ * @error: Failure class (MODBUS_PARSE_OK is ignored)
+ * @timestamp_ns: Packet timestamp (nanoseconds since epoch)
+ * @suppressed: Output: failures not logged since the last logged one
+ *              (only set when true is returned)
  *
- * Updates per-frame security statistics including:
- * - Frame counters (total, exceptions)
- * - Function code tracking (unique codes, sequential patterns)
- * - Timing analysis (burst detection)
- * - Threat indicators (scanning patterns)
- *
- * Detection logic:
- * - Exception responses: function_code >= 0x80
- * - Sequential scanning: 3+ consecutive sequential function codes
- * - Rapid bursts: frames < 0.1 seconds apart
+ * The library never prints; callers log via their own output path
+ * (modbus_log_parse_error() in the CLI) when this returns true.
  *
- * Call once per frame during PCAP processing.
- * Must call modbus_init_attack_stats() before first use.
- * Call modbus_finalize_attack_stats() after all frames processed.
+ * Return: true if the caller should log this failure
  */
 
-void modbus_update_attack_stats(attack_stats_t *stats, const modbus_tcp_frame_t *frame, double timestamp);
+bool modbus_parse_errors_record(modbus_parse_errors_t *errors, modbus_parse_error_t error,
+                                int64_t timestamp_ns, uint64_t *suppressed);
 
 
 /**
- * modbus_display_attack_summary() - Display security analysis summary
- * @stats: Finalised statistics structure
- * @param2: Description of second parameter
+ * modbus_parse_errors_total() - Total failures across all classes
+ * @errors: Accounting structure
  *
- * Outputs human-readable security analysis to stdout including:
- * - Exception rate (percentage)
- * - Threat indicators (scanning detected, unusual patterns)
- * - Timing anomalies (rapid bursts)
- * - Function code coverage
- *
- * Should be called after modbus_finalize_attack_stats().
- * Output is suitable for terminal display (uses ANSI colors).
+ * Return: Sum of all failure counters
  */
 
-void modbus_display_attack_summary(const attack_stats_t *stats);
+uint64_t modbus_parse_errors_total(const modbus_parse_errors_t *errors);
 
 
 /**
- * modbus_open_report() - Open markdown report file for writing
- * @stats: Statistics structure to intialise for reporting
- * @pcap_filename: Base filename for report (e.g., "capture,pcap" -> 
- * "capture_analysis.md")
+ * modbus_free_frame() - Frere memory allocated by modbus_parse_frame()
+ * @frame: Frame structure to free (must have been populated by 
+ *         modbus_parse_frame())
+ *
+ * Frees the dynamically allocated data field and zeros pointers.
+ * Must be called for every successfully parsed frame.
+ * Does not free the frame structure itself (typically stack-allocated).
  *
- * Creates and opens markdown report file with naming convention:
- * <input_filename>_analysis.md
+ * Safe to call:
+ * - Multiple times (checks for NULL)
+ * - On failed parse (data will be NULL)
  *
- * Return: true on success, false if file creation failed
+ * @warning Do not use frame->data after calling this function
  */
 
-bool modbus_open_report(attack_stats_t *stats, const char *pcap_filename);
+void modbus_free_frame(modbus_tcp_frame_t *frame);
 
 
 /**
- * modbus_write_report_header() - Write markdown report header and traffic
- * table header
- * @stats: Statistics structure with open report file
- * @pcap_filename: Original PCAP filename for report metadata
+ * modbus_get_exception_name() - Get human-readable exception code name 
+ * @exception_code: Modbus exception code (0x01-0x0B)
+ * @param2: Description of second parameter
  *
- * Writes:
- * - Report title and metadata (date, source file)
- * - Traffic summary table header
+ * Returns descriptive name for standard Modbus exception codes.
+ * Used when function_code >= 0x80 indicates an exception response.
  *
- * Call once after modbus_open_report() before writing frames.
- */
-
-void modbus_write_report_header(attack_stats_t *stats, const char *pcap_filename);
-
-
-/**
- * modbus_write_report_frame() - Write single frame entry to report
- * @stats: Statistics structure with open report file
- * @frame: Parsed frame to report
- * @src_ip: Source IP address
- * @src_port: Source TCP port
- * @dst_ip: Destination IP address
- * @dst_port: Destination TCP port
- * @packet_number: Frame sequence number
- * @timestamp: Frame timestamp
- *
- * Writes markdown table row for the frame including:
- * - Packet number
- * - Formatted timestamp
- * - Source/destination addresses
- * - Transaction ID, Unit ID
- * - Function code with name
- * - Function-specific details
- *
- * Call once per frame during PCAP processing (if reporting enabled).
- * No-op if report not enabled in stats.
+ * Return: Static string with exception name (never NULL)
+ *         "Unknown Exception" for undefined codes
+ *         String must not be freed by caller
  */
 
-void modbus_write_report_frame(attack_stats_t *stats, const modbus_tcp_frame_t *frame,
-                                const char *src_ip, uint16_t src_port,
-                                const char *dst_ip, uint16_t dst_port,
-                                uint32_t packet_number,
-                                double timestamp);
+const char* modbus_get_exception_name(uint8_t exception_code);
 
 
 /**
- * modbus_write_report_summary() - Write security analysis section to report
- * @stats: Finalised statistics structure
- * @function_counts: Array of 256 counters (perfunction code usage)
- *
- * Writes markdown sections:
- * - Exception rate analysis
- * - Threat indicators
- * - Timing analysis
- * - Function code summary table
- * - Function code coverage
- *
- * Call once after all frames processed and stats finalized.
+ * modbus_get_address_range() - Extract the data address range of a frame
+ * @frame: Parsed frame
+ * @is_request: true if the frame was sent to the server (port 502)
+ * @address: Output start address
+ * @quantity: Output number of coils/registers (1 for single writes)
+ *
+ * Requests of 0x01-0x06, 0x0F, 0x10, 0x16 and 0x17 carry a start address
+ * (0x17: the read range). Responses only echo an address for the write
+ * functions 0x05, 0x06, 0x0F and 0x10; read responses start with a byte
+ * count instead and are rejected.
+ *
+ * Return: true if @address/@quantity were filled in
  */
 
-void modbus_write_report_summary(attack_stats_t *stats, const uint32_t *function_counts);
+bool modbus_get_address_range(const modbus_tcp_frame_t *frame, bool is_request,
+                              uint16_t *address, uint16_t *quantity);
 
 
 /**
- * modbus_close_report() - CLose report file and clean up
- * @stats: Statistics structure with open report
+ * modbus_update_sttack_stats() - Update security statistics for a frame
+ * @stats: Statistics structure to update
+ * @frame: Parsed frame to analyse
+ * @timestamp_ns: Frame timestamp (nanoseconds since epoch)
+ *
+ * Updates capture-wide statistics including:
+ * - Frame counters (total, exceptions)
+ * - Function code tracking (unique codes)
+ * - Timing (first/last frame time)
+ *
+ * Exception responses are frames with function_code >= 0x80.
+ * Windowed per-source detection lives in anomaly_detector_update().
  *
- * Flushes and closes the report file.
- * Sets report_file to NULL.
- * No-op if report not enabled.
+ * Call once per frame during PCAP processing.
+ * Must call modbus_init_attack_stats() before first use.
+ * Call modbus_finalize_attack_stats() after all frames processed.
  */
 
-void modbus_close_report(attack_stats_t *stats);
+void modbus_update_attack_stats(attack_stats_t *stats, const modbus_tcp_frame_t *frame,
+                                int64_t timestamp_ns);
 
 #endif /* MODBUS_PARSER_H */
-
-
-
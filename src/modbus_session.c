@@ -0,0 +1,509 @@
+/*
+ * modbus_session.c - Embeddable decoding session (modbus_parse library)
+ *
+ * Glues the capture iterator to the strict frame parser. The session
+ * keeps the current frame's data buffer and frees it on the next call,
+ * so callers never manage frame memory themselves.
+ *
+ * Copyright (C) 2025 Marty
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+
+#include "modbus_session.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/* Version string matching MODBUS_PARSE_VERSION_* */
+#define MODBUS_PARSE_STR2(x) #x
+#define MODBUS_PARSE_STR(x) MODBUS_PARSE_STR2(x)
+#define MODBUS_PARSE_VERSION_STRING MODBUS_PARSE_STR(MODBUS_PARSE_VERSION_MAJOR) "." \
+                                    MODBUS_PARSE_STR(MODBUS_PARSE_VERSION_MINOR) "." \
+                                    MODBUS_PARSE_STR(MODBUS_PARSE_VERSION_PATCH)
+
+/* Error message buffer size */
+#define MODBUS_SESSION_ERROR_LEN 256
+
+
+/**
+ * struct modbus_session - Decoding session state
+ * @reader: Capture iterator
+ * @flags: MODBUS_SESSION_* flags
+ * @errors: Parse failure counters
+ * @current: Frame returned by the last call
+ * @arena: Frame data; reset on the next call, or by
+ *         modbus_session_release_frames() with MODBUS_SESSION_RETAIN_FRAMES
+ * @frames: Frames decoded successfully
+ * @endpoints: Address interning table
+ * @error: Last error message
+ */
+
+struct modbus_session {
+    pcap_reader_t *reader;
+    unsigned flags;
+    modbus_parse_errors_t errors;
+    modbus_tcp_frame_t current;
+    arena_t arena;
+    uint64_t frames;
+    endpoint_table_t endpoints;
+    char error[MODBUS_SESSION_ERROR_LEN];
+};
+
+
+/*
+ * session_create() - Session around an open reader
+ *
+ * Takes @reader over, closing it on failure.
+ */
+
+static modbus_session_t *session_create(pcap_reader_t *reader, unsigned flags,
+                                        char *errbuf, size_t errlen) {
+    modbus_session_t *session = calloc(1, sizeof(modbus_session_t));
+    if (!session) {
+        if (errbuf) snprintf(errbuf, errlen, "out of memory");
+        pcap_reader_close(reader);
+        return NULL;
+    }
+
+    if (!endpoint_table_init(&session->endpoints)) {
+        if (errbuf) snprintf(errbuf, errlen, "out of memory");
+        pcap_reader_close(reader);
+        free(session);
+        return NULL;
+    }
+
+    session->reader = reader;
+    session->flags = flags;
+    arena_init(&session->arena);
+    modbus_parse_errors_init(&session->errors, 0);
+    return session;
+}
+
+
+/**
+ * modbus_session_open() - Open a capture for decoding
+ * @filename: Path to PCAP file
+ * @flags: MODBUS_SESSION_* flags
+ * @errbuf: Output error message on failure (may be NULL)
+ * @errlen: Size of @errbuf
+ *
+ * Return: Session handle, or NULL on failure
+ */
+
+modbus_session_t *modbus_session_open(const char *filename, unsigned flags,
+                                      char *errbuf, size_t errlen) {
+    return modbus_session_open_with(filename, flags, NULL, errbuf, errlen);
+}
+
+
+/**
+ * modbus_session_open_with() - Open a capture with explicit I/O settings
+ * @filename: Path to PCAP file
+ * @flags: MODBUS_SESSION_* flags
+ * @options: Capture reader I/O settings (NULL = defaults)
+ * @errbuf: Output error message on failure (may be NULL)
+ * @errlen: Size of @errbuf
+ *
+ * Return: Session handle, or NULL on failure
+ */
+
+modbus_session_t *modbus_session_open_with(const char *filename, unsigned flags,
+                                           const pcap_reader_options_t *options,
+                                           char *errbuf, size_t errlen) {
+    pcap_reader_t *reader = pcap_reader_open_with(filename, options, errbuf, errlen);
+    if (!reader) {
+        return NULL;
+    }
+    return session_create(reader, flags, errbuf, errlen);
+}
+
+
+/**
+ * modbus_session_open_merged() - Decode several captures as one stream
+ * @filenames: Paths of the captures (2 to PCAP_MERGE_MAX_CAPTURES)
+ * @count: Entries in @filenames
+ * @flags: MODBUS_SESSION_* flags
+ * @options: Capture reader settings for every capture (NULL = defaults)
+ * @window_ms: Duplicate window in milliseconds (0 = keep every copy)
+ * @errbuf: Output error message on failure (may be NULL)
+ * @errlen: Size of @errbuf
+ *
+ * Return: Session handle, or NULL on failure
+ */
+
+modbus_session_t *modbus_session_open_merged(const char *const *filenames, uint32_t count,
+                                             unsigned flags, const pcap_reader_options_t *options,
+                                             uint32_t window_ms, char *errbuf, size_t errlen) {
+    pcap_reader_t *reader = pcap_reader_open_merged(filenames, count, options, window_ms,
+                                                    errbuf, errlen);
+    if (!reader) {
+        return NULL;
+    }
+    return session_create(reader, flags, errbuf, errlen);
+}
+
+
+/**
+ * modbus_session_add_protocol() - Decode another protocol in the same pass
+ * @session: Session from modbus_session_open() or modbus_session_open_with()
+ * @transport: TCP or UDP
+ * @port: Port of the protocol
+ * @handler: Called with every payload on @port while frames are read
+ * @user_data: Passed to @handler
+ *
+ * See pcap_reader_add_protocol(). Register before the first frame.
+ *
+ * Return: false if the handler was refused (see modbus_session_error())
+ */
+
+bool modbus_session_add_protocol(modbus_session_t *session, pcap_transport_t transport,
+                                 uint16_t port, pcap_protocol_handler_t handler,
+                                 void *user_data) {
+    if (!pcap_reader_add_protocol(session->reader, transport, port, handler, user_data)) {
+        snprintf(session->error, sizeof(session->error), "%s",
+                 pcap_reader_error(session->reader));
+        return false;
+    }
+    return true;
+}
+
+
+/**
+ * modbus_session_next_frame() - Decode the next Modbus TCP payload
+ * @session: Open session
+ * @record: Output record
+ *
+ * Return: 1 if @record was filled, 0 at end of capture, -1 on error
+ */
+
+int modbus_session_next_frame(modbus_session_t *session, modbus_record_t *record) {
+    pcap_payload_t pkt;
+    int result;
+
+    // Release the previous record's data (the batch is one record by default)
+    if (!(session->flags & MODBUS_SESSION_RETAIN_FRAMES)) {
+        arena_reset(&session->arena);
+    }
+
+    while ((result = pcap_reader_next(session->reader, &pkt)) > 0) {
+        modbus_parse_error_t error = modbus_parse_frame_arena(pkt.payload, pkt.length,
+                                                              pkt.wire_length,
+                                                              &session->current,
+                                                              &session->arena);
+        record->log_error = false;
+        record->log_suppressed = 0;
+        if (error != MODBUS_PARSE_OK) {
+            // Logging is the caller's business; the session only keeps the budget
+            record->log_error = modbus_parse_errors_record(&session->errors, error,
+                                                           pkt.timestamp_ns,
+                                                           &record->log_suppressed);
+            if (!(session->flags & MODBUS_SESSION_INCLUDE_ERRORS)) {
+                continue;
+            }
+        } else {
+            session->frames++;
+        }
+
+        record->error = error;
+        record->frame = session->current;
+        record->is_request = pkt.dst_port == MODBUS_SESSION_PORT;
+        record->src = pkt.src;
+        record->src_id = endpoint_intern(&session->endpoints, &pkt.src);
+        record->src_port = pkt.src_port;
+        record->dst = pkt.dst;
+        record->dst_id = endpoint_intern(&session->endpoints, &pkt.dst);
+        record->dst_port = pkt.dst_port;
+        record->timestamp_ns = pkt.timestamp_ns;
+        record->payload = pkt.payload;
+        record->length = pkt.length;
+        record->wire_length = pkt.wire_length;
+        return 1;
+    }
+
+    if (result < 0) {
+        snprintf(session->error, sizeof(session->error), "%s",
+                 pcap_reader_error(session->reader));
+        return -1;
+    }
+    return 0;
+}
+
+
+/**
+ * modbus_session_run() - Decode all remaining payloads into a callback
+ * @session: Open session
+ * @callback: Invoked once per record
+ * @user_data: Opaque pointer passed to @callback
+ *
+ * Return: true at end of capture or when @callback stopped the run,
+ *         false on read error
+ */
+
+bool modbus_session_run(modbus_session_t *session, modbus_record_callback_t callback,
+                        void *user_data) {
+    modbus_record_t record;
+    int result;
+
+    while ((result = modbus_session_next_frame(session, &record)) > 0) {
+        if (!callback(&record, user_data)) {
+            return true;
+        }
+    }
+    return result == 0;
+}
+
+
+/**
+ * modbus_session_release_frames() - End a batch of retained frames
+ * @session: Session
+ *
+ * Invalidates the data of every record returned so far.
+ */
+
+void modbus_session_release_frames(modbus_session_t *session) {
+    arena_reset(&session->arena);
+}
+
+
+/**
+ * modbus_session_arena() - Allocator of the session
+ * @session: Session
+ *
+ * Return: Arena owned by the session
+ */
+
+arena_t *modbus_session_arena(modbus_session_t *session) {
+    return &session->arena;
+}
+
+
+/**
+ * modbus_session_parse_errors() - Parse failure counters of the session
+ * @session: Session
+ *
+ * Return: Counters owned by the session
+ */
+
+modbus_parse_errors_t *modbus_session_parse_errors(modbus_session_t *session) {
+    return &session->errors;
+}
+
+
+/**
+ * modbus_session_frame_count() - Frames decoded successfully so far
+ * @session: Session
+ *
+ * Return: Frame count
+ */
+
+uint64_t modbus_session_frame_count(const modbus_session_t *session) {
+    return session->frames;
+}
+
+
+/**
+ * modbus_session_packet_count() - Capture packets read so far
+ * @session: Session
+ *
+ * Return: Packet count (all protocols)
+ */
+
+uint64_t modbus_session_packet_count(const modbus_session_t *session) {
+    return pcap_reader_packet_count(session->reader);
+}
+
+
+/**
+ * modbus_session_input_stats() - Decompression pipeline timing
+ * @session: Session
+ * @stats: Output statistics
+ *
+ * Return: false if the capture is not compressed
+ */
+
+bool modbus_session_input_stats(const modbus_session_t *session, capture_input_stats_t *stats) {
+    return pcap_reader_input_stats(session->reader, stats);
+}
+
+
+/**
+ * modbus_session_merge_stats() - Counters of a merged session
+ * @session: Session
+ * @stats: Output statistics
+ *
+ * Return: false unless the session came from modbus_session_open_merged()
+ */
+
+bool modbus_session_merge_stats(const modbus_session_t *session, pcap_merge_stats_t *stats) {
+    return pcap_reader_merge_stats(session->reader, stats);
+}
+
+
+/**
+ * modbus_session_endpoint_count() - Distinct endpoints seen so far
+ * @session: Session
+ *
+ * Return: Number of ids handed out
+ */
+
+uint32_t modbus_session_endpoint_count(const modbus_session_t *session) {
+    return session->endpoints.count;
+}
+
+
+/**
+ * modbus_session_endpoint() - Address of an endpoint id
+ * @session: Session
+ * @id: Id from a record
+ *
+ * Return: Address, or NULL for an unknown id
+ */
+
+const endpoint_t *modbus_session_endpoint(const modbus_session_t *session, endpoint_id_t id) {
+    return endpoint_table_get(&session->endpoints, id);
+}
+
+
+/**
+ * modbus_session_endpoint_name() - Text of an endpoint id
+ * @session: Session
+ * @id: Id from a record
+ *
+ * Return: Address string ("-" for an unknown id)
+ */
+
+const char *modbus_session_endpoint_name(modbus_session_t *session, endpoint_id_t id) {
+    return endpoint_table_name(&session->endpoints, id);
+}
+
+
+/**
+ * modbus_session_offset() - Capture bytes consumed so far
+ * @session: Session
+ *
+ * Return: File offset of the next packet record, -1 if not seekable
+ */
+
+int64_t modbus_session_offset(const modbus_session_t *session) {
+    pcap_reader_position_t pos;
+    return pcap_reader_tell(session->reader, &pos) ? pos.offset : -1;
+}
+
+
+/**
+ * struct session_snapshot_t - Fixed part of a session snapshot
+ * @position: Reader position
+ * @frames: Frames decoded successfully
+ * @errors: Parse failure counters and log budget
+ * @endpoint_count: Endpoint addresses that follow, in id order
+ */
+
+typedef struct {
+    pcap_reader_position_t position;
+    uint64_t frames;
+    modbus_parse_errors_t errors;
+    uint32_t endpoint_count;
+} session_snapshot_t;
+
+
+/**
+ * modbus_session_save() - Write a resumable snapshot of the session
+ * @session: Session
+ * @f: Open binary file
+ *
+ * Return: false if the capture is not seekable or writing failed
+ */
+
+bool modbus_session_save(const modbus_session_t *session, FILE *f) {
+    session_snapshot_t snap;
+
+    memset(&snap, 0, sizeof(snap));
+    if (!pcap_reader_tell(session->reader, &snap.position)) {
+        return false;
+    }
+    snap.frames = session->frames;
+    snap.errors = session->errors;
+    snap.endpoint_count = session->endpoints.count;
+
+    return fwrite(&snap, sizeof(snap), 1, f) == 1 &&
+           fwrite(session->endpoints.addrs, sizeof(endpoint_t), snap.endpoint_count, f)
+               == snap.endpoint_count;
+}
+
+
+/**
+ * modbus_session_restore() - Continue from a snapshot
+ * @session: Session freshly opened on the same capture
+ * @f: File positioned at a modbus_session_save() snapshot
+ *
+ * Endpoints are re-interned in id order, which reproduces the ids.
+ *
+ * Return: false on a short or inconsistent snapshot, or if the capture
+ *         cannot seek
+ */
+
+bool modbus_session_restore(modbus_session_t *session, FILE *f) {
+    session_snapshot_t snap;
+
+    if (fread(&snap, sizeof(snap), 1, f) != 1) {
+        snprintf(session->error, sizeof(session->error), "truncated session snapshot");
+        return false;
+    }
+
+    for (uint32_t i = 0; i < snap.endpoint_count; i++) {
+        endpoint_t ep;
+        if (fread(&ep, sizeof(ep), 1, f) != 1 ||
+            endpoint_intern(&session->endpoints, &ep) != i) {
+            snprintf(session->error, sizeof(session->error), "bad endpoint table in snapshot");
+            return false;
+        }
+    }
+
+    if (!pcap_reader_seek(session->reader, &snap.position)) {
+        snprintf(session->error, sizeof(session->error), "%s",
+                 pcap_reader_error(session->reader));
+        return false;
+    }
+    session->frames = snap.frames;
+    session->errors = snap.errors;
+    return true;
+}
+
+
+/**
+ * modbus_session_error() - Last error message
+ * @session: Session
+ *
+ * Return: Error string ("" if none)
+ */
+
+const char *modbus_session_error(const modbus_session_t *session) {
+    return session->error;
+}
+
+
+/**
+ * modbus_session_close() - Close the capture and free the session
+ * @session: Session (NULL is ignored)
+ */
+
+void modbus_session_close(modbus_session_t *session) {
+    if (!session) return;
+    arena_free(&session->arena);
+    pcap_reader_close(session->reader);
+    endpoint_table_free(&session->endpoints);
+    free(session);
+}
+
+
+/**
+ * modbus_parse_version() - Library version string
+ *
+ * Return: "major.minor.patch"
+ */
+
+const char *modbus_parse_version(void) {
+    return MODBUS_PARSE_VERSION_STRING;
+}
@@ -0,0 +1,391 @@
+/*
+ * modbus_session.h - Embeddable decoding session (modbus_parse library)
+ *
+ * Public entry point of the modbus_parse library. A session owns a
+ * capture reader, parse failure counters and the buffers of the current
+ * record; no state is global and nothing is printed. Frames can be
+ * pulled one at a time:
+ *
+ *   modbus_session_t *s = modbus_session_open("capture.pcap", 0, err, sizeof(err));
+ *   modbus_record_t rec;
+ *   while (modbus_session_next_frame(s, &rec) > 0) {
+ *       use(rec.frame.function_code, rec.src_id, ...);
+ *   }
+ *   modbus_session_close(s);
+ *
+ * or pushed to a callback with modbus_session_run(). Endpoints are
+ * interned per session: records carry small integer ids, and
+ * modbus_session_endpoint_name() turns an id into text when needed.
+ * Frame data comes from a per-session arena (arena.h), so steady-state
+ * decoding makes no heap calls.
+ *
+ * Copyright (C) 2025 Marty
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef MODBUS_SESSION_H
+#define MODBUS_SESSION_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include "modbus_parser.h"
+#include "pcap_reader.h"
+#include "endpoint.h"
+
+
+/* Library version */
+#define MODBUS_PARSE_VERSION_MAJOR 2
+#define MODBUS_PARSE_VERSION_MINOR 0
+#define MODBUS_PARSE_VERSION_PATCH 0
+
+/* Session flags for modbus_session_open() */
+#define MODBUS_SESSION_INCLUDE_ERRORS 0x01  // Also return payloads that failed to parse
+#define MODBUS_SESSION_RETAIN_FRAMES 0x02   // Frame data valid until modbus_session_release_frames()
+
+/* Modbus TCP server port, used to tell requests from responses */
+#define MODBUS_SESSION_PORT 502
+
+
+/* Opaque session (see modbus_session_open()) */
+typedef struct modbus_session modbus_session_t;
+
+
+/**
+ * struct modbus_record_t - One decoded payload
+ * @error: MODBUS_PARSE_OK, or the failure class (only returned with
+ *         MODBUS_SESSION_INCLUDE_ERRORS)
+ * @frame: Parsed frame (valid if @error is MODBUS_PARSE_OK); frame.data
+ *         is owned by the session and valid until the next call (or
+ *         until modbus_session_release_frames() with
+ *         MODBUS_SESSION_RETAIN_FRAMES)
+ * @is_request: true if sent to port 502
+ * @src: Source address
+ * @src_id: Interned source id (ENDPOINT_ID_NONE if the table is full)
+ * @src_port: Source TCP port
+ * @dst: Destination address
+ * @dst_id: Interned destination id
+ * @dst_port: Destination TCP port
+ * @timestamp_ns: Packet timestamp (nanoseconds since epoch)
+ * @payload: Raw payload bytes, valid until the next call
+ * @length: Captured payload length
+ * @wire_length: Payload length on the wire
+ * @log_error: Failure is within the parse error log budget (see
+ *             modbus_session_parse_errors()); the caller should log it
+ * @log_suppressed: Failures dropped by the log budget before this one
+ */
+
+typedef struct {
+    modbus_parse_error_t error;
+    modbus_tcp_frame_t frame;
+    bool is_request;
+    endpoint_t src;
+    endpoint_id_t src_id;
+    uint16_t src_port;
+    endpoint_t dst;
+    endpoint_id_t dst_id;
+    uint16_t dst_port;
+    int64_t timestamp_ns;
+    const uint8_t *payload;
+    uint32_t length;
+    uint32_t wire_length;
+    bool log_error;
+    uint64_t log_suppressed;
+} modbus_record_t;
+
+
+/**
+ * modbus_record_callback_t() - Callback for modbus_session_run()
+ * @record: Decoded record, valid only during the call
+ * @user_data: Pointer passed to modbus_session_run()
+ *
+ * Return: true to continue, false to stop the run early
+ */
+
+typedef bool (*modbus_record_callback_t)(const modbus_record_t *record, void *user_data);
+
+
+/**
+ * modbus_session_open() - Open a capture for decoding
+ * @filename: Path to PCAP file
+ * @flags: MODBUS_SESSION_* flags
+ * @errbuf: Output error message on failure (may be NULL)
+ * @errlen: Size of @errbuf
+ *
+ * Return: Session handle, or NULL on failure
+ */
+
+modbus_session_t *modbus_session_open(const char *filename, unsigned flags,
+                                      char *errbuf, size_t errlen);
+
+
+/**
+ * modbus_session_open_with() - Open a capture with explicit I/O settings
+ * @filename: Path to PCAP file
+ * @flags: MODBUS_SESSION_* flags
+ * @options: Capture reader I/O settings, e.g. the mmap or io_uring
+ *           backend (NULL = defaults, as modbus_session_open())
+ * @errbuf: Output error message on failure (may be NULL)
+ * @errlen: Size of @errbuf
+ *
+ * Return: Session handle, or NULL on failure
+ */
+
+modbus_session_t *modbus_session_open_with(const char *filename, unsigned flags,
+                                           const pcap_reader_options_t *options,
+                                           char *errbuf, size_t errlen);
+
+
+/**
+ * modbus_session_open_merged() - Decode several captures as one stream
+ * @filenames: Paths of the captures (2 to PCAP_MERGE_MAX_CAPTURES)
+ * @count: Entries in @filenames
+ * @flags: MODBUS_SESSION_* flags
+ * @options: Capture reader settings for every capture (NULL = defaults)
+ * @window_ms: Duplicate window in milliseconds (0 = keep every copy)
+ * @errbuf: Output error message on failure (may be NULL)
+ * @errlen: Size of @errbuf
+ *
+ * For captures of the same traffic from several taps: frames come in
+ * timestamp order across the captures and a frame already taken from
+ * another capture within @window_ms is decoded once (see
+ * pcap_reader_open_merged()). A merged session has no offset and cannot
+ * be saved.
+ *
+ * Return: Session handle, or NULL on failure
+ */
+
+modbus_session_t *modbus_session_open_merged(const char *const *filenames, uint32_t count,
+                                             unsigned flags, const pcap_reader_options_t *options,
+                                             uint32_t window_ms, char *errbuf, size_t errlen);
+
+
+/**
+ * modbus_session_add_protocol() - Decode another protocol in the same pass
+ * @session: Session from modbus_session_open() or modbus_session_open_with()
+ * @transport: TCP or UDP
+ * @port: Port of the protocol
+ * @handler: Called with every payload on @port while frames are read
+ * @user_data: Passed to @handler
+ *
+ * See pcap_reader_add_protocol(). Register before the first frame.
+ *
+ * Return: false if the handler was refused (see modbus_session_error())
+ */
+
+bool modbus_session_add_protocol(modbus_session_t *session, pcap_transport_t transport,
+                                 uint16_t port, pcap_protocol_handler_t handler,
+                                 void *user_data);
+
+
+/**
+ * modbus_session_next_frame() - Decode the next Modbus TCP payload
+ * @session: Open session
+ * @record: Output record
+ *
+ * Payloads that fail to parse are counted and skipped unless the
+ * session was opened with MODBUS_SESSION_INCLUDE_ERRORS.
+ *
+ * Return: 1 if @record was filled, 0 at end of capture, -1 on error
+ *         (see modbus_session_error())
+ */
+
+int modbus_session_next_frame(modbus_session_t *session, modbus_record_t *record);
+
+
+/**
+ * modbus_session_run() - Decode all remaining payloads into a callback
+ * @session: Open session
+ * @callback: Invoked once per record
+ * @user_data: Opaque pointer passed to @callback
+ *
+ * Return: true at end of capture or when @callback stopped the run,
+ *         false on read error
+ */
+
+bool modbus_session_run(modbus_session_t *session, modbus_record_callback_t callback,
+                        void *user_data);
+
+
+/**
+ * modbus_session_release_frames() - End a batch of retained frames
+ * @session: Session
+ *
+ * With MODBUS_SESSION_RETAIN_FRAMES, record frame data stays valid
+ * across calls (for transaction matching, columnar batches, deferred
+ * writers) until this is called; the memory is then reused by the next
+ * batch. Without the flag every call is its own batch.
+ */
+
+void modbus_session_release_frames(modbus_session_t *session);
+
+
+/**
+ * modbus_session_arena() - Allocator of the session
+ * @session: Session
+ *
+ * arena_stats() reports allocation counts and peak bytes. Freed with
+ * the session.
+ *
+ * Return: Arena owned by the session
+ */
+
+arena_t *modbus_session_arena(modbus_session_t *session);
+
+
+/**
+ * modbus_session_parse_errors() - Parse failure counters of the session
+ * @session: Session
+ *
+ * The counters can be given a log budget with modbus_parse_errors_init()
+ * before the first frame is read.
+ *
+ * Return: Counters owned by the session
+ */
+
+modbus_parse_errors_t *modbus_session_parse_errors(modbus_session_t *session);
+
+
+/**
+ * modbus_session_frame_count() - Frames decoded successfully so far
+ * @session: Session
+ *
+ * Return: Frame count
+ */
+
+uint64_t modbus_session_frame_count(const modbus_session_t *session);
+
+
+/**
+ * modbus_session_packet_count() - Capture packets read so far
+ * @session: Session
+ *
+ * Return: Packet count (all protocols)
+ */
+
+uint64_t modbus_session_packet_count(const modbus_session_t *session);
+
+
+/**
+ * modbus_session_input_stats() - Decompression pipeline timing
+ * @session: Session
+ * @stats: Output statistics
+ *
+ * Return: false if the capture is not compressed
+ */
+
+bool modbus_session_input_stats(const modbus_session_t *session, capture_input_stats_t *stats);
+
+
+/**
+ * modbus_session_merge_stats() - Counters of a merged session
+ * @session: Session
+ * @stats: Output statistics
+ *
+ * Return: false unless the session came from modbus_session_open_merged()
+ */
+
+bool modbus_session_merge_stats(const modbus_session_t *session, pcap_merge_stats_t *stats);
+
+
+/**
+ * modbus_session_endpoint_count() - Distinct endpoints seen so far
+ * @session: Session
+ *
+ * Return: Number of ids handed out (ids are 0 .. count - 1)
+ */
+
+uint32_t modbus_session_endpoint_count(const modbus_session_t *session);
+
+
+/**
+ * modbus_session_endpoint() - Address of an endpoint id
+ * @session: Session
+ * @id: Id from a record
+ *
+ * Return: Address, or NULL for an unknown id
+ */
+
+const endpoint_t *modbus_session_endpoint(const modbus_session_t *session, endpoint_id_t id);
+
+
+/**
+ * modbus_session_endpoint_name() - Text of an endpoint id
+ * @session: Session
+ * @id: Id from a record
+ *
+ * Formatted on first use and cached for the life of the session.
+ *
+ * Return: Address string ("-" for an unknown id)
+ */
+
+const char *modbus_session_endpoint_name(modbus_session_t *session, endpoint_id_t id);
+
+
+/**
+ * modbus_session_offset() - Capture bytes consumed so far
+ * @session: Session
+ *
+ * Return: File offset of the next packet record, -1 if the capture is
+ *         not seekable
+ */
+
+int64_t modbus_session_offset(const modbus_session_t *session);
+
+
+/**
+ * modbus_session_save() - Write a resumable snapshot of the session
+ * @session: Session
+ * @f: Open binary file
+ *
+ * Records the capture position, counters, parse error state and the
+ * endpoint table, so ids handed out after a restore match the ids of
+ * an uninterrupted run. The snapshot is in host byte order and only
+ * meant for the same build.
+ *
+ * Return: false if the capture is not seekable or writing failed
+ */
+
+bool modbus_session_save(const modbus_session_t *session, FILE *f);
+
+
+/**
+ * modbus_session_restore() - Continue from a snapshot
+ * @session: Session freshly opened on the same capture
+ * @f: File positioned at a modbus_session_save() snapshot
+ *
+ * Return: false on a short or inconsistent snapshot, or if the capture
+ *         cannot seek (see modbus_session_error())
+ */
+
+bool modbus_session_restore(modbus_session_t *session, FILE *f);
+
+
+/**
+ * modbus_session_error() - Last error message
+ * @session: Session
+ *
+ * Return: Error string ("" if none)
+ */
+
+const char *modbus_session_error(const modbus_session_t *session);
+
+
+/**
+ * modbus_session_close() - Close the capture and free the session
+ * @session: Session (NULL is ignored)
+ */
+
+void modbus_session_close(modbus_session_t *session);
+
+
+/**
+ * modbus_parse_version() - Library version string
+ *
+ * Return: "major.minor.patch"
+ */
+
+const char *modbus_parse_version(void);
+
+#endif /* MODBUS_SESSION_H */
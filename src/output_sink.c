@@ -0,0 +1,595 @@
+/*
+ * output_sink.c - Decode-once fan-out of frames to output sinks
+ *
+ * sink_set_frame() fills one sink_record_t with the fields the
+ * registered sinks asked for and hands it to each of them. The frame
+ * fields come from sink_summarise(), done by the caller so that they can
+ * be memoised (decode_cache.h). The sinks below only format; none of
+ * them decodes the frame again.
+ *
+ * Copyright (C) 2025 Marty
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+
+#include "output_sink.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include "modbus_output.h"
+#include "colors.h"
+
+
+/*
+ * load_be16() - Big-endian 16-bit value at @p
+ */
+
+static inline uint16_t load_be16(const uint8_t *p) {
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+
+/*
+ * format_exception() - "Exception: <name> (FC=0x..: <function>)"
+ */
+
+static void format_exception(const sink_summary_t *summary, char *buf, size_t len) {
+    snprintf(buf, len, "Exception: %s (FC=0x%02X: %s)", summary->exception_name,
+             summary->original_function, summary->original_function_name);
+}
+
+
+/**
+ * sink_summarise() - Decode the frame fields the sinks show
+ * @frame: Parsed frame
+ * @fields: SINK_FIELD_NAMES and/or SINK_FIELD_DETAILS to fill in
+ * @summary: Output
+ */
+
+void sink_summarise(const modbus_tcp_frame_t *frame, unsigned fields, sink_summary_t *summary) {
+    if (fields & (SINK_FIELD_DETAILS | SINK_FIELD_NAMES)) {
+        summary->detail = SINK_DETAIL_NONE;
+        if (frame->function_code & 0x80) {
+            summary->original_function = frame->function_code & 0x7F;
+            if (frame->data_length >= 1) {
+                summary->detail = SINK_DETAIL_EXCEPTION;
+                summary->exception_code = frame->data[0];
+            } else {
+                summary->detail = SINK_DETAIL_EXCEPTION_NO_DATA;
+            }
+        } else if (frame->data_length >= 4 &&
+                   ((frame->function_code >= 0x01 && frame->function_code <= 0x06) ||
+                    frame->function_code == 0x0F || frame->function_code == 0x10)) {
+            summary->detail = SINK_DETAIL_RANGE;
+            summary->address = load_be16(&frame->data[0]);
+            summary->quantity = load_be16(&frame->data[2]);
+        }
+    }
+
+    if (fields & SINK_FIELD_NAMES) {
+        summary->function_name = modbus_get_function_name(frame->function_code);
+        if (summary->detail == SINK_DETAIL_EXCEPTION) {
+            summary->exception_name = modbus_get_exception_name(summary->exception_code);
+            summary->original_function_name = modbus_get_function_name(summary->original_function);
+        }
+    }
+
+    if ((fields & (SINK_FIELD_DETAILS | SINK_FIELD_NAMES)) ==
+        (SINK_FIELD_DETAILS | SINK_FIELD_NAMES)) {
+        switch (summary->detail) {
+            case SINK_DETAIL_RANGE:
+                snprintf(summary->details, sizeof(summary->details), "%u/%u",
+                         summary->address, summary->quantity);
+                break;
+            case SINK_DETAIL_EXCEPTION:
+                format_exception(summary, summary->details, sizeof(summary->details));
+                break;
+            case SINK_DETAIL_EXCEPTION_NO_DATA:
+                snprintf(summary->details, sizeof(summary->details), "Exception (no data)");
+                break;
+            default:
+                snprintf(summary->details, sizeof(summary->details), "-");
+                break;
+        }
+    }
+}
+
+
+/**
+ * sink_format_rules() - Fill in the text of rule hits
+ * @rules: Rule hits with @hits and @hit_ids set
+ */
+
+void sink_format_rules(sink_rule_hits_t *rules) {
+    rules->text[0] = '\0';
+    if (rules->hits > 0) {
+        rule_format_hits(rules->hit_ids, rules->hits, rules->text, sizeof(rules->text));
+    }
+}
+
+
+/*
+ * summarise() - Fill the per-packet fields of @rec from its record
+ *
+ * Time and endpoints change with every packet; the frame fields come
+ * from the caller's sink_summary_t.
+ */
+
+static void summarise(sink_set_t *set, sink_record_t *rec, unsigned fields) {
+    const modbus_record_t *record = rec->record;
+
+    rec->fields = fields;
+
+    if (fields & SINK_FIELD_TIME) {
+        time_t sec = (time_t)(record->timestamp_ns / 1000000000);
+        struct tm *tm_info = localtime(&sec);
+        rec->hour = tm_info->tm_hour;
+        rec->minute = tm_info->tm_min;
+        rec->second = tm_info->tm_sec;
+        rec->microsecond = (int)(record->timestamp_ns % 1000000000 / 1000);
+    }
+
+    if (fields & (SINK_FIELD_ADDRESSES | SINK_FIELD_ENDPOINTS)) {
+        rec->src_ip = modbus_session_endpoint_name(set->session, record->src_id);
+        rec->dst_ip = modbus_session_endpoint_name(set->session, record->dst_id);
+    }
+    if (fields & SINK_FIELD_ENDPOINTS) {
+        modbus_format_host_port(rec->src, sizeof(rec->src), rec->src_ip, record->src_port);
+        modbus_format_host_port(rec->dst, sizeof(rec->dst), rec->dst_ip, record->dst_port);
+    }
+}
+
+
+/*
+ * table_frame() - Colour table row, preceded by the header on frame 1
+ *
+ * Details are address/quantity or the exception, followed by the rule
+ * hits in brackets.
+ */
+
+static void table_frame(output_sink_t *sink, const sink_record_t *rec) {
+    const modbus_tcp_frame_t *frame = &rec->record->frame;
+    (void)sink;
+
+    if (rec->number == 1) {
+        printf("\n%s%-8s %-15s %-22s %-22s %-10s %-6s %-30s %-80s%s\n", COLOR_WHITE,
+                "Packet", "Timestamp", "Source IP:Port", "Dest IP:Port", "Trans ID", "Unit", "Function", "Details", COLOR_RESET);
+        printf("%s----------------------------------------------------------------------"
+               "----------------------------------------------------------------------------%s\n",
+               COLOR_GRAY, COLOR_RESET);
+    }
+
+    const char *details = rec->summary->details;
+    char with_rules[SINK_DETAILS_LEN + sizeof(rec->rules->text) + 3];
+    if (rec->rules->text[0]) {
+        snprintf(with_rules, sizeof(with_rules), "%s [%s]", details, rec->rules->text);
+        details = with_rules;
+    }
+
+    char time_str[20];
+    snprintf(time_str, sizeof(time_str), "%02d:%-2d:%02d.%06d",
+             rec->hour, rec->minute, rec->second, rec->microsecond);
+
+    printf("%s%-8u%s%s%-16s %s%s%-22s%-22s%s%s0x%04X    %s%s0x%02X  %s%s%-30s%s%s%-80s%s\n",
+           COLOR_WHITE, rec->number, COLOR_RESET,
+           COLOR_GRAY, time_str, COLOR_RESET,
+           COLOR_CYAN, rec->src, rec->dst, COLOR_RESET,
+           COLOR_YELLOW, frame->mbap.transaction_id, COLOR_RESET,
+           COLOR_GREEN, frame->mbap.unit_id, COLOR_RESET,
+           COLOR_MAGENTA, rec->summary->function_name, COLOR_RESET,
+           COLOR_BLUE, details, COLOR_RESET);
+}
+
+
+/**
+ * sink_init_table() - Colour table on stdout, one row per frame
+ * @sink: Sink to initialise
+ */
+
+void sink_init_table(output_sink_t *sink) {
+    memset(sink, 0, sizeof(*sink));
+    sink->name = "table";
+    sink->fields = SINK_FIELD_TIME | SINK_FIELD_ENDPOINTS | SINK_FIELD_NAMES |
+                   SINK_FIELD_DETAILS | SINK_FIELD_RULES;
+    sink->frame = table_frame;
+}
+
+
+/*
+ * verbose_frame() - Frame heading, connection and full breakdown
+ */
+
+static void verbose_frame(output_sink_t *sink, const sink_record_t *rec) {
+    (void)sink;
+
+    printf("\n--- Frame %u ---\n", rec->number);
+    printf("Connection: %s -> %s\n", rec->src, rec->dst);
+    modbus_display_frame(&rec->record->frame);
+    if (rec->rules->text[0]) {
+        printf("%sRule hits: %s%s\n", COLOR_YELLOW, rec->rules->text, COLOR_RESET);
+    }
+}
+
+
+/**
+ * sink_init_verbose() - Detailed frame breakdown on stdout
+ * @sink: Sink to initialise
+ */
+
+void sink_init_verbose(output_sink_t *sink) {
+    memset(sink, 0, sizeof(*sink));
+    sink->name = "verbose";
+    sink->fields = SINK_FIELD_ENDPOINTS | SINK_FIELD_RULES;
+    sink->frame = verbose_frame;
+}
+
+
+/*
+ * markdown_frame() - One row of the report's traffic table
+ */
+
+static void markdown_frame(output_sink_t *sink, const sink_record_t *rec) {
+    attack_stats_t *stats = sink->state;
+    const modbus_tcp_frame_t *frame = &rec->record->frame;
+
+    if (!stats->report_enabled || !stats->report_file) return;
+
+    char time_str[20];
+    snprintf(time_str, sizeof(time_str), "%02d:%02d:%02d.%06d",
+             rec->hour, rec->minute, rec->second, rec->microsecond);
+
+    const sink_summary_t *summary = rec->summary;
+    char details[128] = "-";
+    if (summary->detail == SINK_DETAIL_RANGE) {
+        snprintf(details, sizeof(details), "Addr=%u, Qty=%u", summary->address,
+                 summary->quantity);
+    } else if (summary->detail == SINK_DETAIL_EXCEPTION) {
+        format_exception(summary, details, sizeof(details));
+    }
+
+    fprintf(stats->report_file, "| %u | %s | %s | %s | 0x%04X | 0x%02X | %s | %s | %s |\n",
+            rec->number, time_str, rec->src, rec->dst, frame->mbap.transaction_id,
+            frame->mbap.unit_id, summary->function_name, details,
+            rec->rules->text[0] ? rec->rules->text : "-");
+}
+
+
+/**
+ * sink_init_markdown() - Traffic rows of the markdown report
+ * @sink: Sink to initialise
+ * @stats: Statistics owning the report file
+ */
+
+void sink_init_markdown(output_sink_t *sink, attack_stats_t *stats) {
+    memset(sink, 0, sizeof(*sink));
+    sink->name = "markdown";
+    sink->fields = SINK_FIELD_TIME | SINK_FIELD_ENDPOINTS | SINK_FIELD_NAMES |
+                   SINK_FIELD_DETAILS | SINK_FIELD_RULES;
+    sink->frame = markdown_frame;
+    sink->state = stats;
+}
+
+
+/*
+ * file_begin() - Create the output file of a file sink
+ */
+
+static bool file_begin(output_sink_t *sink) {
+    sink->file = fopen(sink->path, "wb");
+    if (!sink->file) {
+        printf("Error: Could not create %s output %s: %s\n", sink->name, sink->path,
+               strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+
+/*
+ * file_batch() - Push buffered records to the file
+ */
+
+static void file_batch(output_sink_t *sink) {
+    fflush(sink->file);
+}
+
+
+/*
+ * file_end() - Close the output file, reporting lost writes
+ */
+
+static bool file_end(output_sink_t *sink) {
+    bool ok = !ferror(sink->file);
+    if (fclose(sink->file) != 0) {
+        ok = false;
+    }
+    sink->file = NULL;
+    return ok;
+}
+
+
+/*
+ * jsonl_frame() - One JSON object per line
+ *
+ * Names and addresses come from fixed tables and the address formatter
+ * and never need escaping.
+ */
+
+static void jsonl_frame(output_sink_t *sink, const sink_record_t *rec) {
+    const modbus_record_t *record = rec->record;
+    const modbus_tcp_frame_t *frame = &record->frame;
+    const sink_summary_t *summary = rec->summary;
+    const sink_rule_hits_t *rules = rec->rules;
+    FILE *f = sink->file;
+
+    fprintf(f, "{\"frame\":%u,\"timestamp_ns\":%lld,\"src\":\"%s\",\"src_port\":%u,"
+               "\"dst\":\"%s\",\"dst_port\":%u,\"request\":%s,\"transaction_id\":%u,"
+               "\"unit_id\":%u,\"function_code\":%u,\"function\":\"%s\"",
+            rec->number, (long long)record->timestamp_ns, rec->src_ip, record->src_port,
+            rec->dst_ip, record->dst_port, record->is_request ? "true" : "false",
+            frame->mbap.transaction_id, frame->mbap.unit_id, frame->function_code,
+            summary->function_name);
+
+    if (summary->detail == SINK_DETAIL_RANGE) {
+        fprintf(f, ",\"address\":%u,\"quantity\":%u", summary->address, summary->quantity);
+    } else if (summary->detail == SINK_DETAIL_EXCEPTION) {
+        fprintf(f, ",\"exception_code\":%u,\"exception\":\"%s\"", summary->exception_code,
+                summary->exception_name);
+    }
+
+    if (rules->hits > 0) {
+        uint32_t shown = rules->hits < RULE_MAX_HITS ? rules->hits : RULE_MAX_HITS;
+        fprintf(f, ",\"rule_hits\":%u,\"rules\":[", rules->hits);
+        for (uint32_t i = 0; i < shown; i++) {
+            fprintf(f, i ? ",%u" : "%u", rules->hit_ids[i]);
+        }
+        fputc(']', f);
+    }
+    fputs("}\n", f);
+}
+
+
+/**
+ * sink_init_jsonl() - One JSON object per frame
+ * @sink: Sink to initialise
+ * @path: Output file, created by sink_set_begin()
+ */
+
+void sink_init_jsonl(output_sink_t *sink, const char *path) {
+    memset(sink, 0, sizeof(*sink));
+    sink->name = "JSONL";
+    sink->fields = SINK_FIELD_ADDRESSES | SINK_FIELD_NAMES | SINK_FIELD_DETAILS;
+    sink->begin = file_begin;
+    sink->frame = jsonl_frame;
+    sink->batch = file_batch;
+    sink->end = file_end;
+    sink->path = path;
+}
+
+
+/*
+ * binary_begin() - Create the file and write its header
+ */
+
+static bool binary_begin(output_sink_t *sink) {
+    sink_binary_header_t header;
+
+    if (!file_begin(sink)) {
+        return false;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SINK_BINARY_MAGIC, sizeof(SINK_BINARY_MAGIC));
+    header.version = SINK_BINARY_VERSION;
+    header.record_size = sizeof(sink_binary_record_t);
+    if (fwrite(&header, sizeof(header), 1, sink->file) != 1) {
+        printf("Error: Could not write %s output %s\n", sink->name, sink->path);
+        fclose(sink->file);
+        sink->file = NULL;
+        return false;
+    }
+    return true;
+}
+
+
+/*
+ * binary_frame() - Append one fixed-size record
+ */
+
+static void binary_frame(output_sink_t *sink, const sink_record_t *rec) {
+    const modbus_record_t *record = rec->record;
+    const modbus_tcp_frame_t *frame = &record->frame;
+    sink_binary_record_t out;
+
+    memset(&out, 0, sizeof(out));
+    out.timestamp_ns = record->timestamp_ns;
+    out.number = rec->number;
+    out.transaction_id = frame->mbap.transaction_id;
+    out.src_port = record->src_port;
+    out.dst_port = record->dst_port;
+    out.unit_id = frame->mbap.unit_id;
+    out.function_code = frame->function_code;
+    out.src_family = record->src.family;
+    out.dst_family = record->dst.family;
+    memcpy(out.src_addr, record->src.addr, ENDPOINT_ADDR_LEN);
+    memcpy(out.dst_addr, record->dst.addr, ENDPOINT_ADDR_LEN);
+
+    if (record->is_request) {
+        out.flags |= SINK_BINARY_REQUEST;
+    }
+    if (rec->summary->detail == SINK_DETAIL_RANGE) {
+        out.flags |= SINK_BINARY_RANGE;
+        out.address = rec->summary->address;
+        out.quantity = rec->summary->quantity;
+    } else if (rec->summary->detail == SINK_DETAIL_EXCEPTION) {
+        out.flags |= SINK_BINARY_EXCEPTION;
+        out.exception_code = rec->summary->exception_code;
+    }
+    if (rec->rules->hits > 0) {
+        out.flags |= SINK_BINARY_RULE_HIT;
+    }
+
+    fwrite(&out, sizeof(out), 1, sink->file);
+}
+
+
+/**
+ * sink_init_binary() - Fixed-size sink_binary_record_t per frame
+ * @sink: Sink to initialise
+ * @path: Output file, created by sink_set_begin()
+ */
+
+void sink_init_binary(output_sink_t *sink, const char *path) {
+    memset(sink, 0, sizeof(*sink));
+    sink->name = "binary";
+    sink->fields = SINK_FIELD_DETAILS;
+    sink->begin = binary_begin;
+    sink->frame = binary_frame;
+    sink->batch = file_batch;
+    sink->end = file_end;
+    sink->path = path;
+}
+
+
+/*
+ * null_frame() - Discard the frame
+ */
+
+static void null_frame(output_sink_t *sink, const sink_record_t *rec) {
+    (void)sink;
+    (void)rec;
+}
+
+
+/**
+ * sink_init_null() - Discard frames
+ * @sink: Sink to initialise
+ */
+
+void sink_init_null(output_sink_t *sink) {
+    memset(sink, 0, sizeof(*sink));
+    sink->name = "null";
+    sink->frame = null_frame;
+}
+
+
+/**
+ * sink_set_init() - Start an empty sink set
+ * @set: Set
+ * @session: Session resolving endpoint ids
+ */
+
+void sink_set_init(sink_set_t *set, modbus_session_t *session) {
+    memset(set, 0, sizeof(*set));
+    set->session = session;
+}
+
+
+/**
+ * sink_set_add() - Register a sink
+ * @set: Set
+ * @sink: Initialised sink (copied)
+ *
+ * Return: false if SINK_MAX sinks are already registered
+ */
+
+bool sink_set_add(sink_set_t *set, const output_sink_t *sink) {
+    if (set->count == SINK_MAX) {
+        return false;
+    }
+    set->sinks[set->count++] = *sink;
+    set->fields |= sink->fields;
+    return true;
+}
+
+
+/**
+ * sink_set_begin() - Open every sink
+ * @set: Set
+ *
+ * Return: false if a sink could not be opened
+ */
+
+bool sink_set_begin(sink_set_t *set) {
+    for (uint32_t i = 0; i < set->count; i++) {
+        output_sink_t *sink = &set->sinks[i];
+        if (sink->begin && !sink->begin(sink)) {
+            // Close what was opened; nothing has been written yet
+            while (i-- > 0) {
+                if (set->sinks[i].end) {
+                    set->sinks[i].end(&set->sinks[i]);
+                }
+            }
+            set->count = 0;
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/**
+ * sink_set_frame() - Summarise one frame and pass it to every sink
+ * @set: Set
+ * @record: Successfully decoded record
+ * @number: 1-based frame number
+ * @summary: Output of sink_summarise() with at least the set's fields
+ * @rules: Rule hits, text filled in if the set needs SINK_FIELD_RULES
+ */
+
+void sink_set_frame(sink_set_t *set, const modbus_record_t *record, uint32_t number,
+                    const sink_summary_t *summary, const sink_rule_hits_t *rules) {
+    sink_record_t rec;
+
+    if (set->count == 0) {
+        return;
+    }
+
+    rec.record = record;
+    rec.number = number;
+    rec.summary = summary;
+    rec.rules = rules;
+    summarise(set, &rec, set->fields);
+
+    for (uint32_t i = 0; i < set->count; i++) {
+        set->sinks[i].frame(&set->sinks[i], &rec);
+    }
+}
+
+
+/**
+ * sink_set_batch() - Flush every sink (before a checkpoint)
+ * @set: Set
+ */
+
+void sink_set_batch(sink_set_t *set) {
+    for (uint32_t i = 0; i < set->count; i++) {
+        if (set->sinks[i].batch) {
+            set->sinks[i].batch(&set->sinks[i]);
+        }
+    }
+}
+
+
+/**
+ * sink_set_end() - Finish and close every sink
+ * @set: Set
+ *
+ * Return: false if any sink failed
+ */
+
+bool sink_set_end(sink_set_t *set) {
+    bool ok = true;
+
+    for (uint32_t i = 0; i < set->count; i++) {
+        output_sink_t *sink = &set->sinks[i];
+        if (sink->end && !sink->end(sink)) {
+            printf("Warning: %s output %s is incomplete (write error)\n", sink->name,
+                   sink->path ? sink->path : "-");
+            ok = false;
+        }
+    }
+    set->count = 0;
+    return ok;
+}
@@ -0,0 +1,388 @@
+/*
+ * output_sink.h - Decode-once fan-out of frames to output sinks
+ *
+ * Every frame is summarised once into a sink_record_t that is handed to
+ * all registered sinks (terminal table, verbose, markdown report, JSONL,
+ * binary, null). Each sink declares the SINK_FIELD_* it reads; the
+ * summary only computes the union of those, so localtime(), endpoint
+ * text, names and address/quantity decoding are done at most once per
+ * frame, and not at all when no sink needs them (e.g. --summary-only).
+ *
+ * Copyright (C) 2025 Marty
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef OUTPUT_SINK_H
+#define OUTPUT_SINK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "modbus_session.h"
+#include "rule_engine.h"
+
+
+/* Summary fields a sink can ask for */
+#define SINK_FIELD_TIME      0x01  // Local time of day (one localtime() per frame)
+#define SINK_FIELD_ADDRESSES 0x02  // Source/destination address text
+#define SINK_FIELD_ENDPOINTS 0x04  // "address:port" text (implies ADDRESSES)
+#define SINK_FIELD_NAMES     0x08  // Function and exception names
+#define SINK_FIELD_DETAILS   0x10  // Address/quantity or exception code
+#define SINK_FIELD_RULES     0x20  // Rule hits as "R<id>,..." text
+
+/* Sinks one run can fan out to */
+#define SINK_MAX 8
+
+/* Text of "[address]:port" */
+#define SINK_HOST_PORT_LEN 64
+
+/* Text of the details column (address/quantity or exception) */
+#define SINK_DETAILS_LEN 100
+
+/* Binary sink file magic and format version */
+#define SINK_BINARY_MAGIC "MBFRAME"
+#define SINK_BINARY_VERSION 1
+
+/* sink_binary_record_t flags */
+#define SINK_BINARY_REQUEST   0x01  // Sent to the server
+#define SINK_BINARY_RANGE     0x02  // address/quantity are valid
+#define SINK_BINARY_EXCEPTION 0x04  // exception_code is valid
+#define SINK_BINARY_RULE_HIT  0x08  // At least one detection rule matched
+
+
+/**
+ * enum sink_detail_t - What the details column of a frame shows
+ * @SINK_DETAIL_NONE: Nothing decoded
+ * @SINK_DETAIL_RANGE: Address and quantity (FC 0x01-0x06, 0x0F, 0x10)
+ * @SINK_DETAIL_EXCEPTION: Exception response with its code
+ * @SINK_DETAIL_EXCEPTION_NO_DATA: Exception response without a code
+ */
+
+typedef enum {
+    SINK_DETAIL_NONE = 0,
+    SINK_DETAIL_RANGE,
+    SINK_DETAIL_EXCEPTION,
+    SINK_DETAIL_EXCEPTION_NO_DATA
+} sink_detail_t;
+
+
+/**
+ * struct sink_summary_t - Fields that only depend on the frame bytes
+ * @function_name: Name of the function code (SINK_FIELD_NAMES)
+ * @exception_name: Name of @exception_code (SINK_FIELD_NAMES, exceptions)
+ * @original_function_name: Name of @original_function (likewise)
+ * @detail: Kind of details (SINK_FIELD_DETAILS)
+ * @address: Start address (SINK_DETAIL_RANGE)
+ * @quantity: Quantity, or value of single writes (SINK_DETAIL_RANGE)
+ * @exception_code: Exception code (SINK_DETAIL_EXCEPTION)
+ * @original_function: Function code without the exception bit
+ * @details: Details column text, "-" if none (SINK_FIELD_NAMES and
+ *           SINK_FIELD_DETAILS)
+ *
+ * The transaction id is not part of the summary, so frames that only
+ * differ in it share one (see decode_cache.h).
+ */
+
+typedef struct {
+    const char *function_name;
+    const char *exception_name;
+    const char *original_function_name;
+    sink_detail_t detail;
+    uint16_t address;
+    uint16_t quantity;
+    uint8_t exception_code;
+    uint8_t original_function;
+    char details[SINK_DETAILS_LEN];
+} sink_summary_t;
+
+
+/**
+ * struct sink_rule_hits_t - Detection rules matched by a frame
+ * @hits: Number of matching rules
+ * @hit_ids: Matching rule ids (first RULE_MAX_HITS)
+ * @hit_rules: Rule indices of @hit_ids, for rule_engine_replay()
+ * @text: Rule hits as "R<id>,..." text, "" if none (SINK_FIELD_RULES)
+ */
+
+typedef struct {
+    uint32_t hits;
+    uint32_t hit_ids[RULE_MAX_HITS];
+    uint32_t hit_rules[RULE_MAX_HITS];
+    char text[RULE_HITS_STR_LEN];
+} sink_rule_hits_t;
+
+
+/**
+ * struct sink_record_t - One frame, summarised once for all sinks
+ * @record: Decoded record (frame memory valid during the callback only)
+ * @number: 1-based frame number
+ * @summary: Decoded fields and details text
+ * @rules: Rule hits
+ * @fields: SINK_FIELD_* filled in below
+ * @hour: Local time of day (SINK_FIELD_TIME)
+ * @minute: See @hour
+ * @second: See @hour
+ * @microsecond: See @hour
+ * @src_ip: Source address text (SINK_FIELD_ADDRESSES)
+ * @dst_ip: Destination address text (SINK_FIELD_ADDRESSES)
+ * @src: Source "address:port" (SINK_FIELD_ENDPOINTS)
+ * @dst: Destination "address:port" (SINK_FIELD_ENDPOINTS)
+ */
+
+typedef struct {
+    const modbus_record_t *record;
+    uint32_t number;
+    const sink_summary_t *summary;
+    const sink_rule_hits_t *rules;
+    unsigned fields;
+    int hour;
+    int minute;
+    int second;
+    int microsecond;
+    const char *src_ip;
+    const char *dst_ip;
+    char src[SINK_HOST_PORT_LEN];
+    char dst[SINK_HOST_PORT_LEN];
+} sink_record_t;
+
+
+/**
+ * struct sink_binary_header_t - Binary sink file header
+ * @magic: SINK_BINARY_MAGIC, NUL padded
+ * @version: SINK_BINARY_VERSION
+ * @record_size: sizeof(sink_binary_record_t)
+ */
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+} sink_binary_header_t;
+
+
+/**
+ * struct sink_binary_record_t - One frame in a binary sink file
+ * @timestamp_ns: Capture time in nanoseconds since epoch
+ * @number: 1-based frame number
+ * @transaction_id: MBAP transaction id
+ * @src_port: Source TCP port
+ * @dst_port: Destination TCP port
+ * @address: Start address (SINK_BINARY_RANGE)
+ * @quantity: Quantity (SINK_BINARY_RANGE)
+ * @unit_id: MBAP unit id
+ * @function_code: Function code (exception bit included)
+ * @exception_code: Exception code (SINK_BINARY_EXCEPTION)
+ * @flags: SINK_BINARY_* flags
+ * @src_family: Source address family (4 or 6)
+ * @dst_family: Destination address family
+ * @reserved: Zero
+ * @src_addr: Source address bytes (IPv4 in the first four)
+ * @dst_addr: Destination address bytes
+ *
+ * Fixed size, host byte order, like checkpoints.
+ */
+
+typedef struct {
+    int64_t timestamp_ns;
+    uint32_t number;
+    uint16_t transaction_id;
+    uint16_t src_port;
+    uint16_t dst_port;
+    uint16_t address;
+    uint16_t quantity;
+    uint8_t unit_id;
+    uint8_t function_code;
+    uint8_t exception_code;
+    uint8_t flags;
+    uint8_t src_family;
+    uint8_t dst_family;
+    uint8_t reserved[4];
+    uint8_t src_addr[ENDPOINT_ADDR_LEN];
+    uint8_t dst_addr[ENDPOINT_ADDR_LEN];
+} sink_binary_record_t;
+
+
+typedef struct output_sink output_sink_t;
+
+/**
+ * struct output_sink - One output and its callbacks
+ * @name: Sink name for messages
+ * @fields: SINK_FIELD_* the sink reads
+ * @begin: Open the output (NULL = nothing to do); false aborts the run
+ * @frame: Write one frame
+ * @batch: Flush buffered output before a checkpoint (may be NULL)
+ * @end: Finish and close the output (may be NULL); false if data was lost
+ * @path: Output file (file sinks)
+ * @file: Open output file (file sinks)
+ * @state: Sink-specific data
+ */
+
+struct output_sink {
+    const char *name;
+    unsigned fields;
+    bool (*begin)(output_sink_t *sink);
+    void (*frame)(output_sink_t *sink, const sink_record_t *rec);
+    void (*batch)(output_sink_t *sink);
+    bool (*end)(output_sink_t *sink);
+    const char *path;
+    FILE *file;
+    void *state;
+};
+
+
+/**
+ * struct sink_set_t - Registered sinks and the fields they need together
+ * @sinks: Sinks in registration order
+ * @count: Entries in @sinks
+ * @fields: Union of the sinks' SINK_FIELD_* masks
+ * @session: Session resolving endpoint ids to text
+ */
+
+typedef struct {
+    output_sink_t sinks[SINK_MAX];
+    uint32_t count;
+    unsigned fields;
+    modbus_session_t *session;
+} sink_set_t;
+
+
+/**
+ * sink_init_table() - Colour table on stdout, one row per frame
+ * @sink: Sink to initialise
+ */
+
+void sink_init_table(output_sink_t *sink);
+
+
+/**
+ * sink_init_verbose() - Detailed frame breakdown on stdout
+ * @sink: Sink to initialise
+ */
+
+void sink_init_verbose(output_sink_t *sink);
+
+
+/**
+ * sink_init_markdown() - Traffic rows of the markdown report
+ * @sink: Sink to initialise
+ * @stats: Statistics owning the report file
+ *
+ * The report header and summary sections are written by the caller;
+ * nothing is written while @stats->report_enabled is false.
+ */
+
+void sink_init_markdown(output_sink_t *sink, attack_stats_t *stats);
+
+
+/**
+ * sink_init_jsonl() - One JSON object per frame
+ * @sink: Sink to initialise
+ * @path: Output file, created by sink_set_begin()
+ */
+
+void sink_init_jsonl(output_sink_t *sink, const char *path);
+
+
+/**
+ * sink_init_binary() - Fixed-size sink_binary_record_t per frame
+ * @sink: Sink to initialise
+ * @path: Output file, created by sink_set_begin()
+ */
+
+void sink_init_binary(output_sink_t *sink, const char *path);
+
+
+/**
+ * sink_init_null() - Discard frames
+ * @sink: Sink to initialise
+ *
+ * Needs no fields, so a run whose only sink is the null sink does no
+ * per-frame formatting (--summary-only, decode benchmarks).
+ */
+
+void sink_init_null(output_sink_t *sink);
+
+
+/**
+ * sink_set_init() - Start an empty sink set
+ * @set: Set
+ * @session: Session resolving endpoint ids
+ */
+
+void sink_set_init(sink_set_t *set, modbus_session_t *session);
+
+
+/**
+ * sink_set_add() - Register a sink
+ * @set: Set
+ * @sink: Initialised sink (copied)
+ *
+ * Return: false if SINK_MAX sinks are already registered
+ */
+
+bool sink_set_add(sink_set_t *set, const output_sink_t *sink);
+
+
+/**
+ * sink_set_begin() - Open every sink
+ * @set: Set
+ *
+ * Prints an error and closes the sinks already opened on failure.
+ *
+ * Return: false if a sink could not be opened
+ */
+
+bool sink_set_begin(sink_set_t *set);
+
+
+/**
+ * sink_summarise() - Decode the frame fields the sinks show
+ * @frame: Parsed frame
+ * @fields: SINK_FIELD_NAMES and/or SINK_FIELD_DETAILS to fill in
+ * @summary: Output
+ */
+
+void sink_summarise(const modbus_tcp_frame_t *frame, unsigned fields, sink_summary_t *summary);
+
+
+/**
+ * sink_format_rules() - Fill in the text of rule hits
+ * @rules: Rule hits with @hits and @hit_ids set
+ */
+
+void sink_format_rules(sink_rule_hits_t *rules);
+
+
+/**
+ * sink_set_frame() - Summarise one frame and pass it to every sink
+ * @set: Set
+ * @record: Successfully decoded record
+ * @number: 1-based frame number
+ * @summary: Output of sink_summarise() with at least the set's fields
+ * @rules: Rule hits, text filled in if the set needs SINK_FIELD_RULES
+ */
+
+void sink_set_frame(sink_set_t *set, const modbus_record_t *record, uint32_t number,
+                    const sink_summary_t *summary, const sink_rule_hits_t *rules);
+
+
+/**
+ * sink_set_batch() - Flush every sink (before a checkpoint)
+ * @set: Set
+ */
+
+void sink_set_batch(sink_set_t *set);
+
+
+/**
+ * sink_set_end() - Finish and close every sink
+ * @set: Set
+ *
+ * Prints a warning for each sink that lost data.
+ *
+ * Return: false if any sink failed
+ */
+
+bool sink_set_end(sink_set_t *set);
+
+#endif /* OUTPUT_SINK_H */
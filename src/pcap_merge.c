@@ -0,0 +1,426 @@
+/*
+ * pcap_merge.c - K-way timestamp merge of captures from several taps
+ *
+ * Implements the merge declared in pcap_merge.h. The heap holds the
+ * indexes of the captures that still have a payload, ordered on that
+ * payload's timestamp and then on the capture index, so equal
+ * timestamps come out in the order the captures were given. The
+ * capture at the root is advanced lazily, on the call after its payload
+ * was returned.
+ *
+ * Copyright (C) 2025 Marty
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+
+#include "pcap_merge.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/* Entries per window bucket, and buckets in the window */
+#define MERGE_WAYS 4
+#define MERGE_BUCKETS 16384
+
+/* Read errors are prefixed with the capture name */
+#define MERGE_ERROR_SIZE 512
+
+
+/**
+ * struct merge_entry_t - One fingerprint in the duplicate window
+ * @fingerprint: Payload fingerprint
+ * @seen_ns: Timestamp the payload was last taken
+ * @captures: Bit i set once the payload was seen on capture i (0 = free)
+ */
+
+typedef struct {
+    uint64_t fingerprint;
+    int64_t seen_ns;
+    uint32_t captures;
+} merge_entry_t;
+
+
+/**
+ * struct merge_capture_t - One merged capture
+ * @reader: Its reader
+ * @head: Its oldest payload not yet returned (while it is in the heap)
+ * @name: Path, for error messages
+ */
+
+typedef struct {
+    pcap_reader_t *reader;
+    pcap_payload_t head;
+    char *name;
+} merge_capture_t;
+
+
+struct pcap_merge {
+    merge_capture_t captures[PCAP_MERGE_MAX_CAPTURES];
+    uint32_t count;
+    uint8_t heap[PCAP_MERGE_MAX_CAPTURES];
+    uint32_t heap_size;
+    bool advance_root;
+    merge_entry_t *window;
+    int64_t window_ns;
+    int64_t newest_ns;
+    pcap_merge_stats_t stats;
+    char error[MERGE_ERROR_SIZE];
+};
+
+
+/*
+ * heap_before() - Whether capture @a's payload comes before @b's
+ */
+
+static inline bool heap_before(const pcap_merge_t *merge, uint8_t a, uint8_t b) {
+    int64_t ta = merge->captures[a].head.timestamp_ns;
+    int64_t tb = merge->captures[b].head.timestamp_ns;
+    return ta < tb || (ta == tb && a < b);
+}
+
+
+/*
+ * heap_sift_down() - Restore the heap below @pos
+ */
+
+static void heap_sift_down(pcap_merge_t *merge, uint32_t pos) {
+    for (;;) {
+        uint32_t child = 2 * pos + 1;
+        if (child >= merge->heap_size) {
+            return;
+        }
+        if (child + 1 < merge->heap_size &&
+            heap_before(merge, merge->heap[child + 1], merge->heap[child])) {
+            child++;
+        }
+        if (!heap_before(merge, merge->heap[child], merge->heap[pos])) {
+            return;
+        }
+        uint8_t swap = merge->heap[pos];
+        merge->heap[pos] = merge->heap[child];
+        merge->heap[child] = swap;
+        pos = child;
+    }
+}
+
+
+/*
+ * heap_push() - Add a capture whose head was just read
+ */
+
+static void heap_push(pcap_merge_t *merge, uint8_t index) {
+    uint32_t pos = merge->heap_size++;
+
+    merge->heap[pos] = index;
+    while (pos > 0) {
+        uint32_t parent = (pos - 1) / 2;
+        if (!heap_before(merge, merge->heap[pos], merge->heap[parent])) {
+            return;
+        }
+        uint8_t swap = merge->heap[pos];
+        merge->heap[pos] = merge->heap[parent];
+        merge->heap[parent] = swap;
+        pos = parent;
+    }
+}
+
+
+/*
+ * read_head() - Read the next payload of a capture into its head
+ *
+ * Return: as pcap_reader_next(); on -1 the merge error is set
+ */
+
+static int read_head(pcap_merge_t *merge, uint8_t index) {
+    merge_capture_t *capture = &merge->captures[index];
+    int result = pcap_reader_next(capture->reader, &capture->head);
+
+    if (result < 0) {
+        snprintf(merge->error, sizeof(merge->error), "%s: %s", capture->name,
+                 pcap_reader_error(capture->reader));
+    }
+    return result;
+}
+
+
+/*
+ * advance_root() - Replace the root capture's head with its next payload
+ *
+ * Return: false on read error
+ */
+
+static bool advance_root(pcap_merge_t *merge) {
+    int result = read_head(merge, merge->heap[0]);
+
+    if (result < 0) {
+        return false;
+    }
+    if (result == 0) {
+        merge->heap[0] = merge->heap[--merge->heap_size];
+    }
+    heap_sift_down(merge, 0);
+    return true;
+}
+
+
+/*
+ * payload_fingerprint() - Hash of what a copy on another tap has in common
+ *
+ * Addresses, ports, sequence number, captured length and payload bytes;
+ * not the timestamp, the link layer or the IP header, which differ
+ * between taps.
+ */
+
+static uint64_t payload_fingerprint(const pcap_payload_t *payload) {
+    uint64_t h = endpoint_hash(&payload->src) * 31 + endpoint_hash(&payload->dst);
+    uint32_t i = 0;
+
+    h ^= (uint64_t)payload->src_port << 48 | (uint64_t)payload->dst_port << 32 | payload->tcp_seq;
+    h = (h ^ payload->length) * 0xff51afd7ed558ccdULL;
+
+    for (; i + 8 <= payload->length; i += 8) {
+        uint64_t word;
+        memcpy(&word, payload->payload + i, sizeof(word));
+        h = (h ^ word) * 0xff51afd7ed558ccdULL;
+        h ^= h >> 32;
+    }
+    if (i < payload->length) {
+        uint64_t word = 0;
+        memcpy(&word, payload->payload + i, payload->length - i);
+        h = (h ^ word) * 0xff51afd7ed558ccdULL;
+    }
+    h ^= h >> 29;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    return h ^ (h >> 32);
+}
+
+
+/*
+ * is_copy() - Check a payload against the window and record it
+ * @merge: Merge with a window
+ * @index: Capture the payload came from
+ * @payload: Payload
+ *
+ * Return: true if another capture already gave this payload within the
+ *         window
+ */
+
+static bool is_copy(pcap_merge_t *merge, uint8_t index, const pcap_payload_t *payload) {
+    uint64_t fingerprint = payload_fingerprint(payload);
+    merge_entry_t *bucket = &merge->window[(fingerprint & (MERGE_BUCKETS - 1)) * MERGE_WAYS];
+    merge_entry_t *victim = &bucket[0];
+    int64_t now = payload->timestamp_ns;
+    uint32_t bit = 1u << index;
+
+    for (uint32_t way = 0; way < MERGE_WAYS; way++) {
+        merge_entry_t *entry = &bucket[way];
+        if (entry->captures != 0 && entry->fingerprint == fingerprint &&
+            llabs(now - entry->seen_ns) <= merge->window_ns) {
+            if (!(entry->captures & bit)) {
+                entry->captures |= bit;
+                return true;
+            }
+            // Again on the same tap: a retransmission, which the other taps copy anew
+            entry->captures = bit;
+            entry->seen_ns = now;
+            return false;
+        }
+        if (victim->captures != 0 &&
+            (entry->captures == 0 || entry->seen_ns < victim->seen_ns)) {
+            victim = entry;
+        }
+    }
+
+    if (victim->captures != 0 && now - victim->seen_ns <= merge->window_ns) {
+        merge->stats.evictions++;
+    }
+    victim->fingerprint = fingerprint;
+    victim->seen_ns = now;
+    victim->captures = bit;
+    return false;
+}
+
+
+/**
+ * pcap_merge_open() - Open captures for merging
+ * @filenames: Paths of the captures (1 to PCAP_MERGE_MAX_CAPTURES)
+ * @count: Entries in @filenames
+ * @options: Reader settings for every capture (NULL = libpcap backend)
+ * @window_ms: Duplicate window in milliseconds (0 = no suppression)
+ * @errbuf: Output error message on failure (may be NULL)
+ * @errlen: Size of @errbuf
+ *
+ * Return: Merge handle, or NULL on failure
+ */
+
+pcap_merge_t *pcap_merge_open(const char *const *filenames, uint32_t count,
+                              const pcap_reader_options_t *options, uint32_t window_ms,
+                              char *errbuf, size_t errlen) {
+    if (count == 0 || count > PCAP_MERGE_MAX_CAPTURES) {
+        if (errbuf) snprintf(errbuf, errlen, "can merge 1 to %d captures, not %u",
+                             PCAP_MERGE_MAX_CAPTURES, count);
+        return NULL;
+    }
+
+    pcap_merge_t *merge = calloc(1, sizeof(pcap_merge_t));
+    if (!merge) {
+        if (errbuf) snprintf(errbuf, errlen, "out of memory");
+        return NULL;
+    }
+    merge->stats.captures = count;
+
+    if (window_ms > 0) {
+        merge->window = calloc((size_t)MERGE_BUCKETS * MERGE_WAYS, sizeof(merge_entry_t));
+        if (!merge->window) {
+            if (errbuf) snprintf(errbuf, errlen, "out of memory");
+            free(merge);
+            return NULL;
+        }
+        merge->window_ns = (int64_t)window_ms * 1000000;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        merge_capture_t *capture = &merge->captures[i];
+
+        capture->reader = pcap_reader_open_with(filenames[i], options, errbuf, errlen);
+        if (!capture->reader) {
+            pcap_merge_close(merge);
+            return NULL;
+        }
+        merge->count++;
+
+        size_t name_length = strlen(filenames[i]) + 1;
+        capture->name = malloc(name_length);
+        if (!capture->name) {
+            if (errbuf) snprintf(errbuf, errlen, "out of memory");
+            pcap_merge_close(merge);
+            return NULL;
+        }
+        memcpy(capture->name, filenames[i], name_length);
+
+        int result = read_head(merge, (uint8_t)i);
+        if (result < 0) {
+            if (errbuf) snprintf(errbuf, errlen, "%s", merge->error);
+            pcap_merge_close(merge);
+            return NULL;
+        }
+        if (result > 0) {
+            heap_push(merge, (uint8_t)i);
+        }
+    }
+
+    merge->newest_ns = INT64_MIN;
+    return merge;
+}
+
+
+/**
+ * pcap_merge_next() - Oldest payload not yet returned, copies dropped
+ * @merge: Open merge
+ * @out: Output payload, valid until the next call
+ *
+ * Return: 1 if @out was filled, 0 when every capture has ended, -1 on
+ *         read error (see pcap_merge_error())
+ */
+
+int pcap_merge_next(pcap_merge_t *merge, pcap_payload_t *out) {
+    for (;;) {
+        if (merge->advance_root) {
+            if (!advance_root(merge)) {
+                return -1;
+            }
+            merge->advance_root = false;
+        }
+        if (merge->heap_size == 0) {
+            return 0;
+        }
+
+        uint8_t index = merge->heap[0];
+        const pcap_payload_t *head = &merge->captures[index].head;
+
+        // The head stays in its reader's buffer until the root is advanced
+        merge->advance_root = true;
+        if (merge->window && is_copy(merge, index, head)) {
+            merge->stats.duplicates[index]++;
+            continue;
+        }
+
+        merge->stats.payloads[index]++;
+        if (head->timestamp_ns < merge->newest_ns) {
+            merge->stats.out_of_order++;
+        } else {
+            merge->newest_ns = head->timestamp_ns;
+        }
+        *out = *head;
+        return 1;
+    }
+}
+
+
+/**
+ * pcap_merge_datalink() - Link-layer type of the first capture
+ * @merge: Merge
+ *
+ * Return: libpcap DLT_* value (each capture is decoded with its own)
+ */
+
+int pcap_merge_datalink(const pcap_merge_t *merge) {
+    return pcap_reader_datalink(merge->captures[0].reader);
+}
+
+
+/**
+ * pcap_merge_packet_count() - Packets read so far from all captures
+ * @merge: Merge
+ *
+ * Return: Packet count
+ */
+
+uint64_t pcap_merge_packet_count(const pcap_merge_t *merge) {
+    uint64_t packets = 0;
+
+    for (uint32_t i = 0; i < merge->count; i++) {
+        packets += pcap_reader_packet_count(merge->captures[i].reader);
+    }
+    return packets;
+}
+
+
+/**
+ * pcap_merge_stats() - Merge counters
+ * @merge: Merge
+ * @stats: Output statistics
+ */
+
+void pcap_merge_stats(const pcap_merge_t *merge, pcap_merge_stats_t *stats) {
+    *stats = merge->stats;
+}
+
+
+/**
+ * pcap_merge_error() - Last read error message
+ * @merge: Merge
+ *
+ * Return: Error string, prefixed with the capture's name ("" if none)
+ */
+
+const char *pcap_merge_error(const pcap_merge_t *merge) {
+    return merge->error;
+}
+
+
+/**
+ * pcap_merge_close() - Close every capture and free the merge
+ * @merge: Merge (NULL is ignored)
+ */
+
+void pcap_merge_close(pcap_merge_t *merge) {
+    if (!merge) return;
+    for (uint32_t i = 0; i < merge->count; i++) {
+        pcap_reader_close(merge->captures[i].reader);
+        free(merge->captures[i].name);
+    }
+    free(merge->window);
+    free(merge);
+}
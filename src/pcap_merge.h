@@ -0,0 +1,116 @@
+/*
+ * pcap_merge.h - K-way timestamp merge of captures from several taps
+ *
+ * The same traffic captured at several points (taps on a ring, mirror
+ * ports on both sides of a switch) is read as one stream: every capture
+ * has its own pcap_reader_t, and a binary min-heap of their current
+ * payloads, keyed on the timestamp, picks the oldest. Only the capture
+ * whose payload was returned is advanced, so the others' payloads stay
+ * valid in their readers and nothing is copied.
+ *
+ * Copies seen on several taps are dropped with a short-horizon window:
+ * a 4-way set-associative table of payload fingerprints (addresses,
+ * ports, TCP sequence number, length and payload bytes), each with the
+ * time it was last taken and the set of captures it has been seen on.
+ * A fingerprint already in the window from another capture is a copy;
+ * one already seen on the same capture is a retransmission and is kept.
+ *
+ * pcap_reader_open_merged() wraps a merge in an ordinary reader.
+ * Internal to libmodbus_parse; not installed.
+ *
+ * Copyright (C) 2025 Marty
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef PCAP_MERGE_H
+#define PCAP_MERGE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "pcap_reader.h"
+
+
+/* Opaque merge of several captures (see pcap_merge_open()) */
+typedef struct pcap_merge pcap_merge_t;
+
+
+/**
+ * pcap_merge_open() - Open captures for merging
+ * @filenames: Paths of the captures (1 to PCAP_MERGE_MAX_CAPTURES)
+ * @count: Entries in @filenames
+ * @options: Reader settings for every capture (NULL = libpcap backend)
+ * @window_ms: Duplicate window in milliseconds (0 = no suppression)
+ * @errbuf: Output error message on failure (may be NULL)
+ * @errlen: Size of @errbuf
+ *
+ * The first payload of every capture is read here, so a capture that
+ * cannot be read fails the open.
+ *
+ * Return: Merge handle, or NULL on failure
+ */
+
+pcap_merge_t *pcap_merge_open(const char *const *filenames, uint32_t count,
+                              const pcap_reader_options_t *options, uint32_t window_ms,
+                              char *errbuf, size_t errlen);
+
+
+/**
+ * pcap_merge_next() - Oldest payload not yet returned, copies dropped
+ * @merge: Open merge
+ * @out: Output payload, valid until the next call
+ *
+ * Return: 1 if @out was filled, 0 when every capture has ended, -1 on
+ *         read error (see pcap_merge_error())
+ */
+
+int pcap_merge_next(pcap_merge_t *merge, pcap_payload_t *out);
+
+
+/**
+ * pcap_merge_datalink() - Link-layer type of the first capture
+ * @merge: Merge
+ *
+ * Return: libpcap DLT_* value (each capture is decoded with its own)
+ */
+
+int pcap_merge_datalink(const pcap_merge_t *merge);
+
+
+/**
+ * pcap_merge_packet_count() - Packets read so far from all captures
+ * @merge: Merge
+ *
+ * Return: Packet count
+ */
+
+uint64_t pcap_merge_packet_count(const pcap_merge_t *merge);
+
+
+/**
+ * pcap_merge_stats() - Merge counters
+ * @merge: Merge
+ * @stats: Output statistics
+ */
+
+void pcap_merge_stats(const pcap_merge_t *merge, pcap_merge_stats_t *stats);
+
+
+/**
+ * pcap_merge_error() - Last read error message
+ * @merge: Merge
+ *
+ * Return: Error string, prefixed with the capture's name ("" if none)
+ */
+
+const char *pcap_merge_error(const pcap_merge_t *merge);
+
+
+/**
+ * pcap_merge_close() - Close every capture and free the merge
+ * @merge: Merge (NULL is ignored)
+ */
+
+void pcap_merge_close(pcap_merge_t *merge);
+
+#endif /* PCAP_MERGE_H */
@@ -6,11 +6,28 @@
  * extraction for Modbus TCP frames.
  *
  * Key features:
+ * - Pull-based iterator (open / next / close), one payload or one batch
+ *   at a time; pcap_process_file() and pcap_process_file_batch() are
+ *   callback loops over the batch iterator
  * - Robust PCAP parsing via libpcap
- * - Automatic layer skipping (Ethernet, IP options, TCP options)
+ * - Per-datalink decode loops chosen once per file (Ethernet with
+ *   VLAN/QinQ tags, Linux SLL/SLL2, raw IP, BSD loopback)
+ * - Automatic layer skipping (link layer, IP options, TCP options)
  * - Port 502 filtering (source or destination)
- * - IP address formatting
- * - Timestamp conversion
+ * - Port-to-handler dispatch: payloads on other registered TCP or UDP
+ *   ports go to their protocol's handler in the same pass
+ * - IPv4 and IPv6 (with extension headers); addresses stay binary
+ * - Integer nanosecond timestamps (libpcap opened at nanosecond
+ *   precision, so pcapng and nanosecond pcap keep every digit)
+ * - Optional 1-in-N sampling of packets, flows or capture seconds,
+ *   decided before the payload is returned
+ * - gzip/zstd/lz4 captures decompressed on a pipeline thread
+ *   (capture_input.c), with no temporary file
+ * - Optional mmap / io_uring backends (capture_io.c): classic pcap
+ *   records are parsed straight out of the mapped or read-ahead blocks,
+ *   and only records straddling two blocks are copied
+ * - Several captures of the same traffic merged into one time-ordered
+ *   stream with cross-tap copies dropped (pcap_merge.c)
  * - Cross-platform support (Windows/Linux/macOS)
  *
  * Copyright (C) 2025 Marty
@@ -19,7 +36,11 @@
 
 
 #include "pcap_reader.h"
+#include "capture_io.h"
+#include "pcap_merge.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/time.h>
 #include <pcap.h>
 
@@ -35,15 +56,107 @@
 /* Ethernet header size */
 #define ETHERNET_HEADER_SIZE 14
 
+/* 802.1Q / 802.1ad tag size */
+#define VLAN_TAG_SIZE 4
+
+/* Maximum stacked VLAN tags followed (QinQ and a little more) */
+#define VLAN_MAX_DEPTH 4
+
+/* Linux cooked capture header sizes (DLT_LINUX_SLL / DLT_LINUX_SLL2) */
+#define SLL_HEADER_SIZE 16
+#define SLL2_HEADER_SIZE 20
+
+/* BSD loopback header size (DLT_NULL / DLT_LOOP) */
+#define LOOPBACK_HEADER_SIZE 4
+
 /* IP header minimum size */
 #define IP_HEADER_MIN_SIZE 20
 
 /* TCP header minimum size */
 #define TCP_HEADER_MIN_SIZE 20
 
+/* IPv6 fixed header size */
+#define IPV6_HEADER_SIZE 40
+
+/* Longest IPv6 extension header chain followed */
+#define IPV6_MAX_EXTENSIONS 8
+
+/* UDP header size */
+#define UDP_HEADER_SIZE 8
+
+/* IP protocol / IPv6 next-header values */
+#define IP_PROTO_TCP 6
+#define IP_PROTO_UDP 17
+#define IPV6_EXT_HOP_BY_HOP 0
+#define IPV6_EXT_ROUTING 43
+#define IPV6_EXT_FRAGMENT 44
+#define IPV6_EXT_AUTH 51
+#define IPV6_EXT_DEST_OPTIONS 60
+#define IPV6_EXT_MOBILITY 135
+#define IPV6_EXT_HIP 139
+#define IPV6_EXT_SHIM6 140
+
 /* Modbus TCP port */
 #define MODBUS_TCP_PORT 502
 
+/* Where a decoded payload goes: port table entries, then handler slots */
+#define DISPATCH_NONE 0
+#define DISPATCH_MODBUS 1
+#define DISPATCH_HANDLER 2
+
+/* Entries in a port-to-handler table */
+#define DISPATCH_PORTS 65536
+
+/* Initial payload bytes per batch entry (a full Modbus TCP ADU is 260) */
+#define PCAP_BATCH_BYTES_PER_ITEM 256
+
+/* EtherTypes */
+#define ETHERTYPE_IPV4 0x0800
+#define ETHERTYPE_IPV6 0x86DD
+#define ETHERTYPE_VLAN 0x8100
+#define ETHERTYPE_QINQ 0x88A8
+#define ETHERTYPE_QINQ_OLD 0x9100
+
+/* Loopback address families (AF_INET6 differs between BSDs) */
+#define LOOPBACK_AF_INET 2
+#define LOOPBACK_AF_INET6_BSD 24
+#define LOOPBACK_AF_INET6_FREEBSD 28
+#define LOOPBACK_AF_INET6_DARWIN 30
+
+/* Link-layer types that may be missing from older pcap.h */
+#ifndef DLT_LINUX_SLL2
+#define DLT_LINUX_SLL2 276
+#endif
+#ifndef DLT_IPV4
+#define DLT_IPV4 228
+#endif
+#ifndef DLT_IPV6
+#define DLT_IPV6 229
+#endif
+
+/* Classic pcap file format, parsed by the native (mmap / io_uring) path */
+#define PCAP_FILE_HEADER_SIZE 24
+#define PCAP_RECORD_HEADER_SIZE 16
+#define PCAP_MAGIC_USEC 0xA1B2C3D4u
+#define PCAP_MAGIC_NSEC 0xA1B23C4Du
+#define PCAP_MAGIC_USEC_SWAPPED 0xD4C3B2A1u
+#define PCAP_MAGIC_NSEC_SWAPPED 0x4D3CB2A1u
+#define PCAPNG_MAGIC 0x0A0D0D0Au
+
+/* Largest caplen accepted, as libpcap does for these link types */
+#define PCAP_MAX_CAPLEN 262144
+
+/* LINKTYPE_* values whose DLT_* differs on some platforms */
+#define LINKTYPE_RAW 101
+#define LINKTYPE_LOOP 108
+
+/* Force the per-datalink loops to be specialised copies */
+#if defined(__GNUC__) || defined(__clang__)
+#define READER_INLINE static inline __attribute__((always_inline))
+#else
+#define READER_INLINE static inline
+#endif
+
 
 /**
  * struct ip_header_t - Simplified IPv4 header structure
@@ -61,6 +174,8 @@
  * 
  * Minimum IPv4 header fields needed for Modbus TCP extraction.
  * Does not include IP options (if present, calculated via IHL).
+ * Packet bytes have no alignment guarantee (SLL, VLAN tags), so the
+ * header is always copied out with memcpy() rather than cast in place.
  *
  * Wire format: 20 bytes minimum (no options)
  */
@@ -110,139 +225,1672 @@ typedef struct {
 } tcp_header_t;
 
 
+/* Where packet records come from (a constant in every decode loop) */
+typedef enum {
+    SOURCE_LIBPCAP,
+    SOURCE_NATIVE
+} record_source_t;
+
+
+/* Link-layer framing handled by the specialised decode loops */
+typedef enum {
+    LINK_ETHERNET,
+    LINK_SLL,
+    LINK_SLL2,
+    LINK_RAW,
+    LINK_NULL,
+    LINK_LOOP
+} link_type_t;
+
+
 /**
- * pcap_process_file() - Oricess PCAP file and extract MOdbus TCP payloads
- * @filename: Path to PCAP file (relative or absolute)
- * @callback: Function to invoke for each Modbus TCP frame
- * @user_data: Opaque pointer passed to callback
+ * struct reader_protocol_t - Handler registered with pcap_reader_add_protocol()
+ * @handler: Consumer of the payloads
+ * @user_data: Passed to @handler
+ * @transport: Transport of the registration
+ */
+
+typedef struct {
+    pcap_protocol_handler_t handler;
+    void *user_data;
+    pcap_transport_t transport;
+} reader_protocol_t;
+
+
+/**
+ * struct pcap_reader - Open capture and per-file counters
+ * @handle: libpcap handle (NULL with a native backend)
+ * @input: Decompression pipeline feeding @handle (NULL for plain files)
+ * @io: Block reader of a native backend (NULL with libpcap)
+ * @merge: Merger of several captures (NULL for one file)
+ * @block: Native: current block
+ * @block_length: Native: bytes in @block
+ * @block_pos: Native: offset of the next record in @block
+ * @block_offset: Native: file offset of @block
+ * @swapped: Native: file written with the other byte order
+ * @nanosecond: Native: timestamps are in nanoseconds
+ * @straddle: Native: record copied together from two blocks
+ * @record: Native: header of the record just returned
+ * @next: Decode loop for the capture's datalink type (chosen at open)
+ * @datalink: libpcap DLT_* value of the capture
+ * @packets: Packets read so far
+ * @payloads: Port-502 payloads returned so far
+ * @merged: Payloads returned by the merger so far (sampling index)
+ * @sample: Records kept (mode PCAP_SAMPLE_NONE = all)
+ * @ports: Per transport, DISPATCH_* target of every port (NULL = no
+ *         handler on that transport)
+ * @protocols: Handlers; port table value DISPATCH_HANDLER + i is @protocols[i]
+ * @protocol_count: Entries used in @protocols
+ * @batch_failed: A read error ended the last batch early; the next
+ *                pcap_reader_next_batch() reports it
+ * @error: Last error message
+ */
+
+struct pcap_reader {
+    pcap_t *handle;
+    capture_input_t *input;
+    capture_io_t *io;
+    pcap_merge_t *merge;
+    const uint8_t *block;
+    size_t block_length;
+    size_t block_pos;
+    int64_t block_offset;
+    bool swapped;
+    bool nanosecond;
+    uint8_t *straddle;
+    struct pcap_pkthdr record;
+    int (*next)(pcap_reader_t *reader, pcap_payload_t *out);
+    int datalink;
+    uint64_t packets;
+    uint64_t payloads;
+    uint64_t merged;
+    pcap_sample_t sample;
+    uint8_t *ports[PCAP_TRANSPORT_COUNT];
+    reader_protocol_t protocols[PCAP_MAX_PROTOCOLS];
+    uint32_t protocol_count;
+    bool batch_failed;
+    char error[PCAP_ERRBUF_SIZE];
+};
+
+
+/*
+ * load_be16() - Read a big-endian 16-bit value from unaligned bytes
+ */
+
+static inline uint16_t load_be16(const uint8_t *p) {
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+
+/*
+ * link_decode() - Strip the link-layer header
+ * @link: Framing (a constant in every caller, so the switch folds away)
+ * @packet: Captured bytes
+ * @caplen: Captured length
+ * @l3_offset: Output offset of the network-layer header
+ * @ethertype: Output network protocol as an EtherType
  *
- * Opens PCAP file via libpcap, iterates through all packets, and invokes
- * callback for each TCP packet on port 502 (Modbus TCP).
- *
- * Processing flow:
- * 1. Open PCAP file (pcap_open_offline)
- * 2. For each packet:
- *    a. Validate minimum size (Ethernet + IP + TCP headers)
- *    b. Skip Ethernet header (14 bytes)
- *    c. Parse IP header, extract IHL for variable length
- *    d. Check protocol == 6 (TCP)
- *    e. Parse TCP header, extract data offset for variable length
- *    f. Check port == 502 (source or destination)
- *    g. Calculate payload offset and extract data
- *    h. Format IP addresses as strings
- *    i. Convert timestamp to double (seconds.microseconds)
- *    j. Invoke callback with payload and metadata
- * 3. Close PCAP file
- *
- * Non-TCP packets and non-port-502 traffic are silently skipped.
- * Empty payloads (e.g., TCP ACK without data) are skipped.
- * Malformed packets are skipped with no error.
+ * Return: false if the packet is too short or not IP
+ */
+
+READER_INLINE bool link_decode(link_type_t link, const uint8_t *packet, uint32_t caplen,
+                               uint32_t *l3_offset, uint16_t *ethertype) {
+    uint32_t family;
+
+    switch (link) {
+        case LINK_ETHERNET: {
+            uint32_t offset = ETHERNET_HEADER_SIZE;
+            uint16_t type;
+            int depth = 0;
+
+            if (caplen < ETHERNET_HEADER_SIZE) {
+                return false;
+            }
+            type = load_be16(packet + 12);
+
+            // Tag type sits where the EtherType was; the inner type follows the TCI
+            while ((type == ETHERTYPE_VLAN || type == ETHERTYPE_QINQ ||
+                    type == ETHERTYPE_QINQ_OLD) && depth < VLAN_MAX_DEPTH) {
+                if (caplen < offset + VLAN_TAG_SIZE) {
+                    return false;
+                }
+                type = load_be16(packet + offset + 2);
+                offset += VLAN_TAG_SIZE;
+                depth++;
+            }
+            *l3_offset = offset;
+            *ethertype = type;
+            return true;
+        }
+
+        case LINK_SLL:
+            if (caplen < SLL_HEADER_SIZE) {
+                return false;
+            }
+            *l3_offset = SLL_HEADER_SIZE;
+            *ethertype = load_be16(packet + 14);
+            return true;
+
+        case LINK_SLL2:
+            if (caplen < SLL2_HEADER_SIZE) {
+                return false;
+            }
+            *l3_offset = SLL2_HEADER_SIZE;
+            *ethertype = load_be16(packet);
+            return true;
+
+        case LINK_RAW:
+            // No header: the IP version nibble tells v4 from v6
+            if (caplen < 1) {
+                return false;
+            }
+            *l3_offset = 0;
+            *ethertype = (packet[0] >> 4) == 6 ? ETHERTYPE_IPV6 : ETHERTYPE_IPV4;
+            return true;
+
+        case LINK_NULL:
+        case LINK_LOOP:
+            if (caplen < LOOPBACK_HEADER_SIZE) {
+                return false;
+            }
+            // DLT_NULL stores the family in the capturing host's byte order
+            memcpy(&family, packet, sizeof(family));
+            if (link == LINK_LOOP) {
+                family = ntohl(family);
+            } else if (family > 0xFFFF) {
+                family = ntohl(family);
+            }
+            *l3_offset = LOOPBACK_HEADER_SIZE;
+            if (family == LOOPBACK_AF_INET) {
+                *ethertype = ETHERTYPE_IPV4;
+            } else if (family == LOOPBACK_AF_INET6_BSD || family == LOOPBACK_AF_INET6_FREEBSD ||
+                       family == LOOPBACK_AF_INET6_DARWIN) {
+                *ethertype = ETHERTYPE_IPV6;
+            } else {
+                return false;
+            }
+            return true;
+    }
+    return false;
+}
+
+
+/*
+ * dispatch_target() - DISPATCH_* target of a segment from its two ports
  *
- * Return: true if file processed successfully (even if 0 Modbus frames)
- *         false if file open failed or read error occurred
+ * The destination port is looked up first: it is the server's port on
+ * requests, and the source port then catches the responses.
  */
 
-bool pcap_process_file(const char *filename, modbus_payload_callback_t callback, void *user_data) {
-    char errbuf[PCAP_ERRBUF_SIZE];
-    pcap_t *handle;
-    struct pcap_pkthdr *header;
-    const uint8_t *packet;
-    int result;
-    uint32_t packet_count = 0;
-    uint32_t modbus_count = 0;
+static inline uint8_t dispatch_target(const uint8_t *ports, uint16_t src_port, uint16_t dst_port) {
+    if (!ports) {
+        return DISPATCH_NONE;
+    }
+    return ports[dst_port] != DISPATCH_NONE ? ports[dst_port] : ports[src_port];
+}
 
-    // Open PCAP file
-    handle = pcap_open_offline(filename, errbuf);
-    if (handle == NULL) {
-        printf("Error opening PCAP file: %s\n", errbuf);
-        return false;
+
+/*
+ * decode_tcp() - Extract a port-502 or registered payload from a TCP segment
+ * @reader: Reader (for its port-to-handler table)
+ * @header: libpcap packet header
+ * @packet: Captured bytes
+ * @tcp_offset: Offset of the TCP header (IP header already checked)
+ * @segment_length: TCP header + payload bytes per the IP header, or 0
+ *                  if unknown (jumbograms, offloaded captures)
+ * @out: Output payload descriptor (addresses filled in by the caller)
+ *
+ * Return: DISPATCH_* target if @out was filled, else DISPATCH_NONE
+ */
+
+READER_INLINE uint8_t decode_tcp(const pcap_reader_t *reader, const struct pcap_pkthdr *header,
+                                 const uint8_t *packet, uint32_t tcp_offset,
+                                 uint32_t segment_length, pcap_payload_t *out) {
+    tcp_header_t tcp_hdr;
+    uint32_t caplen = header->caplen;
+    uint8_t target = DISPATCH_MODBUS;
+
+    if (caplen < tcp_offset + TCP_HEADER_MIN_SIZE) {
+        return DISPATCH_NONE;  // TCP header not captured
     }
 
-    printf("Processing PCAP file: %s\n", filename);
-    printf("Looking for Modbus TCP traffic (port %d)...\n\n", MODBUS_TCP_PORT);
+    // Parse TCP header
+    memcpy(&tcp_hdr, packet + tcp_offset, sizeof(tcp_hdr));
+    uint32_t tcp_header_length = ((tcp_hdr.data_offset_reserved >> 4) & 0x0F) * 4;
+    if (tcp_header_length < TCP_HEADER_MIN_SIZE) {
+        return DISPATCH_NONE;
+    }
 
-    // Read packets
-    while ((result = pcap_next_ex(handle, &header, &packet)) >= 0) {
-        if (result == 0) {
-            continue;  // Timeout
+    // Convert port from network byte order
+    uint16_t src_port = ntohs(tcp_hdr.source_port);
+    uint16_t dst_port = ntohs(tcp_hdr.dest_port);
+
+    // Modbus TCP port (502) first, then the registered protocols
+    if (src_port != MODBUS_TCP_PORT && dst_port != MODBUS_TCP_PORT) {
+        target = dispatch_target(reader->ports[PCAP_TRANSPORT_TCP], src_port, dst_port);
+        if (target == DISPATCH_NONE) {
+            return DISPATCH_NONE;
         }
+    }
+
+    // Calculate payload offset and length (TCP options must be captured)
+    uint32_t headers_size = tcp_offset + tcp_header_length;
+    if (caplen <= headers_size) {
+        return DISPATCH_NONE;  // No payload
+    }
 
-        packet_count++;
+    uint32_t payload_length = caplen - headers_size;
 
-        // Validate minimum packet size (Ethernet + IP + TCP headers)
-        if (header->caplen < ETHERNET_HEADER_SIZE + IP_HEADER_MIN_SIZE + TCP_HEADER_MIN_SIZE) {
-            continue;
-        }
+    // Wire length from the IP header; falls back to the frame length
+    // when the IP length is unset (segmentation offload captures)
+    uint32_t wire_length = header->len > headers_size ? header->len - headers_size : 0;
+    if (segment_length >= tcp_header_length) {
+        wire_length = segment_length - tcp_header_length;
+    }
+    if (payload_length > wire_length) {
+        payload_length = wire_length;  // Drop link-layer trailer padding
+    }
 
-        // Skip Ethernet header
-        const uint8_t *ip_packet = packet + ETHERNET_HEADER_SIZE;
+    // Skip if payload is empty
+    if (payload_length == 0) {
+        return DISPATCH_NONE;
+    }
 
-        // Parse IP header
-        ip_header_t *ip_hdr = (ip_header_t *)ip_packet;
-        uint8_t ip_header_length = (ip_hdr->version_ihl & 0x0F) * 4;
+    out->payload = packet + headers_size;
+    out->length = payload_length;
+    out->wire_length = wire_length;
+    out->src_port = src_port;
+    out->dst_port = dst_port;
+    out->tcp_seq = ntohl(tcp_hdr.seq_number);
 
-        // Check if TCP protocol (6)
-        if (ip_hdr->protocol != 6) {
-            continue;
-        }
+    // Every record source fills tv_usec with nanoseconds (see pcap_reader_open_with())
+    out->timestamp_ns = (int64_t)header->ts.tv_sec * 1000000000 + header->ts.tv_usec;
+    return target;
+}
+
+
+/*
+ * decode_udp() - Extract a registered payload from a UDP datagram
+ * @reader: Reader (for its port-to-handler table)
+ * @header: libpcap packet header
+ * @packet: Captured bytes
+ * @udp_offset: Offset of the UDP header (IP header already checked)
+ * @out: Output payload descriptor (addresses filled in by the caller)
+ *
+ * Return: DISPATCH_* target if @out was filled, else DISPATCH_NONE
+ */
 
-        // Parse TCP header
-        const uint8_t *tcp_packet = ip_packet + ip_header_length;
-        tcp_header_t *tcp_hdr = (tcp_header_t *)tcp_packet;
-        uint8_t tcp_header_length = ((tcp_hdr->data_offset_reserved >> 4) & 0x0F) * 4;
+READER_INLINE uint8_t decode_udp(const pcap_reader_t *reader, const struct pcap_pkthdr *header,
+                                 const uint8_t *packet, uint32_t udp_offset,
+                                 pcap_payload_t *out) {
+    uint32_t caplen = header->caplen;
 
-        // Convert port from network byte order
-        uint16_t src_port = ntohs(tcp_hdr->source_port);
-        uint16_t dst_port = ntohs(tcp_hdr->dest_port);
+    if (caplen < udp_offset + UDP_HEADER_SIZE) {
+        return DISPATCH_NONE;
+    }
 
-        // Check if Modbus TCP port (502)
-        if (src_port != MODBUS_TCP_PORT && dst_port != MODBUS_TCP_PORT) {
-            continue;
+    const uint8_t *udp = packet + udp_offset;
+    uint16_t src_port = load_be16(udp);
+    uint16_t dst_port = load_be16(udp + 2);
+    uint8_t target = dispatch_target(reader->ports[PCAP_TRANSPORT_UDP], src_port, dst_port);
+    if (target == DISPATCH_NONE) {
+        return DISPATCH_NONE;
+    }
+
+    // The UDP length covers the header; trailer padding is dropped with it
+    uint32_t datagram_length = load_be16(udp + 4);
+    if (datagram_length <= UDP_HEADER_SIZE) {
+        return DISPATCH_NONE;
+    }
+    uint32_t wire_length = datagram_length - UDP_HEADER_SIZE;
+    uint32_t payload_length = caplen - udp_offset - UDP_HEADER_SIZE;
+    if (payload_length > wire_length) {
+        payload_length = wire_length;
+    }
+    if (payload_length == 0) {
+        return DISPATCH_NONE;
+    }
+
+    out->payload = udp + UDP_HEADER_SIZE;
+    out->length = payload_length;
+    out->wire_length = wire_length;
+    out->src_port = src_port;
+    out->dst_port = dst_port;
+    out->tcp_seq = 0;
+    out->timestamp_ns = (int64_t)header->ts.tv_sec * 1000000000 + header->ts.tv_usec;
+    return target;
+}
+
+
+/*
+ * decode_ipv4() - Locate the TCP segment or UDP datagram of an IPv4 packet
+ * @reader: Reader (for its port-to-handler tables)
+ * @header: libpcap packet header
+ * @packet: Captured bytes
+ * @l3_offset: Offset of the IPv4 header
+ * @out: Output payload descriptor
+ *
+ * Every header length is checked against caplen before it is read.
+ * Non-first fragments carry no transport header and are skipped. UDP
+ * is only decoded when a handler is registered for it.
+ *
+ * Return: DISPATCH_* target if @out was filled, else DISPATCH_NONE
+ */
+
+READER_INLINE uint8_t decode_ipv4(const pcap_reader_t *reader, const struct pcap_pkthdr *header,
+                                  const uint8_t *packet, uint32_t l3_offset,
+                                  pcap_payload_t *out) {
+    ip_header_t ip_hdr;
+    uint8_t target;
+
+    // Validate minimum packet size (IP + UDP headers; TCP is checked on its own)
+    if (header->caplen < l3_offset + IP_HEADER_MIN_SIZE + UDP_HEADER_SIZE) {
+        return DISPATCH_NONE;
+    }
+
+    // Parse IP header
+    memcpy(&ip_hdr, packet + l3_offset, sizeof(ip_hdr));
+    uint32_t ip_header_length = (ip_hdr.version_ihl & 0x0F) * 4;
+    if ((ip_hdr.version_ihl >> 4) != 4 || ip_header_length < IP_HEADER_MIN_SIZE) {
+        return DISPATCH_NONE;  // Not IPv4 or bogus IHL
+    }
+
+    // Only the first (or only) fragment carries the transport header
+    if ((ntohs(ip_hdr.flags_fragment) & 0x1FFF) != 0) {
+        return DISPATCH_NONE;
+    }
+
+    if (ip_hdr.protocol == IP_PROTO_TCP) {
+        uint32_t ip_total_length = ntohs(ip_hdr.total_length);
+        uint32_t segment_length = ip_total_length > ip_header_length
+                                  ? ip_total_length - ip_header_length : 0;
+        target = decode_tcp(reader, header, packet, l3_offset + ip_header_length,
+                            segment_length, out);
+    } else if (ip_hdr.protocol == IP_PROTO_UDP && reader->ports[PCAP_TRANSPORT_UDP]) {
+        target = decode_udp(reader, header, packet, l3_offset + ip_header_length, out);
+    } else {
+        return DISPATCH_NONE;
+    }
+    if (target == DISPATCH_NONE) {
+        return DISPATCH_NONE;
+    }
+
+    endpoint_from_ipv4(&out->src, ntohl(ip_hdr.source_ip));
+    endpoint_from_ipv4(&out->dst, ntohl(ip_hdr.dest_ip));
+    return target;
+}
+
+
+/*
+ * decode_ipv6() - Locate the TCP segment or UDP datagram of an IPv6 packet
+ * @reader: Reader (for its port-to-handler tables)
+ * @header: libpcap packet header
+ * @packet: Captured bytes
+ * @l3_offset: Offset of the IPv6 header
+ * @out: Output payload descriptor
+ *
+ * Walks up to IPV6_MAX_EXTENSIONS extension headers (hop-by-hop,
+ * routing, destination options, fragment, AH, mobility, HIP, shim6),
+ * bounds-checking each against caplen. ESP-protected and non-first
+ * fragment packets are skipped.
+ *
+ * Return: DISPATCH_* target if @out was filled, else DISPATCH_NONE
+ */
+
+READER_INLINE uint8_t decode_ipv6(const pcap_reader_t *reader, const struct pcap_pkthdr *header,
+                                  const uint8_t *packet, uint32_t l3_offset,
+                                  pcap_payload_t *out) {
+    uint32_t caplen = header->caplen;
+    uint8_t target;
+
+    if (caplen < l3_offset + IPV6_HEADER_SIZE + UDP_HEADER_SIZE) {
+        return DISPATCH_NONE;
+    }
+
+    const uint8_t *ip6 = packet + l3_offset;
+    if ((ip6[0] >> 4) != 6) {
+        return DISPATCH_NONE;
+    }
+
+    uint32_t payload_length = load_be16(ip6 + 4);  // 0 for jumbograms
+    uint8_t next_header = ip6[6];
+    uint32_t offset = l3_offset + IPV6_HEADER_SIZE;
+    uint32_t extensions_length = 0;
+
+    for (int depth = 0; next_header != IP_PROTO_TCP && next_header != IP_PROTO_UDP; depth++) {
+        uint32_t ext_length;
+
+        if (depth == IPV6_MAX_EXTENSIONS || caplen < offset + 8) {
+            return DISPATCH_NONE;
         }
 
-        // Calculate payload offset and length
-        uint32_t headers_size = ETHERNET_HEADER_SIZE + ip_header_length + tcp_header_length;
-        if (header->caplen <= headers_size) {
-            continue;  // No payload
+        switch (next_header) {
+            case IPV6_EXT_HOP_BY_HOP:
+            case IPV6_EXT_ROUTING:
+            case IPV6_EXT_DEST_OPTIONS:
+            case IPV6_EXT_MOBILITY:
+            case IPV6_EXT_HIP:
+            case IPV6_EXT_SHIM6:
+                ext_length = ((uint32_t)packet[offset + 1] + 1) * 8;
+                break;
+            case IPV6_EXT_FRAGMENT:
+                if ((load_be16(packet + offset + 2) & 0xFFF8) != 0) {
+                    return DISPATCH_NONE;  // Not the first fragment
+                }
+                ext_length = 8;
+                break;
+            case IPV6_EXT_AUTH:
+                ext_length = ((uint32_t)packet[offset + 1] + 2) * 4;
+                break;
+            default:
+                return DISPATCH_NONE;  // ESP, no-next-header, ICMPv6, ...
         }
 
-        const uint8_t *payload = packet + headers_size;
-        uint32_t payload_length = header->caplen - headers_size;
+        next_header = packet[offset];
+        offset += ext_length;
+        extensions_length += ext_length;
+    }
+
+    if (next_header == IP_PROTO_TCP) {
+        uint32_t segment_length = payload_length > extensions_length
+                                  ? payload_length - extensions_length : 0;
+        target = decode_tcp(reader, header, packet, offset, segment_length, out);
+    } else if (reader->ports[PCAP_TRANSPORT_UDP]) {
+        target = decode_udp(reader, header, packet, offset, out);
+    } else {
+        return DISPATCH_NONE;
+    }
+    if (target == DISPATCH_NONE) {
+        return DISPATCH_NONE;
+    }
 
-        // Skip if payload is empty
-        if (payload_length == 0) {
-            continue;
+    endpoint_from_ipv6(&out->src, ip6 + 8);
+    endpoint_from_ipv6(&out->dst, ip6 + 24);
+    return target;
+}
+
+
+/*
+ * load_file32() - Read a 32-bit pcap file field in the file's byte order
+ */
+
+static inline uint32_t load_file32(const pcap_reader_t *reader, const uint8_t *p) {
+    uint32_t value;
+
+    memcpy(&value, p, sizeof(value));
+    if (reader->swapped) {
+        value = (value >> 24) | ((value >> 8) & 0xFF00u) | ((value << 8) & 0xFF0000u) | (value << 24);
+    }
+    return value;
+}
+
+
+/*
+ * set_record() - Fill the record header from its 16 file bytes
+ *
+ * Like libpcap opened at nanosecond precision, tv_usec holds
+ * nanoseconds; microsecond files are scaled up.
+ */
+
+static inline void set_record(pcap_reader_t *reader, const uint8_t *p) {
+    uint32_t fraction = load_file32(reader, p + 4);
+
+    reader->record.ts.tv_sec = (int32_t)load_file32(reader, p);
+    reader->record.ts.tv_usec = reader->nanosecond ? fraction : fraction * 1000;
+    reader->record.caplen = load_file32(reader, p + 8);
+    reader->record.len = load_file32(reader, p + 12);
+}
+
+
+/*
+ * native_copy() - Copy the next bytes of the file, across blocks
+ * @reader: Native reader
+ * @dst: Destination
+ * @length: Bytes wanted
+ *
+ * Return: Bytes copied (fewer than @length only at end of file), or -1
+ *         on a read error
+ */
+
+static long native_copy(pcap_reader_t *reader, uint8_t *dst, size_t length) {
+    size_t copied = 0;
+
+    while (copied < length) {
+        if (reader->block_pos == reader->block_length) {
+            const uint8_t *block;
+            size_t block_length;
+            int result = capture_io_next_block(reader->io, &block, &block_length);
+
+            if (result < 0) {
+                snprintf(reader->error, sizeof(reader->error), "%s",
+                         capture_io_error(reader->io));
+                return -1;
+            }
+            if (result == 0) {
+                break;
+            }
+            reader->block_offset += (int64_t)reader->block_length;
+            reader->block = block;
+            reader->block_length = block_length;
+            reader->block_pos = 0;
+        }
+
+        size_t take = reader->block_length - reader->block_pos;
+        if (take > length - copied) {
+            take = length - copied;
         }
+        memcpy(dst + copied, reader->block + reader->block_pos, take);
+        reader->block_pos += take;
+        copied += take;
+    }
+    return (long)copied;
+}
 
-        modbus_count++;
 
-        // Format IP addresses
-        char src_ip_str[16], dst_ip_str[16];
-        snprintf(src_ip_str, sizeof(src_ip_str), "%u.%u.%u.%u",
-                    (ntohl(ip_hdr->source_ip) >> 24) & 0xFF,
-                    (ntohl(ip_hdr->source_ip) >> 16) & 0xFF,
-                    (ntohl(ip_hdr->source_ip) >> 8) & 0xFF,
-                    ntohl(ip_hdr->source_ip) & 0xFF);
+/*
+ * native_next_slow() - Next record when it is not whole in the block
+ *
+ * The record is assembled in @straddle: its header and data may start
+ * in one block and end in the next (or at a block boundary). libpcap's
+ * messages are used for truncated files and oversized records.
+ *
+ * Return: 1 for a record, -2 at end of file, -1 on error
+ */
 
-        snprintf(dst_ip_str, sizeof(dst_ip_str), "%u.%u.%u.%u",
-                    (ntohl(ip_hdr->dest_ip) >> 24) & 0xFF,
-                    (ntohl(ip_hdr->dest_ip) >> 16) & 0xFF,
-                    (ntohl(ip_hdr->dest_ip) >> 8) & 0xFF,
-                    ntohl(ip_hdr->dest_ip) & 0xFF);
-        
-        // Convert timestamp to double (seconds.milliseconds)
-        double packet_time = (double)header->ts.tv_sec + (double)header->ts.tv_usec / 1000000.0;
+static int native_next_slow(pcap_reader_t *reader, struct pcap_pkthdr **header,
+                            const uint8_t **packet) {
+    long got = native_copy(reader, reader->straddle, PCAP_RECORD_HEADER_SIZE);
 
-        // Call callback with Modbus TCP payload and connection info
-        callback(payload, payload_length, src_ip_str, src_port, dst_ip_str, dst_port, packet_time, user_data);
+    if (got < 0) {
+        return -1;
+    }
+    if (got == 0) {
+        return -2;
+    }
+    if (got < PCAP_RECORD_HEADER_SIZE) {
+        snprintf(reader->error, sizeof(reader->error),
+                 "truncated dump file; tried to read %d header bytes, only got %ld",
+                 PCAP_RECORD_HEADER_SIZE, got);
+        return -1;
     }
 
-    if (result == -1) {
-        printf("Error reading packet: %s\n", pcap_geterr(handle));
-        pcap_close(handle);
-        return false;
+    set_record(reader, reader->straddle);
+    uint32_t caplen = reader->record.caplen;
+    if (caplen > PCAP_MAX_CAPLEN) {
+        snprintf(reader->error, sizeof(reader->error),
+                 "invalid packet capture length %u, bigger than maximum of %u",
+                 caplen, PCAP_MAX_CAPLEN);
+        return -1;
     }
 
-    pcap_close(handle);
-    return true;
+    got = native_copy(reader, reader->straddle + PCAP_RECORD_HEADER_SIZE, caplen);
+    if (got < 0) {
+        return -1;
+    }
+    if ((uint32_t)got < caplen) {
+        snprintf(reader->error, sizeof(reader->error),
+                 "truncated dump file; tried to read %u captured bytes, only got %ld",
+                 caplen, got);
+        return -1;
+    }
+
+    *header = &reader->record;
+    *packet = reader->straddle + PCAP_RECORD_HEADER_SIZE;
+    return 1;
+}
+
+
+/*
+ * native_next() - Next record of a native backend
+ *
+ * A record lying wholly inside the current block is returned in place;
+ * everything else takes the slow path.
+ *
+ * Return: 1 for a record, -2 at end of file, -1 on error (the
+ *         pcap_next_ex() convention)
+ */
+
+READER_INLINE int native_next(pcap_reader_t *reader, struct pcap_pkthdr **header,
+                              const uint8_t **packet) {
+    size_t available = reader->block_length - reader->block_pos;
+
+    if (available >= PCAP_RECORD_HEADER_SIZE) {
+        const uint8_t *record = reader->block + reader->block_pos;
+        uint32_t caplen = load_file32(reader, record + 8);
+
+        if (caplen <= available - PCAP_RECORD_HEADER_SIZE && caplen <= PCAP_MAX_CAPLEN) {
+            set_record(reader, record);
+            reader->block_pos += PCAP_RECORD_HEADER_SIZE + caplen;
+            *header = &reader->record;
+            *packet = record + PCAP_RECORD_HEADER_SIZE;
+            return 1;
+        }
+    }
+    return native_next_slow(reader, header, packet);
+}
+
+
+/*
+ * sample_keep() - Whether the record, flow or second @key is in the sample
+ *
+ * The key is mixed (splitmix64 finaliser) so consecutive keys are kept
+ * independently of each other.
+ */
+
+static inline bool sample_keep(uint32_t rate, uint64_t key) {
+    key ^= key >> 30;
+    key *= 0xbf58476d1ce4e5b9ULL;
+    key ^= key >> 27;
+    key *= 0x94d049bb133111ebULL;
+    key ^= key >> 31;
+    return key % rate == 0;
+}
+
+
+/*
+ * record_sampled_out() - Whether packet or time sampling skips a record
+ *
+ * Needs nothing but the record header.
+ */
+
+static inline bool record_sampled_out(const pcap_reader_t *reader,
+                                      const struct pcap_pkthdr *header) {
+    switch (reader->sample.mode) {
+        case PCAP_SAMPLE_PACKETS: return !sample_keep(reader->sample.rate, reader->packets);
+        case PCAP_SAMPLE_TIME:    return !sample_keep(reader->sample.rate,
+                                                      (uint64_t)header->ts.tv_sec);
+        default:                  return false;
+    }
+}
+
+
+/**
+ * pcap_sample_flow_key() - Key by which flow sampling picks a connection
+ * @src: Source address
+ * @src_port: Source TCP port
+ * @dst: Destination address
+ * @dst_port: Destination TCP port
+ *
+ * The two endpoint hashes are combined with addition, so both
+ * directions of a connection have the same key.
+ *
+ * Return: 64-bit flow key
+ */
+
+uint64_t pcap_sample_flow_key(const endpoint_t *src, uint16_t src_port, const endpoint_t *dst,
+                              uint16_t dst_port) {
+    return (endpoint_hash(src) ^ ((uint64_t)src_port << 48)) +
+           (endpoint_hash(dst) ^ ((uint64_t)dst_port << 48));
+}
+
+
+/*
+ * flow_sampled_out() - Whether flow sampling skips a payload
+ */
+
+static inline bool flow_sampled_out(const pcap_reader_t *reader, const pcap_payload_t *out) {
+    return !sample_keep(reader->sample.rate,
+                        pcap_sample_flow_key(&out->src, out->src_port, &out->dst,
+                                             out->dst_port));
+}
+
+
+/*
+ * reader_loop() - Read packets until a Modbus TCP payload is found
+ * @reader: Open reader (payloads of registered protocols go to their
+ *          handlers on the way)
+ * @out: Output payload descriptor
+ * @link: Framing of the capture
+ * @source: libpcap or a native backend
+ *
+ * Always inlined into one wrapper per link type and record source with
+ * both constant, so each capture runs a loop with its framing and read
+ * path compiled in.
+ *
+ * Return: 1 if @out was filled, 0 at end of file, -1 on read error
+ */
+
+READER_INLINE int reader_loop(pcap_reader_t *reader, pcap_payload_t *out, link_type_t link,
+                              record_source_t source) {
+    struct pcap_pkthdr *header;
+    const uint8_t *packet;
+    int result;
+
+    // Read packets
+    while ((result = source == SOURCE_NATIVE
+                     ? native_next(reader, &header, &packet)
+                     : pcap_next_ex(reader->handle, &header, &packet)) >= 0) {
+        uint32_t l3_offset;
+        uint16_t ethertype;
+
+        if (result == 0) {
+            continue;  // Timeout
+        }
+
+        reader->packets++;
+
+        if (reader->sample.mode != PCAP_SAMPLE_NONE && record_sampled_out(reader, header)) {
+            continue;
+        }
+
+        if (!link_decode(link, packet, header->caplen, &l3_offset, &ethertype)) {
+            continue;
+        }
+
+        uint8_t target = ethertype == ETHERTYPE_IPV4
+                         ? decode_ipv4(reader, header, packet, l3_offset, out)
+                         : ethertype == ETHERTYPE_IPV6
+                         ? decode_ipv6(reader, header, packet, l3_offset, out)
+                         : DISPATCH_NONE;
+        if (target == DISPATCH_NONE) {
+            continue;
+        }
+        if (reader->sample.mode == PCAP_SAMPLE_FLOWS && flow_sampled_out(reader, out)) {
+            continue;
+        }
+        if (target != DISPATCH_MODBUS) {
+            const reader_protocol_t *protocol = &reader->protocols[target - DISPATCH_HANDLER];
+            protocol->handler(out, protocol->transport, protocol->user_data);
+            continue;
+        }
+        reader->payloads++;
+        return 1;
+    }
+
+    if (result == -1) {
+        if (source == SOURCE_LIBPCAP) {
+            snprintf(reader->error, sizeof(reader->error), "%s", pcap_geterr(reader->handle));
+        }
+        return -1;
+    }
+    return 0;
+}
+
+
+/* Specialised decode loops, one per supported datalink and record source */
+
+static int next_ethernet(pcap_reader_t *r, pcap_payload_t *o) { return reader_loop(r, o, LINK_ETHERNET, SOURCE_LIBPCAP); }
+static int next_sll(pcap_reader_t *r, pcap_payload_t *o) { return reader_loop(r, o, LINK_SLL, SOURCE_LIBPCAP); }
+static int next_sll2(pcap_reader_t *r, pcap_payload_t *o) { return reader_loop(r, o, LINK_SLL2, SOURCE_LIBPCAP); }
+static int next_raw(pcap_reader_t *r, pcap_payload_t *o) { return reader_loop(r, o, LINK_RAW, SOURCE_LIBPCAP); }
+static int next_null(pcap_reader_t *r, pcap_payload_t *o) { return reader_loop(r, o, LINK_NULL, SOURCE_LIBPCAP); }
+static int next_loop(pcap_reader_t *r, pcap_payload_t *o) { return reader_loop(r, o, LINK_LOOP, SOURCE_LIBPCAP); }
+
+static int native_ethernet(pcap_reader_t *r, pcap_payload_t *o) { return reader_loop(r, o, LINK_ETHERNET, SOURCE_NATIVE); }
+static int native_sll(pcap_reader_t *r, pcap_payload_t *o) { return reader_loop(r, o, LINK_SLL, SOURCE_NATIVE); }
+static int native_sll2(pcap_reader_t *r, pcap_payload_t *o) { return reader_loop(r, o, LINK_SLL2, SOURCE_NATIVE); }
+static int native_raw(pcap_reader_t *r, pcap_payload_t *o) { return reader_loop(r, o, LINK_RAW, SOURCE_NATIVE); }
+static int native_null(pcap_reader_t *r, pcap_payload_t *o) { return reader_loop(r, o, LINK_NULL, SOURCE_NATIVE); }
+static int native_loop(pcap_reader_t *r, pcap_payload_t *o) { return reader_loop(r, o, LINK_LOOP, SOURCE_NATIVE); }
+
+
+/*
+ * select_decoder() - Decode loop for a libpcap datalink type
+ * @datalink: DLT_* value
+ * @source: Where records come from
+ *
+ * Return: Loop function, or NULL if the link type is not supported
+ */
+
+static int (*select_decoder(int datalink, record_source_t source))(pcap_reader_t *, pcap_payload_t *) {
+    bool native = source == SOURCE_NATIVE;
+
+    switch (datalink) {
+        case DLT_EN10MB:     return native ? native_ethernet : next_ethernet;
+        case DLT_LINUX_SLL:  return native ? native_sll : next_sll;
+        case DLT_LINUX_SLL2: return native ? native_sll2 : next_sll2;
+        case DLT_RAW:
+        case DLT_IPV4:
+        case DLT_IPV6:       return native ? native_raw : next_raw;
+        case DLT_NULL:       return native ? native_null : next_null;
+        case DLT_LOOP:       return native ? native_loop : next_loop;
+        default:             return NULL;
+    }
+}
+
+
+/**
+ * pcap_io_backend_parse() - Backend from its name
+ * @name: "libpcap", "mmap" or "uring"
+ * @backend: Output backend
+ *
+ * Return: false if @name is unknown
+ */
+
+bool pcap_io_backend_parse(const char *name, pcap_io_backend_t *backend) {
+    if (strcmp(name, "libpcap") == 0) {
+        *backend = PCAP_IO_LIBPCAP;
+    } else if (strcmp(name, "mmap") == 0) {
+        *backend = PCAP_IO_MMAP;
+    } else if (strcmp(name, "uring") == 0) {
+        *backend = PCAP_IO_URING;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+
+/**
+ * pcap_io_backend_name() - Name of a backend
+ * @backend: Backend
+ *
+ * Return: "libpcap", "mmap" or "uring"
+ */
+
+const char *pcap_io_backend_name(pcap_io_backend_t backend) {
+    switch (backend) {
+        case PCAP_IO_MMAP:  return "mmap";
+        case PCAP_IO_URING: return "uring";
+        default:            return "libpcap";
+    }
+}
+
+
+/**
+ * pcap_sample_parse() - Sampling from "packets:N", "flows:N" or "time:N"
+ * @spec: Mode and rate
+ * @sample: Output sampling
+ *
+ * Return: false if the mode is unknown or N is not 2-PCAP_SAMPLE_MAX_RATE
+ */
+
+bool pcap_sample_parse(const char *spec, pcap_sample_t *sample) {
+    const char *colon = strchr(spec, ':');
+    size_t name_length = colon ? (size_t)(colon - spec) : 0;
+
+    if (!colon) {
+        return false;
+    }
+    if (name_length == 7 && strncmp(spec, "packets", 7) == 0) {
+        sample->mode = PCAP_SAMPLE_PACKETS;
+    } else if (name_length == 5 && strncmp(spec, "flows", 5) == 0) {
+        sample->mode = PCAP_SAMPLE_FLOWS;
+    } else if (name_length == 4 && strncmp(spec, "time", 4) == 0) {
+        sample->mode = PCAP_SAMPLE_TIME;
+    } else {
+        return false;
+    }
+
+    char *end;
+    unsigned long rate = strtoul(colon + 1, &end, 10);
+    if (end == colon + 1 || *end != '\0' || rate < 2 || rate > PCAP_SAMPLE_MAX_RATE) {
+        return false;
+    }
+    sample->rate = (uint32_t)rate;
+    return true;
+}
+
+
+/**
+ * pcap_sample_name() - Unit a sampling mode keeps 1 in N of
+ * @mode: Mode
+ *
+ * Return: "packets", "flows", "seconds" or "records" (NONE)
+ */
+
+const char *pcap_sample_name(pcap_sample_mode_t mode) {
+    switch (mode) {
+        case PCAP_SAMPLE_PACKETS: return "packets";
+        case PCAP_SAMPLE_FLOWS:   return "flows";
+        case PCAP_SAMPLE_TIME:    return "seconds";
+        default:                  return "records";
+    }
+}
+
+
+/*
+ * open_native() - Open a classic pcap file through capture_io
+ *
+ * Reads and checks the file header; the first record follows it.
+ *
+ * Return: false on failure (message in @errbuf)
+ */
+
+static bool open_native(pcap_reader_t *reader, const char *filename,
+                        const pcap_reader_options_t *options, char *errbuf, size_t errlen) {
+    uint8_t header[PCAP_FILE_HEADER_SIZE];
+    uint32_t magic;
+
+    if (capture_detect(filename) != CAPTURE_PLAIN) {
+        if (errbuf) snprintf(errbuf, errlen, "%s: compressed captures need --io-backend libpcap",
+                             filename);
+        return false;
+    }
+
+    reader->io = capture_io_open(filename, options, errbuf, errlen);
+    reader->straddle = malloc(PCAP_RECORD_HEADER_SIZE + PCAP_MAX_CAPLEN);
+    if (!reader->io || !reader->straddle) {
+        if (reader->io && errbuf) snprintf(errbuf, errlen, "out of memory");
+        return false;
+    }
+
+    long got = native_copy(reader, header, sizeof(header));
+    if (got < 0) {
+        if (errbuf) snprintf(errbuf, errlen, "%s: %s", filename, reader->error);
+        return false;
+    }
+    if (got < PCAP_FILE_HEADER_SIZE) {
+        if (errbuf) snprintf(errbuf, errlen,
+                             "truncated dump file; tried to read %d file header bytes, only got %ld",
+                             PCAP_FILE_HEADER_SIZE, got);
+        return false;
+    }
+
+    memcpy(&magic, header, sizeof(magic));
+    switch (magic) {
+        case PCAP_MAGIC_USEC:         break;
+        case PCAP_MAGIC_NSEC:         reader->nanosecond = true; break;
+        case PCAP_MAGIC_USEC_SWAPPED: reader->swapped = true; break;
+        case PCAP_MAGIC_NSEC_SWAPPED: reader->swapped = reader->nanosecond = true; break;
+        case PCAPNG_MAGIC:
+            if (errbuf) snprintf(errbuf, errlen, "%s: pcapng captures need --io-backend libpcap",
+                                 filename);
+            return false;
+        default:
+            if (errbuf) snprintf(errbuf, errlen, "%s: unknown file format", filename);
+            return false;
+    }
+
+    // Link type in the low 26 bits (the rest is FCS information)
+    uint32_t linktype = load_file32(reader, header + 20) & 0x03FFFFFF;
+    if (linktype == LINKTYPE_RAW) {
+        reader->datalink = DLT_RAW;
+    } else if (linktype == LINKTYPE_LOOP) {
+        reader->datalink = DLT_LOOP;
+    } else {
+        reader->datalink = (int)linktype;
+    }
+    return true;
+}
+
+
+/**
+ * pcap_reader_open() - Open a capture file for iteration
+ * @filename: Path to PCAP file (relative or absolute)
+ * @errbuf: Output error message on failure (may be NULL)
+ * @errlen: Size of @errbuf
+ *
+ * The decode loop is chosen here from pcap_datalink(), so packets are
+ * not re-dispatched on link type one by one. Compressed captures are
+ * detected by magic and read through a capture_input pipeline.
+ *
+ * Return: Reader handle, or NULL on failure (including unsupported
+ *         link-layer types)
+ */
+
+pcap_reader_t *pcap_reader_open(const char *filename, char *errbuf, size_t errlen) {
+    return pcap_reader_open_with(filename, NULL, errbuf, errlen);
+}
+
+
+/**
+ * pcap_reader_open_with() - Open a capture file with explicit I/O settings
+ * @filename: Path to PCAP file (relative or absolute)
+ * @options: I/O settings (NULL = libpcap backend)
+ * @errbuf: Output error message on failure (may be NULL)
+ * @errlen: Size of @errbuf
+ *
+ * With a native backend the decode loops read records from capture_io
+ * blocks instead of pcap_next_ex(); link-layer decoding is shared.
+ * libpcap is opened at nanosecond precision, so both paths put
+ * nanoseconds in tv_usec.
+ *
+ * Return: Reader handle, or NULL on failure
+ */
+
+pcap_reader_t *pcap_reader_open_with(const char *filename, const pcap_reader_options_t *options,
+                                     char *errbuf, size_t errlen) {
+    char pcap_errbuf[PCAP_ERRBUF_SIZE];
+
+    pcap_reader_t *reader = calloc(1, sizeof(pcap_reader_t));
+    if (!reader) {
+        if (errbuf) snprintf(errbuf, errlen, "out of memory");
+        return NULL;
+    }
+    if (options && options->sample.mode != PCAP_SAMPLE_NONE) {
+        reader->sample = options->sample;
+    }
+
+    if (options && options->backend != PCAP_IO_LIBPCAP) {
+        if (!open_native(reader, filename, options, errbuf, errlen)) {
+            pcap_reader_close(reader);
+            return NULL;
+        }
+        reader->next = select_decoder(reader->datalink, SOURCE_NATIVE);
+        if (!reader->next) {
+            if (errbuf) snprintf(errbuf, errlen, "%s: unsupported link-layer type %d",
+                                 filename, reader->datalink);
+            pcap_reader_close(reader);
+            return NULL;
+        }
+        return reader;
+    }
+
+    capture_compression_t compression = capture_detect(filename);
+    if (compression == CAPTURE_PLAIN) {
+        reader->handle = pcap_open_offline_with_tstamp_precision(
+            filename, PCAP_TSTAMP_PRECISION_NANO, pcap_errbuf);
+    } else {
+        reader->input = capture_input_open(filename, compression, errbuf, errlen);
+        if (!reader->input) {
+            free(reader);
+            return NULL;
+        }
+        // On failure the stream stays ours and capture_input_close() closes it
+        reader->handle = pcap_fopen_offline_with_tstamp_precision(
+            capture_input_stream(reader->input), PCAP_TSTAMP_PRECISION_NANO, pcap_errbuf);
+    }
+    if (reader->handle == NULL) {
+        if (errbuf) snprintf(errbuf, errlen, "%s", pcap_errbuf);
+        capture_input_close(reader->input);
+        free(reader);
+        return NULL;
+    }
+
+    reader->datalink = pcap_datalink(reader->handle);
+    reader->next = select_decoder(reader->datalink, SOURCE_LIBPCAP);
+    if (!reader->next) {
+        if (errbuf) snprintf(errbuf, errlen, "%s: unsupported link-layer type %d",
+                             filename, reader->datalink);
+        pcap_close(reader->handle);
+        capture_input_close(reader->input);
+        free(reader);
+        return NULL;
+    }
+    return reader;
+}
+
+
+/*
+ * merged_next() - Next payload of a merged reader
+ *
+ * The captures did flow and time sampling themselves; packet sampling
+ * counts the payloads left after the copies were dropped.
+ */
+
+static int merged_next(pcap_reader_t *reader, pcap_payload_t *out) {
+    int result;
+
+    while ((result = pcap_merge_next(reader->merge, out)) > 0) {
+        if (reader->sample.mode == PCAP_SAMPLE_PACKETS &&
+            !sample_keep(reader->sample.rate, reader->merged++)) {
+            continue;
+        }
+        reader->payloads++;
+        return 1;
+    }
+    if (result < 0) {
+        snprintf(reader->error, sizeof(reader->error), "%s", pcap_merge_error(reader->merge));
+    }
+    return result;
+}
+
+
+/**
+ * pcap_reader_open_merged() - Read several captures as one stream
+ * @filenames: Paths of the captures (2 to PCAP_MERGE_MAX_CAPTURES)
+ * @count: Entries in @filenames
+ * @options: I/O settings and sampling applied to every capture (NULL =
+ *           libpcap backend)
+ * @window_ms: Duplicate window in milliseconds (0 = keep every copy, at
+ *             most PCAP_MERGE_MAX_WINDOW_MS)
+ * @errbuf: Output error message on failure (may be NULL)
+ * @errlen: Size of @errbuf
+ *
+ * Return: Reader handle, or NULL on failure
+ */
+
+pcap_reader_t *pcap_reader_open_merged(const char *const *filenames, uint32_t count,
+                                       const pcap_reader_options_t *options, uint32_t window_ms,
+                                       char *errbuf, size_t errlen) {
+    pcap_reader_options_t capture_options = {0};
+
+    if (count < 2 || count > PCAP_MERGE_MAX_CAPTURES) {
+        if (errbuf) snprintf(errbuf, errlen, "can merge 2 to %d captures, not %u",
+                             PCAP_MERGE_MAX_CAPTURES, count);
+        return NULL;
+    }
+    if (window_ms > PCAP_MERGE_MAX_WINDOW_MS) {
+        if (errbuf) snprintf(errbuf, errlen, "duplicate window above %d ms",
+                             PCAP_MERGE_MAX_WINDOW_MS);
+        return NULL;
+    }
+
+    pcap_reader_t *reader = calloc(1, sizeof(pcap_reader_t));
+    if (!reader) {
+        if (errbuf) snprintf(errbuf, errlen, "out of memory");
+        return NULL;
+    }
+
+    // Packet indexes differ between taps, so packet sampling waits for the merge
+    if (options) {
+        capture_options = *options;
+        if (options->sample.mode == PCAP_SAMPLE_PACKETS) {
+            reader->sample = options->sample;
+            capture_options.sample.mode = PCAP_SAMPLE_NONE;
+        }
+    }
+
+    reader->merge = pcap_merge_open(filenames, count, &capture_options, window_ms,
+                                    errbuf, errlen);
+    if (!reader->merge) {
+        free(reader);
+        return NULL;
+    }
+    reader->datalink = pcap_merge_datalink(reader->merge);
+    reader->next = merged_next;
+    return reader;
+}
+
+
+/**
+ * pcap_reader_add_protocol() - Decode another protocol in the same pass
+ * @reader: Reader opened with pcap_reader_open() or pcap_reader_open_with()
+ * @transport: TCP or UDP
+ * @port: Port of the protocol (source or destination)
+ * @handler: Called with every non-empty payload on @port
+ * @user_data: Passed to @handler
+ *
+ * The table of a transport is 64 KiB of one-byte handler slots,
+ * allocated on its first registration; a reader without handlers does
+ * not look ports up at all.
+ *
+ * Return: false if the port is taken, the table is full, the reader is
+ *         merged or allocation failed (see pcap_reader_error())
+ */
+
+bool pcap_reader_add_protocol(pcap_reader_t *reader, pcap_transport_t transport, uint16_t port,
+                              pcap_protocol_handler_t handler, void *user_data) {
+    if (reader->merge) {
+        snprintf(reader->error, sizeof(reader->error),
+                 "protocol handlers are not supported on merged captures");
+        return false;
+    }
+    if ((unsigned)transport >= PCAP_TRANSPORT_COUNT || !handler) {
+        snprintf(reader->error, sizeof(reader->error), "invalid protocol registration");
+        return false;
+    }
+    if (reader->protocol_count == PCAP_MAX_PROTOCOLS) {
+        snprintf(reader->error, sizeof(reader->error), "more than %d protocol handlers",
+                 PCAP_MAX_PROTOCOLS);
+        return false;
+    }
+    if ((transport == PCAP_TRANSPORT_TCP && port == MODBUS_TCP_PORT) ||
+        (reader->ports[transport] && reader->ports[transport][port] != DISPATCH_NONE)) {
+        snprintf(reader->error, sizeof(reader->error), "%s port %u already has a handler",
+                 transport == PCAP_TRANSPORT_TCP ? "TCP" : "UDP", port);
+        return false;
+    }
+
+    if (!reader->ports[transport]) {
+        reader->ports[transport] = calloc(DISPATCH_PORTS, sizeof(uint8_t));
+        if (!reader->ports[transport]) {
+            snprintf(reader->error, sizeof(reader->error), "out of memory");
+            return false;
+        }
+    }
+
+    reader_protocol_t *protocol = &reader->protocols[reader->protocol_count];
+    protocol->handler = handler;
+    protocol->user_data = user_data;
+    protocol->transport = transport;
+    reader->ports[transport][port] = (uint8_t)(DISPATCH_HANDLER + reader->protocol_count);
+    reader->protocol_count++;
+    return true;
+}
+
+
+/**
+ * pcap_reader_next() - Advance to the next Modbus TCP payload
+ * @reader: Open reader
+ * @out: Output payload descriptor
+ *
+ * Processing flow per packet (in the loop selected at open):
+ * 1. Strip the link layer: Ethernet with up to four 802.1Q/802.1ad
+ *    tags, Linux SLL/SLL2, raw IP or BSD loopback
+ * 2. Parse the IPv4 header (IHL checked against caplen) or the IPv6
+ *    header and its extension header chain
+ * 3. Check protocol == 6 (TCP) and skip non-first fragments
+ * 4. Parse TCP header, extract data offset for variable length
+ * 5. Check port == 502 (source or destination); a payload on a port
+ *    registered with pcap_reader_add_protocol() goes to its handler
+ *    and the loop goes on
+ * 6. Calculate payload offset and length; the wire length comes from
+ *    the IP total length
+ * 7. Copy the binary addresses and the timestamp in nanoseconds
+ *
+ * Non-TCP packets and non-port-502 traffic are silently skipped, as are
+ * records left out by sampling (see pcap_sample_t).
+ * Empty payloads (e.g., TCP ACK without data) are skipped.
+ * Malformed packets are skipped with no error.
+ *
+ * A decompression error ends a compressed capture with -1 even when it
+ * falls on a record boundary, where libpcap would only see end of file.
+ *
+ * Return: 1 if @out was filled, 0 at end of file, -1 on read error
+ */
+
+int pcap_reader_next(pcap_reader_t *reader, pcap_payload_t *out) {
+    int result = reader->next(reader, out);
+
+    if (result <= 0 && reader->input) {
+        const char *error = capture_input_error(reader->input);
+        if (error[0] != '\0') {
+            snprintf(reader->error, sizeof(reader->error), "%s", error);
+            return -1;
+        }
+    }
+    return result;
+}
+
+
+/**
+ * pcap_batch_init() - Allocate an empty batch
+ * @batch: Batch
+ * @capacity: Payloads per batch (0 = PCAP_BATCH_DEFAULT, at most PCAP_BATCH_MAX)
+ *
+ * Return: false on allocation failure
+ */
+
+bool pcap_batch_init(pcap_batch_t *batch, uint32_t capacity) {
+    if (capacity == 0) {
+        capacity = PCAP_BATCH_DEFAULT;
+    } else if (capacity > PCAP_BATCH_MAX) {
+        capacity = PCAP_BATCH_MAX;
+    }
+
+    memset(batch, 0, sizeof(*batch));
+    batch->items = malloc(capacity * sizeof(pcap_payload_t));
+    batch->bytes_capacity = (size_t)capacity * PCAP_BATCH_BYTES_PER_ITEM;
+    batch->bytes = malloc(batch->bytes_capacity);
+    if (!batch->items || !batch->bytes) {
+        pcap_batch_free(batch);
+        return false;
+    }
+    batch->capacity = capacity;
+    return true;
+}
+
+
+/**
+ * pcap_batch_free() - Release a batch
+ * @batch: Batch from pcap_batch_init()
+ */
+
+void pcap_batch_free(pcap_batch_t *batch) {
+    free(batch->items);
+    free(batch->bytes);
+    memset(batch, 0, sizeof(*batch));
+}
+
+
+/*
+ * batch_reserve() - Make room for @length more payload bytes
+ *
+ * Payload pointers are set once the batch is complete, so @bytes may
+ * move here.
+ */
+
+static bool batch_reserve(pcap_batch_t *batch, size_t used, uint32_t length) {
+    if (used + length <= batch->bytes_capacity) {
+        return true;
+    }
+
+    size_t capacity = batch->bytes_capacity * 2;
+    while (capacity < used + length) {
+        capacity *= 2;
+    }
+    uint8_t *bytes = realloc(batch->bytes, capacity);
+    if (!bytes) {
+        return false;
+    }
+    batch->bytes = bytes;
+    batch->bytes_capacity = capacity;
+    return true;
+}
+
+
+/**
+ * pcap_reader_next_batch() - Read up to a batch of Modbus TCP payloads
+ * @reader: Open reader
+ * @batch: Batch from pcap_batch_init(); its previous payloads are released
+ *
+ * Same filtering as pcap_reader_next(). Payloads are copied into the
+ * batch because every backend reuses its packet buffer: libpcap on the
+ * next packet, the native backends on the next block. A read error that
+ * ends a partly filled batch is returned by the following call, so no
+ * payload is lost.
+ *
+ * Return: Payloads in @batch (1 to capacity), 0 at end of file, -1 on
+ *         read error or allocation failure
+ */
+
+int pcap_reader_next_batch(pcap_reader_t *reader, pcap_batch_t *batch) {
+    size_t used = 0;
+    uint32_t count = 0;
+    int result = 1;
+
+    batch->count = 0;
+    if (reader->batch_failed) {
+        reader->batch_failed = false;
+        return -1;
+    }
+
+    while (count < batch->capacity) {
+        pcap_payload_t *item = &batch->items[count];
+        result = pcap_reader_next(reader, item);
+        if (result <= 0) {
+            break;
+        }
+        if (!batch_reserve(batch, used, item->length)) {
+            snprintf(reader->error, sizeof(reader->error), "out of memory");
+            result = -1;
+            break;
+        }
+        memcpy(batch->bytes + used, item->payload, item->length);
+        used += item->length;
+        count++;
+    }
+
+    // Point the descriptors at the copies now that @bytes no longer moves
+    used = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        batch->items[i].payload = batch->bytes + used;
+        used += batch->items[i].length;
+    }
+    batch->count = count;
+
+    if (result < 0) {
+        if (count == 0) {
+            return -1;
+        }
+        reader->batch_failed = true;
+    }
+    return (int)count;
+}
+
+
+/**
+ * pcap_reader_datalink() - Link-layer type of the capture
+ * @reader: Reader
+ *
+ * Return: libpcap DLT_* value
+ */
+
+int pcap_reader_datalink(const pcap_reader_t *reader) {
+    return reader->datalink;
+}
+
+
+/**
+ * pcap_reader_error() - Last read error message
+ * @reader: Reader
+ *
+ * Return: Error string ("" if none)
+ */
+
+const char *pcap_reader_error(const pcap_reader_t *reader) {
+    return reader->error;
+}
+
+
+/**
+ * pcap_reader_packet_count() - Packets read so far (all protocols)
+ * @reader: Reader
+ *
+ * Return: Packet count
+ */
+
+uint64_t pcap_reader_packet_count(const pcap_reader_t *reader) {
+    if (reader->merge) {
+        return pcap_merge_packet_count(reader->merge);
+    }
+    return reader->packets;
+}
+
+
+/**
+ * pcap_reader_input_stats() - Pipeline timing of a compressed capture
+ * @reader: Reader
+ * @stats: Output statistics
+ *
+ * Return: false for an uncompressed capture (@stats untouched)
+ */
+
+bool pcap_reader_input_stats(const pcap_reader_t *reader, capture_input_stats_t *stats) {
+    if (!reader->input) {
+        return false;
+    }
+    capture_input_stats(reader->input, stats);
+    return true;
+}
+
+
+/**
+ * pcap_reader_merge_stats() - Counters of a merged reader
+ * @reader: Reader
+ * @stats: Output statistics
+ *
+ * Return: false unless @reader came from pcap_reader_open_merged()
+ *         (@stats untouched)
+ */
+
+bool pcap_reader_merge_stats(const pcap_reader_t *reader, pcap_merge_stats_t *stats) {
+    if (!reader->merge) {
+        return false;
+    }
+    pcap_merge_stats(reader->merge, stats);
+    return true;
+}
+
+
+/*
+ * file_tell() / file_seek() - 64-bit offsets on the capture FILE
+ */
+
+static int64_t file_tell(FILE *fp) {
+#ifdef _WIN32
+    return _ftelli64(fp);
+#else
+    return (int64_t)ftello(fp);
+#endif
+}
+
+static bool file_seek(FILE *fp, int64_t offset) {
+#ifdef _WIN32
+    return _fseeki64(fp, offset, SEEK_SET) == 0;
+#else
+    return fseeko(fp, (off_t)offset, SEEK_SET) == 0;
+#endif
+}
+
+
+/**
+ * pcap_reader_tell() - Current position, for a later pcap_reader_seek()
+ * @reader: Reader
+ * @pos: Output position
+ *
+ * libpcap reads offline captures through a stdio FILE, so between two
+ * pcap_next_ex() calls the FILE offset is the start of the next record.
+ * Native backends track the same offset themselves, so positions are
+ * interchangeable between backends.
+ *
+ * Return: false if the capture is not a seekable file (e.g. stdin) or the
+ *         reader is merged
+ */
+
+bool pcap_reader_tell(const pcap_reader_t *reader, pcap_reader_position_t *pos) {
+    if (reader->merge) {
+        return false;
+    }
+    if (reader->io) {
+        pos->offset = reader->block_offset + (int64_t)reader->block_pos;
+        pos->packets = reader->packets;
+        pos->payloads = reader->payloads;
+        return true;
+    }
+
+    FILE *fp = pcap_file(reader->handle);
+    if (!fp) {
+        return false;
+    }
+
+    pos->offset = file_tell(fp);
+    pos->packets = reader->packets;
+    pos->payloads = reader->payloads;
+    return pos->offset >= 0;
+}
+
+
+/**
+ * pcap_reader_seek() - Continue reading from a saved position
+ * @reader: Reader opened on the same capture
+ * @pos: Position from pcap_reader_tell()
+ *
+ * Return: false if the capture cannot seek to @pos
+ */
+
+bool pcap_reader_seek(pcap_reader_t *reader, const pcap_reader_position_t *pos) {
+    if (reader->merge) {
+        snprintf(reader->error, sizeof(reader->error), "a merged capture cannot seek");
+        return false;
+    }
+    if (reader->io) {
+        if (!capture_io_seek(reader->io, pos->offset)) {
+            snprintf(reader->error, sizeof(reader->error), "%s", capture_io_error(reader->io));
+            return false;
+        }
+        reader->block = NULL;
+        reader->block_length = 0;
+        reader->block_pos = 0;
+        reader->block_offset = pos->offset;
+        reader->packets = pos->packets;
+        reader->payloads = pos->payloads;
+        return true;
+    }
+
+    FILE *fp = pcap_file(reader->handle);
+    if (!fp || pos->offset < 0 || !file_seek(fp, pos->offset)) {
+        snprintf(reader->error, sizeof(reader->error), "cannot seek to offset %lld",
+                 (long long)pos->offset);
+        return false;
+    }
+
+    reader->packets = pos->packets;
+    reader->payloads = pos->payloads;
+    return true;
+}
+
+
+/**
+ * pcap_reader_close() - Close the capture and free the reader
+ * @reader: Reader (NULL is ignored)
+ */
+
+void pcap_reader_close(pcap_reader_t *reader) {
+    if (!reader) return;
+    if (reader->handle) {
+        pcap_close(reader->handle);
+    }
+    capture_input_close(reader->input);
+    capture_io_close(reader->io);
+    pcap_merge_close(reader->merge);
+    for (int t = 0; t < PCAP_TRANSPORT_COUNT; t++) {
+        free(reader->ports[t]);
+    }
+    free(reader->straddle);
+    free(reader);
+}
+
+
+/**
+ * struct payload_adapter_t - Per-payload callback behind pcap_process_file()
+ * @callback: Caller's callback
+ * @user_data: Caller's opaque pointer
+ */
+
+typedef struct {
+    modbus_payload_callback_t callback;
+    void *user_data;
+} payload_adapter_t;
+
+
+/*
+ * deliver_payloads() - Batch callback that calls the per-payload callback
+ *
+ * Formats the addresses the per-payload signature expects.
+ */
+
+static void deliver_payloads(const pcap_payload_t *items, uint32_t count, void *user_data) {
+    const payload_adapter_t *adapter = user_data;
+
+    for (uint32_t i = 0; i < count; i++) {
+        const pcap_payload_t *pkt = &items[i];
+        char src_ip[ENDPOINT_STR_LEN], dst_ip[ENDPOINT_STR_LEN];
+
+        endpoint_format(&pkt->src, src_ip, sizeof(src_ip));
+        endpoint_format(&pkt->dst, dst_ip, sizeof(dst_ip));
+        adapter->callback(pkt->payload, pkt->length, pkt->wire_length, src_ip, pkt->src_port,
+                          dst_ip, pkt->dst_port, pkt->timestamp_ns, adapter->user_data);
+    }
+}
+
+
+/**
+ * pcap_process_file() - Process PCAP file and extract Modbus TCP payloads
+ * @filename: Path to PCAP file (relative or absolute)
+ * @callback: Function to invoke for each Modbus TCP frame
+ * @user_data: Opaque pointer passed to callback
+ *
+ * Adapter over pcap_process_file_batch() that formats the addresses and
+ * calls @callback once per payload. Prints nothing; use the reader API
+ * directly to get error messages.
+ *
+ * Return: true if file processed successfully (even if 0 Modbus frames)
+ *         false if file open failed or read error occurred
+ */
+
+bool pcap_process_file(const char *filename, modbus_payload_callback_t callback, void *user_data) {
+    payload_adapter_t adapter = { callback, user_data };
+
+    return pcap_process_file_batch(filename, PCAP_BATCH_DEFAULT, deliver_payloads, &adapter);
+}
+
+
+/**
+ * pcap_process_file_batch() - Process PCAP file in batches of payloads
+ * @filename: Path to PCAP file (relative or absolute)
+ * @batch_size: Payloads per batch (0 = PCAP_BATCH_DEFAULT, at most PCAP_BATCH_MAX)
+ * @callback: Function to invoke for each batch
+ * @user_data: Opaque pointer passed to callback
+ *
+ * Convenience loop over pcap_reader_open()/pcap_reader_next_batch().
+ * Prints nothing; use the reader API directly to get error messages.
+ *
+ * Return: true if file processed successfully (even if 0 Modbus frames)
+ *         false if file open failed or read error occurred
+ */
+
+bool pcap_process_file_batch(const char *filename, uint32_t batch_size,
+                             modbus_batch_callback_t callback, void *user_data) {
+    pcap_batch_t batch;
+    int result;
+
+    if (!pcap_batch_init(&batch, batch_size)) {
+        return false;
+    }
+    pcap_reader_t *reader = pcap_reader_open(filename, NULL, 0);
+    if (!reader) {
+        pcap_batch_free(&batch);
+        return false;
+    }
+
+    while ((result = pcap_reader_next_batch(reader, &batch)) > 0) {
+        callback(batch.items, batch.count, user_data);
+    }
+
+    pcap_reader_close(reader);
+    pcap_batch_free(&batch);
+    return result == 0;
 }
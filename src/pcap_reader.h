@@ -4,8 +4,14 @@
  * This module provides functionality to read PCAP files, filter for Modbus TCP 
  * traffic (port 502), and invoke callbacks with extracted payload data.
  * 
- * Uses libpcap for robust PCAP parsing and handles Ethernet/IP/TCP layer
- * extraction automatically
+ * Uses libpcap for robust PCAP parsing and handles link/IP/TCP layer
+ * extraction automatically (Ethernet with VLAN tags, Linux SLL/SLL2, raw
+ * IP and loopback captures). Classic pcap files can instead be read
+ * through mmap or io_uring and parsed in place (see capture_io.h).
+ * Captures of the same traffic from several taps can be read as one
+ * time-ordered stream without duplicates (see pcap_merge.h). Other
+ * protocols can be decoded in the same pass by registering a handler
+ * for their TCP or UDP port (pcap_reader_add_protocol()).
  *
  * Copyright (C) 2025 Marty
  * SPDX-License-Identifier: GPL-3.0-or-later
@@ -17,20 +23,30 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include "endpoint.h"
+#include "capture_input.h"
 
 
 /**
  * modbus_payload_callback_t() - Callback function type for processing Modbus TCP payloads
  * 
  * @payload: Pointer to Modbus TCP frame data (MBAP + PDU)
- * @length: Length of payload in bytes (minimum 8 for valid frame)
- * @src_ip: Source IP address as null-terminated string (e.g., "192.168.1.1")
+ * @length: Captured payload bytes (link-layer padding removed)
+ * @wire_length: Payload bytes on the wire per the IP header; larger than
+ *               @length when the capture snaplen clipped the packet
+ * @src_ip: Source IP address as null-terminated string (e.g., "192.168.1.1"
+ *          or "fd00::10")
  * @src_port: Source TCP port number
  * @dst_ip: Destination IP address as null-terminated string
  * @dst_port: Destination TCP port (typically 502 for Modbus)
- * @timestamp: Packet timestamp in seconds since epoch (microsecond precision)
+ * @timestamp_ns: Packet timestamp in nanoseconds since epoch (microsecond
+ *                captures are scaled; nanosecond captures keep every digit)
  * @user_data: Opaque pointer passed from pcap_process_file() call
  *
+ * Called once per payload; pcap_process_file_batch() delivers the same
+ * payloads in batches without formatting the addresses.
+ *
  * @note All pointer parameters (payload, IP strings) are only valid during the
  *       callback invocation. Copy data if needed beyond callback scope.
  * @note Callback should not free the payload or IP strings - managed by caller.
@@ -38,15 +54,529 @@
  * Return: void
  */
 
-typedef void (*modbus_payload_callback_t)(const uint8_t *payload, uint32_t length, 
+typedef void (*modbus_payload_callback_t)(const uint8_t *payload, uint32_t length,
+                                            uint32_t wire_length,
                                             const char *src_ip, uint16_t src_port,
                                             const char *dst_ip, uint16_t dst_port,
-                                            double timestamp,
+                                            int64_t timestamp_ns,
                                             void *user_data);
 
 
 
-// Process PCAP file and extract Modbus TCP payloads
+/**
+ * struct pcap_payload_t - One Modbus TCP payload returned by the iterator
+ * @payload: TCP payload (MBAP + PDU), valid until the next call
+ * @length: Captured payload bytes (link-layer padding removed)
+ * @wire_length: Payload bytes on the wire per the IP header
+ * @src: Source address (IPv4 or IPv6)
+ * @src_port: Source TCP port
+ * @dst: Destination address
+ * @dst_port: Destination TCP port
+ * @tcp_seq: TCP sequence number of the segment (0 for UDP)
+ * @timestamp_ns: Packet timestamp in nanoseconds since epoch
+ *
+ * Addresses are binary; format them with endpoint_format() when needed.
+ * The timestamp keeps the full precision of the capture: captures are
+ * read at nanosecond precision, and microsecond ones are scaled.
+ */
+
+typedef struct {
+    const uint8_t *payload;
+    uint32_t length;
+    uint32_t wire_length;
+    endpoint_t src;
+    uint16_t src_port;
+    endpoint_t dst;
+    uint16_t dst_port;
+    uint32_t tcp_seq;
+    int64_t timestamp_ns;
+} pcap_payload_t;
+
+
+/**
+ * enum pcap_transport_t - Transport a protocol handler is registered on
+ * @PCAP_TRANSPORT_TCP: TCP segments (first fragment only, like Modbus)
+ * @PCAP_TRANSPORT_UDP: UDP datagrams
+ */
+
+typedef enum {
+    PCAP_TRANSPORT_TCP = 0,
+    PCAP_TRANSPORT_UDP,
+    PCAP_TRANSPORT_COUNT
+} pcap_transport_t;
+
+
+/* Handlers one reader dispatches to besides Modbus (one per transport and port) */
+#define PCAP_MAX_PROTOCOLS 16
+
+
+/**
+ * pcap_protocol_handler_t() - Consumer of another protocol's payloads
+ * @payload: Payload on the registered port (bytes valid during the call)
+ * @transport: Transport the handler was registered for
+ * @user_data: Opaque pointer given to pcap_reader_add_protocol()
+ *
+ * Called from inside pcap_reader_next() while it looks for the next
+ * Modbus payload, so every protocol is decoded from one read of the
+ * capture. Payloads are delivered in capture order.
+ */
+
+typedef void (*pcap_protocol_handler_t)(const pcap_payload_t *payload,
+                                        pcap_transport_t transport, void *user_data);
+
+
+/**
+ * struct pcap_reader_position_t - Resumable point in a capture
+ * @offset: Byte offset of the next packet record in the file
+ * @packets: Packets read before @offset
+ * @payloads: Modbus TCP payloads returned before @offset
+ */
+
+typedef struct {
+    int64_t offset;
+    uint64_t packets;
+    uint64_t payloads;
+} pcap_reader_position_t;
+
+
+/**
+ * enum pcap_io_backend_t - How capture bytes are read from disk
+ * @PCAP_IO_LIBPCAP: libpcap's stdio reader (any format, compressed, pipes)
+ * @PCAP_IO_MMAP: Whole-file mapping parsed in place (classic pcap only)
+ * @PCAP_IO_URING: Deep io_uring read-ahead into registered buffers
+ *                 (classic pcap only, Linux)
+ */
+
+typedef enum {
+    PCAP_IO_LIBPCAP = 0,
+    PCAP_IO_MMAP,
+    PCAP_IO_URING
+} pcap_io_backend_t;
+
+
+/* io_uring geometry: reads kept in flight and bytes per read */
+#define PCAP_URING_DEFAULT_DEPTH 8
+#define PCAP_URING_DEFAULT_BUFFER (1u << 20)
+#define PCAP_URING_MAX_DEPTH 256
+#define PCAP_URING_MIN_BUFFER 4096
+#define PCAP_URING_MAX_BUFFER (1u << 30)
+
+
+/**
+ * enum pcap_sample_mode_t - Which records a sampling reader keeps
+ * @PCAP_SAMPLE_NONE: Every record
+ * @PCAP_SAMPLE_PACKETS: About 1 in N packet records, picked by record index
+ * @PCAP_SAMPLE_FLOWS: About 1 in N TCP flows, whole (both directions)
+ * @PCAP_SAMPLE_TIME: About 1 in N capture seconds, whole
+ *
+ * Records are picked by a hash of the index, flow or second rather than
+ * every Nth one, so periodic polling cannot alias with the sample. The
+ * choice depends on nothing else, so a run resumed from a checkpoint
+ * keeps the same records.
+ */
+
+typedef enum {
+    PCAP_SAMPLE_NONE = 0,
+    PCAP_SAMPLE_PACKETS,
+    PCAP_SAMPLE_FLOWS,
+    PCAP_SAMPLE_TIME
+} pcap_sample_mode_t;
+
+
+/* Largest sampling rate (1 in N) */
+#define PCAP_SAMPLE_MAX_RATE 1000000
+
+
+/**
+ * struct pcap_sample_t - Statistical sampling of a capture
+ * @mode: What is sampled
+ * @rate: Keep 1 in @rate (2 to PCAP_SAMPLE_MAX_RATE; ignored for NONE)
+ *
+ * Packet and time sampling decide on the record header alone, so a
+ * skipped record's link, IP and TCP headers are never parsed. Flow
+ * sampling needs the addresses and ports, so it decides after the TCP
+ * header and before the payload is returned.
+ */
+
+typedef struct {
+    pcap_sample_mode_t mode;
+    uint32_t rate;
+} pcap_sample_t;
+
+
+/**
+ * struct pcap_reader_options_t - Reader I/O settings
+ * @backend: Read path
+ * @queue_depth: PCAP_IO_URING reads in flight (0 = default)
+ * @buffer_size: PCAP_IO_URING bytes per read (0 = default)
+ * @sample: Records to keep (zero = all)
+ */
+
+typedef struct {
+    pcap_io_backend_t backend;
+    uint32_t queue_depth;
+    uint32_t buffer_size;
+    pcap_sample_t sample;
+} pcap_reader_options_t;
+
+
+/* Captures pcap_reader_open_merged() accepts */
+#define PCAP_MERGE_MAX_CAPTURES 16
+
+/* Duplicate window when none is given, and the longest accepted */
+#define PCAP_MERGE_DEFAULT_WINDOW_MS 100
+#define PCAP_MERGE_MAX_WINDOW_MS 60000
+
+
+/**
+ * struct pcap_merge_stats_t - Counters of a merged reader
+ * @captures: Captures merged (entries used in the arrays)
+ * @payloads: Payloads each capture contributed to the merged stream
+ * @duplicates: Payloads of each capture dropped as copies of a payload
+ *              already taken from another capture
+ * @out_of_order: Payloads older than one already returned (a capture
+ *                that is not in time order)
+ * @evictions: Window entries replaced while still inside the window,
+ *             whose copies may then have passed undetected
+ */
+
+typedef struct {
+    uint32_t captures;
+    uint64_t payloads[PCAP_MERGE_MAX_CAPTURES];
+    uint64_t duplicates[PCAP_MERGE_MAX_CAPTURES];
+    uint64_t out_of_order;
+    uint64_t evictions;
+} pcap_merge_stats_t;
+
+
+/* Payloads per batch when none is given, and the largest batch */
+#define PCAP_BATCH_DEFAULT 64
+#define PCAP_BATCH_MAX 4096
+
+
+/**
+ * struct pcap_batch_t - Payloads read together by pcap_reader_next_batch()
+ * @items: Payload descriptors (@count filled)
+ * @count: Descriptors filled by the last pcap_reader_next_batch()
+ * @capacity: Entries in @items
+ * @bytes: Payload bytes of @items, back to back
+ * @bytes_capacity: Size of @bytes (grows when a batch needs more)
+ *
+ * Every @items[i].payload points into @bytes, so all of them stay valid
+ * until the next pcap_reader_next_batch() on the batch, whatever the
+ * I/O backend does with its own buffers.
+ */
+
+typedef struct {
+    pcap_payload_t *items;
+    uint32_t count;
+    uint32_t capacity;
+    uint8_t *bytes;
+    size_t bytes_capacity;
+} pcap_batch_t;
+
+
+/**
+ * modbus_batch_callback_t() - Callback receiving a batch of payloads
+ * @items: Payload descriptors, valid only during the call
+ * @count: Descriptors in @items (at least 1)
+ * @user_data: Opaque pointer passed from pcap_process_file_batch()
+ */
+
+typedef void (*modbus_batch_callback_t)(const pcap_payload_t *items, uint32_t count,
+                                        void *user_data);
+
+
+/* Opaque capture reader (see pcap_reader_open()) */
+typedef struct pcap_reader pcap_reader_t;
+
+
+/**
+ * pcap_io_backend_parse() - Backend from its name
+ * @name: "libpcap", "mmap" or "uring"
+ * @backend: Output backend
+ *
+ * Return: false if @name is unknown
+ */
+
+bool pcap_io_backend_parse(const char *name, pcap_io_backend_t *backend);
+
+
+/**
+ * pcap_io_backend_name() - Name of a backend
+ * @backend: Backend
+ *
+ * Return: "libpcap", "mmap" or "uring"
+ */
+
+const char *pcap_io_backend_name(pcap_io_backend_t backend);
+
+
+/**
+ * pcap_sample_parse() - Sampling from "packets:N", "flows:N" or "time:N"
+ * @spec: Mode and rate
+ * @sample: Output sampling
+ *
+ * Return: false if the mode is unknown or N is not 2-PCAP_SAMPLE_MAX_RATE
+ */
+
+bool pcap_sample_parse(const char *spec, pcap_sample_t *sample);
+
+
+/**
+ * pcap_sample_name() - Unit a sampling mode keeps 1 in N of
+ * @mode: Mode
+ *
+ * Return: "packets", "flows", "seconds" or "records" (NONE)
+ */
+
+const char *pcap_sample_name(pcap_sample_mode_t mode);
+
+
+/**
+ * pcap_sample_flow_key() - Key by which flow sampling picks a connection
+ * @src: Source address
+ * @src_port: Source TCP port
+ * @dst: Destination address
+ * @dst_port: Destination TCP port
+ *
+ * Both directions of a connection have the same key.
+ *
+ * Return: 64-bit flow key
+ */
+
+uint64_t pcap_sample_flow_key(const endpoint_t *src, uint16_t src_port, const endpoint_t *dst,
+                              uint16_t dst_port);
+
+
+/**
+ * pcap_reader_open() - Open a capture file for iteration
+ * @filename: Path to PCAP file (relative or absolute)
+ * @errbuf: Output error message on failure (may be NULL)
+ * @errlen: Size of @errbuf
+ *
+ * gzip, zstd and lz4 compressed captures are detected by magic and
+ * decompressed on a separate thread (see capture_input.h).
+ *
+ * Return: Reader handle, or NULL on failure
+ */
+
+pcap_reader_t *pcap_reader_open(const char *filename, char *errbuf, size_t errlen);
+
+
+/**
+ * pcap_reader_open_with() - Open a capture file with explicit I/O settings
+ * @filename: Path to PCAP file (relative or absolute)
+ * @options: I/O settings (NULL = libpcap backend)
+ * @errbuf: Output error message on failure (may be NULL)
+ * @errlen: Size of @errbuf
+ *
+ * The mmap and uring backends parse classic pcap records themselves and
+ * need an uncompressed regular file; other captures are refused with an
+ * error rather than silently read another way.
+ *
+ * libpcap is asked for nanosecond timestamps, as the native backends
+ * always produce.
+ *
+ * Return: Reader handle, or NULL on failure
+ */
+
+pcap_reader_t *pcap_reader_open_with(const char *filename, const pcap_reader_options_t *options,
+                                     char *errbuf, size_t errlen);
+
+
+/**
+ * pcap_reader_open_merged() - Read several captures as one stream
+ * @filenames: Paths of the captures (2 to PCAP_MERGE_MAX_CAPTURES)
+ * @count: Entries in @filenames
+ * @options: I/O settings and sampling applied to every capture (NULL =
+ *           libpcap backend)
+ * @window_ms: Duplicate window in milliseconds (0 = keep every copy, at
+ *             most PCAP_MERGE_MAX_WINDOW_MS)
+ * @errbuf: Output error message on failure (may be NULL)
+ * @errlen: Size of @errbuf
+ *
+ * For captures of the same traffic taken at several points (taps on a
+ * ring, both sides of a firewall). Payloads are returned in timestamp
+ * order across the captures, ties in capture order. A payload whose
+ * addresses, ports, TCP sequence number, length and bytes match one
+ * taken from another capture less than @window_ms earlier is dropped,
+ * so every frame is decoded once; a repeat within one capture is a
+ * retransmission and is kept. No merged file is written.
+ *
+ * Flow and time sampling pick the same flows and seconds in every
+ * capture; packet sampling is applied to the merged stream after the
+ * duplicates are removed. A merged reader cannot tell or seek.
+ *
+ * Return: Reader handle, or NULL on failure
+ */
+
+pcap_reader_t *pcap_reader_open_merged(const char *const *filenames, uint32_t count,
+                                       const pcap_reader_options_t *options, uint32_t window_ms,
+                                       char *errbuf, size_t errlen);
+
+
+/**
+ * pcap_reader_add_protocol() - Decode another protocol in the same pass
+ * @reader: Reader opened with pcap_reader_open() or pcap_reader_open_with()
+ * @transport: TCP or UDP
+ * @port: Port of the protocol (source or destination)
+ * @handler: Called with every non-empty payload on @port
+ * @user_data: Passed to @handler
+ *
+ * Builds a port-to-handler table for the transport on first use; the
+ * decode loop then looks every segment's ports up in it, so a payload
+ * costs one table read whatever the number of protocols. TCP port 502
+ * stays Modbus. When both ports of a packet are registered the
+ * destination port wins. Sampling applies to these payloads as to
+ * Modbus ones. Register before the first read.
+ *
+ * Merged readers refuse handlers: copies from several taps would reach
+ * them before the merge drops them.
+ *
+ * Return: false if the port is taken, the table is full, the reader is
+ *         merged or allocation failed (see pcap_reader_error())
+ */
+
+bool pcap_reader_add_protocol(pcap_reader_t *reader, pcap_transport_t transport, uint16_t port,
+                              pcap_protocol_handler_t handler, void *user_data);
+
+
+/**
+ * pcap_reader_next() - Advance to the next Modbus TCP payload
+ * @reader: Open reader
+ * @out: Output payload descriptor
+ *
+ * Handles IPv4 and IPv6 (including extension headers). Skips non-TCP,
+ * non-port-502, malformed and empty packets, and those left out by
+ * sampling (pcap_reader_options_t). Payloads on a port registered with
+ * pcap_reader_add_protocol() go to its handler on the way. The decode
+ * loop was chosen from the capture's datalink type at open.
+ *
+ * Return: 1 if @out was filled, 0 at end of file, -1 on read error
+ */
+
+int pcap_reader_next(pcap_reader_t *reader, pcap_payload_t *out);
+
+
+/**
+ * pcap_batch_init() - Allocate an empty batch
+ * @batch: Batch
+ * @capacity: Payloads per batch (0 = PCAP_BATCH_DEFAULT, at most PCAP_BATCH_MAX)
+ *
+ * Return: false on allocation failure
+ */
+
+bool pcap_batch_init(pcap_batch_t *batch, uint32_t capacity);
+
+
+/**
+ * pcap_batch_free() - Release a batch
+ * @batch: Batch from pcap_batch_init()
+ */
+
+void pcap_batch_free(pcap_batch_t *batch);
+
+
+/**
+ * pcap_reader_next_batch() - Read up to a batch of Modbus TCP payloads
+ * @reader: Open reader
+ * @batch: Batch from pcap_batch_init(); its previous payloads are released
+ *
+ * Same filtering as pcap_reader_next(). A read error that ends a partly
+ * filled batch is returned by the following call, so no payload is lost.
+ *
+ * Return: Payloads in @batch (1 to capacity), 0 at end of file, -1 on
+ *         read error or allocation failure
+ */
+
+int pcap_reader_next_batch(pcap_reader_t *reader, pcap_batch_t *batch);
+
+
+/**
+ * pcap_reader_datalink() - Link-layer type of the capture
+ * @reader: Reader
+ *
+ * Return: libpcap DLT_* value
+ */
+
+int pcap_reader_datalink(const pcap_reader_t *reader);
+
+
+/**
+ * pcap_reader_error() - Last read error message
+ * @reader: Reader
+ *
+ * Return: Error string ("" if none)
+ */
+
+const char *pcap_reader_error(const pcap_reader_t *reader);
+
+
+/**
+ * pcap_reader_packet_count() - Packets read so far (all protocols)
+ * @reader: Reader
+ *
+ * Return: Packet count
+ */
+
+uint64_t pcap_reader_packet_count(const pcap_reader_t *reader);
+
+
+/**
+ * pcap_reader_input_stats() - Pipeline timing of a compressed capture
+ * @reader: Reader
+ * @stats: Output statistics
+ *
+ * Return: false for an uncompressed capture (@stats untouched)
+ */
+
+bool pcap_reader_input_stats(const pcap_reader_t *reader, capture_input_stats_t *stats);
+
+
+/**
+ * pcap_reader_merge_stats() - Counters of a merged reader
+ * @reader: Reader
+ * @stats: Output statistics
+ *
+ * Return: false unless @reader came from pcap_reader_open_merged()
+ *         (@stats untouched)
+ */
+
+bool pcap_reader_merge_stats(const pcap_reader_t *reader, pcap_merge_stats_t *stats);
+
+
+/**
+ * pcap_reader_tell() - Current position, for a later pcap_reader_seek()
+ * @reader: Reader
+ * @pos: Output position
+ *
+ * Return: false if the capture is not a seekable file (e.g. stdin) or the
+ *         reader is merged
+ */
+
+bool pcap_reader_tell(const pcap_reader_t *reader, pcap_reader_position_t *pos);
+
+
+/**
+ * pcap_reader_seek() - Continue reading from a saved position
+ * @reader: Reader opened on the same capture
+ * @pos: Position from pcap_reader_tell()
+ *
+ * Return: false if the capture cannot seek to @pos
+ */
+
+bool pcap_reader_seek(pcap_reader_t *reader, const pcap_reader_position_t *pos);
+
+
+/**
+ * pcap_reader_close() - Close the capture and free the reader
+ * @reader: Reader (NULL is ignored)
+ */
+
+void pcap_reader_close(pcap_reader_t *reader);
+
+
 
 /**
  * pcap_process_file() - Process PCAP file and extract Modbus TCp payloads
@@ -60,12 +590,12 @@ typedef void (*modbus_payload_callback_t)(const uint8_t *payload, uint32_t lengt
  *
  * The function handles:
  * - PCAP file format parsing (via libpcap)
- * - Ethernet/IP/TCP layer extraction
+ * - Link-layer/IP/TCP extraction (Ethernet, VLAN, SLL, SLL2, raw, loopback)
  * - Port 502 filtering (source or destination)
  * - Payload extraction and callback invocation
  *
- * Non-TCP packets and non-port-502 traffic are silently skipped.
- * Malformed packets generate warnings but processing continues.
+ * Non-TCP packets and non-port-502 traffic are silently skipped, as are
+ * malformed packets. Nothing is printed.
  *
  * Return: true if file was successfully processed (even if 0 Modbus frames 
  * found) false if file could not be opened or fatal error occurred
@@ -73,4 +603,23 @@ typedef void (*modbus_payload_callback_t)(const uint8_t *payload, uint32_t lengt
 
 bool pcap_process_file(const char *filename, modbus_payload_callback_t callback, void *user_data);
 
+
+/**
+ * pcap_process_file_batch() - Process PCAP file in batches of payloads
+ * @filename: Path to PCAP file (relative or absolute)
+ * @batch_size: Payloads per batch (0 = PCAP_BATCH_DEFAULT, at most PCAP_BATCH_MAX)
+ * @callback: Function to invoke for each batch
+ * @user_data: Opaque pointer passed to callback (can be NULL)
+ *
+ * Same filtering as pcap_process_file(), but one call delivers up to
+ * @batch_size payloads with binary addresses, so the consumer can
+ * validate and account a whole batch in one loop. Nothing is printed.
+ *
+ * Return: true if file was successfully processed (even if 0 Modbus frames
+ * found) false if file could not be opened or fatal error occurred
+ */
+
+bool pcap_process_file_batch(const char *filename, uint32_t batch_size,
+                             modbus_batch_callback_t callback, void *user_data);
+
 #endif /* PCAP_READER_H */
@@ -0,0 +1,187 @@
+/*
+ * pccc_output.c - Terminal summary and report section for EtherNet/IP
+ *
+ * Implements the display declared in pccc_output.h. Used by the CLI;
+ * not part of the modbus_parse library.
+ *
+ * Copyright (C) 2025 Marty
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+
+#include "pccc_output.h"
+#include <time.h>
+#include "colors.h"
+
+
+/* Names of pccc_function_class_t values */
+static const char *const class_names[PCCC_CLASS_COUNT] = {
+    "Other", "Read", "Write", "Control"
+};
+
+
+/*
+ * format_time() - Format timestamp as HH:MM:SS.microseconds
+ */
+
+static void format_time(int64_t timestamp_ns, char *buf, size_t len) {
+    time_t sec = (time_t)(timestamp_ns / 1000000000);
+    struct tm *tm_info = localtime(&sec);
+    int microsec = (int)(timestamp_ns % 1000000000 / 1000);
+    snprintf(buf, len, "%02d:%02d:%02d.%06d",
+             tm_info->tm_hour, tm_info->tm_min, tm_info->tm_sec, microsec);
+}
+
+
+/*
+ * parse_failures_total() - Messages that did not decode
+ */
+
+static uint64_t parse_failures_total(const pccc_analysis_stats_t *stats) {
+    uint64_t total = 0;
+    for (int i = PCCC_PARSE_OK + 1; i < PCCC_PARSE_ERROR_COUNT; i++) {
+        total += stats->parse_failures[i];
+    }
+    return total;
+}
+
+
+/**
+ * pccc_display_summary() - Print EtherNet/IP, CIP and PCCC counters
+ * @stats: Counters filled during the pass
+ *
+ * Warns about program and mode control functions, which a polling HMI
+ * never sends.
+ */
+
+void pccc_display_summary(const pccc_analysis_stats_t *stats) {
+    printf("\n%sEtherNet/IP / PCCC (port %u):%s\n", COLOR_WHITE, PCCC_ENIP_PORT, COLOR_RESET);
+    if (stats->payloads == 0) {
+        printf("  No traffic on the port\n");
+        return;
+    }
+
+    printf("  %s%-12s%s %llu (%llu over UDP), %llu messages\n", COLOR_YELLOW, "Payloads",
+           COLOR_RESET, (unsigned long long)stats->payloads,
+           (unsigned long long)stats->udp_payloads, (unsigned long long)stats->messages);
+    for (int i = PCCC_PARSE_OK + 1; i < PCCC_PARSE_ERROR_COUNT; i++) {
+        if (stats->parse_failures[i] > 0) {
+            printf("  %s%-12s%s %llu %s\n", COLOR_YELLOW, "Undecoded", COLOR_RESET,
+                   (unsigned long long)stats->parse_failures[i],
+                   pccc_get_parse_error_name((pccc_parse_error_t)i));
+        }
+    }
+
+    printf("  %s%-12s%s", COLOR_YELLOW, "Commands", COLOR_RESET);
+    uint32_t shown = 0;
+    for (int i = 0; i < ENIP_COMMAND_SLOTS; i++) {
+        if (stats->commands[i] > 0) {
+            printf("%s%s %llu", shown++ ? ", " : " ", enip_get_command_name((uint16_t)i),
+                   (unsigned long long)stats->commands[i]);
+        }
+    }
+    if (stats->other_commands > 0) {
+        printf("%sother %llu", shown++ ? ", " : " ", (unsigned long long)stats->other_commands);
+    }
+    printf("\n");
+    printf("  %s%-12s%s %llu registered, %llu encapsulation errors\n", COLOR_YELLOW, "Sessions",
+           COLOR_RESET, (unsigned long long)stats->sessions_registered,
+           (unsigned long long)stats->encap_errors);
+    printf("  %s%-12s%s %llu requests (%llu routed), %llu replies, %llu errors\n", COLOR_YELLOW,
+           "CIP", COLOR_RESET, (unsigned long long)stats->cip_requests,
+           (unsigned long long)stats->cip_routed, (unsigned long long)stats->cip_replies,
+           (unsigned long long)stats->cip_errors);
+    printf("  %s%-12s%s %llu requests, %llu replies, %llu errors\n", COLOR_YELLOW, "PCCC",
+           COLOR_RESET, (unsigned long long)stats->pccc_requests,
+           (unsigned long long)stats->pccc_replies, (unsigned long long)stats->pccc_errors);
+    if (stats->pccc_requests > 0) {
+        printf("  %s%-12s%s read %llu, write %llu, control %llu, other %llu\n", COLOR_YELLOW,
+               "Functions", COLOR_RESET,
+               (unsigned long long)stats->pccc_classes[PCCC_CLASS_READ],
+               (unsigned long long)stats->pccc_classes[PCCC_CLASS_WRITE],
+               (unsigned long long)stats->pccc_classes[PCCC_CLASS_CONTROL],
+               (unsigned long long)stats->pccc_classes[PCCC_CLASS_OTHER]);
+    }
+
+    if (stats->pccc_classes[PCCC_CLASS_CONTROL] > 0) {
+        char time_str[20];
+        format_time(stats->first_control_ns, time_str, sizeof(time_str));
+        printf("  %s[!] PLC CONTROL%s - %llu program/mode requests, first at %s\n",
+               COLOR_YELLOW, COLOR_RESET,
+               (unsigned long long)stats->pccc_classes[PCCC_CLASS_CONTROL], time_str);
+    }
+}
+
+
+/**
+ * pccc_write_report() - Append the EtherNet/IP and PCCC section to report
+ * @stats: Counters filled during the pass
+ * @f: Open report file (no-op if NULL)
+ */
+
+void pccc_write_report(const pccc_analysis_stats_t *stats, FILE *f) {
+    if (!f) return;
+
+    fprintf(f, "\n### EtherNet/IP and PCCC\n\n");
+    if (stats->payloads == 0) {
+        fprintf(f, "No traffic on port %u.\n", PCCC_ENIP_PORT);
+        return;
+    }
+
+    fprintf(f, "- **Payloads:** %llu (%llu over UDP)\n", (unsigned long long)stats->payloads,
+            (unsigned long long)stats->udp_payloads);
+    fprintf(f, "- **Messages:** %llu (%llu undecoded)\n", (unsigned long long)stats->messages,
+            (unsigned long long)parse_failures_total(stats));
+    fprintf(f, "- **Sessions Registered:** %llu\n",
+            (unsigned long long)stats->sessions_registered);
+    fprintf(f, "- **Encapsulation Errors:** %llu\n", (unsigned long long)stats->encap_errors);
+    fprintf(f, "- **CIP:** %llu requests (%llu routed), %llu replies, %llu errors\n",
+            (unsigned long long)stats->cip_requests, (unsigned long long)stats->cip_routed,
+            (unsigned long long)stats->cip_replies, (unsigned long long)stats->cip_errors);
+    fprintf(f, "- **PCCC:** %llu requests, %llu replies, %llu errors\n",
+            (unsigned long long)stats->pccc_requests, (unsigned long long)stats->pccc_replies,
+            (unsigned long long)stats->pccc_errors);
+
+    if (stats->pccc_classes[PCCC_CLASS_CONTROL] > 0) {
+        char time_str[20];
+        format_time(stats->first_control_ns, time_str, sizeof(time_str));
+        fprintf(f, "\n- ⚠️ **PLC CONTROL** - %llu program/mode requests, first at %s\n",
+                (unsigned long long)stats->pccc_classes[PCCC_CLASS_CONTROL], time_str);
+    }
+
+    fprintf(f, "\n| Command | Count |\n");
+    fprintf(f, "|---------|-------|\n");
+    for (int i = 0; i < ENIP_COMMAND_SLOTS; i++) {
+        if (stats->commands[i] > 0) {
+            fprintf(f, "| 0x%04X %s | %llu |\n", i, enip_get_command_name((uint16_t)i),
+                    (unsigned long long)stats->commands[i]);
+        }
+    }
+    if (stats->other_commands > 0) {
+        fprintf(f, "| Other | %llu |\n", (unsigned long long)stats->other_commands);
+    }
+
+    if (stats->cip_requests > 0) {
+        fprintf(f, "\n| CIP Service | Service Name | Requests |\n");
+        fprintf(f, "|-------------|--------------|----------|\n");
+        for (int i = 0; i < CIP_REPLY; i++) {
+            if (stats->cip_services[i] > 0) {
+                fprintf(f, "| 0x%02X | %s | %llu |\n", i, cip_get_service_name((uint8_t)i),
+                        (unsigned long long)stats->cip_services[i]);
+            }
+        }
+    }
+
+    if (stats->pccc_requests > 0) {
+        fprintf(f, "\n| PCCC Function | Function Name | Class | Requests |\n");
+        fprintf(f, "|---------------|---------------|-------|----------|\n");
+        for (int i = 0; i < 256; i++) {
+            if (stats->pccc_functions[i] > 0) {
+                fprintf(f, "| 0x%02X | %s | %s | %llu |\n", i,
+                        pccc_get_function_name((uint8_t)i),
+                        class_names[pccc_classify_function((uint8_t)i)],
+                        (unsigned long long)stats->pccc_functions[i]);
+            }
+        }
+    }
+}
@@ -0,0 +1,39 @@
+/*
+ * pccc_output.h - Terminal summary and report section for EtherNet/IP
+ *
+ * Presents the pccc_analysis_stats_t filled by pccc_handle_payload()
+ * during the Modbus pass (--enip). Used by the CLI; not part of the
+ * modbus_parse library.
+ *
+ * Copyright (C) 2025 Marty
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+
+#ifndef PCCC_OUTPUT_H
+#define PCCC_OUTPUT_H
+
+#include <stdio.h>
+#include "pccc_parser.h"
+
+
+/**
+ * pccc_display_summary() - Print EtherNet/IP, CIP and PCCC counters
+ * @stats: Counters filled during the pass
+ *
+ * Warns about program and mode control functions, which a polling HMI
+ * never sends.
+ */
+
+void pccc_display_summary(const pccc_analysis_stats_t *stats);
+
+
+/**
+ * pccc_write_report() - Append the EtherNet/IP and PCCC section to report
+ * @stats: Counters filled during the pass
+ * @f: Open report file (no-op if NULL)
+ */
+
+void pccc_write_report(const pccc_analysis_stats_t *stats, FILE *f);
+
+#endif /* PCCC_OUTPUT_H */
@@ -0,0 +1,538 @@
+/*
+ * pccc_parser.c - EtherNet/IP, CIP and PCCC parser implementation
+ *
+ * Implements the decoder and counters declared in pccc_parser.h. Part
+ * of the modbus_parse library, so nothing in here writes to stdout;
+ * display and reports live in pccc_output.c.
+ *
+ * Key components:
+ * - Encapsulation header and command data bounds checks
+ * - Common packet format walk to the connected or unconnected data item
+ * - CIP request path / reply status, one level of Unconnected Send
+ * - PCCC requestor ID, command header and function code
+ * - Capture-wide counters and the reader's protocol handler
+ *
+ * Copyright (C) 2025 Marty
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+
+#include "pccc_parser.h"
+#include <string.h>
+
+
+/* Common packet format data item types */
+#define CPF_ITEM_CONNECTED_DATA 0x00B1
+#define CPF_ITEM_UNCONNECTED_DATA 0x00B2
+
+/* Interface handle (4), timeout (2) and item count (2) before the items */
+#define CPF_PREFIX_SIZE 8
+
+/* Item type (2) and length (2) */
+#define CPF_ITEM_HEADER_SIZE 4
+
+/* Connection Manager object: target of Unconnected Send */
+#define CIP_CLASS_CONNECTION_MANAGER 0x06
+
+/* EPATH logical class segments (8- and 16-bit class ID) */
+#define CIP_SEGMENT_CLASS_8 0x20
+#define CIP_SEGMENT_CLASS_16 0x21
+
+/* Requestor ID: length byte, vendor ID (2) and serial number (4) */
+#define PCCC_REQUESTOR_ID_MIN 7
+
+/* CMD, STS and TNS (2) */
+#define PCCC_HEADER_SIZE 4
+
+
+/*
+ * load_le16() - Read a little-endian 16-bit value from unaligned bytes
+ */
+
+static inline uint16_t load_le16(const uint8_t *p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+
+/*
+ * load_le32() - Read a little-endian 32-bit value from unaligned bytes
+ */
+
+static inline uint32_t load_le32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+           ((uint32_t)p[3] << 24);
+}
+
+
+/*
+ * path_class() - Class ID named by the first segment of a request path
+ *
+ * Return: Class ID, or 0xFFFF if the path does not start with a class
+ */
+
+static uint16_t path_class(const uint8_t *path, uint32_t length) {
+    if (length >= 2 && path[0] == CIP_SEGMENT_CLASS_8) {
+        return path[1];
+    }
+    if (length >= 4 && path[0] == CIP_SEGMENT_CLASS_16) {
+        return load_le16(path + 2);  // Pad byte at path[1]
+    }
+    return 0xFFFF;
+}
+
+
+/*
+ * parse_pccc() - Decode the PCCC part of an Execute PCCC request or reply
+ * @p: Requestor ID followed by the PCCC command
+ * @length: Bytes at @p
+ * @reply: @p comes from a reply
+ * @frame: Frame to fill in
+ */
+
+static pccc_parse_error_t parse_pccc(const uint8_t *p, uint32_t length, bool reply,
+                                     pccc_frame_t *frame) {
+    // The requestor ID length byte counts itself
+    if (length < 1 || p[0] < PCCC_REQUESTOR_ID_MIN || p[0] > length) {
+        return PCCC_PARSE_BAD_CIP;
+    }
+    uint32_t offset = p[0];
+    frame->vendor_id = load_le16(p + 1);
+    frame->serial_number = load_le32(p + 3);
+
+    if (length - offset < PCCC_HEADER_SIZE) {
+        return PCCC_PARSE_BAD_CIP;
+    }
+    frame->pccc_command = p[offset];
+    frame->pccc_status = p[offset + 1];
+    frame->tns = load_le16(p + offset + 2);
+    offset += PCCC_HEADER_SIZE;
+
+    if (reply) {
+        if (frame->pccc_status == PCCC_STS_EXTENDED) {
+            if (length - offset < 1) {
+                return PCCC_PARSE_BAD_CIP;
+            }
+            frame->pccc_ext_status = p[offset++];
+        }
+    } else if (frame->pccc_command == PCCC_CMD_TYPED) {
+        if (length - offset < 1) {
+            return PCCC_PARSE_BAD_CIP;
+        }
+        frame->has_function = true;
+        frame->pccc_function = p[offset++];
+    }
+
+    frame->has_pccc = true;
+    frame->data = p + offset;
+    frame->data_length = length - offset;
+    return PCCC_PARSE_OK;
+}
+
+
+/*
+ * parse_cip() - Decode a CIP request or reply
+ * @p: Service code onwards
+ * @length: Bytes at @p
+ * @frame: Frame to fill in
+ *
+ * An Unconnected Send request to the Connection Manager is decoded as
+ * the message it carries, once.
+ */
+
+static pccc_parse_error_t parse_cip(const uint8_t *p, uint32_t length, pccc_frame_t *frame) {
+    if (length < 2) {
+        return PCCC_PARSE_BAD_CIP;
+    }
+    uint8_t service = p[0];
+    frame->has_cip = true;
+    frame->cip_service = service;
+
+    if (service & CIP_REPLY) {
+        // Service, reserved, general status, additional status size in words
+        if (length < 4) {
+            return PCCC_PARSE_BAD_CIP;
+        }
+        frame->cip_status = p[2];
+        uint32_t offset = 4 + (uint32_t)p[3] * 2;
+        if (offset > length) {
+            return PCCC_PARSE_BAD_CIP;
+        }
+        if ((service & ~CIP_REPLY) == CIP_SERVICE_EXECUTE_PCCC && frame->cip_status == 0) {
+            return parse_pccc(p + offset, length - offset, true, frame);
+        }
+        return PCCC_PARSE_OK;
+    }
+
+    // Service, path size in words, path
+    uint32_t path_length = (uint32_t)p[1] * 2;
+    uint32_t offset = 2 + path_length;
+    if (offset > length) {
+        return PCCC_PARSE_BAD_CIP;
+    }
+
+    if (service == CIP_SERVICE_UNCONNECTED_SEND && !frame->routed &&
+        path_class(p + 2, path_length) == CIP_CLASS_CONNECTION_MANAGER) {
+        // Priority/tick time, timeout ticks, embedded message size, message
+        if (length - offset < 4) {
+            return PCCC_PARSE_BAD_CIP;
+        }
+        uint32_t message_length = load_le16(p + offset + 2);
+        if (message_length > length - offset - 4) {
+            return PCCC_PARSE_BAD_CIP;
+        }
+        frame->routed = true;
+        return parse_cip(p + offset + 4, message_length, frame);
+    }
+
+    if (service == CIP_SERVICE_EXECUTE_PCCC) {
+        return parse_pccc(p + offset, length - offset, false, frame);
+    }
+    return PCCC_PARSE_OK;
+}
+
+
+/*
+ * parse_cpf() - Find the CIP message in SendRRData / SendUnitData data
+ * @p: Command data (interface handle onwards)
+ * @length: Bytes at @p
+ * @frame: Frame to fill in
+ *
+ * Every item header is bounds-checked; the first connected or
+ * unconnected data item is decoded.
+ */
+
+static pccc_parse_error_t parse_cpf(const uint8_t *p, uint32_t length, pccc_frame_t *frame) {
+    if (length < CPF_PREFIX_SIZE) {
+        return PCCC_PARSE_BAD_CPF;
+    }
+    uint16_t item_count = load_le16(p + 6);
+    uint32_t offset = CPF_PREFIX_SIZE;
+
+    for (uint16_t i = 0; i < item_count; i++) {
+        if (length - offset < CPF_ITEM_HEADER_SIZE) {
+            return PCCC_PARSE_BAD_CPF;
+        }
+        uint16_t type = load_le16(p + offset);
+        uint32_t item_length = load_le16(p + offset + 2);
+        const uint8_t *item = p + offset + CPF_ITEM_HEADER_SIZE;
+        if (item_length > length - offset - CPF_ITEM_HEADER_SIZE) {
+            return PCCC_PARSE_BAD_CPF;
+        }
+
+        if (type == CPF_ITEM_UNCONNECTED_DATA) {
+            return parse_cip(item, item_length, frame);
+        }
+        if (type == CPF_ITEM_CONNECTED_DATA) {
+            // Connected messages start with a sequence count
+            if (item_length < 2) {
+                return PCCC_PARSE_BAD_CIP;
+            }
+            frame->connected = true;
+            return parse_cip(item + 2, item_length - 2, frame);
+        }
+        offset += CPF_ITEM_HEADER_SIZE + item_length;
+    }
+    return PCCC_PARSE_OK;
+}
+
+
+/**
+ * pccc_parse_frame() - Decode one encapsulation message
+ * @data: Bytes at the start of an encapsulation header
+ * @length: Bytes available at @data
+ * @frame: Output frame (pointers into @data)
+ * @consumed: Output bytes taken by the message (header + command data),
+ *            set even on PCCC_PARSE_BAD_CPF / PCCC_PARSE_BAD_CIP so the
+ *            next message of the segment can still be read
+ *
+ * Return: PCCC_PARSE_OK, or the class of the failure
+ */
+
+pccc_parse_error_t pccc_parse_frame(const uint8_t *data, uint32_t length, pccc_frame_t *frame,
+                                    uint32_t *consumed) {
+    memset(frame, 0, sizeof(*frame));
+    *consumed = length;
+
+    if (length < ENIP_HEADER_SIZE) {
+        return PCCC_PARSE_SHORT_HEADER;
+    }
+    frame->eip.command = load_le16(data);
+    frame->eip.length = load_le16(data + 2);
+    frame->eip.session_handle = load_le32(data + 4);
+    frame->eip.status = load_le32(data + 8);
+    memcpy(frame->eip.sender_context, data + 12, sizeof(frame->eip.sender_context));
+    frame->eip.options = load_le32(data + 20);
+
+    uint32_t total = ENIP_HEADER_SIZE + (uint32_t)frame->eip.length;
+    if (total > length) {
+        return PCCC_PARSE_TRUNCATED;
+    }
+    *consumed = total;
+
+    if (frame->eip.command != ENIP_CMD_SEND_RR_DATA &&
+        frame->eip.command != ENIP_CMD_SEND_UNIT_DATA) {
+        return PCCC_PARSE_OK;
+    }
+    // Error replies may come without command data
+    if (frame->eip.length == 0 && frame->eip.status != 0) {
+        return PCCC_PARSE_OK;
+    }
+    return parse_cpf(data + ENIP_HEADER_SIZE, frame->eip.length, frame);
+}
+
+
+/**
+ * pccc_init_analysis_stats() - Zero the counters
+ * @stats: Statistics
+ */
+
+void pccc_init_analysis_stats(pccc_analysis_stats_t *stats) {
+    memset(stats, 0, sizeof(*stats));
+}
+
+
+/**
+ * pccc_update_analysis_stats() - Count one decoded message
+ * @stats: Statistics
+ * @frame: Message from pccc_parse_frame()
+ * @from_server: The message was sent from port PCCC_ENIP_PORT (a reply)
+ * @timestamp_ns: Capture timestamp in nanoseconds since the epoch
+ */
+
+void pccc_update_analysis_stats(pccc_analysis_stats_t *stats, const pccc_frame_t *frame,
+                                bool from_server, int64_t timestamp_ns) {
+    uint16_t command = frame->eip.command;
+
+    stats->messages++;
+    if (command < ENIP_COMMAND_SLOTS) {
+        stats->commands[command]++;
+    } else {
+        stats->other_commands++;
+    }
+    if (from_server) {
+        if (frame->eip.status != 0) {
+            stats->encap_errors++;
+        } else if (command == ENIP_CMD_REGISTER_SESSION) {
+            stats->sessions_registered++;
+        }
+    }
+
+    if (!frame->has_cip) {
+        return;
+    }
+    bool reply = (frame->cip_service & CIP_REPLY) != 0;
+    if (reply) {
+        stats->cip_replies++;
+        if (frame->cip_status != 0) {
+            stats->cip_errors++;
+        }
+    } else {
+        stats->cip_requests++;
+        stats->cip_services[frame->cip_service]++;
+        if (frame->routed) {
+            stats->cip_routed++;
+        }
+    }
+
+    if (!frame->has_pccc) {
+        return;
+    }
+    if (reply) {
+        stats->pccc_replies++;
+        if (frame->pccc_status != 0) {
+            stats->pccc_errors++;
+        }
+        return;
+    }
+    stats->pccc_requests++;
+    if (frame->has_function) {
+        pccc_function_class_t class = pccc_classify_function(frame->pccc_function);
+        stats->pccc_functions[frame->pccc_function]++;
+        if (class == PCCC_CLASS_CONTROL && stats->pccc_classes[PCCC_CLASS_CONTROL] == 0) {
+            stats->first_control_ns = timestamp_ns;
+        }
+        stats->pccc_classes[class]++;
+    }
+}
+
+
+/**
+ * pccc_handle_payload() - Protocol handler for the capture reader
+ * @payload: Payload on port PCCC_ENIP_PORT
+ * @transport: TCP or UDP
+ * @user_data: pccc_analysis_stats_t to update
+ *
+ * Decodes every encapsulation message in the payload. Register with
+ * pcap_reader_add_protocol() or modbus_session_add_protocol().
+ */
+
+void pccc_handle_payload(const pcap_payload_t *payload, pcap_transport_t transport,
+                         void *user_data) {
+    pccc_analysis_stats_t *stats = user_data;
+    const uint8_t *data = payload->payload;
+    uint32_t remaining = payload->length;
+    bool from_server = payload->src_port == PCCC_ENIP_PORT;
+
+    if (stats->payloads == 0) {
+        stats->first_packet_ns = payload->timestamp_ns;
+    }
+    stats->last_packet_ns = payload->timestamp_ns;
+    stats->payloads++;
+    if (transport == PCAP_TRANSPORT_UDP) {
+        stats->udp_payloads++;
+    }
+
+    // A segment can carry several messages back to back
+    while (remaining > 0) {
+        pccc_frame_t frame;
+        uint32_t consumed;
+        pccc_parse_error_t error = pccc_parse_frame(data, remaining, &frame, &consumed);
+
+        if (error == PCCC_PARSE_OK) {
+            pccc_update_analysis_stats(stats, &frame, from_server, payload->timestamp_ns);
+        } else {
+            stats->parse_failures[error]++;
+        }
+        data += consumed;
+        remaining -= consumed;
+    }
+}
+
+
+/**
+ * pccc_classify_function() - What a typed PCCC function does
+ * @function_code: PCCC function code (FNC)
+ *
+ * Return: Class of the function
+ */
+
+pccc_function_class_t pccc_classify_function(uint8_t function_code) {
+    switch (function_code) {
+        case 0x01: case 0x68: case 0xA1: case 0xA2:
+            return PCCC_CLASS_READ;
+        case 0x00: case 0x02: case 0x26: case 0x67: case 0xA9: case 0xAA: case 0xAB:
+            return PCCC_CLASS_WRITE;
+        case 0x11: case 0x12: case 0x41: case 0x52: case 0x53: case 0x55: case 0x56:
+        case 0x57: case 0x80:
+            return PCCC_CLASS_CONTROL;
+        default:
+            return PCCC_CLASS_OTHER;
+    }
+}
+
+
+/**
+ * enip_get_command_name() - Name of an encapsulation command
+ * @command: ENIP_CMD_* value
+ *
+ * Return: Static string (never NULL)
+ */
+
+const char *enip_get_command_name(uint16_t command) {
+    switch (command) {
+        case ENIP_CMD_NOP:                return "NOP";
+        case ENIP_CMD_LIST_SERVICES:      return "ListServices";
+        case ENIP_CMD_LIST_IDENTITY:      return "ListIdentity";
+        case ENIP_CMD_LIST_INTERFACES:    return "ListInterfaces";
+        case ENIP_CMD_REGISTER_SESSION:   return "RegisterSession";
+        case ENIP_CMD_UNREGISTER_SESSION: return "UnRegisterSession";
+        case ENIP_CMD_SEND_RR_DATA:       return "SendRRData";
+        case ENIP_CMD_SEND_UNIT_DATA:     return "SendUnitData";
+        case ENIP_CMD_INDICATE_STATUS:    return "IndicateStatus";
+        case ENIP_CMD_CANCEL:             return "Cancel";
+        default:                          return "Unknown Command";
+    }
+}
+
+
+/**
+ * cip_get_service_name() - Name of a CIP service
+ * @service: Service code (the reply bit is ignored)
+ *
+ * Return: Static string (never NULL)
+ */
+
+const char *cip_get_service_name(uint8_t service) {
+    switch (service & ~CIP_REPLY) {
+        case 0x01: return "Get Attributes All";
+        case 0x02: return "Set Attributes All";
+        case 0x03: return "Get Attribute List";
+        case 0x04: return "Set Attribute List";
+        case 0x05: return "Reset";
+        case 0x06: return "Start";
+        case 0x07: return "Stop";
+        case 0x08: return "Create";
+        case 0x09: return "Delete";
+        case 0x0A: return "Multiple Service Packet";
+        case 0x0D: return "Apply Attributes";
+        case 0x0E: return "Get Attribute Single";
+        case 0x10: return "Set Attribute Single";
+        case 0x11: return "Find Next Object Instance";
+        case 0x4B: return "Execute PCCC";
+        case 0x4C: return "Read Tag";
+        case 0x4D: return "Write Tag";
+        case 0x4E: return "Forward Close";
+        case 0x52: return "Read Tag Fragmented";  // Unconnected Send is unwrapped
+        case 0x53: return "Write Tag Fragmented";
+        case 0x54: return "Forward Open";
+        case 0x5B: return "Large Forward Open";
+        default:   return "Unknown Service";
+    }
+}
+
+
+/**
+ * pccc_get_function_name() - Name of a typed PCCC function
+ * @function_code: PCCC function code (FNC)
+ *
+ * Return: Static string (never NULL)
+ */
+
+const char *pccc_get_function_name(uint8_t function_code) {
+    switch (function_code) {
+        // Data table access
+        case 0x00: return "Word Range Write";
+        case 0x01: return "Word Range Read";
+        case 0x02: return "Bit Write";
+        case 0x26: return "Read-Modify-Write";
+        case 0x67: return "Typed Write";
+        case 0x68: return "Typed Read";
+        case 0xA1: return "Protected Typed Logical Read (2 fields)";
+        case 0xA2: return "Protected Typed Logical Read (3 fields)";
+        case 0xA9: return "Protected Typed Logical Write (2 fields)";
+        case 0xAA: return "Protected Typed Logical Write (3 fields)";
+        case 0xAB: return "Protected Typed Logical Write with Mask";
+
+        // Program and mode control
+        case 0x11: return "Get Edit Resource";
+        case 0x12: return "Return Edit Resource";
+        case 0x41: return "Disable Forces";
+        case 0x52: return "Download All Request";
+        case 0x53: return "Download Completed";
+        case 0x55: return "Upload All Request";
+        case 0x56: return "Upload Completed";
+        case 0x57: return "Initialize Memory";
+        case 0x80: return "Change Mode";
+
+        default:   return "Unknown Function";
+    }
+}
+
+
+/**
+ * pccc_get_parse_error_name() - Short description of a failure class
+ * @error: Failure class
+ *
+ * Return: Static string (never NULL)
+ */
+
+const char *pccc_get_parse_error_name(pccc_parse_error_t error) {
+    switch (error) {
+        case PCCC_PARSE_OK:           return "ok";
+        case PCCC_PARSE_SHORT_HEADER: return "shorter than a header";
+        case PCCC_PARSE_TRUNCATED:    return "truncated message";
+        case PCCC_PARSE_BAD_CPF:      return "malformed CPF items";
+        case PCCC_PARSE_BAD_CIP:      return "malformed CIP/PCCC";
+        default:                      return "unknown";
+    }
+}
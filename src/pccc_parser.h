@@ -0,0 +1,314 @@
+/*
+ * pccc_parser.h - EtherNet/IP, CIP and PCCC parsing and statistics
+ *
+ * Decodes the Allen-Bradley traffic on port 44818: the EtherNet/IP
+ * encapsulation header, the common packet format (CPF) items of
+ * SendRRData / SendUnitData, the CIP request or reply inside them and,
+ * for Execute PCCC (service 0x4B), the PCCC command carried in it.
+ * Unconnected Send requests to the Connection Manager are unwrapped
+ * once, so PCCC routed through a bridge is seen too.
+ *
+ * The module plugs into the capture reader's protocol dispatch: register
+ * pccc_handle_payload() for TCP (and UDP) port PCCC_ENIP_PORT and the
+ * same read of the capture that feeds the Modbus decoder fills a
+ * pccc_analysis_stats_t. Parsing is stateless and zero-copy; a TCP
+ * segment may hold several encapsulation messages, and messages split
+ * across segments are counted as truncated. Like modbus_parser.h it is
+ * part of the modbus_parse library and never writes to stdout; display
+ * and reports are declared in pccc_output.h.
+ *
+ * Copyright (C) 2025 Marty
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+
+#ifndef PCCC_PARSER_H
+#define PCCC_PARSER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "pcap_reader.h"
+
+
+/* EtherNet/IP explicit messaging port (TCP and UDP) */
+#define PCCC_ENIP_PORT 44818
+
+/* Encapsulation header size */
+#define ENIP_HEADER_SIZE 24
+
+/* Encapsulation commands */
+#define ENIP_CMD_NOP 0x0000
+#define ENIP_CMD_LIST_SERVICES 0x0004
+#define ENIP_CMD_LIST_IDENTITY 0x0063
+#define ENIP_CMD_LIST_INTERFACES 0x0064
+#define ENIP_CMD_REGISTER_SESSION 0x0065
+#define ENIP_CMD_UNREGISTER_SESSION 0x0066
+#define ENIP_CMD_SEND_RR_DATA 0x006F
+#define ENIP_CMD_SEND_UNIT_DATA 0x0070
+#define ENIP_CMD_INDICATE_STATUS 0x0072
+#define ENIP_CMD_CANCEL 0x0073
+
+/* Encapsulation commands counted one by one (all defined ones are lower) */
+#define ENIP_COMMAND_SLOTS 128
+
+/* CIP service codes (a reply has CIP_REPLY set) */
+#define CIP_REPLY 0x80
+#define CIP_SERVICE_EXECUTE_PCCC 0x4B
+#define CIP_SERVICE_UNCONNECTED_SEND 0x52
+
+/* PCCC command with a function code byte, and the reply bit of CMD */
+#define PCCC_CMD_TYPED 0x0F
+#define PCCC_CMD_REPLY 0x40
+
+/* PCCC status announcing an extended status byte */
+#define PCCC_STS_EXTENDED 0xF0
+
+
+/**
+ * struct eip_encap_header_t - EtherNet/IP encapsulation header
+ * @command: Encapsulation command (ENIP_CMD_*)
+ * @length: Bytes of command data after the header
+ * @session_handle: Session from RegisterSession (0 before)
+ * @status: 0 on success, an encapsulation error code otherwise
+ * @sender_context: Echoed by the target
+ * @options: Always 0
+ *
+ * All fields are little-endian on the wire.
+ */
+
+typedef struct {
+    uint16_t command;
+    uint16_t length;
+    uint32_t session_handle;
+    uint32_t status;
+    uint8_t sender_context[8];
+    uint32_t options;
+} eip_encap_header_t;
+
+
+/**
+ * struct pccc_frame_t - One decoded encapsulation message
+ * @eip: Encapsulation header
+ * @has_cip: A CIP message was found in the CPF items
+ * @connected: The CIP message came in a connected data item
+ * @cip_service: CIP service code (CIP_REPLY set for replies); for an
+ *               Unconnected Send request, the embedded service
+ * @routed: The request was unwrapped from an Unconnected Send
+ * @cip_status: General status of a reply (0 = success)
+ * @has_pccc: An Execute PCCC request or reply was decoded
+ * @vendor_id: Requestor ID: CIP vendor of the requesting device
+ * @serial_number: Requestor ID: serial number of the requesting device
+ * @pccc_command: PCCC CMD byte (PCCC_CMD_REPLY set for replies)
+ * @pccc_status: PCCC STS byte (0 = success)
+ * @pccc_ext_status: EXT STS byte when @pccc_status is PCCC_STS_EXTENDED
+ * @tns: PCCC transaction number
+ * @has_function: @pccc_function is present (typed requests)
+ * @pccc_function: PCCC function code (FNC)
+ * @data: Command data after the PCCC header (points into the payload)
+ * @data_length: Bytes at @data
+ */
+
+typedef struct {
+    eip_encap_header_t eip;
+    bool has_cip;
+    bool connected;
+    uint8_t cip_service;
+    bool routed;
+    uint8_t cip_status;
+    bool has_pccc;
+    uint16_t vendor_id;
+    uint32_t serial_number;
+    uint8_t pccc_command;
+    uint8_t pccc_status;
+    uint8_t pccc_ext_status;
+    uint16_t tns;
+    bool has_function;
+    uint8_t pccc_function;
+    const uint8_t *data;
+    uint32_t data_length;
+} pccc_frame_t;
+
+
+/**
+ * enum pccc_parse_error_t - Classified result of pccc_parse_frame()
+ */
+
+typedef enum {
+    PCCC_PARSE_OK,
+    PCCC_PARSE_SHORT_HEADER,    // Fewer bytes than an encapsulation header
+    PCCC_PARSE_TRUNCATED,       // Command data continues past the payload
+    PCCC_PARSE_BAD_CPF,         // Malformed common packet format items
+    PCCC_PARSE_BAD_CIP,         // CIP or PCCC message shorter than its headers
+    PCCC_PARSE_ERROR_COUNT
+} pccc_parse_error_t;
+
+
+/**
+ * enum pccc_function_class_t - What a PCCC function does to the controller
+ * @PCCC_CLASS_OTHER: Diagnostics, unknown functions
+ * @PCCC_CLASS_READ: Reads data table files
+ * @PCCC_CLASS_WRITE: Writes data table files
+ * @PCCC_CLASS_CONTROL: Changes the mode, forces, or the program itself
+ * @PCCC_CLASS_COUNT: Number of classes
+ */
+
+typedef enum {
+    PCCC_CLASS_OTHER,
+    PCCC_CLASS_READ,
+    PCCC_CLASS_WRITE,
+    PCCC_CLASS_CONTROL,
+    PCCC_CLASS_COUNT
+} pccc_function_class_t;
+
+
+/**
+ * struct pccc_analysis_stats_t - Capture-wide EtherNet/IP and PCCC counters
+ * @payloads: Payloads delivered on the port
+ * @udp_payloads: Of @payloads, those carried over UDP
+ * @messages: Encapsulation messages decoded
+ * @parse_failures: Failures per pccc_parse_error_t class
+ * @commands: Messages per encapsulation command below ENIP_COMMAND_SLOTS
+ * @other_commands: Messages with a higher (undefined) command
+ * @encap_errors: Replies with a non-zero encapsulation status
+ * @sessions_registered: Successful RegisterSession replies
+ * @cip_requests: CIP requests
+ * @cip_replies: CIP replies
+ * @cip_errors: CIP replies with a non-zero general status
+ * @cip_routed: Requests unwrapped from an Unconnected Send
+ * @cip_services: CIP requests per service code
+ * @pccc_requests: Execute PCCC requests
+ * @pccc_replies: Execute PCCC replies
+ * @pccc_errors: PCCC replies with a non-zero STS
+ * @pccc_functions: Typed PCCC requests per function code
+ * @pccc_classes: Typed PCCC requests per pccc_function_class_t
+ * @first_control_ns: Timestamp of the first control request (valid when
+ *                    @pccc_classes counts one)
+ * @first_packet_ns: Timestamp of the first payload
+ * @last_packet_ns: Timestamp of the last payload
+ */
+
+typedef struct {
+    uint64_t payloads;
+    uint64_t udp_payloads;
+    uint64_t messages;
+    uint64_t parse_failures[PCCC_PARSE_ERROR_COUNT];
+    uint64_t commands[ENIP_COMMAND_SLOTS];
+    uint64_t other_commands;
+    uint64_t encap_errors;
+    uint64_t sessions_registered;
+    uint64_t cip_requests;
+    uint64_t cip_replies;
+    uint64_t cip_errors;
+    uint64_t cip_routed;
+    uint64_t cip_services[CIP_REPLY];
+    uint64_t pccc_requests;
+    uint64_t pccc_replies;
+    uint64_t pccc_errors;
+    uint64_t pccc_functions[256];
+    uint64_t pccc_classes[PCCC_CLASS_COUNT];
+    int64_t first_control_ns;
+    int64_t first_packet_ns;
+    int64_t last_packet_ns;
+} pccc_analysis_stats_t;
+
+
+/**
+ * pccc_parse_frame() - Decode one encapsulation message
+ * @data: Bytes at the start of an encapsulation header
+ * @length: Bytes available at @data
+ * @frame: Output frame (pointers into @data)
+ * @consumed: Output bytes taken by the message (header + command data),
+ *            set even on PCCC_PARSE_BAD_CPF / PCCC_PARSE_BAD_CIP so the
+ *            next message of the segment can still be read
+ *
+ * Return: PCCC_PARSE_OK, or the class of the failure
+ */
+
+pccc_parse_error_t pccc_parse_frame(const uint8_t *data, uint32_t length, pccc_frame_t *frame,
+                                    uint32_t *consumed);
+
+
+/**
+ * pccc_init_analysis_stats() - Zero the counters
+ * @stats: Statistics
+ */
+
+void pccc_init_analysis_stats(pccc_analysis_stats_t *stats);
+
+
+/**
+ * pccc_update_analysis_stats() - Count one decoded message
+ * @stats: Statistics
+ * @frame: Message from pccc_parse_frame()
+ * @from_server: The message was sent from port PCCC_ENIP_PORT (a reply)
+ * @timestamp_ns: Capture timestamp in nanoseconds since the epoch
+ */
+
+void pccc_update_analysis_stats(pccc_analysis_stats_t *stats, const pccc_frame_t *frame,
+                                bool from_server, int64_t timestamp_ns);
+
+
+/**
+ * pccc_handle_payload() - Protocol handler for the capture reader
+ * @payload: Payload on port PCCC_ENIP_PORT
+ * @transport: TCP or UDP
+ * @user_data: pccc_analysis_stats_t to update
+ *
+ * Decodes every encapsulation message in the payload. Register with
+ * pcap_reader_add_protocol() or modbus_session_add_protocol().
+ */
+
+void pccc_handle_payload(const pcap_payload_t *payload, pcap_transport_t transport,
+                         void *user_data);
+
+
+/**
+ * pccc_classify_function() - What a typed PCCC function does
+ * @function_code: PCCC function code (FNC)
+ *
+ * Return: Class of the function
+ */
+
+pccc_function_class_t pccc_classify_function(uint8_t function_code);
+
+
+/**
+ * enip_get_command_name() - Name of an encapsulation command
+ * @command: ENIP_CMD_* value
+ *
+ * Return: Static string (never NULL)
+ */
+
+const char *enip_get_command_name(uint16_t command);
+
+
+/**
+ * cip_get_service_name() - Name of a CIP service
+ * @service: Service code (the reply bit is ignored)
+ *
+ * Return: Static string (never NULL)
+ */
+
+const char *cip_get_service_name(uint8_t service);
+
+
+/**
+ * pccc_get_function_name() - Name of a typed PCCC function
+ * @function_code: PCCC function code (FNC)
+ *
+ * Return: Static string (never NULL)
+ */
+
+const char *pccc_get_function_name(uint8_t function_code);
+
+
+/**
+ * pccc_get_parse_error_name() - Short description of a failure class
+ * @error: Failure class
+ *
+ * Return: Static string (never NULL)
+ */
+
+const char *pccc_get_parse_error_name(pccc_parse_error_t error);
+
+#endif /* PCCC_PARSER_H */
@@ -0,0 +1,665 @@
+/*
+ * poll_cycle.c - Polling-cycle detection and jitter per poll signature
+ *
+ * Implements the detector declared in poll_cycle.h.
+ *
+ * Per request:
+ * 1. Fold the signature fields into a hash and find (or claim) its slot
+ * 2. While learning, store the interval and try to lock the period
+ * 3. Otherwise classify the interval against the period: on-cycle
+ *    intervals update the Welford statistics and the jitter histogram,
+ *    off-cycle ones count missed, early or stretched polls and extend
+ *    the change run, which replaces the period once it is long enough
+ *
+ * Copyright (C) 2025 Marty
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+
+#include "poll_cycle.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "colors.h"
+
+
+/* Upper bounds of the jitter histogram bins, relative to the period */
+static const double jitter_bounds[POLL_JITTER_BINS] = { 0.01, 0.02, 0.05, 0.10, POLL_TOLERANCE };
+
+/* Signatures listed in the terminal summary */
+#define POLL_DISPLAY_ROWS 10
+
+/* Signatures listed in the report */
+#define POLL_REPORT_ROWS 50
+
+
+/**
+ * poll_detector_init() - Allocate and reset a detector
+ * @det: Detector to initialise
+ *
+ * Return: true on success, false on allocation failure (prints an error)
+ */
+
+bool poll_detector_init(poll_detector_t *det) {
+    memset(det, 0, sizeof(*det));
+
+    det->signatures = calloc(POLL_MAX_SIGNATURES, sizeof(poll_signature_t));
+    if (det->signatures == NULL) {
+        printf("Error: Memory allocation failed\n");
+        return false;
+    }
+    return true;
+}
+
+
+/*
+ * hash_signature() - Fold the signature fields into a table hash
+ *
+ * One multiply-xor step per field, so the key is never serialised.
+ */
+
+static uint32_t hash_signature(const poll_key_t *key) {
+    uint64_t h = 0x9e3779b97f4a7c15ULL;
+
+    h = (h ^ key->master) * 0xff51afd7ed558ccdULL;
+    h = (h ^ key->slave) * 0xff51afd7ed558ccdULL;
+    h = (h ^ (((uint64_t)key->address << 16) | key->quantity)) * 0xc4ceb9fe1a85ec53ULL;
+    h = (h ^ (((uint32_t)key->unit_id << 8) | key->function_code)) * 0xc4ceb9fe1a85ec53ULL;
+    return (uint32_t)(h >> 32);
+}
+
+
+/*
+ * find_signature() - Locate or claim the table slot of a signature
+ *
+ * Linear probing over at most POLL_MAX_PROBES slots. Signatures are kept
+ * for the whole capture, so a lookup stops at the first unused slot.
+ *
+ * Return: Slot pointer, or NULL if the probe window is saturated
+ */
+
+static poll_signature_t* find_signature(poll_detector_t *det, const poll_key_t *key) {
+    uint32_t mask = POLL_MAX_SIGNATURES - 1;
+    uint32_t idx = hash_signature(key) & mask;
+
+    for (uint32_t probe = 0; probe < POLL_MAX_PROBES; probe++) {
+        poll_signature_t *slot = &det->signatures[(idx + probe) & mask];
+
+        if (!slot->used) {
+            slot->used = true;
+            slot->key = *key;
+            det->signature_count++;
+            return slot;
+        }
+        if (memcmp(&slot->key, key, sizeof(*key)) == 0) {
+            return slot;
+        }
+    }
+    return NULL;
+}
+
+
+/*
+ * record_event() - Append a cycle event to the event log
+ */
+
+static void record_event(poll_detector_t *det, const poll_signature_t *sig,
+                         poll_event_kind_t kind, uint32_t missed, double new_period,
+                         int64_t timestamp_ns) {
+    if (det->event_count >= POLL_MAX_EVENTS) {
+        det->events_dropped++;
+        return;
+    }
+
+    poll_event_t *ev = &det->events[det->event_count++];
+    ev->timestamp_ns = timestamp_ns;
+    ev->key = sig->key;
+    ev->kind = kind;
+    ev->missed = missed;
+    ev->old_period = sig->period;
+    ev->new_period = new_period;
+}
+
+
+/*
+ * restart_cycle() - Start fresh on-cycle statistics for a new period
+ */
+
+static void restart_cycle(poll_signature_t *sig, double period) {
+    sig->locked = true;
+    sig->period = period;
+    sig->on_cycle = 0;
+    sig->mean = 0.0;
+    sig->m2 = 0.0;
+    sig->max_deviation = 0.0;
+    sig->run_length = 0;
+}
+
+
+/*
+ * try_lock() - Lock the period once most learned intervals agree
+ *
+ * The period is the mean of the intervals within POLL_TOLERANCE of the
+ * median of the last POLL_LEARN_INTERVALS intervals.
+ */
+
+static void try_lock(poll_signature_t *sig) {
+    float sorted[POLL_LEARN_INTERVALS];
+
+    if (sig->learn_count < POLL_LEARN_INTERVALS) {
+        return;
+    }
+
+    memcpy(sorted, sig->learn, sizeof(sorted));
+    for (int i = 1; i < POLL_LEARN_INTERVALS; i++) {
+        float v = sorted[i];
+        int j = i - 1;
+        while (j >= 0 && sorted[j] > v) {
+            sorted[j + 1] = sorted[j];
+            j--;
+        }
+        sorted[j + 1] = v;
+    }
+
+    double median = (sorted[POLL_LEARN_INTERVALS / 2 - 1] + sorted[POLL_LEARN_INTERVALS / 2]) / 2.0;
+    double sum = 0.0;
+    int agree = 0;
+    for (int i = 0; i < POLL_LEARN_INTERVALS; i++) {
+        if (fabs(sorted[i] - median) <= POLL_TOLERANCE * median) {
+            sum += sorted[i];
+            agree++;
+        }
+    }
+    if (agree >= POLL_LEARN_AGREE) {
+        restart_cycle(sig, sum / agree);
+    }
+}
+
+
+/*
+ * observe_on_cycle() - Account an interval within tolerance of the period
+ */
+
+static void observe_on_cycle(poll_signature_t *sig, double interval, double deviation) {
+    int bin = 0;
+    while (bin < POLL_JITTER_BINS - 1 && deviation > jitter_bounds[bin]) {
+        bin++;
+    }
+    sig->jitter_bins[bin]++;
+
+    // Welford: running mean and sum of squared deviations
+    sig->on_cycle++;
+    double delta = interval - sig->mean;
+    sig->mean += delta / sig->on_cycle;
+    sig->m2 += delta * (interval - sig->mean);
+
+    double absolute = fabs(interval - sig->period);
+    if (absolute > sig->max_deviation) {
+        sig->max_deviation = absolute;
+    }
+    sig->run_length = 0;
+}
+
+
+/*
+ * observe_off_cycle() - Account an interval outside the tolerance
+ *
+ * Consecutive off-cycle intervals within POLL_CHANGE_TOLERANCE of their
+ * running mean form a change run; a run of POLL_CHANGE_INTERVALS
+ * becomes the new period and its counts are taken back.
+ */
+
+static void observe_off_cycle(poll_detector_t *det, poll_signature_t *sig, double interval,
+                              double ratio, int64_t timestamp_ns) {
+    if (sig->run_length == 0 ||
+        fabs(interval - sig->run_mean) > POLL_CHANGE_TOLERANCE * sig->run_mean) {
+        sig->run_length = 0;
+        sig->run_mean = 0.0;
+        sig->run_missed = 0;
+        sig->run_early = 0;
+        sig->run_stretched = 0;
+    }
+
+    double multiple = floor(ratio + 0.5);
+    if (ratio < 1.0) {
+        sig->early++;
+        sig->run_early++;
+    } else if (multiple >= 2.0 && fabs(ratio - multiple) <= POLL_TOLERANCE) {
+        uint32_t missed = (uint32_t)fmin(multiple - 1.0, (double)UINT32_MAX);
+        sig->missed += missed;
+        sig->run_missed += missed;
+        if (missed >= POLL_GAP_EVENT_MISSED) {
+            record_event(det, sig, POLL_EVENT_GAP, missed, sig->period, timestamp_ns);
+        }
+    } else {
+        sig->stretched++;
+        sig->run_stretched++;
+    }
+
+    sig->run_length++;
+    sig->run_mean += (interval - sig->run_mean) / sig->run_length;
+
+    if (sig->run_length >= POLL_CHANGE_INTERVALS) {
+        sig->missed -= sig->run_missed;
+        sig->early -= sig->run_early;
+        sig->stretched -= sig->run_stretched;
+        sig->changes++;
+        record_event(det, sig, POLL_EVENT_CHANGE, 0, sig->run_mean, timestamp_ns);
+        restart_cycle(sig, sig->run_mean);
+    }
+}
+
+
+/**
+ * poll_detector_update() - Account one frame
+ * @det: Detector
+ * @frame: Parsed frame
+ * @is_request: true if sent to the server; responses are ignored
+ * @master: Interned source id
+ * @slave: Interned destination id
+ * @timestamp_ns: Frame timestamp (nanoseconds since epoch)
+ */
+
+void poll_detector_update(poll_detector_t *det, const modbus_tcp_frame_t *frame, bool is_request,
+                          endpoint_id_t master, endpoint_id_t slave, int64_t timestamp_ns) {
+    if (!is_request) {
+        return;
+    }
+
+    poll_key_t key = {
+        .master = master,
+        .slave = slave,
+        .unit_id = frame->mbap.unit_id,
+        .function_code = frame->function_code
+    };
+    if (!modbus_get_address_range(frame, true, &key.address, &key.quantity)) {
+        key.address = 0;
+        key.quantity = 0;
+    }
+
+    poll_signature_t *sig = find_signature(det, &key);
+    if (sig == NULL) {
+        det->requests_dropped++;
+        return;
+    }
+
+    sig->polls++;
+    if (sig->polls == 1) {
+        sig->first_seen_ns = timestamp_ns;
+        sig->last_seen_ns = timestamp_ns;
+        return;
+    }
+
+    if (timestamp_ns < sig->last_seen_ns) {
+        return;  // Out of order: keep the later request as reference
+    }
+    double interval = (double)(timestamp_ns - sig->last_seen_ns) / 1e9;
+    sig->last_seen_ns = timestamp_ns;
+
+    if (!sig->locked) {
+        if (interval > 0.0) {
+            if (sig->learn_count < POLL_LEARN_INTERVALS) {
+                sig->learn[sig->learn_count++] = (float)interval;
+            } else {
+                // Keep the latest intervals, oldest first
+                memmove(sig->learn, sig->learn + 1, sizeof(float) * (POLL_LEARN_INTERVALS - 1));
+                sig->learn[POLL_LEARN_INTERVALS - 1] = (float)interval;
+            }
+            try_lock(sig);
+        }
+        return;
+    }
+
+    double ratio = interval / sig->period;
+    double deviation = fabs(ratio - 1.0);
+    if (deviation <= POLL_TOLERANCE) {
+        observe_on_cycle(sig, interval, deviation);
+    } else {
+        observe_off_cycle(det, sig, interval, ratio, timestamp_ns);
+    }
+}
+
+
+/*
+ * jitter() - Standard deviation of the on-cycle intervals
+ */
+
+static double jitter(const poll_signature_t *sig) {
+    return sig->on_cycle > 1 ? sqrt(sig->m2 / (sig->on_cycle - 1)) : 0.0;
+}
+
+
+/*
+ * stretch() - Mean on-cycle interval relative to the period (%)
+ */
+
+static double stretch(const poll_signature_t *sig) {
+    return sig->on_cycle > 0 ? (sig->mean - sig->period) / sig->period * 100.0 : 0.0;
+}
+
+
+/*
+ * irregularities() - Off-cycle events of a signature
+ */
+
+static uint64_t irregularities(const poll_signature_t *sig) {
+    return (uint64_t)sig->missed + sig->early + sig->stretched + sig->changes;
+}
+
+
+/*
+ * compare_signature_desc() - Order by irregularities, then relative jitter
+ */
+
+static int compare_signature_desc(const void *a, const void *b) {
+    const poll_signature_t *sa = *(const poll_signature_t *const *)a;
+    const poll_signature_t *sb = *(const poll_signature_t *const *)b;
+    uint64_t ia = irregularities(sa);
+    uint64_t ib = irregularities(sb);
+
+    if (ia != ib) {
+        return ia < ib ? 1 : -1;
+    }
+    double ja = jitter(sa) / sa->period;
+    double jb = jitter(sb) / sb->period;
+    return (ja < jb) - (ja > jb);
+}
+
+
+/*
+ * collect_periodic() - Locked signatures, least regular first
+ *
+ * Return: Array of *count entries to free(), or NULL if none or on
+ *         allocation failure
+ */
+
+static const poll_signature_t** collect_periodic(const poll_detector_t *det, uint32_t *count) {
+    const poll_signature_t **out;
+
+    *count = 0;
+    out = malloc(sizeof(*out) * (det->signature_count + 1));
+    if (out == NULL) {
+        return NULL;
+    }
+    for (uint32_t i = 0; i < POLL_MAX_SIGNATURES; i++) {
+        if (det->signatures[i].used && det->signatures[i].locked) {
+            out[(*count)++] = &det->signatures[i];
+        }
+    }
+    if (*count == 0) {
+        free(out);
+        return NULL;
+    }
+    qsort(out, *count, sizeof(*out), compare_signature_desc);
+    return out;
+}
+
+
+/*
+ * jitter_totals() - On-cycle intervals per jitter bin over all signatures
+ *
+ * Return: Total on-cycle intervals
+ */
+
+static uint64_t jitter_totals(const poll_detector_t *det, uint64_t totals[POLL_JITTER_BINS]) {
+    uint64_t all = 0;
+
+    memset(totals, 0, sizeof(uint64_t) * POLL_JITTER_BINS);
+    for (uint32_t i = 0; i < POLL_MAX_SIGNATURES; i++) {
+        for (int b = 0; b < POLL_JITTER_BINS; b++) {
+            totals[b] += det->signatures[i].jitter_bins[b];
+            all += det->signatures[i].jitter_bins[b];
+        }
+    }
+    return all;
+}
+
+
+/*
+ * format_block() - Address/quantity of a signature ("-" if none)
+ */
+
+static void format_block(const poll_key_t *key, char *buf, size_t len) {
+    if (key->quantity == 0) {
+        snprintf(buf, len, "-");
+    } else {
+        snprintf(buf, len, "%u/%u", key->address, key->quantity);
+    }
+}
+
+
+/*
+ * format_time() - Format timestamp as HH:MM:SS.microseconds
+ */
+
+static void format_time(int64_t timestamp_ns, char *buf, size_t len) {
+    time_t sec = (time_t)(timestamp_ns / 1000000000);
+    struct tm *tm_info = localtime(&sec);
+    int microsec = (int)(timestamp_ns % 1000000000 / 1000);
+    snprintf(buf, len, "%02d:%02d:%02d.%06d",
+             tm_info->tm_hour, tm_info->tm_min, tm_info->tm_sec, microsec);
+}
+
+
+/**
+ * poll_display_summary() - Print the least regular poll cycles
+ * @det: Detector
+ * @session: Session the endpoint ids belong to
+ */
+
+void poll_display_summary(const poll_detector_t *det, modbus_session_t *session) {
+    uint32_t n;
+    const poll_signature_t **rows = collect_periodic(det, &n);
+    uint64_t totals[POLL_JITTER_BINS];
+    uint64_t on_cycle = jitter_totals(det, totals);
+
+    printf("\n%sPolling Cycles (per master, slave, unit, function, block):%s\n",
+           COLOR_WHITE, COLOR_RESET);
+    printf("  Signatures:          %u (%u periodic)\n", det->signature_count, n);
+    if (det->requests_dropped > 0) {
+        printf("  %s[!] Signature table saturated%s - %u requests not tracked\n",
+               COLOR_YELLOW, COLOR_RESET, det->requests_dropped);
+    }
+    if (rows == NULL) {
+        printf("  No periodic polls found\n");
+        return;
+    }
+    printf("  On-cycle polls:      %.1f%% within 1%%, %.1f%% within 5%% of the period\n",
+           (double)totals[0] * 100.0 / on_cycle,
+           (double)(totals[0] + totals[1] + totals[2]) * 100.0 / on_cycle);
+
+    printf("  %s%-16s %-16s %4s %-4s %-11s %9s %8s %8s %6s %6s %5s %4s%s\n", COLOR_WHITE,
+           "Master", "Slave", "Unit", "FC", "Block", "Period", "Jitter", "Stretch",
+           "Missed", "Long", "Early", "Chg", COLOR_RESET);
+    for (uint32_t i = 0; i < n && i < POLL_DISPLAY_ROWS; i++) {
+        const poll_signature_t *sig = rows[i];
+        char block[16];
+        format_block(&sig->key, block, sizeof(block));
+        printf("  %s%-16s %-16s%s %s%4u%s %s0x%02X%s %s%-11s%s %8.3fs %7.2f%% %+7.2f%% "
+               "%6u %6u %5u %4u\n",
+               COLOR_CYAN, modbus_session_endpoint_name(session, sig->key.master),
+               modbus_session_endpoint_name(session, sig->key.slave), COLOR_RESET,
+               COLOR_GREEN, sig->key.unit_id, COLOR_RESET,
+               COLOR_MAGENTA, sig->key.function_code, COLOR_RESET,
+               COLOR_BLUE, block, COLOR_RESET,
+               sig->period, jitter(sig) / sig->period * 100.0, stretch(sig),
+               sig->missed, sig->stretched, sig->early, sig->changes);
+    }
+    if (n > POLL_DISPLAY_ROWS) {
+        printf("  ... %u more periodic signatures\n", n - POLL_DISPLAY_ROWS);
+    }
+    free(rows);
+
+    uint32_t changes = 0, gaps = 0;
+    for (uint32_t i = 0; i < det->event_count; i++) {
+        if (det->events[i].kind == POLL_EVENT_CHANGE) {
+            changes++;
+        } else {
+            gaps++;
+        }
+    }
+    if (det->event_count == 0) {
+        printf("  %s[✓] No period changes or gaps%s\n", COLOR_GREEN, COLOR_RESET);
+    } else {
+        printf("  %s[!] %u period changes, %u gaps of %d+ polls%s%s\n",
+               COLOR_YELLOW, changes, gaps, POLL_GAP_EVENT_MISSED,
+               det->events_dropped > 0 ? " (log full)" : "", COLOR_RESET);
+    }
+}
+
+
+/**
+ * poll_write_report() - Append poll cycle section to markdown report
+ * @det: Detector
+ * @session: Session the endpoint ids belong to
+ * @f: Open report file (no-op if NULL)
+ */
+
+void poll_write_report(const poll_detector_t *det, modbus_session_t *session, FILE *f) {
+    if (!f) return;
+
+    uint32_t n;
+    const poll_signature_t **rows = collect_periodic(det, &n);
+    uint64_t totals[POLL_JITTER_BINS];
+    uint64_t on_cycle = jitter_totals(det, totals);
+
+    fprintf(f, "\n### Polling Cycles\n\n");
+    fprintf(f, "- **Poll signatures:** %u (%u periodic)\n", det->signature_count, n);
+    if (det->requests_dropped > 0) {
+        fprintf(f, "- **Requests not tracked (table full):** %u\n", det->requests_dropped);
+    }
+    if (rows == NULL) {
+        fprintf(f, "- No periodic polls found\n");
+        return;
+    }
+    fprintf(f, "- **On-cycle intervals:** %llu\n\n", (unsigned long long)on_cycle);
+
+    fprintf(f, "| Deviation from period | Intervals | Share |\n");
+    fprintf(f, "|-----------------------|-----------|-------|\n");
+    for (int b = 0; b < POLL_JITTER_BINS; b++) {
+        fprintf(f, "| ≤ %.0f%% | %llu | %.1f%% |\n", jitter_bounds[b] * 100.0,
+                (unsigned long long)totals[b], (double)totals[b] * 100.0 / on_cycle);
+    }
+
+    fprintf(f, "\n| Master | Slave | Unit | Function | Block | Period (s) | Jitter | Max Dev. | "
+               "Stretch | Missed | Long | Early | Changes |\n");
+    fprintf(f, "|--------|-------|------|----------|-------|------------|--------|----------|"
+               "---------|--------|------|-------|---------|\n");
+    for (uint32_t i = 0; i < n && i < POLL_REPORT_ROWS; i++) {
+        const poll_signature_t *sig = rows[i];
+        char block[16];
+        format_block(&sig->key, block, sizeof(block));
+        fprintf(f, "| %s | %s | %u | 0x%02X | %s | %.3f | %.2f%% | %.1f ms | %+.2f%% | "
+                   "%u | %u | %u | %u |\n",
+                modbus_session_endpoint_name(session, sig->key.master),
+                modbus_session_endpoint_name(session, sig->key.slave),
+                sig->key.unit_id, sig->key.function_code, block, sig->period,
+                jitter(sig) / sig->period * 100.0, sig->max_deviation * 1000.0, stretch(sig),
+                sig->missed, sig->stretched, sig->early, sig->changes);
+    }
+    if (n > POLL_REPORT_ROWS) {
+        fprintf(f, "\n*%u more periodic signatures*\n", n - POLL_REPORT_ROWS);
+    }
+    free(rows);
+
+    if (det->event_count == 0) {
+        fprintf(f, "\n- ✅ No period changes or gaps\n");
+        return;
+    }
+
+    fprintf(f, "\n| Timestamp | Master | Slave | Unit | Function | Block | Event |\n");
+    fprintf(f, "|-----------|--------|-------|------|----------|-------|-------|\n");
+    for (uint32_t i = 0; i < det->event_count; i++) {
+        const poll_event_t *ev = &det->events[i];
+        char time_str[20];
+        char block[16];
+        format_time(ev->timestamp_ns, time_str, sizeof(time_str));
+        format_block(&ev->key, block, sizeof(block));
+        fprintf(f, "| %s | %s | %s | %u | 0x%02X | %s | ", time_str,
+                modbus_session_endpoint_name(session, ev->key.master),
+                modbus_session_endpoint_name(session, ev->key.slave),
+                ev->key.unit_id, ev->key.function_code, block);
+        if (ev->kind == POLL_EVENT_CHANGE) {
+            fprintf(f, "period %.3f s → %.3f s |\n", ev->old_period, ev->new_period);
+        } else {
+            fprintf(f, "⚠️ %u polls missed (period %.3f s) |\n", ev->missed, ev->old_period);
+        }
+    }
+    if (det->events_dropped > 0) {
+        fprintf(f, "\n*%u further events not logged*\n", det->events_dropped);
+    }
+}
+
+
+/**
+ * poll_detector_save() - Write detector state to a checkpoint
+ * @det: Detector
+ * @f: Open binary file
+ *
+ * Layout: the detector struct, then (slot index, poll_signature_t) per
+ * occupied slot; signature_count gives the number of slots.
+ *
+ * Return: false on write error
+ */
+
+bool poll_detector_save(const poll_detector_t *det, FILE *f) {
+    poll_detector_t head = *det;
+
+    head.signatures = NULL;
+    if (fwrite(&head, sizeof(head), 1, f) != 1) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < POLL_MAX_SIGNATURES; i++) {
+        if (!det->signatures[i].used) continue;
+        if (fwrite(&i, sizeof(i), 1, f) != 1 ||
+            fwrite(&det->signatures[i], sizeof(poll_signature_t), 1, f) != 1) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/**
+ * poll_detector_restore() - Load state written by poll_detector_save()
+ * @det: Detector from poll_detector_init()
+ * @f: Open binary file
+ *
+ * Return: false on a short or inconsistent checkpoint
+ */
+
+bool poll_detector_restore(poll_detector_t *det, FILE *f) {
+    poll_signature_t *signatures = det->signatures;
+
+    if (fread(det, sizeof(*det), 1, f) != 1) {
+        det->signatures = signatures;
+        return false;
+    }
+    det->signatures = signatures;
+    memset(signatures, 0, POLL_MAX_SIGNATURES * sizeof(poll_signature_t));
+    if (det->signature_count > POLL_MAX_SIGNATURES || det->event_count > POLL_MAX_EVENTS) {
+        return false;
+    }
+
+    for (uint32_t n = 0; n < det->signature_count; n++) {
+        uint32_t i;
+        if (fread(&i, sizeof(i), 1, f) != 1 || i >= POLL_MAX_SIGNATURES ||
+            fread(&signatures[i], sizeof(poll_signature_t), 1, f) != 1) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/**
+ * poll_detector_free() - Release the signature table
+ * @det: Detector
+ */
+
+void poll_detector_free(poll_detector_t *det) {
+    free(det->signatures);
+    det->signatures = NULL;
+}
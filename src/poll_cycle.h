@@ -0,0 +1,278 @@
+/*
+ * poll_cycle.h - Polling-cycle detection and jitter per poll signature
+ *
+ * SCADA masters repeat the same request (same slave, unit, function,
+ * address and quantity) on a fixed cycle. A stretched cycle is the
+ * earliest sign of an overloaded master or PLC, but the capture-wide
+ * burst counter in attack_stats_t cannot see it. This detector keys
+ * every request by its poll signature and keeps online inter-arrival
+ * statistics for it:
+ *
+ * - Learning: the first POLL_LEARN_INTERVALS intervals are kept; once
+ *   most of them agree with their median the nominal period is locked.
+ * - On-cycle intervals (within POLL_TOLERANCE of the period) update a
+ *   Welford mean/variance (jitter, stretch) and a small histogram of the
+ *   relative deviation.
+ * - An interval close to k periods counts k - 1 missed polls; shorter
+ *   ones are early polls, longer ones stretched cycles.
+ * - POLL_CHANGE_INTERVALS consecutive off-cycle intervals that agree
+ *   with each other are a period change: the new period replaces the
+ *   nominal one and the run's missed/early/stretched counts are undone.
+ *
+ * Signatures live in a fixed open-addressed table keyed by a hash that
+ * is folded field by field from the interned endpoint ids and request
+ * fields, so per-request cost is constant.
+ *
+ * Copyright (C) 2025 Marty
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef POLL_CYCLE_H
+#define POLL_CYCLE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "modbus_parser.h"
+#include "endpoint.h"
+#include "modbus_session.h"
+
+
+/* Signature table capacity (power of two) */
+#define POLL_MAX_SIGNATURES 4096
+
+/* Maximum probes before a new signature is dropped */
+#define POLL_MAX_PROBES 16
+
+/* Intervals kept while learning the period */
+#define POLL_LEARN_INTERVALS 8
+
+/* Learned intervals that must agree with their median to lock */
+#define POLL_LEARN_AGREE 6
+
+/* Relative deviation from the period still counted as on-cycle */
+#define POLL_TOLERANCE 0.25
+
+/* Consecutive consistent off-cycle intervals that make a period change */
+#define POLL_CHANGE_INTERVALS 5
+
+/* Relative spread allowed between the intervals of a change run */
+#define POLL_CHANGE_TOLERANCE 0.10
+
+/* Missed polls in one gap that are logged as an event */
+#define POLL_GAP_EVENT_MISSED 3
+
+/* Bins of the relative deviation histogram (last bin up to POLL_TOLERANCE) */
+#define POLL_JITTER_BINS 5
+
+/* Maximum events kept in the event log */
+#define POLL_MAX_EVENTS 256
+
+
+/**
+ * struct poll_key_t - Poll signature
+ * @master: Interned id of the requesting endpoint
+ * @slave: Interned id of the server endpoint
+ * @address: Start address (0 if the function has none)
+ * @quantity: Coils/registers (0 if the function has none)
+ * @unit_id: MBAP unit id
+ * @function_code: Request function code
+ * @reserved: Zero
+ */
+
+typedef struct {
+    endpoint_id_t master;
+    endpoint_id_t slave;
+    uint16_t address;
+    uint16_t quantity;
+    uint8_t unit_id;
+    uint8_t function_code;
+    uint16_t reserved;
+} poll_key_t;
+
+
+/**
+ * struct poll_signature_t - Inter-arrival statistics of one signature
+ * @key: Poll signature
+ * @used: Slot holds a signature
+ * @locked: @period has been learned
+ * @learn_count: Entries in @learn
+ * @run_length: Off-cycle intervals in the current change run
+ * @polls: Requests seen
+ * @missed: Polls missing from gaps of several periods
+ * @early: Intervals shorter than the period
+ * @stretched: Intervals longer than the period, not a whole multiple
+ * @changes: Period changes
+ * @run_missed: @missed added by the current change run
+ * @run_early: @early added by the current change run
+ * @run_stretched: @stretched added by the current change run
+ * @jitter_bins: On-cycle intervals by relative deviation (see poll_cycle.c)
+ * @learn: Latest intervals seen before locking, oldest first
+ * @first_seen_ns: Timestamp of the first request (ns)
+ * @last_seen_ns: Timestamp of the latest request (ns)
+ * @period: Nominal period in seconds
+ * @on_cycle: On-cycle intervals since the period was (re)locked
+ * @mean: Welford mean of the on-cycle intervals
+ * @m2: Welford sum of squared deviations
+ * @max_deviation: Largest |interval - period| of an on-cycle interval
+ * @run_mean: Mean interval of the current change run
+ */
+
+typedef struct {
+    poll_key_t key;
+    bool used;
+    bool locked;
+    uint8_t learn_count;
+    uint8_t run_length;
+    uint32_t polls;
+    uint32_t missed;
+    uint32_t early;
+    uint32_t stretched;
+    uint32_t changes;
+    uint32_t run_missed;
+    uint16_t run_early;
+    uint16_t run_stretched;
+    uint32_t jitter_bins[POLL_JITTER_BINS];
+    float learn[POLL_LEARN_INTERVALS];
+    int64_t first_seen_ns;
+    int64_t last_seen_ns;
+    double period;
+    uint32_t on_cycle;
+    double mean;
+    double m2;
+    double max_deviation;
+    double run_mean;
+} poll_signature_t;
+
+
+/**
+ * enum poll_event_kind_t - Logged cycle events
+ * @POLL_EVENT_CHANGE: Nominal period changed
+ * @POLL_EVENT_GAP: At least POLL_GAP_EVENT_MISSED polls missing in one gap
+ */
+
+typedef enum {
+    POLL_EVENT_CHANGE,
+    POLL_EVENT_GAP
+} poll_event_kind_t;
+
+
+/**
+ * struct poll_event_t - One cycle event
+ * @timestamp_ns: Request that completed the change or ended the gap (ns)
+ * @key: Signature
+ * @kind: Event kind
+ * @missed: Polls missing in the gap (POLL_EVENT_GAP)
+ * @old_period: Period before the event
+ * @new_period: Period after the event (POLL_EVENT_CHANGE)
+ */
+
+typedef struct {
+    int64_t timestamp_ns;
+    poll_key_t key;
+    poll_event_kind_t kind;
+    uint32_t missed;
+    double old_period;
+    double new_period;
+} poll_event_t;
+
+
+/**
+ * struct poll_detector_t - Detector state
+ * @signatures: Open-addressed signature table (POLL_MAX_SIGNATURES entries)
+ * @signature_count: Occupied slots
+ * @requests_dropped: Requests ignored because the table was saturated
+ * @events: Event log
+ * @event_count: Entries used in @events
+ * @events_dropped: Events not logged because @events was full
+ */
+
+typedef struct {
+    poll_signature_t *signatures;
+    uint32_t signature_count;
+    uint32_t requests_dropped;
+    poll_event_t events[POLL_MAX_EVENTS];
+    uint32_t event_count;
+    uint32_t events_dropped;
+} poll_detector_t;
+
+
+/**
+ * poll_detector_init() - Allocate and reset a detector
+ * @det: Detector to initialise
+ *
+ * Return: true on success, false on allocation failure (prints an error)
+ */
+
+bool poll_detector_init(poll_detector_t *det);
+
+
+/**
+ * poll_detector_update() - Account one frame
+ * @det: Detector
+ * @frame: Parsed frame
+ * @is_request: true if sent to the server; responses are ignored
+ * @master: Interned source id
+ * @slave: Interned destination id
+ * @timestamp_ns: Frame timestamp (nanoseconds since epoch)
+ *
+ * Intervals are taken between integer timestamps and only then turned
+ * into seconds, so nanosecond captures keep their resolution. Runs in
+ * constant time.
+ */
+
+void poll_detector_update(poll_detector_t *det, const modbus_tcp_frame_t *frame, bool is_request,
+                          endpoint_id_t master, endpoint_id_t slave, int64_t timestamp_ns);
+
+
+/**
+ * poll_display_summary() - Print the least regular poll cycles
+ * @det: Detector
+ * @session: Session the endpoint ids belong to
+ */
+
+void poll_display_summary(const poll_detector_t *det, modbus_session_t *session);
+
+
+/**
+ * poll_write_report() - Append poll cycle section to markdown report
+ * @det: Detector
+ * @session: Session the endpoint ids belong to
+ * @f: Open report file (no-op if NULL)
+ */
+
+void poll_write_report(const poll_detector_t *det, modbus_session_t *session, FILE *f);
+
+
+/**
+ * poll_detector_save() - Write detector state to a checkpoint
+ * @det: Detector
+ * @f: Open binary file
+ *
+ * Only occupied signature slots are written.
+ *
+ * Return: false on write error
+ */
+
+bool poll_detector_save(const poll_detector_t *det, FILE *f);
+
+
+/**
+ * poll_detector_restore() - Load state written by poll_detector_save()
+ * @det: Detector from poll_detector_init()
+ * @f: Open binary file
+ *
+ * Return: false on a short or inconsistent checkpoint
+ */
+
+bool poll_detector_restore(poll_detector_t *det, FILE *f);
+
+
+/**
+ * poll_detector_free() - Release the signature table
+ * @det: Detector
+ */
+
+void poll_detector_free(poll_detector_t *det);
+
+#endif /* POLL_CYCLE_H */
@@ -0,0 +1,874 @@
+/*
+ * rule_engine.c - Compiled site-specific detection rules
+ *
+ * Loading happens in two passes:
+ * 1. Parse every line into a temporary rule_spec_t (values, ranges,
+ *    prefixes), counting rules so bitset width is known
+ * 2. Compile: set each rule's bit in the value tables, build the
+ *    interval tree over address ranges and insert prefixes into the tries
+ *
+ * Matching ANDs the per-dimension bitsets into scratch space and walks
+ * the result to collect rule IDs.
+ *
+ * Copyright (C) 2025 Marty
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+
+#include "rule_engine.h"
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "colors.h"
+
+#ifdef _WIN32
+    #include <winsock2.h>
+    #include <ws2tcpip.h>  // Windows: inet_pton
+#else
+    #include <arpa/inet.h>  // *nix: inet_pton, ntohl
+#endif
+
+
+/* Longest accepted rule line */
+#define RULE_LINE_MAX 1024
+
+/* Maximum values/ranges/prefixes per dimension of one rule */
+#define RULE_MAX_TERMS 32
+
+
+/*
+ * struct rule_range - Inclusive value range while parsing
+ */
+
+typedef struct {
+    uint32_t lo;
+    uint32_t hi;
+} rule_range_t;
+
+
+/*
+ * struct rule_prefix - IPv4 prefix while parsing
+ */
+
+typedef struct {
+    uint32_t addr;
+    uint8_t len;
+} rule_prefix_t;
+
+
+/*
+ * struct rule_spec - One parsed, not yet compiled rule
+ */
+
+typedef struct {
+    uint32_t id;
+    char msg[RULE_MSG_LEN];
+    rule_direction_t dir;
+    rule_range_t fc[RULE_MAX_TERMS];
+    uint32_t fc_count;
+    rule_range_t unit[RULE_MAX_TERMS];
+    uint32_t unit_count;
+    rule_range_t addr[RULE_MAX_TERMS];
+    uint32_t addr_count;
+    rule_prefix_t src[RULE_MAX_TERMS];
+    uint32_t src_count;
+    bool src_negated;
+    rule_prefix_t dst[RULE_MAX_TERMS];
+    uint32_t dst_count;
+    bool dst_negated;
+} rule_spec_t;
+
+
+/*
+ * bit_set() - Set bit @i in a bitset
+ */
+
+static inline void bit_set(uint64_t *set, uint32_t i) {
+    set[i >> 6] |= 1ULL << (i & 63);
+}
+
+
+/*
+ * parse_number() - Parse a decimal or 0x-prefixed number
+ *
+ * Return: true if the whole token was consumed
+ */
+
+static bool parse_number(const char *s, const char **end, uint32_t *out) {
+    char *e;
+    unsigned long v = strtoul(s, &e, 0);
+    if (e == s) {
+        return false;
+    }
+    *out = (uint32_t)v;
+    *end = e;
+    return true;
+}
+
+
+/*
+ * parse_ranges() - Parse "v,lo-hi,..." into ranges bounded by @max_value
+ *
+ * Return: Number of ranges, or -1 on syntax error
+ */
+
+static int parse_ranges(const char *s, rule_range_t *out, uint32_t max_value) {
+    int n = 0;
+
+    while (*s) {
+        const char *e;
+        uint32_t lo, hi;
+
+        if (n >= RULE_MAX_TERMS || !parse_number(s, &e, &lo)) {
+            return -1;
+        }
+        hi = lo;
+        if (*e == '-') {
+            if (!parse_number(e + 1, &e, &hi)) {
+                return -1;
+            }
+        }
+        if (lo > hi || hi > max_value) {
+            return -1;
+        }
+        out[n].lo = lo;
+        out[n].hi = hi;
+        n++;
+
+        if (*e == ',') {
+            e++;
+        } else if (*e != '\0') {
+            return -1;
+        }
+        s = e;
+    }
+    return n;
+}
+
+
+/*
+ * parse_prefixes() - Parse "[!]a.b.c.d[/len],..." into prefixes
+ *
+ * Return: Number of prefixes, or -1 on syntax error
+ */
+
+static int parse_prefixes(const char *s, rule_prefix_t *out, bool *negated) {
+    char buf[64];
+    int n = 0;
+
+    *negated = (*s == '!');
+    if (*negated) {
+        s++;
+    }
+
+    while (*s) {
+        const char *comma = strchr(s, ',');
+        size_t len = comma ? (size_t)(comma - s) : strlen(s);
+        if (len == 0 || len >= sizeof(buf) || n >= RULE_MAX_TERMS) {
+            return -1;
+        }
+        memcpy(buf, s, len);
+        buf[len] = '\0';
+
+        uint32_t prefix_len = 32;
+        char *slash = strchr(buf, '/');
+        if (slash) {
+            *slash = '\0';
+            const char *e;
+            if (!parse_number(slash + 1, &e, &prefix_len) || *e != '\0' || prefix_len > 32) {
+                return -1;
+            }
+        }
+
+        struct in_addr in;
+        if (inet_pton(AF_INET, buf, &in) != 1) {
+            return -1;
+        }
+        out[n].addr = ntohl(in.s_addr);
+        out[n].len = (uint8_t)prefix_len;
+        if (prefix_len < 32) {
+            out[n].addr &= prefix_len ? ~0u << (32 - prefix_len) : 0;
+        }
+        n++;
+
+        s += len;
+        if (*s == ',') {
+            s++;
+        }
+    }
+    return n;
+}
+
+
+/*
+ * next_token() - Split the next whitespace-delimited token
+ *
+ * Quoted values (key="a b") are kept in one token; quotes are removed.
+ *
+ * Return: Token start, or NULL at end of line
+ */
+
+static char* next_token(char **cursor) {
+    char *p = *cursor;
+
+    while (*p && isspace((unsigned char)*p)) p++;
+    if (*p == '\0' || *p == '#') {
+        return NULL;
+    }
+
+    char *start = p;
+    char *out = p;
+    bool quoted = false;
+
+    while (*p && (quoted || !isspace((unsigned char)*p))) {
+        if (*p == '"') {
+            quoted = !quoted;
+            p++;
+            continue;
+        }
+        *out++ = *p++;
+    }
+    if (*p) p++;
+    *out = '\0';
+    *cursor = p;
+    return start;
+}
+
+
+/*
+ * parse_rule_line() - Parse one non-empty rule line
+ *
+ * Return: 1 if a rule was parsed, 0 for blank/comment, -1 on error
+ */
+
+static int parse_rule_line(char *line, rule_spec_t *spec) {
+    char *cursor = line;
+    char *tok = next_token(&cursor);
+    int n;
+
+    if (tok == NULL) {
+        return 0;
+    }
+    if (strcmp(tok, "rule") != 0) {
+        return -1;
+    }
+
+    memset(spec, 0, sizeof(*spec));
+    spec->dir = RULE_DIR_REQUEST;
+
+    tok = next_token(&cursor);
+    const char *e;
+    if (tok == NULL || !parse_number(tok, &e, &spec->id) || *e != '\0') {
+        return -1;
+    }
+
+    while ((tok = next_token(&cursor)) != NULL) {
+        char *eq = strchr(tok, '=');
+        if (eq == NULL) {
+            return -1;
+        }
+        *eq = '\0';
+        const char *key = tok;
+        const char *value = eq + 1;
+
+        if (strcmp(key, "fc") == 0) {
+            if ((n = parse_ranges(value, spec->fc, 0xFF)) < 0) return -1;
+            spec->fc_count = (uint32_t)n;
+        } else if (strcmp(key, "unit") == 0) {
+            if ((n = parse_ranges(value, spec->unit, 0xFF)) < 0) return -1;
+            spec->unit_count = (uint32_t)n;
+        } else if (strcmp(key, "addr") == 0) {
+            if ((n = parse_ranges(value, spec->addr, 0xFFFF)) < 0) return -1;
+            spec->addr_count = (uint32_t)n;
+        } else if (strcmp(key, "src") == 0) {
+            if ((n = parse_prefixes(value, spec->src, &spec->src_negated)) < 0) return -1;
+            spec->src_count = (uint32_t)n;
+        } else if (strcmp(key, "dst") == 0) {
+            if ((n = parse_prefixes(value, spec->dst, &spec->dst_negated)) < 0) return -1;
+            spec->dst_count = (uint32_t)n;
+        } else if (strcmp(key, "dir") == 0) {
+            if (strcmp(value, "request") == 0) spec->dir = RULE_DIR_REQUEST;
+            else if (strcmp(value, "response") == 0) spec->dir = RULE_DIR_RESPONSE;
+            else if (strcmp(value, "any") == 0) spec->dir = RULE_DIR_ANY;
+            else return -1;
+        } else if (strcmp(key, "msg") == 0) {
+            strncpy(spec->msg, value, RULE_MSG_LEN - 1);
+        } else {
+            return -1;
+        }
+    }
+    return 1;
+}
+
+
+/*
+ * trie_init() - Allocate a trie with a root node
+ */
+
+static bool trie_init(rule_trie_t *t, uint32_t words) {
+    memset(t, 0, sizeof(*t));
+    t->node_capacity = 64;
+    t->child = calloc(t->node_capacity, sizeof(*t->child));
+    t->bits = malloc(t->node_capacity * sizeof(int32_t));
+    t->negated = calloc(words, sizeof(uint64_t));
+    t->unconstrained = calloc(words, sizeof(uint64_t));
+    if (!t->child || !t->bits || !t->negated || !t->unconstrained) {
+        return false;
+    }
+    t->bits[0] = -1;
+    t->node_count = 1;
+    return true;
+}
+
+
+/*
+ * trie_insert() - Mark @rule on the node for @prefix
+ */
+
+static bool trie_insert(rule_trie_t *t, uint32_t words, const rule_prefix_t *prefix,
+                        uint32_t rule) {
+    uint32_t node = 0;
+
+    for (uint8_t depth = 0; depth < prefix->len; depth++) {
+        uint32_t bit = (prefix->addr >> (31 - depth)) & 1;
+        if (t->child[node][bit] == 0) {
+            if (t->node_count == t->node_capacity) {
+                uint32_t cap = t->node_capacity * 2;
+                void *c = realloc(t->child, cap * sizeof(*t->child));
+                if (!c) return false;
+                t->child = c;
+                void *b = realloc(t->bits, cap * sizeof(int32_t));
+                if (!b) return false;
+                t->bits = b;
+                t->node_capacity = cap;
+            }
+            uint32_t n = t->node_count++;
+            t->child[n][0] = t->child[n][1] = 0;
+            t->bits[n] = -1;
+            t->child[node][bit] = n;
+        }
+        node = t->child[node][bit];
+    }
+
+    if (t->bits[node] < 0) {
+        void *p = realloc(t->pool, ((size_t)t->pool_count + 1) * words * sizeof(uint64_t));
+        if (!p) return false;
+        t->pool = p;
+        memset(&t->pool[(size_t)t->pool_count * words], 0, words * sizeof(uint64_t));
+        t->bits[node] = (int32_t)t->pool_count++;
+    }
+    bit_set(&t->pool[(size_t)t->bits[node] * words], rule);
+    return true;
+}
+
+
+/*
+ * trie_lookup() - OR of every prefix bitset on the path to @ep, with
+ * negated rules inverted. Result written to @out.
+ */
+
+static void trie_lookup(const rule_trie_t *t, uint32_t words, const endpoint_t *ep,
+                        uint64_t *out) {
+    uint32_t addr = endpoint_ipv4(ep);
+    uint32_t node = 0;
+
+    if (ep->family != ENDPOINT_IPV4) {
+        // Outside every (IPv4) prefix
+        for (uint32_t w = 0; w < words; w++) {
+            out[w] = t->unconstrained[w] | t->negated[w];
+        }
+        return;
+    }
+
+    memset(out, 0, words * sizeof(uint64_t));
+    for (uint32_t depth = 0; ; depth++) {
+        if (t->bits[node] >= 0) {
+            const uint64_t *set = &t->pool[(size_t)t->bits[node] * words];
+            for (uint32_t w = 0; w < words; w++) out[w] |= set[w];
+        }
+        if (depth == 32) break;
+        uint32_t next = t->child[node][(addr >> (31 - depth)) & 1];
+        if (next == 0) break;
+        node = next;
+    }
+
+    for (uint32_t w = 0; w < words; w++) {
+        out[w] ^= t->negated[w];
+    }
+}
+
+
+/*
+ * trie_free() - Release trie storage
+ */
+
+static void trie_free(rule_trie_t *t) {
+    free(t->child);
+    free(t->bits);
+    free(t->pool);
+    free(t->negated);
+    free(t->unconstrained);
+    memset(t, 0, sizeof(*t));
+}
+
+
+/*
+ * compile_prefixes() - Insert a rule's prefixes (or /0 if none)
+ */
+
+static bool compile_prefixes(rule_trie_t *t, uint32_t words, const rule_prefix_t *prefixes,
+                             uint32_t count, bool negated, uint32_t rule) {
+    static const rule_prefix_t any = { 0, 0 };
+
+    if (count == 0) {
+        bit_set(t->unconstrained, rule);
+        return trie_insert(t, words, &any, rule);
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        if (!trie_insert(t, words, &prefixes[i], rule)) {
+            return false;
+        }
+    }
+    if (negated) {
+        bit_set(t->negated, rule);
+    }
+    return true;
+}
+
+
+/*
+ * compare_interval() - qsort comparator by start address
+ */
+
+static int compare_interval(const void *a, const void *b) {
+    const rule_interval_t *x = a;
+    const rule_interval_t *y = b;
+    return (int)x->lo - (int)y->lo;
+}
+
+
+/*
+ * build_interval_max() - Fill max-hi of the implicit subtree [lo, hi)
+ */
+
+static uint16_t build_interval_max(rule_engine_t *eng, uint32_t lo, uint32_t hi) {
+    if (lo >= hi) {
+        return 0;
+    }
+    uint32_t mid = lo + (hi - lo) / 2;
+    uint16_t m = eng->intervals[mid].hi;
+    uint16_t l = build_interval_max(eng, lo, mid);
+    uint16_t r = build_interval_max(eng, mid + 1, hi);
+    if (lo < mid && l > m) m = l;
+    if (mid + 1 < hi && r > m) m = r;
+    eng->interval_max[mid] = m;
+    return m;
+}
+
+
+/*
+ * query_intervals() - Set bits of rules whose range overlaps [a, b]
+ */
+
+static void query_intervals(const rule_engine_t *eng, uint32_t lo, uint32_t hi,
+                            uint16_t a, uint16_t b, uint64_t *out) {
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (eng->interval_max[mid] < a) {
+            return;  // Nothing in this subtree reaches a
+        }
+        query_intervals(eng, lo, mid, a, b, out);
+        if (eng->intervals[mid].lo > b) {
+            return;  // Everything to the right starts after b
+        }
+        if (eng->intervals[mid].hi >= a) {
+            bit_set(out, eng->intervals[mid].rule);
+        }
+        lo = mid + 1;
+    }
+}
+
+
+/*
+ * compile_rules() - Build all lookup structures from parsed specs
+ */
+
+static bool compile_rules(rule_engine_t *eng, const rule_spec_t *specs, uint32_t count) {
+    uint32_t words = (count + 63) / 64;
+    if (words == 0) words = 1;
+    eng->words = words;
+    eng->rule_count = count;
+
+    uint32_t interval_total = 0;
+    for (uint32_t r = 0; r < count; r++) {
+        interval_total += specs[r].addr_count;
+    }
+
+    eng->rules = calloc(count ? count : 1, sizeof(rule_t));
+    eng->fc_bits = calloc((size_t)256 * words, sizeof(uint64_t));
+    eng->unit_bits = calloc((size_t)256 * words, sizeof(uint64_t));
+    eng->addr_any = calloc(words, sizeof(uint64_t));
+    eng->dir_bits[0] = calloc(words, sizeof(uint64_t));
+    eng->dir_bits[1] = calloc(words, sizeof(uint64_t));
+    eng->intervals = calloc(interval_total ? interval_total : 1, sizeof(rule_interval_t));
+    eng->interval_max = calloc(interval_total ? interval_total : 1, sizeof(uint16_t));
+    eng->scratch = calloc((size_t)2 * words, sizeof(uint64_t));
+
+    if (!eng->rules || !eng->fc_bits || !eng->unit_bits || !eng->addr_any ||
+        !eng->dir_bits[0] || !eng->dir_bits[1] || !eng->intervals || !eng->interval_max ||
+        !eng->scratch || !trie_init(&eng->src, words) || !trie_init(&eng->dst, words)) {
+        return false;
+    }
+
+    for (uint32_t r = 0; r < count; r++) {
+        const rule_spec_t *s = &specs[r];
+
+        eng->rules[r].id = s->id;
+        memcpy(eng->rules[r].msg, s->msg, RULE_MSG_LEN);
+
+        for (uint32_t v = 0; v < 256; v++) {
+            bool fc_ok = (s->fc_count == 0);
+            for (uint32_t i = 0; i < s->fc_count && !fc_ok; i++) {
+                fc_ok = (v >= s->fc[i].lo && v <= s->fc[i].hi);
+            }
+            if (fc_ok) bit_set(&eng->fc_bits[(size_t)v * words], r);
+
+            bool unit_ok = (s->unit_count == 0);
+            for (uint32_t i = 0; i < s->unit_count && !unit_ok; i++) {
+                unit_ok = (v >= s->unit[i].lo && v <= s->unit[i].hi);
+            }
+            if (unit_ok) bit_set(&eng->unit_bits[(size_t)v * words], r);
+        }
+
+        if (s->addr_count == 0) {
+            bit_set(eng->addr_any, r);
+        }
+        for (uint32_t i = 0; i < s->addr_count; i++) {
+            rule_interval_t *iv = &eng->intervals[eng->interval_count++];
+            iv->lo = (uint16_t)s->addr[i].lo;
+            iv->hi = (uint16_t)s->addr[i].hi;
+            iv->rule = r;
+        }
+
+        if (s->dir != RULE_DIR_RESPONSE) bit_set(eng->dir_bits[0], r);
+        if (s->dir != RULE_DIR_REQUEST) bit_set(eng->dir_bits[1], r);
+
+        if (!compile_prefixes(&eng->src, words, s->src, s->src_count, s->src_negated, r) ||
+            !compile_prefixes(&eng->dst, words, s->dst, s->dst_count, s->dst_negated, r)) {
+            return false;
+        }
+    }
+
+    qsort(eng->intervals, eng->interval_count, sizeof(rule_interval_t), compare_interval);
+    build_interval_max(eng, 0, eng->interval_count);
+    return true;
+}
+
+
+/**
+ * rule_engine_load() - Parse and compile a rule file
+ * @eng: Engine to initialise
+ * @path: Rule file path
+ *
+ * Return: true on success, false on I/O, syntax or allocation error
+ */
+
+bool rule_engine_load(rule_engine_t *eng, const char *path) {
+    memset(eng, 0, sizeof(*eng));
+
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        printf("Error: Could not open rule file: %s\n", path);
+        return false;
+    }
+
+    rule_spec_t *specs = NULL;
+    uint32_t count = 0, capacity = 0, line_no = 0;
+    char line[RULE_LINE_MAX];
+    bool ok = true;
+
+    while (fgets(line, sizeof(line), f)) {
+        line_no++;
+        line[strcspn(line, "\r\n")] = '\0';
+
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            rule_spec_t *grown = realloc(specs, capacity * sizeof(rule_spec_t));
+            if (!grown) {
+                printf("Error: Memory allocation failed\n");
+                ok = false;
+                break;
+            }
+            specs = grown;
+        }
+
+        int r = parse_rule_line(line, &specs[count]);
+        if (r < 0) {
+            printf("Error: %s:%u: invalid rule\n", path, line_no);
+            ok = false;
+            break;
+        }
+        count += (uint32_t)r;
+    }
+    fclose(f);
+
+    if (ok && !compile_rules(eng, specs, count)) {
+        printf("Error: Memory allocation failed while compiling rules\n");
+        ok = false;
+    }
+    free(specs);
+
+    if (!ok) {
+        rule_engine_free(eng);
+        return false;
+    }
+    return true;
+}
+
+
+/**
+ * rule_engine_match() - Evaluate all rules against one frame
+ * @eng: Compiled engine
+ * @frame: Parsed frame
+ * @src: Source address
+ * @dst: Destination address
+ * @is_request: true if the frame was sent to port 502
+ * @hit_ids: Output rule IDs (may be NULL)
+ * @hit_rules: Output rule indices for rule_engine_replay() (may be NULL)
+ * @max_hits: Capacity of @hit_ids and @hit_rules
+ *
+ * Return: Number of matching rules (may exceed @max_hits)
+ */
+
+uint32_t rule_engine_match(rule_engine_t *eng, const modbus_tcp_frame_t *frame,
+                           const endpoint_t *src, const endpoint_t *dst, bool is_request,
+                           uint32_t *hit_ids, uint32_t *hit_rules, uint32_t max_hits) {
+    if (eng->rule_count == 0) {
+        return 0;
+    }
+    eng->frames_evaluated++;
+
+    uint32_t words = eng->words;
+    uint64_t *acc = eng->scratch;
+    uint64_t *tmp = eng->scratch + words;
+    const uint64_t *fc = &eng->fc_bits[(size_t)frame->function_code * words];
+    const uint64_t *unit = &eng->unit_bits[(size_t)frame->mbap.unit_id * words];
+    const uint64_t *dir = eng->dir_bits[is_request ? 0 : 1];
+    bool any = false;
+
+    for (uint32_t w = 0; w < words; w++) {
+        acc[w] = fc[w] & unit[w] & dir[w];
+        any |= (acc[w] != 0);
+    }
+    if (!any) {
+        return 0;
+    }
+
+    // Address: rules without constraint, plus intervals overlapping the range
+    uint16_t address, quantity;
+    memcpy(tmp, eng->addr_any, words * sizeof(uint64_t));
+    if (eng->interval_count > 0 &&
+        modbus_get_address_range(frame, is_request, &address, &quantity) && quantity > 0) {
+        uint32_t last = (uint32_t)address + quantity - 1;
+        query_intervals(eng, 0, eng->interval_count, address,
+                        (uint16_t)(last > 0xFFFF ? 0xFFFF : last), tmp);
+    }
+    for (uint32_t w = 0; w < words; w++) acc[w] &= tmp[w];
+
+    trie_lookup(&eng->src, words, src, tmp);
+    for (uint32_t w = 0; w < words; w++) acc[w] &= tmp[w];
+    trie_lookup(&eng->dst, words, dst, tmp);
+    for (uint32_t w = 0; w < words; w++) acc[w] &= tmp[w];
+
+    uint32_t hits = 0;
+    for (uint32_t w = 0; w < words; w++) {
+        uint64_t bits = acc[w];
+        while (bits) {
+            uint32_t r = w * 64 + (uint32_t)__builtin_ctzll(bits);
+            bits &= bits - 1;
+            eng->rules[r].hits++;
+            if (hit_ids && hits < max_hits) {
+                hit_ids[hits] = eng->rules[r].id;
+            }
+            if (hit_rules && hits < max_hits) {
+                hit_rules[hits] = r;
+            }
+            hits++;
+        }
+    }
+
+    if (hits > 0) {
+        eng->frames_hit++;
+    }
+    return hits;
+}
+
+
+/**
+ * rule_engine_replay() - Count a verdict remembered from rule_engine_match()
+ * @eng: Compiled engine
+ * @hit_rules: Rule indices returned by rule_engine_match()
+ * @hits: Number of matching rules (all of them must have been returned)
+ *
+ * Updates the counters exactly as the original match did.
+ */
+
+void rule_engine_replay(rule_engine_t *eng, const uint32_t *hit_rules, uint32_t hits) {
+    if (eng->rule_count == 0) {
+        return;
+    }
+    eng->frames_evaluated++;
+    for (uint32_t i = 0; i < hits; i++) {
+        eng->rules[hit_rules[i]].hits++;
+    }
+    if (hits > 0) {
+        eng->frames_hit++;
+    }
+}
+
+
+/**
+ * rule_format_hits() - Format rule IDs as "R<id>,R<id>,..."
+ * @ids: Rule IDs
+ * @count: Number of matches
+ * @buf: Output buffer
+ * @len: Size of @buf
+ */
+
+void rule_format_hits(const uint32_t *ids, uint32_t count, char *buf, size_t len) {
+    size_t used = 0;
+    uint32_t shown = count < RULE_MAX_HITS ? count : RULE_MAX_HITS;
+
+    buf[0] = '\0';
+    for (uint32_t i = 0; i < shown && used < len; i++) {
+        used += (size_t)snprintf(buf + used, len - used, "%sR%u", i ? "," : "", ids[i]);
+    }
+    if (count > shown && used < len) {
+        snprintf(buf + used, len - used, ",+%u", count - shown);
+    }
+}
+
+
+/**
+ * rule_display_summary() - Print per-rule hit counts to stdout
+ * @eng: Engine
+ */
+
+void rule_display_summary(const rule_engine_t *eng) {
+    printf("\n%sDetection Rules:%s\n", COLOR_WHITE, COLOR_RESET);
+    printf("  Rules loaded:        %u\n", eng->rule_count);
+    printf("  Frames with hits:    %llu of %llu evaluated\n",
+           (unsigned long long)eng->frames_hit, (unsigned long long)eng->frames_evaluated);
+
+    for (uint32_t r = 0; r < eng->rule_count; r++) {
+        if (eng->rules[r].hits == 0) {
+            continue;
+        }
+        printf("  %s[!] R%u%s %8llu  %s\n", COLOR_YELLOW, eng->rules[r].id, COLOR_RESET,
+               (unsigned long long)eng->rules[r].hits, eng->rules[r].msg);
+    }
+}
+
+
+/**
+ * rule_write_report() - Append per-rule hit counts to markdown report
+ * @eng: Engine
+ * @f: Open report file (no-op if NULL)
+ */
+
+void rule_write_report(const rule_engine_t *eng, FILE *f) {
+    if (!f) return;
+
+    fprintf(f, "\n### Detection Rules\n\n");
+    fprintf(f, "- **Rules loaded:** %u\n", eng->rule_count);
+    fprintf(f, "- **Frames with hits:** %llu of %llu evaluated\n\n",
+            (unsigned long long)eng->frames_hit, (unsigned long long)eng->frames_evaluated);
+
+    if (eng->frames_hit == 0) {
+        fprintf(f, "- ✅ No rule matched\n");
+        return;
+    }
+
+    fprintf(f, "| Rule | Hits | Description |\n");
+    fprintf(f, "|------|------|-------------|\n");
+    for (uint32_t r = 0; r < eng->rule_count; r++) {
+        if (eng->rules[r].hits > 0) {
+            fprintf(f, "| R%u | %llu | %s |\n", eng->rules[r].id,
+                    (unsigned long long)eng->rules[r].hits, eng->rules[r].msg);
+        }
+    }
+}
+
+
+/**
+ * rule_engine_save() - Write hit counters to a checkpoint
+ * @eng: Engine (an empty engine writes an empty rule set)
+ * @f: Open binary file
+ *
+ * Layout: rule count, frame counters, then (id, hits) per rule.
+ *
+ * Return: false on write error
+ */
+
+bool rule_engine_save(const rule_engine_t *eng, FILE *f) {
+    if (fwrite(&eng->rule_count, sizeof(eng->rule_count), 1, f) != 1 ||
+        fwrite(&eng->frames_evaluated, sizeof(eng->frames_evaluated), 1, f) != 1 ||
+        fwrite(&eng->frames_hit, sizeof(eng->frames_hit), 1, f) != 1) {
+        return false;
+    }
+    for (uint32_t r = 0; r < eng->rule_count; r++) {
+        if (fwrite(&eng->rules[r].id, sizeof(eng->rules[r].id), 1, f) != 1 ||
+            fwrite(&eng->rules[r].hits, sizeof(eng->rules[r].hits), 1, f) != 1) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/**
+ * rule_engine_restore() - Load counters written by rule_engine_save()
+ * @eng: Engine compiled from the same rule file
+ * @f: Open binary file
+ *
+ * Return: false on a short checkpoint or if the rule IDs differ
+ */
+
+bool rule_engine_restore(rule_engine_t *eng, FILE *f) {
+    uint32_t count;
+
+    if (fread(&count, sizeof(count), 1, f) != 1 || count != eng->rule_count ||
+        fread(&eng->frames_evaluated, sizeof(eng->frames_evaluated), 1, f) != 1 ||
+        fread(&eng->frames_hit, sizeof(eng->frames_hit), 1, f) != 1) {
+        return false;
+    }
+    for (uint32_t r = 0; r < count; r++) {
+        uint32_t id;
+        if (fread(&id, sizeof(id), 1, f) != 1 || id != eng->rules[r].id ||
+            fread(&eng->rules[r].hits, sizeof(eng->rules[r].hits), 1, f) != 1) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/**
+ * rule_engine_free() - Release a compiled engine
+ * @eng: Engine
+ */
+
+void rule_engine_free(rule_engine_t *eng) {
+    free(eng->rules);
+    free(eng->fc_bits);
+    free(eng->unit_bits);
+    free(eng->addr_any);
+    free(eng->dir_bits[0]);
+    free(eng->dir_bits[1]);
+    free(eng->intervals);
+    free(eng->interval_max);
+    free(eng->scratch);
+    trie_free(&eng->src);
+    trie_free(&eng->dst);
+    memset(eng, 0, sizeof(*eng));
+}
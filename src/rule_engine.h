@@ -0,0 +1,263 @@
+/*
+ * rule_engine.h - Compiled site-specific detection rules
+ *
+ * Loads a text rule file at startup and compiles it into per-dimension
+ * lookup structures whose results are rule bitsets:
+ * - function codes and unit IDs: one bitset per value (256 each)
+ * - address ranges: static augmented interval tree (overlap query)
+ * - source/destination IPv4: binary prefix trie, bitsets on prefix nodes
+ *
+ * A frame's hits are the AND of the per-dimension bitsets, so evaluating
+ * thousands of rules costs a handful of table lookups and word-wide ANDs.
+ *
+ * Rule file format (one rule per line, '#' starts a comment):
+ *
+ *   rule <id> [fc=<list>] [unit=<list>] [addr=<list>]
+ *             [src=[!]<prefix>[,<prefix>...]] [dst=[!]<prefix>[,...]]
+ *             [dir=request|response|any] [msg="<text>"]
+ *
+ *   <list>   comma separated values or lo-hi ranges (decimal or 0x hex)
+ *   <prefix> a.b.c.d or a.b.c.d/len; a leading '!' negates the whole set
+ *
+ * Prefixes are IPv4 only. An IPv6 endpoint lies outside every prefix: it
+ * fails src=/dst= sets and satisfies negated ones.
+ *
+ * Omitted dimensions match anything; dir defaults to request. Example,
+ * a write to the safety block from outside the OT subnet:
+ *
+ *   rule 100 fc=0x05,0x06,0x0F,0x10 unit=3 addr=4000-4100 src=!10.1.2.0/24 msg="Safety write"
+ *
+ * Copyright (C) 2025 Marty
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef RULE_ENGINE_H
+#define RULE_ENGINE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include "modbus_parser.h"
+#include "endpoint.h"
+
+
+/* Maximum rule message length (including NUL) */
+#define RULE_MSG_LEN 96
+
+/* Maximum hits reported per frame */
+#define RULE_MAX_HITS 16
+
+/* Buffer size for a formatted hit list ("R1,R2,...") */
+#define RULE_HITS_STR_LEN 128
+
+
+/**
+ * enum rule_direction_t - Which frames a rule applies to
+ */
+
+typedef enum {
+    RULE_DIR_REQUEST,       // Frames sent to port 502
+    RULE_DIR_RESPONSE,      // Frames sent from port 502
+    RULE_DIR_ANY
+} rule_direction_t;
+
+
+/**
+ * struct rule_t - Metadata of one compiled rule
+ * @id: User-assigned rule ID
+ * @msg: Description shown in summaries
+ * @hits: Frames matched so far
+ */
+
+typedef struct {
+    uint32_t id;
+    char msg[RULE_MSG_LEN];
+    uint64_t hits;
+} rule_t;
+
+
+/**
+ * struct rule_interval_t - Address range owned by one rule
+ * @lo: First address (inclusive)
+ * @hi: Last address (inclusive)
+ * @rule: Rule index
+ */
+
+typedef struct {
+    uint16_t lo;
+    uint16_t hi;
+    uint32_t rule;
+} rule_interval_t;
+
+
+/**
+ * struct rule_trie_t - Binary prefix trie over IPv4 addresses
+ * @child: Child node indices per bit (0 = none; node 0 is the root)
+ * @bits: Per-node offset into @pool, or -1 if no prefix ends here
+ * @node_count: Nodes in use
+ * @node_capacity: Nodes allocated
+ * @pool: Bitset storage (words_per_set words each)
+ * @pool_count: Bitsets in use
+ * @negated: Rules whose prefix set is negated ('!')
+ * @unconstrained: Rules without a prefix set on this dimension
+ */
+
+typedef struct {
+    uint32_t (*child)[2];
+    int32_t *bits;
+    uint32_t node_count;
+    uint32_t node_capacity;
+    uint64_t *pool;
+    uint32_t pool_count;
+    uint64_t *negated;
+    uint64_t *unconstrained;
+} rule_trie_t;
+
+
+/**
+ * struct rule_engine_t - Compiled rule set
+ * @rules: Rule metadata (@rule_count entries)
+ * @rule_count: Number of rules
+ * @words: 64-bit words per rule bitset
+ * @fc_bits: 256 bitsets indexed by function code
+ * @unit_bits: 256 bitsets indexed by unit ID
+ * @addr_any: Rules without an address constraint
+ * @intervals: Address intervals sorted by @lo (implicit BST)
+ * @interval_max: Max @hi in each implicit subtree
+ * @interval_count: Number of intervals
+ * @dir_bits: Bitset per frame direction (request, response)
+ * @src: Source address trie
+ * @dst: Destination address trie
+ * @scratch: Per-frame working bitsets (2 x @words)
+ * @frames_evaluated: Frames passed to rule_engine_match()
+ * @frames_hit: Frames with at least one hit
+ */
+
+typedef struct {
+    rule_t *rules;
+    uint32_t rule_count;
+    uint32_t words;
+    uint64_t *fc_bits;
+    uint64_t *unit_bits;
+    uint64_t *addr_any;
+    rule_interval_t *intervals;
+    uint16_t *interval_max;
+    uint32_t interval_count;
+    uint64_t *dir_bits[2];
+    rule_trie_t src;
+    rule_trie_t dst;
+    uint64_t *scratch;
+    uint64_t frames_evaluated;
+    uint64_t frames_hit;
+} rule_engine_t;
+
+
+/**
+ * rule_engine_load() - Parse and compile a rule file
+ * @eng: Engine to initialise
+ * @path: Rule file path
+ *
+ * Syntax errors are reported with their line number and abort loading.
+ *
+ * Return: true on success, false on I/O, syntax or allocation error
+ */
+
+bool rule_engine_load(rule_engine_t *eng, const char *path);
+
+
+/**
+ * rule_engine_match() - Evaluate all rules against one frame
+ * @eng: Compiled engine
+ * @frame: Parsed frame
+ * @src: Source address
+ * @dst: Destination address
+ * @is_request: true if the frame was sent to port 502
+ * @hit_ids: Output rule IDs (may be NULL)
+ * @hit_rules: Output rule indices for rule_engine_replay() (may be NULL)
+ * @max_hits: Capacity of @hit_ids and @hit_rules
+ *
+ * Also increments the per-rule hit counters.
+ *
+ * Return: Number of matching rules (may exceed @max_hits)
+ */
+
+uint32_t rule_engine_match(rule_engine_t *eng, const modbus_tcp_frame_t *frame,
+                           const endpoint_t *src, const endpoint_t *dst, bool is_request,
+                           uint32_t *hit_ids, uint32_t *hit_rules, uint32_t max_hits);
+
+
+/**
+ * rule_engine_replay() - Count a verdict remembered from rule_engine_match()
+ * @eng: Compiled engine
+ * @hit_rules: Rule indices returned by rule_engine_match()
+ * @hits: Number of matching rules (all of them must have been returned)
+ *
+ * Updates the counters exactly as the original match did, for callers
+ * that skip matching a frame whose verdict is already known.
+ */
+
+void rule_engine_replay(rule_engine_t *eng, const uint32_t *hit_rules, uint32_t hits);
+
+
+/**
+ * rule_format_hits() - Format rule IDs as "R<id>,R<id>,..."
+ * @ids: Rule IDs
+ * @count: Number of matches (entries beyond RULE_MAX_HITS shown as "+n")
+ * @buf: Output buffer
+ * @len: Size of @buf
+ */
+
+void rule_format_hits(const uint32_t *ids, uint32_t count, char *buf, size_t len);
+
+
+/**
+ * rule_display_summary() - Print per-rule hit counts to stdout
+ * @eng: Engine
+ */
+
+void rule_display_summary(const rule_engine_t *eng);
+
+
+/**
+ * rule_write_report() - Append per-rule hit counts to markdown report
+ * @eng: Engine
+ * @f: Open report file (no-op if NULL)
+ */
+
+void rule_write_report(const rule_engine_t *eng, FILE *f);
+
+
+/**
+ * rule_engine_save() - Write hit counters to a checkpoint
+ * @eng: Engine (an empty engine writes an empty rule set)
+ * @f: Open binary file
+ *
+ * The compiled structures are rebuilt from the rule file on resume;
+ * only the counters are run state.
+ *
+ * Return: false on write error
+ */
+
+bool rule_engine_save(const rule_engine_t *eng, FILE *f);
+
+
+/**
+ * rule_engine_restore() - Load counters written by rule_engine_save()
+ * @eng: Engine compiled from the same rule file
+ * @f: Open binary file
+ *
+ * Return: false on a short checkpoint or if the rule IDs differ
+ */
+
+bool rule_engine_restore(rule_engine_t *eng, FILE *f);
+
+
+/**
+ * rule_engine_free() - Release a compiled engine
+ * @eng: Engine
+ */
+
+void rule_engine_free(rule_engine_t *eng);
+
+#endif /* RULE_ENGINE_H */
@@ -0,0 +1,200 @@
+/*
+ * sample_estimate.c - Design effect of a sampled run (--sample)
+ *
+ * Implements the cluster tracker declared in sample_estimate.h: a
+ * linear-probing table from flow key or capture second to a frame
+ * count, doubled when it gets half full.
+ *
+ * Copyright (C) 2025 Marty
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+
+#include "sample_estimate.h"
+#include <stdlib.h>
+#include <string.h>
+
+
+/*
+ * mix_key() - Spread a key over all bits (capture seconds are sequential)
+ */
+
+static inline uint64_t mix_key(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return key;
+}
+
+
+/*
+ * clusters_grow() - Double the table and reinsert every cluster
+ */
+
+static bool clusters_grow(sample_clusters_t *clusters) {
+    uint32_t slot_count = clusters->slots ? (clusters->slot_mask + 1) * 2
+                                          : SAMPLE_CLUSTERS_INITIAL;
+
+    sample_cluster_t *slots = calloc(slot_count, sizeof(sample_cluster_t));
+    if (!slots) {
+        return false;
+    }
+
+    if (clusters->slots) {
+        for (uint32_t i = 0; i <= clusters->slot_mask; i++) {
+            const sample_cluster_t *old = &clusters->slots[i];
+            if (old->frames == 0) {
+                continue;
+            }
+            uint32_t idx = (uint32_t)mix_key(old->key) & (slot_count - 1);
+            while (slots[idx].frames != 0) {
+                idx = (idx + 1) & (slot_count - 1);
+            }
+            slots[idx] = *old;
+        }
+    }
+
+    free(clusters->slots);
+    clusters->slots = slots;
+    clusters->slot_mask = slot_count - 1;
+    return true;
+}
+
+
+/**
+ * sample_clusters_init() - Allocate an empty tracker
+ * @clusters: Tracker
+ *
+ * Return: false on allocation failure
+ */
+
+bool sample_clusters_init(sample_clusters_t *clusters) {
+    memset(clusters, 0, sizeof(*clusters));
+    return clusters_grow(clusters);
+}
+
+
+/**
+ * sample_clusters_add() - Count one frame of a cluster
+ * @clusters: Tracker
+ * @key: Flow key or capture second of the frame
+ */
+
+void sample_clusters_add(sample_clusters_t *clusters, uint64_t key) {
+    uint32_t idx = (uint32_t)mix_key(key) & clusters->slot_mask;
+
+    while (clusters->slots[idx].frames != 0) {
+        if (clusters->slots[idx].key == key) {
+            clusters->slots[idx].frames++;
+            return;
+        }
+        idx = (idx + 1) & clusters->slot_mask;
+    }
+
+    if (clusters->truncated) {
+        return;
+    }
+    if (clusters->count + 1 > (clusters->slot_mask + 1) / 2) {
+        if (clusters->slot_mask >= UINT32_MAX / 4 || !clusters_grow(clusters)) {
+            clusters->truncated = true;
+            return;
+        }
+        // Slot positions changed with the table size
+        idx = (uint32_t)mix_key(key) & clusters->slot_mask;
+        while (clusters->slots[idx].frames != 0) {
+            idx = (idx + 1) & clusters->slot_mask;
+        }
+    }
+
+    clusters->slots[idx].key = key;
+    clusters->slots[idx].frames = 1;
+    clusters->count++;
+}
+
+
+/**
+ * sample_clusters_design_effect() - Variance factor of the clustering
+ * @clusters: Tracker
+ *
+ * Return: sum(c^2) / sum(c) over the clusters counted, 1 if there are none
+ */
+
+double sample_clusters_design_effect(const sample_clusters_t *clusters) {
+    double frames = 0.0;
+    double squares = 0.0;
+
+    if (!clusters->slots) {
+        return 1.0;
+    }
+    for (uint32_t i = 0; i <= clusters->slot_mask; i++) {
+        double c = (double)clusters->slots[i].frames;
+        frames += c;
+        squares += c * c;
+    }
+    return frames > 0.0 ? squares / frames : 1.0;
+}
+
+
+/**
+ * sample_clusters_save() - Write the tracker to a checkpoint
+ * @clusters: Tracker
+ * @f: Open binary file
+ *
+ * Layout: the tracker struct (table pointer cleared), then its slots.
+ *
+ * Return: false on write error
+ */
+
+bool sample_clusters_save(const sample_clusters_t *clusters, FILE *f) {
+    sample_clusters_t head = *clusters;
+    size_t slot_count = (size_t)clusters->slot_mask + 1;
+
+    head.slots = NULL;
+    return fwrite(&head, sizeof(head), 1, f) == 1 &&
+           fwrite(clusters->slots, sizeof(sample_cluster_t), slot_count, f) == slot_count;
+}
+
+
+/**
+ * sample_clusters_restore() - Load a tracker written by sample_clusters_save()
+ * @clusters: Tracker from sample_clusters_init()
+ * @f: Open binary file
+ *
+ * Return: false on a short or inconsistent checkpoint, or allocation failure
+ */
+
+bool sample_clusters_restore(sample_clusters_t *clusters, FILE *f) {
+    sample_clusters_t head;
+
+    // The saved table size is a power of two at least SAMPLE_CLUSTERS_INITIAL, half full at most
+    if (fread(&head, sizeof(head), 1, f) != 1 || head.slot_mask < SAMPLE_CLUSTERS_INITIAL - 1 ||
+        head.slot_mask > UINT32_MAX / 2 || (head.slot_mask & (head.slot_mask + 1)) != 0 ||
+        head.count > (head.slot_mask + 1) / 2) {
+        return false;
+    }
+
+    size_t slot_count = (size_t)head.slot_mask + 1;
+    head.slots = malloc(slot_count * sizeof(sample_cluster_t));
+    if (!head.slots) {
+        return false;
+    }
+    if (fread(head.slots, sizeof(sample_cluster_t), slot_count, f) != slot_count) {
+        free(head.slots);
+        return false;
+    }
+
+    free(clusters->slots);
+    *clusters = head;
+    return true;
+}
+
+
+/**
+ * sample_clusters_free() - Release the table
+ * @clusters: Tracker (zeroed or initialised)
+ */
+
+void sample_clusters_free(sample_clusters_t *clusters) {
+    free(clusters->slots);
+    clusters->slots = NULL;
+}
@@ -0,0 +1,121 @@
+/*
+ * sample_estimate.h - Design effect of a sampled run (--sample)
+ *
+ * With packet sampling every record is kept or skipped on its own, so a
+ * count k seen in a 1-in-N sample estimates k * N with variance
+ * k * N * (N - 1). Flow and time sampling keep whole flows or whole
+ * capture seconds, and frames of one flow or second are not
+ * independent: the variance of a total is N * (N - 1) times the sum of
+ * the squared cluster sizes, not their plain sum.
+ *
+ * This module counts the frames of every kept flow or second and
+ * reports the design effect, sum(c^2) / sum(c) over clusters c. The
+ * same factor widens the intervals of all counters; it is measured on
+ * the frame totals, so it can understate the clustering of a counter
+ * that sits in a few flows (an exception storm, for example).
+ *
+ * Copyright (C) 2025 Marty
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef SAMPLE_ESTIMATE_H
+#define SAMPLE_ESTIMATE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+
+/* Cluster slots of a new tracker */
+#define SAMPLE_CLUSTERS_INITIAL 1024
+
+
+/**
+ * struct sample_cluster_t - Frames of one kept flow or second
+ * @key: Flow key (pcap_sample_flow_key()) or capture second
+ * @frames: Frames counted (0 = free slot)
+ */
+
+typedef struct {
+    uint64_t key;
+    uint64_t frames;
+} sample_cluster_t;
+
+
+/**
+ * struct sample_clusters_t - Frame counts per cluster
+ * @slots: Open-addressing table, at most half full
+ * @slot_mask: Slot count - 1
+ * @count: Clusters in @slots
+ * @truncated: The table could not grow; later clusters were not counted
+ */
+
+typedef struct {
+    sample_cluster_t *slots;
+    uint32_t slot_mask;
+    uint32_t count;
+    bool truncated;
+} sample_clusters_t;
+
+
+/**
+ * sample_clusters_init() - Allocate an empty tracker
+ * @clusters: Tracker
+ *
+ * Return: false on allocation failure
+ */
+
+bool sample_clusters_init(sample_clusters_t *clusters);
+
+
+/**
+ * sample_clusters_add() - Count one frame of a cluster
+ * @clusters: Tracker
+ * @key: Flow key or capture second of the frame
+ */
+
+void sample_clusters_add(sample_clusters_t *clusters, uint64_t key);
+
+
+/**
+ * sample_clusters_design_effect() - Variance factor of the clustering
+ * @clusters: Tracker
+ *
+ * Return: sum(c^2) / sum(c) over the clusters counted, 1 if there are none
+ */
+
+double sample_clusters_design_effect(const sample_clusters_t *clusters);
+
+
+/**
+ * sample_clusters_save() - Write the tracker to a checkpoint
+ * @clusters: Tracker
+ * @f: Open binary file
+ *
+ * Layout: the tracker struct (table pointer cleared), then its slots.
+ *
+ * Return: false on write error
+ */
+
+bool sample_clusters_save(const sample_clusters_t *clusters, FILE *f);
+
+
+/**
+ * sample_clusters_restore() - Load a tracker written by sample_clusters_save()
+ * @clusters: Tracker from sample_clusters_init()
+ * @f: Open binary file
+ *
+ * Return: false on a short or inconsistent checkpoint, or allocation failure
+ */
+
+bool sample_clusters_restore(sample_clusters_t *clusters, FILE *f);
+
+
+/**
+ * sample_clusters_free() - Release the table
+ * @clusters: Tracker (zeroed or initialised)
+ */
+
+void sample_clusters_free(sample_clusters_t *clusters);
+
+#endif /* SAMPLE_ESTIMATE_H */
@@ -0,0 +1,1182 @@
+/*
+ * sketch.c - Memory-bounded approximate statistics
+ *
+ * Implements the HyperLogLog, count-min and space-saving sketches
+ * declared in sketch.h and the per-frame sketch layer built on them.
+ *
+ * Hashing: keys are packed into 64-bit words and passed through a
+ * splitmix64 finaliser; strings use FNV-1a 64 first. Count-min rows use
+ * double hashing (h1 + i*h2) so a single 64-bit hash feeds every row.
+ *
+ * Copyright (C) 2025 Marty
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+
+#include "sketch.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "colors.h"
+
+#ifdef _WIN32
+    #include <winsock2.h>  //Windows: For ntohs (network to host short)
+#else
+    #include <arpa/inet.h>  // *nix: For ntohs (network to host short)
+#endif
+
+
+/* Modbus TCP server port, used to tell requests from responses */
+#define SKETCH_MODBUS_PORT 502
+
+/* Largest quantity of a single request: coils/inputs and registers, per spec */
+#define SKETCH_MAX_COILS 2000
+#define SKETCH_MAX_REGISTERS 125
+
+/* Coils and discrete inputs are sketched per 16-bit word of this many bits */
+#define SKETCH_COIL_WORD 16
+
+/* Rows shown in summary tables */
+#define SKETCH_TOP_ROWS 10
+
+/* z-score for the two-sided 95% interval */
+#define SKETCH_Z95 1.96
+
+/* Name of the slot shared by masters beyond SKETCH_MAX_MASTERS */
+static const char SKETCH_OVERFLOW_NAME[] = "(other)";
+
+
+/*
+ * mix64() - splitmix64 finaliser
+ */
+
+static uint64_t mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+
+/*
+ * floor_pow2() - Largest power of two <= v (v >= 1)
+ */
+
+static uint32_t floor_pow2(size_t v) {
+    uint32_t p = 1;
+    while ((size_t)p * 2 <= v && p < (1u << 30)) {
+        p *= 2;
+    }
+    return p;
+}
+
+
+/* ------------------------------------------------------------------ */
+/* HyperLogLog                                                         */
+/* ------------------------------------------------------------------ */
+
+/**
+ * hll_init() - Allocate a HyperLogLog sketch
+ * @hll: Sketch to initialise
+ * @precision: log2 register count (clamped to 4-16)
+ *
+ * Return: true on success, false on allocation failure
+ */
+
+bool hll_init(hll_t *hll, uint8_t precision) {
+    if (precision < 4) precision = 4;
+    if (precision > 16) precision = 16;
+
+    hll->precision = precision;
+    hll->registers = calloc((size_t)1 << precision, 1);
+    return hll->registers != NULL;
+}
+
+
+/**
+ * hll_add() - Add a pre-hashed item
+ * @hll: Sketch
+ * @hash: 64-bit hash of the item
+ *
+ * The top @precision bits select a register; the register keeps the
+ * maximum rank (leading zeros + 1) of the remaining bits.
+ */
+
+void hll_add(hll_t *hll, uint64_t hash) {
+    uint32_t idx = (uint32_t)(hash >> (64 - hll->precision));
+    uint64_t rest = hash << hll->precision;
+    uint8_t rank = rest ? (uint8_t)(__builtin_clzll(rest) + 1)
+                        : (uint8_t)(64 - hll->precision + 1);
+
+    if (rank > hll->registers[idx]) {
+        hll->registers[idx] = rank;
+    }
+}
+
+
+/**
+ * hll_estimate() - Estimate the number of distinct items added
+ * @hll: Sketch
+ *
+ * Return: Cardinality estimate (linear counting for small ranges)
+ */
+
+double hll_estimate(const hll_t *hll) {
+    uint32_t m = 1u << hll->precision;
+    double sum = 0.0;
+    uint32_t zeros = 0;
+
+    for (uint32_t i = 0; i < m; i++) {
+        sum += ldexp(1.0, -hll->registers[i]);
+        if (hll->registers[i] == 0) {
+            zeros++;
+        }
+    }
+
+    double alpha;
+    switch (m) {
+        case 16: alpha = 0.673; break;
+        case 32: alpha = 0.697; break;
+        case 64: alpha = 0.709; break;
+        default: alpha = 0.7213 / (1.0 + 1.079 / m); break;
+    }
+
+    double estimate = alpha * (double)m * (double)m / sum;
+    if (estimate <= 2.5 * m && zeros > 0) {
+        estimate = (double)m * log((double)m / (double)zeros);
+    }
+    return estimate;
+}
+
+
+/**
+ * hll_relative_error() - Relative standard error of a sketch
+ * @hll: Sketch
+ *
+ * Return: 1.04 / sqrt(m)
+ */
+
+double hll_relative_error(const hll_t *hll) {
+    return 1.04 / sqrt((double)(1u << hll->precision));
+}
+
+
+/**
+ * hll_merge() - Fold @src into @dst (register-wise max)
+ * @dst: Destination sketch
+ * @src: Source sketch (same precision)
+ *
+ * Return: false if the precisions differ
+ */
+
+bool hll_merge(hll_t *dst, const hll_t *src) {
+    if (dst->precision != src->precision) {
+        return false;
+    }
+
+    uint32_t m = 1u << dst->precision;
+    for (uint32_t i = 0; i < m; i++) {
+        if (src->registers[i] > dst->registers[i]) {
+            dst->registers[i] = src->registers[i];
+        }
+    }
+    return true;
+}
+
+
+/**
+ * hll_free() - Release a HyperLogLog sketch
+ * @hll: Sketch
+ */
+
+void hll_free(hll_t *hll) {
+    free(hll->registers);
+    hll->registers = NULL;
+}
+
+
+/* ------------------------------------------------------------------ */
+/* Count-min                                                           */
+/* ------------------------------------------------------------------ */
+
+/**
+ * cms_init() - Allocate a count-min sketch
+ * @cms: Sketch to initialise
+ * @width: Counters per row (rounded down to a power of two)
+ * @depth: Number of rows
+ *
+ * Return: true on success, false on allocation failure
+ */
+
+bool cms_init(cms_t *cms, uint32_t width, uint32_t depth) {
+    cms->width = floor_pow2(width ? width : 1);
+    cms->depth = depth ? depth : 1;
+    cms->total = 0;
+    cms->counters = calloc((size_t)cms->width * cms->depth, sizeof(uint32_t));
+    return cms->counters != NULL;
+}
+
+
+/**
+ * cms_add() - Increment a pre-hashed key
+ * @cms: Sketch
+ * @hash: 64-bit key hash
+ * @count: Increment
+ */
+
+void cms_add(cms_t *cms, uint64_t hash, uint32_t count) {
+    uint32_t h1 = (uint32_t)hash;
+    uint32_t h2 = (uint32_t)(hash >> 32) | 1;
+
+    for (uint32_t row = 0; row < cms->depth; row++) {
+        uint32_t col = (h1 + row * h2) & (cms->width - 1);
+        cms->counters[(size_t)row * cms->width + col] += count;
+    }
+    cms->total += count;
+}
+
+
+/**
+ * cms_estimate() - Estimated count of a pre-hashed key
+ * @cms: Sketch
+ * @hash: 64-bit key hash
+ *
+ * Return: Upper-biased count estimate (minimum over rows)
+ */
+
+uint64_t cms_estimate(const cms_t *cms, uint64_t hash) {
+    uint32_t h1 = (uint32_t)hash;
+    uint32_t h2 = (uint32_t)(hash >> 32) | 1;
+    uint64_t best = UINT64_MAX;
+
+    for (uint32_t row = 0; row < cms->depth; row++) {
+        uint32_t col = (h1 + row * h2) & (cms->width - 1);
+        uint64_t v = cms->counters[(size_t)row * cms->width + col];
+        if (v < best) {
+            best = v;
+        }
+    }
+    return best;
+}
+
+
+/**
+ * cms_merge() - Fold @src into @dst (counter-wise add)
+ * @dst: Destination sketch
+ * @src: Source sketch (same dimensions)
+ *
+ * Return: false if the dimensions differ
+ */
+
+bool cms_merge(cms_t *dst, const cms_t *src) {
+    if (dst->width != src->width || dst->depth != src->depth) {
+        return false;
+    }
+
+    size_t n = (size_t)dst->width * dst->depth;
+    for (size_t i = 0; i < n; i++) {
+        dst->counters[i] += src->counters[i];
+    }
+    dst->total += src->total;
+    return true;
+}
+
+
+/**
+ * cms_free() - Release a count-min sketch
+ * @cms: Sketch
+ */
+
+void cms_free(cms_t *cms) {
+    free(cms->counters);
+    cms->counters = NULL;
+}
+
+
+/* ------------------------------------------------------------------ */
+/* Space-saving                                                        */
+/* ------------------------------------------------------------------ */
+
+/**
+ * ss_init() - Allocate a space-saving summary
+ * @ss: Summary to initialise
+ * @capacity: Number of monitored keys (k)
+ *
+ * Return: true on success, false on allocation failure
+ */
+
+bool ss_init(spacesaving_t *ss, uint32_t capacity) {
+    memset(ss, 0, sizeof(*ss));
+    if (capacity == 0) capacity = 1;
+
+    uint32_t index_size = floor_pow2((size_t)capacity * 2) * 2;
+
+    ss->capacity = capacity;
+    ss->entries = calloc(capacity, sizeof(ss_entry_t));
+    ss->heap = calloc(capacity, sizeof(uint32_t));
+    ss->heap_pos = calloc(capacity, sizeof(uint32_t));
+    ss->index = calloc(index_size, sizeof(uint32_t));
+    ss->index_mask = index_size - 1;
+
+    if (!ss->entries || !ss->heap || !ss->heap_pos || !ss->index) {
+        ss_free(ss);
+        return false;
+    }
+    return true;
+}
+
+
+/*
+ * ss_find() - Entry index for a key, or -1
+ */
+
+static int64_t ss_find(const spacesaving_t *ss, uint64_t key) {
+    uint32_t i = (uint32_t)key & ss->index_mask;
+
+    while (ss->index[i] != 0) {
+        uint32_t e = ss->index[i] - 1;
+        if (ss->entries[e].key == key) {
+            return e;
+        }
+        i = (i + 1) & ss->index_mask;
+    }
+    return -1;
+}
+
+
+/*
+ * ss_index_insert() - Map a key to an entry index
+ */
+
+static void ss_index_insert(spacesaving_t *ss, uint64_t key, uint32_t entry) {
+    uint32_t i = (uint32_t)key & ss->index_mask;
+
+    while (ss->index[i] != 0) {
+        i = (i + 1) & ss->index_mask;
+    }
+    ss->index[i] = entry + 1;
+}
+
+
+/*
+ * ss_index_remove() - Unmap a key using backward-shift deletion
+ */
+
+static void ss_index_remove(spacesaving_t *ss, uint64_t key) {
+    uint32_t i = (uint32_t)key & ss->index_mask;
+
+    while (ss->index[i] != 0 && ss->entries[ss->index[i] - 1].key != key) {
+        i = (i + 1) & ss->index_mask;
+    }
+    if (ss->index[i] == 0) {
+        return;
+    }
+
+    uint32_t hole = i;
+    for (;;) {
+        i = (i + 1) & ss->index_mask;
+        if (ss->index[i] == 0) {
+            break;
+        }
+        uint32_t home = (uint32_t)ss->entries[ss->index[i] - 1].key & ss->index_mask;
+        // Move i into the hole unless its home lies cyclically in (hole, i]
+        bool in_range = (hole <= i) ? (home > hole && home <= i)
+                                    : (home > hole || home <= i);
+        if (!in_range) {
+            ss->index[hole] = ss->index[i];
+            hole = i;
+        }
+    }
+    ss->index[hole] = 0;
+}
+
+
+/*
+ * ss_heap_swap() - Swap two heap slots and fix positions
+ */
+
+static void ss_heap_swap(spacesaving_t *ss, uint32_t a, uint32_t b) {
+    uint32_t t = ss->heap[a];
+    ss->heap[a] = ss->heap[b];
+    ss->heap[b] = t;
+    ss->heap_pos[ss->heap[a]] = a;
+    ss->heap_pos[ss->heap[b]] = b;
+}
+
+
+/*
+ * ss_sift_up() - Restore heap order after a count decrease / insert
+ */
+
+static void ss_sift_up(spacesaving_t *ss, uint32_t pos) {
+    while (pos > 0) {
+        uint32_t parent = (pos - 1) / 2;
+        if (ss->entries[ss->heap[parent]].count <= ss->entries[ss->heap[pos]].count) {
+            break;
+        }
+        ss_heap_swap(ss, pos, parent);
+        pos = parent;
+    }
+}
+
+
+/*
+ * ss_sift_down() - Restore heap order after a count increase
+ */
+
+static void ss_sift_down(spacesaving_t *ss, uint32_t pos) {
+    for (;;) {
+        uint32_t left = pos * 2 + 1;
+        uint32_t right = left + 1;
+        uint32_t smallest = pos;
+
+        if (left < ss->used &&
+            ss->entries[ss->heap[left]].count < ss->entries[ss->heap[smallest]].count) {
+            smallest = left;
+        }
+        if (right < ss->used &&
+            ss->entries[ss->heap[right]].count < ss->entries[ss->heap[smallest]].count) {
+            smallest = right;
+        }
+        if (smallest == pos) {
+            break;
+        }
+        ss_heap_swap(ss, pos, smallest);
+        pos = smallest;
+    }
+}
+
+
+/*
+ * ss_insert() - Add a new monitored key (summary must not be full)
+ */
+
+static void ss_insert(spacesaving_t *ss, uint64_t key, uint64_t count, uint64_t error,
+                      const sketch_tuple_t *tuple) {
+    uint32_t e = ss->used++;
+
+    ss->entries[e].key = key;
+    ss->entries[e].count = count;
+    ss->entries[e].error = error;
+    ss->entries[e].tuple = *tuple;
+    ss->heap[e] = e;
+    ss->heap_pos[e] = e;
+    ss_index_insert(ss, key, e);
+    ss_sift_up(ss, e);
+}
+
+
+/**
+ * ss_add() - Count one occurrence of a key
+ * @ss: Summary
+ * @hash: 64-bit key hash
+ * @tuple: Decoded key, stored when the key becomes monitored
+ *
+ * O(log k): index lookup plus one heap sift.
+ */
+
+void ss_add(spacesaving_t *ss, uint64_t hash, const sketch_tuple_t *tuple) {
+    ss->total++;
+
+    int64_t e = ss_find(ss, hash);
+    if (e >= 0) {
+        ss->entries[e].count++;
+        ss_sift_down(ss, ss->heap_pos[e]);
+        return;
+    }
+
+    if (ss->used < ss->capacity) {
+        ss_insert(ss, hash, 1, 0, tuple);
+        return;
+    }
+
+    // Replace the minimum: the newcomer inherits its count as error
+    uint32_t victim = ss->heap[0];
+    ss_entry_t *v = &ss->entries[victim];
+    ss_index_remove(ss, v->key);
+    v->key = hash;
+    v->error = v->count;
+    v->count++;
+    v->tuple = *tuple;
+    ss_index_insert(ss, hash, victim);
+    ss_sift_down(ss, 0);
+}
+
+
+/*
+ * ss_min_count() - Minimum monitored count if full, else 0
+ */
+
+static uint64_t ss_min_count(const spacesaving_t *ss) {
+    if (ss->used < ss->capacity || ss->used == 0) {
+        return 0;
+    }
+    return ss->entries[ss->heap[0]].count;
+}
+
+
+/*
+ * compare_entry_desc() - qsort comparator, descending count
+ */
+
+static int compare_entry_desc(const void *a, const void *b) {
+    const ss_entry_t *x = a;
+    const ss_entry_t *y = b;
+    if (x->count != y->count) {
+        return (x->count < y->count) ? 1 : -1;
+    }
+    return (x->key > y->key) - (x->key < y->key);
+}
+
+
+/**
+ * ss_merge() - Fold @src into @dst
+ * @dst: Destination summary
+ * @src: Source summary
+ *
+ * Return: false on allocation failure
+ */
+
+bool ss_merge(spacesaving_t *dst, const spacesaving_t *src) {
+    uint32_t n = 0;
+    uint64_t dst_min = ss_min_count(dst);
+    uint64_t src_min = ss_min_count(src);
+    ss_entry_t *merged = malloc(((size_t)dst->used + src->used) * sizeof(ss_entry_t) + 1);
+
+    if (merged == NULL) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < dst->used; i++) {
+        merged[n] = dst->entries[i];
+        int64_t other = ss_find(src, merged[n].key);
+        if (other >= 0) {
+            merged[n].count += src->entries[other].count;
+            merged[n].error += src->entries[other].error;
+        } else {
+            merged[n].count += src_min;
+            merged[n].error += src_min;
+        }
+        n++;
+    }
+
+    for (uint32_t i = 0; i < src->used; i++) {
+        if (ss_find(dst, src->entries[i].key) >= 0) {
+            continue;
+        }
+        merged[n] = src->entries[i];
+        merged[n].count += dst_min;
+        merged[n].error += dst_min;
+        n++;
+    }
+
+    qsort(merged, n, sizeof(ss_entry_t), compare_entry_desc);
+
+    uint64_t total = dst->total + src->total;
+    memset(dst->index, 0, ((size_t)dst->index_mask + 1) * sizeof(uint32_t));
+    dst->used = 0;
+    dst->total = total;
+
+    for (uint32_t i = 0; i < n && i < dst->capacity; i++) {
+        ss_insert(dst, merged[i].key, merged[i].count, merged[i].error, &merged[i].tuple);
+    }
+
+    free(merged);
+    return true;
+}
+
+
+/**
+ * ss_top() - Copy monitored entries sorted by descending count
+ * @ss: Summary
+ * @out: Output array
+ * @max: Capacity of @out
+ *
+ * Return: Number of entries written
+ */
+
+uint32_t ss_top(const spacesaving_t *ss, ss_entry_t *out, uint32_t max) {
+    ss_entry_t *sorted = malloc((size_t)ss->used * sizeof(ss_entry_t) + 1);
+    if (sorted == NULL) {
+        return 0;
+    }
+
+    memcpy(sorted, ss->entries, (size_t)ss->used * sizeof(ss_entry_t));
+    qsort(sorted, ss->used, sizeof(ss_entry_t), compare_entry_desc);
+
+    uint32_t n = ss->used < max ? ss->used : max;
+    memcpy(out, sorted, (size_t)n * sizeof(ss_entry_t));
+    free(sorted);
+    return n;
+}
+
+
+/**
+ * ss_free() - Release a space-saving summary
+ * @ss: Summary
+ */
+
+void ss_free(spacesaving_t *ss) {
+    free(ss->entries);
+    free(ss->heap);
+    free(ss->heap_pos);
+    free(ss->index);
+    ss->entries = NULL;
+    ss->heap = NULL;
+    ss->heap_pos = NULL;
+    ss->index = NULL;
+}
+
+
+/* ------------------------------------------------------------------ */
+/* Sketch layer                                                        */
+/* ------------------------------------------------------------------ */
+
+/*
+ * ss_bytes() - Bytes ss_init() allocates for a capacity
+ */
+
+static size_t ss_bytes(uint32_t capacity) {
+    size_t index_size = (size_t)floor_pow2((size_t)capacity * 2) * 2;
+    return (size_t)capacity * (sizeof(ss_entry_t) + 2 * sizeof(uint32_t)) +
+           index_size * sizeof(uint32_t);
+}
+
+
+/*
+ * floor_log2() - Largest p with 2^p <= v, clamped to [lo, hi]
+ */
+
+static uint8_t floor_log2(size_t v, uint8_t lo, uint8_t hi) {
+    uint8_t p = lo;
+    while (p < hi && ((size_t)1 << (p + 1)) <= v) {
+        p++;
+    }
+    return p;
+}
+
+
+/**
+ * sketch_stats_init() - Lay out all sketches inside a memory budget
+ * @sk: Sketch layer to initialise
+ * @budget: Total bytes (raised to SKETCH_MIN_BUDGET if smaller)
+ *
+ * Three quarters of the budget go to per-master HyperLogLogs, the rest
+ * is split between the count-min matrix and the space-saving summary.
+ * Each part is sized from its exact allocation, so sketch_stats_memory()
+ * never exceeds @budget.
+ *
+ * Return: true on success, false on allocation failure
+ */
+
+bool sketch_stats_init(sketch_stats_t *sk, size_t budget) {
+    memset(sk, 0, sizeof(*sk));
+    if (budget < SKETCH_MIN_BUDGET) {
+        budget = SKETCH_MIN_BUDGET;
+    }
+    sk->budget = budget;
+
+    // 3/4 of the budget: per-master register + unit HLLs; small budgets
+    // lower the unit precision before the register sketch drops below it
+    size_t per_master = (budget * 3 / 4) / (SKETCH_MAX_MASTERS + 1);
+    uint8_t unit_precision = floor_log2(per_master / 2, 4, SKETCH_UNIT_PRECISION);
+    uint8_t precision = floor_log2(per_master - ((size_t)1 << unit_precision), 4, 16);
+    sk->register_precision = precision;
+    sk->unit_precision = unit_precision;
+
+    for (int i = 0; i <= SKETCH_MAX_MASTERS; i++) {
+        if (!hll_init(&sk->masters[i].registers, precision) ||
+            !hll_init(&sk->masters[i].units, unit_precision)) {
+            sketch_stats_free(sk);
+            return false;
+        }
+    }
+
+    // 1/8: count-min, 1/8: space-saving (entries, heap and key index)
+    size_t eighth = budget / 8;
+    uint32_t width = (uint32_t)(eighth / (SKETCH_CMS_DEPTH * sizeof(uint32_t)));
+    uint32_t capacity = (uint32_t)(eighth / (sizeof(ss_entry_t) + 6 * sizeof(uint32_t)));
+    while (ss_bytes(capacity + 1) <= eighth) {
+        capacity++;
+    }
+
+    if (!cms_init(&sk->tuples, width, SKETCH_CMS_DEPTH) || !ss_init(&sk->heavy, capacity)) {
+        sketch_stats_free(sk);
+        return false;
+    }
+
+    return true;
+}
+
+
+/*
+ * find_master() - Slot for a master, claiming a free one if needed
+ *
+ * Linear probing over SKETCH_MAX_MASTERS slots; when all are taken the
+ * overflow slot absorbs the remaining masters so memory stays fixed.
+ */
+
+static sketch_master_t* find_master(sketch_stats_t *sk, const endpoint_t *master) {
+    uint32_t idx = (uint32_t)endpoint_hash(master) & (SKETCH_MAX_MASTERS - 1);
+
+    for (uint32_t probe = 0; probe < SKETCH_MAX_MASTERS; probe++) {
+        sketch_master_t *slot = &sk->masters[(idx + probe) & (SKETCH_MAX_MASTERS - 1)];
+        if (slot->master.family == ENDPOINT_NONE) {
+            slot->master = *master;
+            return slot;
+        }
+        if (endpoint_equal(&slot->master, master)) {
+            return slot;
+        }
+    }
+    return &sk->masters[SKETCH_MAX_MASTERS];
+}
+
+
+/*
+ * register_range() - Data table, start address and quantity of a request
+ *
+ * Tables: 0 = coils, 1 = discrete inputs, 2 = holding, 3 = input registers.
+ *
+ * Return: false if the function does not address a register range
+ */
+
+static bool register_range(const modbus_tcp_frame_t *frame, uint8_t *table,
+                           uint16_t *address, uint16_t *quantity) {
+    if (frame->data_length < 4) {
+        return false;
+    }
+
+    *address = ntohs(*(uint16_t*)&frame->data[0]);
+    *quantity = ntohs(*(uint16_t*)&frame->data[2]);
+
+    switch (frame->function_code) {
+        case 0x01: case 0x0F: *table = 0; break;
+        case 0x05:            *table = 0; *quantity = 1; break;
+        case 0x02:            *table = 1; break;
+        case 0x03: case 0x10: case 0x17: *table = 2; break;
+        case 0x06: case 0x16: *table = 2; *quantity = 1; break;
+        case 0x04:            *table = 3; break;
+        default:
+            return false;
+    }
+
+    uint16_t max = (*table <= 1) ? SKETCH_MAX_COILS : SKETCH_MAX_REGISTERS;
+    if (*quantity > max) {
+        *quantity = max;
+    }
+    return true;
+}
+
+
+/**
+ * sketch_stats_update() - Account one frame
+ * @sk: Sketch layer
+ * @frame: Parsed frame
+ * @src: Source address
+ * @src_port: Source TCP port
+ *
+ * Only requests (frames not sent from port 502) are sketched. Register
+ * ranges cost one HLL update per register (at most 125); coil and
+ * discrete-input ranges are hashed per 16-bit word, so a 2000-coil
+ * request costs at most 126 updates instead of 2000.
+ */
+
+void sketch_stats_update(sketch_stats_t *sk, const modbus_tcp_frame_t *frame,
+                         const endpoint_t *src, uint16_t src_port) {
+    if (src_port == SKETCH_MODBUS_PORT) {
+        return;
+    }
+
+    sketch_master_t *m = find_master(sk, src);
+    m->requests++;
+    hll_add(&m->units, mix64(frame->mbap.unit_id));
+
+    uint8_t table = 0;
+    uint16_t address = 0, quantity;
+    bool has_range = register_range(frame, &table, &address, &quantity);
+
+    if (has_range && quantity > 0) {
+        uint64_t base = ((uint64_t)frame->mbap.unit_id << 24) | ((uint64_t)table << 16);
+        if (table <= 1) {
+            // Bit tables: one update per word, at most 126 for 2000 coils
+            uint32_t first = address / SKETCH_COIL_WORD;
+            uint32_t last = ((uint32_t)address + quantity - 1) / SKETCH_COIL_WORD;
+            for (uint32_t w = first; w <= last; w++) {
+                hll_add(&m->registers, mix64(base | (w & (65536 / SKETCH_COIL_WORD - 1))));
+            }
+        } else {
+            for (uint32_t i = 0; i < quantity; i++) {
+                hll_add(&m->registers, mix64(base | (uint16_t)(address + i)));
+            }
+        }
+    }
+
+    uint8_t fc = frame->function_code & 0x7F;
+    uint64_t key = mix64(endpoint_hash(src) ^ ((uint64_t)fc << 16) ^ address);
+    cms_add(&sk->tuples, key, 1);
+
+    sketch_tuple_t tuple = { .master = *src, .function_code = fc, .address = address };
+    ss_add(&sk->heavy, key, &tuple);
+}
+
+
+/**
+ * sketch_stats_merge() - Fold @src into @dst
+ * @dst: Destination layer
+ * @src: Source layer built with the same budget
+ *
+ * Masters are matched by address; unmatched masters claim a free slot
+ * or fall into the overflow slot.
+ *
+ * Return: false if the layouts differ or allocation failed
+ */
+
+bool sketch_stats_merge(sketch_stats_t *dst, const sketch_stats_t *src) {
+    if (dst->budget != src->budget || dst->register_precision != src->register_precision ||
+        dst->unit_precision != src->unit_precision) {
+        return false;
+    }
+
+    for (int i = 0; i <= SKETCH_MAX_MASTERS; i++) {
+        const sketch_master_t *s = &src->masters[i];
+        if (s->requests == 0) {
+            continue;
+        }
+
+        sketch_master_t *d = (i == SKETCH_MAX_MASTERS) ? &dst->masters[SKETCH_MAX_MASTERS]
+                                                     : find_master(dst, &s->master);
+        if (!hll_merge(&d->registers, &s->registers) || !hll_merge(&d->units, &s->units)) {
+            return false;
+        }
+        d->requests += s->requests;
+    }
+
+    return cms_merge(&dst->tuples, &src->tuples) && ss_merge(&dst->heavy, &src->heavy);
+}
+
+
+/**
+ * sketch_stats_memory() - Bytes actually allocated by the layer
+ * @sk: Sketch layer
+ *
+ * Return: Allocated bytes (always <= budget)
+ */
+
+size_t sketch_stats_memory(const sketch_stats_t *sk) {
+    size_t bytes = 0;
+
+    bytes += (size_t)(SKETCH_MAX_MASTERS + 1) *
+             (((size_t)1 << sk->register_precision) + ((size_t)1 << sk->unit_precision));
+    bytes += (size_t)sk->tuples.width * sk->tuples.depth * sizeof(uint32_t);
+    bytes += ss_bytes(sk->heavy.capacity);
+    return bytes;
+}
+
+
+/*
+ * write_block() / read_block() - Whole-or-nothing checkpoint I/O
+ */
+
+static bool write_block(FILE *f, const void *data, size_t bytes) {
+    return bytes == 0 || fwrite(data, bytes, 1, f) == 1;
+}
+
+static bool read_block(FILE *f, void *data, size_t bytes) {
+    return bytes == 0 || fread(data, bytes, 1, f) == 1;
+}
+
+
+/**
+ * sketch_stats_save() - Write all sketches to a checkpoint
+ * @sk: Sketch layer
+ * @f: Open binary file
+ *
+ * Layout: budget and precision (the layout key), used master slots as
+ * (index, address, requests, registers, units), the count-min matrix,
+ * then the space-saving entries, heap and index.
+ *
+ * Return: false on write error
+ */
+
+bool sketch_stats_save(const sketch_stats_t *sk, FILE *f) {
+    const spacesaving_t *ss = &sk->heavy;
+    uint64_t budget = sk->budget;
+    uint32_t used = 0;
+
+    for (uint32_t i = 0; i <= SKETCH_MAX_MASTERS; i++) {
+        used += sk->masters[i].requests > 0;
+    }
+    if (!write_block(f, &budget, sizeof(budget)) ||
+        !write_block(f, &sk->register_precision, sizeof(sk->register_precision)) ||
+        !write_block(f, &used, sizeof(used))) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i <= SKETCH_MAX_MASTERS; i++) {
+        const sketch_master_t *m = &sk->masters[i];
+        if (m->requests == 0) continue;
+        if (!write_block(f, &i, sizeof(i)) ||
+            !write_block(f, &m->master, sizeof(m->master)) ||
+            !write_block(f, &m->requests, sizeof(m->requests)) ||
+            !write_block(f, m->registers.registers, (size_t)1 << m->registers.precision) ||
+            !write_block(f, m->units.registers, (size_t)1 << m->units.precision)) {
+            return false;
+        }
+    }
+
+    return write_block(f, &sk->tuples.total, sizeof(sk->tuples.total)) &&
+           write_block(f, sk->tuples.counters,
+                       (size_t)sk->tuples.width * sk->tuples.depth * sizeof(uint32_t)) &&
+           write_block(f, &ss->used, sizeof(ss->used)) &&
+           write_block(f, &ss->total, sizeof(ss->total)) &&
+           write_block(f, ss->entries, (size_t)ss->used * sizeof(ss_entry_t)) &&
+           write_block(f, ss->heap, (size_t)ss->used * sizeof(uint32_t)) &&
+           write_block(f, ss->heap_pos, (size_t)ss->used * sizeof(uint32_t)) &&
+           write_block(f, ss->index, ((size_t)ss->index_mask + 1) * sizeof(uint32_t));
+}
+
+
+/**
+ * sketch_stats_restore() - Load sketches written by sketch_stats_save()
+ * @sk: Layer from sketch_stats_init() with the same budget
+ * @f: Open binary file
+ *
+ * Return: false on a short checkpoint or a different layout
+ */
+
+bool sketch_stats_restore(sketch_stats_t *sk, FILE *f) {
+    spacesaving_t *ss = &sk->heavy;
+    uint64_t budget;
+    uint8_t precision;
+    uint32_t used;
+
+    if (!read_block(f, &budget, sizeof(budget)) ||
+        !read_block(f, &precision, sizeof(precision)) ||
+        !read_block(f, &used, sizeof(used)) ||
+        budget != sk->budget || precision != sk->register_precision ||
+        used > SKETCH_MAX_MASTERS + 1) {
+        return false;
+    }
+
+    for (uint32_t n = 0; n < used; n++) {
+        uint32_t i;
+        if (!read_block(f, &i, sizeof(i)) || i > SKETCH_MAX_MASTERS) {
+            return false;
+        }
+        sketch_master_t *m = &sk->masters[i];
+        if (!read_block(f, &m->master, sizeof(m->master)) ||
+            !read_block(f, &m->requests, sizeof(m->requests)) ||
+            !read_block(f, m->registers.registers, (size_t)1 << m->registers.precision) ||
+            !read_block(f, m->units.registers, (size_t)1 << m->units.precision)) {
+            return false;
+        }
+    }
+
+    if (!read_block(f, &sk->tuples.total, sizeof(sk->tuples.total)) ||
+        !read_block(f, sk->tuples.counters,
+                    (size_t)sk->tuples.width * sk->tuples.depth * sizeof(uint32_t)) ||
+        !read_block(f, &ss->used, sizeof(ss->used)) ||
+        !read_block(f, &ss->total, sizeof(ss->total)) ||
+        ss->used > ss->capacity) {
+        return false;
+    }
+    return read_block(f, ss->entries, (size_t)ss->used * sizeof(ss_entry_t)) &&
+           read_block(f, ss->heap, (size_t)ss->used * sizeof(uint32_t)) &&
+           read_block(f, ss->heap_pos, (size_t)ss->used * sizeof(uint32_t)) &&
+           read_block(f, ss->index, ((size_t)ss->index_mask + 1) * sizeof(uint32_t));
+}
+
+
+/*
+ * struct master_estimate - Sort helper for per-master summaries
+ */
+
+typedef struct {
+    const sketch_master_t *master;
+    double registers;
+    double units;
+} master_estimate_t;
+
+
+/*
+ * master_name() - Display text of a slot ("(other)" for the overflow slot)
+ */
+
+static const char* master_name(const sketch_master_t *m, char *buf) {
+    if (m->master.family == ENDPOINT_NONE) {
+        return SKETCH_OVERFLOW_NAME;
+    }
+    endpoint_format(&m->master, buf, ENDPOINT_STR_LEN);
+    return buf;
+}
+
+
+/*
+ * compare_master_desc() - qsort comparator, descending register estimate
+ */
+
+static int compare_master_desc(const void *a, const void *b) {
+    const master_estimate_t *x = a;
+    const master_estimate_t *y = b;
+    return (x->registers < y->registers) - (x->registers > y->registers);
+}
+
+
+/*
+ * collect_masters() - Estimates for every used slot, sorted
+ *
+ * Return: Number of entries written to @out
+ */
+
+static uint32_t collect_masters(const sketch_stats_t *sk, master_estimate_t *out) {
+    uint32_t n = 0;
+
+    for (int i = 0; i <= SKETCH_MAX_MASTERS; i++) {
+        const sketch_master_t *m = &sk->masters[i];
+        if (m->requests == 0) {
+            continue;
+        }
+        out[n].master = m;
+        out[n].registers = hll_estimate(&m->registers);
+        out[n].units = hll_estimate(&m->units);
+        n++;
+    }
+
+    qsort(out, n, sizeof(master_estimate_t), compare_master_desc);
+    return n;
+}
+
+
+/**
+ * sketch_display_summary() - Print estimates with error bounds
+ * @sk: Sketch layer
+ */
+
+void sketch_display_summary(const sketch_stats_t *sk) {
+    master_estimate_t estimates[SKETCH_MAX_MASTERS + 1];
+    ss_entry_t top[SKETCH_TOP_ROWS];
+    char name[ENDPOINT_STR_LEN];
+    uint32_t n = collect_masters(sk, estimates);
+    double reg_err = 1.04 / sqrt((double)(1u << sk->register_precision));
+    double unit_err = 1.04 / sqrt((double)(1u << sk->unit_precision));
+    double cms_eps = exp(1.0) / sk->tuples.width;
+
+    printf("\n%sApproximate Statistics (budget %zu KiB, used %zu KiB):%s\n",
+           COLOR_WHITE, sk->budget / 1024, sketch_stats_memory(sk) / 1024, COLOR_RESET);
+    printf("  Distinct registers: HLL m=%u, ±%.1f%% (1σ), ±%.1f%% (95%%)\n",
+           1u << sk->register_precision, reg_err * 100.0, reg_err * SKETCH_Z95 * 100.0);
+    printf("  Distinct units:     HLL m=%u, ±%.1f%% (1σ)\n",
+           1u << sk->unit_precision, unit_err * 100.0);
+
+    if (n > 0) {
+        printf("  %s%-16s %10s %12s %8s%s\n", COLOR_WHITE,
+               "Master", "Requests", "~Registers", "~Units", COLOR_RESET);
+        for (uint32_t i = 0; i < n && i < SKETCH_TOP_ROWS; i++) {
+            printf("  %s%-16s%s %10llu %12.0f %8.0f\n",
+                   COLOR_CYAN, master_name(estimates[i].master, name), COLOR_RESET,
+                   (unsigned long long)estimates[i].master->requests,
+                   estimates[i].registers, estimates[i].units);
+        }
+        if (n > SKETCH_TOP_ROWS) {
+            printf("  ... %u more masters\n", n - SKETCH_TOP_ROWS);
+        }
+    }
+
+    uint32_t k = ss_top(&sk->heavy, top, SKETCH_TOP_ROWS);
+    if (k == 0) {
+        return;
+    }
+
+    printf("\n  %sHeaviest (master, function, address) tuples:%s\n", COLOR_WHITE, COLOR_RESET);
+    printf("  Space-saving k=%u: counts overestimate by at most the listed error\n",
+           sk->heavy.capacity);
+    printf("  Count-min %ux%u: +%.4f%% of N (N=%llu) with p=%.3f\n",
+           sk->tuples.depth, sk->tuples.width, cms_eps * 100.0,
+           (unsigned long long)sk->tuples.total, 1.0 - exp(-(double)sk->tuples.depth));
+
+    for (uint32_t i = 0; i < k; i++) {
+        endpoint_format(&top[i].tuple.master, name, sizeof(name));
+        printf("  %s%-16s%s %s0x%02X%s %s%-6u%s %10llu ±%llu\n",
+               COLOR_CYAN, name, COLOR_RESET,
+               COLOR_MAGENTA, top[i].tuple.function_code, COLOR_RESET,
+               COLOR_BLUE, top[i].tuple.address, COLOR_RESET,
+               (unsigned long long)top[i].count, (unsigned long long)top[i].error);
+    }
+}
+
+
+/**
+ * sketch_write_report() - Append estimates to markdown report
+ * @sk: Sketch layer
+ * @f: Open report file (no-op if NULL)
+ */
+
+void sketch_write_report(const sketch_stats_t *sk, FILE *f) {
+    if (!f) return;
+
+    master_estimate_t estimates[SKETCH_MAX_MASTERS + 1];
+    ss_entry_t top[SKETCH_TOP_ROWS];
+    char name[ENDPOINT_STR_LEN];
+    uint32_t n = collect_masters(sk, estimates);
+    double reg_err = 1.04 / sqrt((double)(1u << sk->register_precision));
+    double unit_err = 1.04 / sqrt((double)(1u << sk->unit_precision));
+    double cms_eps = exp(1.0) / sk->tuples.width;
+
+    fprintf(f, "\n### Approximate Statistics\n\n");
+    fprintf(f, "- **Sketch budget:** %zu KiB (%zu KiB used)\n",
+            sk->budget / 1024, sketch_stats_memory(sk) / 1024);
+    fprintf(f, "- **Distinct registers:** HyperLogLog m=%u, ±%.1f%% (1σ), ±%.1f%% (95%%)\n",
+            1u << sk->register_precision, reg_err * 100.0, reg_err * SKETCH_Z95 * 100.0);
+    fprintf(f, "- **Distinct units:** HyperLogLog m=%u, ±%.1f%% (1σ)\n",
+            1u << sk->unit_precision, unit_err * 100.0);
+    fprintf(f, "- **Tuple frequencies:** count-min %u×%u, overestimate ≤ %.4f%% of N "
+               "(N=%llu) with probability %.3f\n\n",
+            sk->tuples.depth, sk->tuples.width, cms_eps * 100.0,
+            (unsigned long long)sk->tuples.total, 1.0 - exp(-(double)sk->tuples.depth));
+
+    if (n > 0) {
+        fprintf(f, "| Master | Requests | ~Distinct Registers | ~Distinct Units |\n");
+        fprintf(f, "|--------|----------|---------------------|-----------------|\n");
+        for (uint32_t i = 0; i < n; i++) {
+            fprintf(f, "| %s | %llu | %.0f ± %.0f | %.0f ± %.0f |\n",
+                    master_name(estimates[i].master, name),
+                    (unsigned long long)estimates[i].master->requests,
+                    estimates[i].registers, estimates[i].registers * reg_err,
+                    estimates[i].units, estimates[i].units * unit_err);
+        }
+    }
+
+    uint32_t k = ss_top(&sk->heavy, top, SKETCH_TOP_ROWS);
+    if (k == 0) {
+        return;
+    }
+
+    fprintf(f, "\n**Heaviest tuples** (space-saving k=%u; count never below true value, "
+               "overestimate ≤ error):\n\n", sk->heavy.capacity);
+    fprintf(f, "| Master | Function | Address | Count | Error |\n");
+    fprintf(f, "|--------|----------|---------|-------|-------|\n");
+    for (uint32_t i = 0; i < k; i++) {
+        endpoint_format(&top[i].tuple.master, name, sizeof(name));
+        fprintf(f, "| %s | 0x%02X | %u | %llu | %llu |\n",
+                name, top[i].tuple.function_code, top[i].tuple.address,
+                (unsigned long long)top[i].count, (unsigned long long)top[i].error);
+    }
+}
+
+
+/**
+ * sketch_stats_free() - Release all sketches
+ * @sk: Sketch layer
+ */
+
+void sketch_stats_free(sketch_stats_t *sk) {
+    for (int i = 0; i <= SKETCH_MAX_MASTERS; i++) {
+        hll_free(&sk->masters[i].registers);
+        hll_free(&sk->masters[i].units);
+    }
+    cms_free(&sk->tuples);
+    ss_free(&sk->heavy);
+}
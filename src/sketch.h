@@ -0,0 +1,424 @@
+/*
+ * sketch.h - Memory-bounded approximate statistics
+ *
+ * Probabilistic sketches for long captures where exact per-key sets
+ * would grow without bound:
+ * - HyperLogLog: distinct registers per master, distinct units per master
+ * - Count-min: frequency of arbitrary (master, function, address) tuples
+ * - Space-saving: top-k heaviest (master, function, address) tuples
+ *
+ * All three are mergeable (register max / counter add / summary combine)
+ * so per-thread or per-file sketches can be folded into one; see
+ * tests/sketch_merge.c. Memory is fixed at init time from a byte budget
+ * and never grows afterwards.
+ *
+ * Copyright (C) 2025 Marty
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef SKETCH_H
+#define SKETCH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include "modbus_parser.h"
+#include "endpoint.h"
+
+
+/* Default memory budget for sketch_stats_t (bytes) */
+#define SKETCH_DEFAULT_BUDGET (1024 * 1024)
+
+/* Smallest accepted memory budget (bytes) */
+#define SKETCH_MIN_BUDGET (64 * 1024)
+
+/* Number of per-master slots before masters share the overflow slot */
+#define SKETCH_MAX_MASTERS 256
+
+/* Largest HyperLogLog precision used for unit IDs (at most 256 distinct) */
+#define SKETCH_UNIT_PRECISION 8
+
+/* Count-min depth (rows); failure probability is e^-depth */
+#define SKETCH_CMS_DEPTH 4
+
+
+/**
+ * struct hll_t - HyperLogLog cardinality sketch
+ * @precision: log2 of the register count (4-16)
+ * @registers: 2^precision rank registers
+ *
+ * Relative standard error is 1.04 / sqrt(2^precision).
+ */
+
+typedef struct {
+    uint8_t precision;
+    uint8_t *registers;
+} hll_t;
+
+
+/**
+ * struct cms_t - Count-min frequency sketch
+ * @width: Counters per row (power of two)
+ * @depth: Number of rows
+ * @total: Sum of all increments (N)
+ * @counters: depth x width counter matrix
+ *
+ * Estimates never undercount; overcount is at most (e / width) * N with
+ * probability 1 - e^-depth.
+ */
+
+typedef struct {
+    uint32_t width;
+    uint32_t depth;
+    uint64_t total;
+    uint32_t *counters;
+} cms_t;
+
+
+/**
+ * struct sketch_tuple_t - Decoded heavy-hitter key
+ * @master: Master address
+ * @function_code: Request function code
+ * @address: Request start address
+ */
+
+typedef struct {
+    endpoint_t master;
+    uint8_t function_code;
+    uint16_t address;
+} sketch_tuple_t;
+
+
+/**
+ * struct ss_entry_t - One space-saving counter
+ * @key: 64-bit hash of @tuple
+ * @count: Estimated count (never below the true count)
+ * @error: Maximum overestimate included in @count
+ * @tuple: Decoded key for display
+ */
+
+typedef struct {
+    uint64_t key;
+    uint64_t count;
+    uint64_t error;
+    sketch_tuple_t tuple;
+} ss_entry_t;
+
+
+/**
+ * struct spacesaving_t - Space-saving top-k summary
+ * @capacity: Maximum monitored keys (k)
+ * @used: Keys currently monitored
+ * @total: Sum of all increments (N)
+ * @entries: Counter storage (@capacity entries)
+ * @heap: Min-heap of entry indices ordered by count
+ * @heap_pos: Position of each entry in @heap
+ * @index: Open-addressed key -> entry+1 table (0 = empty)
+ * @index_mask: Size of @index minus one
+ *
+ * Any key with true count above N / k is guaranteed to be monitored.
+ */
+
+typedef struct {
+    uint32_t capacity;
+    uint32_t used;
+    uint64_t total;
+    ss_entry_t *entries;
+    uint32_t *heap;
+    uint32_t *heap_pos;
+    uint32_t *index;
+    uint32_t index_mask;
+} spacesaving_t;
+
+
+/**
+ * struct sketch_master_t - Per-master cardinality sketches
+ * @master: Master address (unset for unused slots and the overflow slot)
+ * @requests: Requests accounted to this master
+ * @registers: Distinct (table, address) pairs touched; coils and discrete
+ *             inputs are counted per 16-bit word
+ * @units: Distinct unit IDs addressed
+ */
+
+typedef struct {
+    endpoint_t master;
+    uint64_t requests;
+    hll_t registers;
+    hll_t units;
+} sketch_master_t;
+
+
+/**
+ * struct sketch_stats_t - Sketch layer kept next to attack_stats_t
+ * @budget: Memory budget the layout was derived from (bytes)
+ * @register_precision: HLL precision of the per-master register sketch
+ * @unit_precision: HLL precision of the per-master unit sketch
+ * @masters: SKETCH_MAX_MASTERS slots plus one overflow slot
+ * @tuples: Count-min over (master, function, address)
+ * @heavy: Space-saving top-k over (master, function, address)
+ *
+ * Two sketch_stats_t built with the same budget can be merged.
+ */
+
+typedef struct {
+    size_t budget;
+    uint8_t register_precision;
+    uint8_t unit_precision;
+    sketch_master_t masters[SKETCH_MAX_MASTERS + 1];
+    cms_t tuples;
+    spacesaving_t heavy;
+} sketch_stats_t;
+
+
+/**
+ * hll_init() - Allocate a HyperLogLog sketch
+ * @hll: Sketch to initialise
+ * @precision: log2 register count (clamped to 4-16)
+ *
+ * Return: true on success, false on allocation failure
+ */
+
+bool hll_init(hll_t *hll, uint8_t precision);
+
+/**
+ * hll_add() - Add a pre-hashed item
+ * @hll: Sketch
+ * @hash: 64-bit hash of the item
+ */
+
+void hll_add(hll_t *hll, uint64_t hash);
+
+/**
+ * hll_estimate() - Estimate the number of distinct items added
+ * @hll: Sketch
+ *
+ * Return: Cardinality estimate (linear counting for small ranges)
+ */
+
+double hll_estimate(const hll_t *hll);
+
+/**
+ * hll_relative_error() - Relative standard error of a sketch
+ * @hll: Sketch
+ *
+ * Return: 1.04 / sqrt(m)
+ */
+
+double hll_relative_error(const hll_t *hll);
+
+/**
+ * hll_merge() - Fold @src into @dst (register-wise max)
+ * @dst: Destination sketch
+ * @src: Source sketch (same precision)
+ *
+ * Return: false if the precisions differ
+ */
+
+bool hll_merge(hll_t *dst, const hll_t *src);
+
+/**
+ * hll_free() - Release a HyperLogLog sketch
+ * @hll: Sketch
+ */
+
+void hll_free(hll_t *hll);
+
+
+/**
+ * cms_init() - Allocate a count-min sketch
+ * @cms: Sketch to initialise
+ * @width: Counters per row (rounded down to a power of two)
+ * @depth: Number of rows
+ *
+ * Return: true on success, false on allocation failure
+ */
+
+bool cms_init(cms_t *cms, uint32_t width, uint32_t depth);
+
+/**
+ * cms_add() - Increment a pre-hashed key
+ * @cms: Sketch
+ * @hash: 64-bit key hash
+ * @count: Increment
+ */
+
+void cms_add(cms_t *cms, uint64_t hash, uint32_t count);
+
+/**
+ * cms_estimate() - Estimated count of a pre-hashed key
+ * @cms: Sketch
+ * @hash: 64-bit key hash
+ *
+ * Return: Upper-biased count estimate
+ */
+
+uint64_t cms_estimate(const cms_t *cms, uint64_t hash);
+
+/**
+ * cms_merge() - Fold @src into @dst (counter-wise add)
+ * @dst: Destination sketch
+ * @src: Source sketch (same dimensions)
+ *
+ * Return: false if the dimensions differ
+ */
+
+bool cms_merge(cms_t *dst, const cms_t *src);
+
+/**
+ * cms_free() - Release a count-min sketch
+ * @cms: Sketch
+ */
+
+void cms_free(cms_t *cms);
+
+
+/**
+ * ss_init() - Allocate a space-saving summary
+ * @ss: Summary to initialise
+ * @capacity: Number of monitored keys (k)
+ *
+ * Return: true on success, false on allocation failure
+ */
+
+bool ss_init(spacesaving_t *ss, uint32_t capacity);
+
+/**
+ * ss_add() - Count one occurrence of a key
+ * @ss: Summary
+ * @hash: 64-bit key hash
+ * @tuple: Decoded key, stored when the key becomes monitored
+ *
+ * O(log k): index lookup plus one heap sift.
+ */
+
+void ss_add(spacesaving_t *ss, uint64_t hash, const sketch_tuple_t *tuple);
+
+/**
+ * ss_merge() - Fold @src into @dst
+ * @dst: Destination summary
+ * @src: Source summary
+ *
+ * Keys missing from a full summary are charged that summary's minimum
+ * count as additional error, preserving the space-saving guarantee.
+ *
+ * Return: false on allocation failure
+ */
+
+bool ss_merge(spacesaving_t *dst, const spacesaving_t *src);
+
+/**
+ * ss_top() - Copy monitored entries sorted by descending count
+ * @ss: Summary
+ * @out: Output array
+ * @max: Capacity of @out
+ *
+ * Return: Number of entries written
+ */
+
+uint32_t ss_top(const spacesaving_t *ss, ss_entry_t *out, uint32_t max);
+
+/**
+ * ss_free() - Release a space-saving summary
+ * @ss: Summary
+ */
+
+void ss_free(spacesaving_t *ss);
+
+
+/**
+ * sketch_stats_init() - Lay out all sketches inside a memory budget
+ * @sk: Sketch layer to initialise
+ * @budget: Total bytes (raised to SKETCH_MIN_BUDGET if smaller)
+ *
+ * Three quarters of the budget go to per-master HyperLogLogs, the rest
+ * is split between the count-min matrix and the space-saving summary.
+ * Each part is sized from its exact allocation, so sketch_stats_memory()
+ * never exceeds @budget.
+ *
+ * Return: true on success, false on allocation failure
+ */
+
+bool sketch_stats_init(sketch_stats_t *sk, size_t budget);
+
+/**
+ * sketch_stats_update() - Account one frame
+ * @sk: Sketch layer
+ * @frame: Parsed frame
+ * @src: Source address
+ * @src_port: Source TCP port
+ *
+ * Only requests (frames not sent from port 502) are sketched. Register
+ * ranges cost one HLL update per register (at most 125); coil and
+ * discrete-input ranges are hashed per 16-bit word, so a 2000-coil
+ * request costs at most 126 updates instead of 2000.
+ */
+
+void sketch_stats_update(sketch_stats_t *sk, const modbus_tcp_frame_t *frame,
+                         const endpoint_t *src, uint16_t src_port);
+
+/**
+ * sketch_stats_merge() - Fold @src into @dst
+ * @dst: Destination layer
+ * @src: Source layer built with the same budget
+ *
+ * Return: false if the layouts differ or allocation failed
+ */
+
+bool sketch_stats_merge(sketch_stats_t *dst, const sketch_stats_t *src);
+
+/**
+ * sketch_stats_memory() - Bytes actually allocated by the layer
+ * @sk: Sketch layer
+ *
+ * Return: Allocated bytes (always <= budget)
+ */
+
+size_t sketch_stats_memory(const sketch_stats_t *sk);
+
+/**
+ * sketch_stats_save() - Write all sketches to a checkpoint
+ * @sk: Sketch layer
+ * @f: Open binary file
+ *
+ * Unused master slots are skipped, so the checkpoint is smaller than the
+ * budget until many masters have been seen.
+ *
+ * Return: false on write error
+ */
+
+bool sketch_stats_save(const sketch_stats_t *sk, FILE *f);
+
+/**
+ * sketch_stats_restore() - Load sketches written by sketch_stats_save()
+ * @sk: Layer from sketch_stats_init() with the same budget
+ * @f: Open binary file
+ *
+ * Return: false on a short checkpoint or a different layout
+ */
+
+bool sketch_stats_restore(sketch_stats_t *sk, FILE *f);
+
+/**
+ * sketch_display_summary() - Print estimates with error bounds
+ * @sk: Sketch layer
+ */
+
+void sketch_display_summary(const sketch_stats_t *sk);
+
+/**
+ * sketch_write_report() - Append estimates to markdown report
+ * @sk: Sketch layer
+ * @f: Open report file (no-op if NULL)
+ */
+
+void sketch_write_report(const sketch_stats_t *sk, FILE *f);
+
+/**
+ * sketch_stats_free() - Release all sketches
+ * @sk: Sketch layer
+ */
+
+void sketch_stats_free(sketch_stats_t *sk);
+
+#endif /* SKETCH_H */
@@ -0,0 +1,542 @@
+/*
+ * timeseries.c - Per-second traffic counts with minute and hour rollups
+ *
+ * Only the open second is updated per frame. When a frame falls into a
+ * later second the open one is closed: it is checked against the peak,
+ * exported, and merged into the open minute, which is closed the same
+ * way when the minute changes, and so on up to the hour. Buckets track
+ * which function codes and units they have seen, so merging and
+ * clearing never walk all 256 counters.
+ *
+ * Copyright (C) 2025 Marty
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+
+#include "timeseries.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "colors.h"
+
+
+/* Resolution names used in the CSV export and summaries */
+static const char *const resolution_names[TS_RESOLUTIONS] = { "second", "minute", "hour" };
+
+
+/*
+ * floor_div() - Division rounding towards negative infinity
+ */
+
+static int64_t floor_div(int64_t a, int64_t b) {
+    int64_t q = a / b;
+    if ((a % b) != 0 && ((a < 0) != (b < 0))) {
+        q--;
+    }
+    return q;
+}
+
+
+/*
+ * is_write_request() - Function codes that modify the server
+ */
+
+static bool is_write_request(uint8_t function_code) {
+    switch (function_code) {
+        case 0x05: case 0x06: case 0x0F: case 0x10:
+        case 0x15: case 0x16: case 0x17:
+            return true;
+        default:
+            return false;
+    }
+}
+
+
+/*
+ * bucket_clear() - Reset a bucket, touching only the entries it used
+ */
+
+static void bucket_clear(ts_bucket_t *b, int64_t start) {
+    for (uint16_t i = 0; i < b->function_used; i++) {
+        b->by_function[b->functions[i]] = 0;
+    }
+    for (uint16_t i = 0; i < b->unit_used; i++) {
+        b->by_unit[b->units[i]] = 0;
+    }
+    b->start = start;
+    b->frames = 0;
+    b->exceptions = 0;
+    b->writes = 0;
+    b->function_used = 0;
+    b->unit_used = 0;
+}
+
+
+/*
+ * bucket_count() - Add @n frames of a function code and unit
+ */
+
+static inline void bucket_count(ts_bucket_t *b, uint8_t function_code, uint8_t unit_id,
+                                uint32_t n) {
+    if (b->by_function[function_code] == 0) {
+        b->functions[b->function_used++] = function_code;
+    }
+    b->by_function[function_code] += n;
+    if (b->by_unit[unit_id] == 0) {
+        b->units[b->unit_used++] = unit_id;
+    }
+    b->by_unit[unit_id] += n;
+}
+
+
+/*
+ * bucket_merge() - Add the counts of @src to @dst
+ */
+
+static void bucket_merge(ts_bucket_t *dst, const ts_bucket_t *src) {
+    dst->frames += src->frames;
+    dst->exceptions += src->exceptions;
+    dst->writes += src->writes;
+
+    for (uint16_t i = 0; i < src->function_used; i++) {
+        uint8_t fc = src->functions[i];
+        if (dst->by_function[fc] == 0) {
+            dst->functions[dst->function_used++] = fc;
+        }
+        dst->by_function[fc] += src->by_function[fc];
+    }
+    for (uint16_t i = 0; i < src->unit_used; i++) {
+        uint8_t unit = src->units[i];
+        if (dst->by_unit[unit] == 0) {
+            dst->units[dst->unit_used++] = unit;
+        }
+        dst->by_unit[unit] += src->by_unit[unit];
+    }
+}
+
+
+/*
+ * bucket_top() - Most frequent entry of a used list
+ */
+
+static uint8_t bucket_top(const uint8_t *used, uint16_t count, const uint32_t *counts,
+                          uint32_t *top_count) {
+    uint8_t top = 0;
+
+    *top_count = 0;
+    for (uint16_t i = 0; i < count; i++) {
+        if (counts[used[i]] > *top_count) {
+            top = used[i];
+            *top_count = counts[used[i]];
+        }
+    }
+    return top;
+}
+
+
+/*
+ * open_bucket() - Start the next ring bucket at @start
+ */
+
+static ts_bucket_t *open_bucket(ts_tier_t *tier, int64_t start) {
+    if (tier->filled == 0) {
+        tier->head = 0;
+        tier->filled = 1;
+    } else {
+        tier->head = (tier->head + 1) % tier->slots;
+        if (tier->filled < tier->slots) {
+            tier->filled++;
+        }
+    }
+
+    ts_bucket_t *b = &tier->ring[tier->head];
+    bucket_clear(b, start);
+    tier->open = true;
+    return b;
+}
+
+
+/*
+ * export_bucket() - Append one completed bucket to the CSV file
+ */
+
+static void export_bucket(timeseries_t *ts, ts_resolution_t level, const ts_bucket_t *b) {
+    FILE *f = ts->export_file;
+    time_t start = (time_t)b->start;
+    struct tm *tm_info = gmtime(&start);
+    char when[32] = "-";
+
+    if (tm_info) {
+        strftime(when, sizeof(when), "%Y-%m-%dT%H:%M:%SZ", tm_info);
+    }
+    fprintf(f, "%s,%lld,%s,%u,%u,%u,", resolution_names[level], (long long)b->start, when,
+            b->frames, b->exceptions, b->writes);
+    for (uint16_t i = 0; i < b->function_used; i++) {
+        fprintf(f, i ? ";%u=%u" : "%u=%u", b->functions[i], b->by_function[b->functions[i]]);
+    }
+    fputc(',', f);
+    for (uint16_t i = 0; i < b->unit_used; i++) {
+        fprintf(f, i ? ";%u=%u" : "%u=%u", b->units[i], b->by_unit[b->units[i]]);
+    }
+    fputc('\n', f);
+}
+
+
+static void fold_bucket(timeseries_t *ts, ts_resolution_t level, const ts_bucket_t *src);
+
+
+/*
+ * close_bucket() - Complete the open bucket of a resolution
+ *
+ * Updates the peak, exports the bucket and merges it into the next
+ * coarser resolution.
+ */
+
+static void close_bucket(timeseries_t *ts, ts_resolution_t level) {
+    ts_tier_t *tier = &ts->tiers[level];
+    const ts_bucket_t *b = &tier->ring[tier->head];
+
+    tier->open = false;
+    tier->closed++;
+    if (b->frames > tier->peak.frames) {
+        tier->peak = *b;
+    }
+    if (ts->export_file) {
+        export_bucket(ts, level, b);
+    }
+    if (level + 1 < TS_RESOLUTIONS) {
+        fold_bucket(ts, level + 1, b);
+    }
+}
+
+
+/*
+ * fold_bucket() - Merge a completed finer bucket into its coarser bucket
+ */
+
+static void fold_bucket(timeseries_t *ts, ts_resolution_t level, const ts_bucket_t *src) {
+    ts_tier_t *tier = &ts->tiers[level];
+    int64_t start = floor_div(src->start, tier->width) * tier->width;
+
+    if (tier->open && tier->ring[tier->head].start != start) {
+        close_bucket(ts, level);
+    }
+    if (!tier->open) {
+        open_bucket(tier, start);
+    }
+    bucket_merge(&tier->ring[tier->head], src);
+}
+
+
+/**
+ * timeseries_init() - Allocate empty rings
+ * @ts: Aggregator
+ *
+ * Return: false on allocation failure (prints an error)
+ */
+
+bool timeseries_init(timeseries_t *ts) {
+    static const uint32_t widths[TS_RESOLUTIONS] = { 1, 60, 3600 };
+    static const uint32_t slots[TS_RESOLUTIONS] = {
+        TIMESERIES_SECOND_SLOTS, TIMESERIES_MINUTE_SLOTS, TIMESERIES_HOUR_SLOTS
+    };
+
+    memset(ts, 0, sizeof(*ts));
+    for (int level = 0; level < TS_RESOLUTIONS; level++) {
+        ts_tier_t *tier = &ts->tiers[level];
+        tier->width = widths[level];
+        tier->slots = slots[level];
+        tier->ring = calloc(tier->slots, sizeof(ts_bucket_t));
+        if (!tier->ring) {
+            printf("Error: Could not allocate time series rings\n");
+            timeseries_free(ts);
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/**
+ * timeseries_export() - Stream completed buckets to a CSV file
+ * @ts: Aggregator
+ * @path: Output file (created, header written)
+ *
+ * Return: false if the file could not be created (prints an error)
+ */
+
+bool timeseries_export(timeseries_t *ts, const char *path) {
+    ts->export_file = fopen(path, "w");
+    if (!ts->export_file) {
+        printf("Error: Could not create time series file %s\n", path);
+        return false;
+    }
+    fprintf(ts->export_file, "resolution,start,time,frames,exceptions,writes,functions,units\n");
+    return true;
+}
+
+
+/**
+ * timeseries_update() - Count one frame
+ * @ts: Aggregator
+ * @frame: Parsed frame
+ * @is_request: true if sent to the server
+ * @timestamp_ns: Capture time in nanoseconds since epoch
+ *
+ * A frame older than the open second (out-of-order capture) is counted
+ * in the open second rather than reopening a closed one.
+ */
+
+void timeseries_update(timeseries_t *ts, const modbus_tcp_frame_t *frame, bool is_request,
+                       int64_t timestamp_ns) {
+    ts_tier_t *tier = &ts->tiers[TS_SECOND];
+    int64_t second = floor_div(timestamp_ns, 1000000000);
+    ts_bucket_t *b = &tier->ring[tier->head];
+
+    if (!tier->open) {
+        b = open_bucket(tier, second);
+    } else if (second > b->start) {
+        close_bucket(ts, TS_SECOND);
+        b = open_bucket(tier, second);
+    } else if (second < b->start) {
+        ts->late_frames++;
+    }
+
+    b->frames++;
+    if (frame->function_code & 0x80) {
+        b->exceptions++;
+    } else if (is_request && is_write_request(frame->function_code)) {
+        b->writes++;
+    }
+    bucket_count(b, frame->function_code, frame->mbap.unit_id, 1);
+}
+
+
+/**
+ * timeseries_finish() - Close the open buckets at the end of the capture
+ * @ts: Aggregator
+ *
+ * Return: false if the export file lost data (prints a warning)
+ */
+
+bool timeseries_finish(timeseries_t *ts) {
+    // Finer buckets first: closing a second may reopen its minute
+    for (int level = 0; level < TS_RESOLUTIONS; level++) {
+        if (ts->tiers[level].open) {
+            close_bucket(ts, level);
+        }
+    }
+
+    if (!ts->export_file) {
+        return true;
+    }
+    bool ok = !ferror(ts->export_file);
+    if (fclose(ts->export_file) != 0) {
+        ok = false;
+    }
+    ts->export_file = NULL;
+    if (!ok) {
+        printf("Warning: Time series file is incomplete (write error)\n");
+    }
+    return ok;
+}
+
+
+/**
+ * timeseries_save() - Write aggregator state to a checkpoint
+ * @ts: Aggregator
+ * @f: Open binary file
+ *
+ * Layout: late frame count, then per resolution the tier struct
+ * (ring pointer cleared) followed by its @filled buckets.
+ *
+ * Return: false on write error
+ */
+
+bool timeseries_save(const timeseries_t *ts, FILE *f) {
+    if (fwrite(&ts->late_frames, sizeof(ts->late_frames), 1, f) != 1) {
+        return false;
+    }
+    for (int level = 0; level < TS_RESOLUTIONS; level++) {
+        ts_tier_t head = ts->tiers[level];
+        head.ring = NULL;
+        if (fwrite(&head, sizeof(head), 1, f) != 1 ||
+            fwrite(ts->tiers[level].ring, sizeof(ts_bucket_t), head.filled, f) != head.filled) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/**
+ * timeseries_restore() - Load state written by timeseries_save()
+ * @ts: Aggregator from timeseries_init()
+ * @f: Open binary file
+ *
+ * Return: false on a short or inconsistent checkpoint
+ */
+
+bool timeseries_restore(timeseries_t *ts, FILE *f) {
+    if (fread(&ts->late_frames, sizeof(ts->late_frames), 1, f) != 1) {
+        return false;
+    }
+    for (int level = 0; level < TS_RESOLUTIONS; level++) {
+        ts_tier_t *tier = &ts->tiers[level];
+        ts_tier_t head;
+        if (fread(&head, sizeof(head), 1, f) != 1 || head.width != tier->width ||
+            head.slots != tier->slots || head.filled > head.slots || head.head >= head.slots) {
+            return false;
+        }
+        head.ring = tier->ring;
+        *tier = head;
+        if (fread(tier->ring, sizeof(ts_bucket_t), tier->filled, f) != tier->filled) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/*
+ * format_local() - Local time of a bucket start
+ */
+
+static void format_local(int64_t start, const char *format, char *buf, size_t len) {
+    time_t t = (time_t)start;
+    struct tm *tm_info = localtime(&t);
+
+    if (!tm_info || strftime(buf, len, format, tm_info) == 0) {
+        snprintf(buf, len, "%lld", (long long)start);
+    }
+}
+
+
+/*
+ * peak_formats - strftime() format of each resolution's bucket start
+ */
+
+static const char *const peak_formats[TS_RESOLUTIONS] = {
+    "%Y-%m-%d %H:%M:%S", "%Y-%m-%d %H:%M", "%Y-%m-%d %H:00"
+};
+
+
+/**
+ * timeseries_display_summary() - Print peak second, minute and hour
+ * @ts: Aggregator after timeseries_finish()
+ */
+
+void timeseries_display_summary(const timeseries_t *ts) {
+    static const char *const labels[TS_RESOLUTIONS] = {
+        "Peak Second:", "Peak Minute:", "Peak Hour:"
+    };
+
+    if (ts->tiers[TS_SECOND].closed == 0) {
+        return;
+    }
+
+    printf("\n%sTraffic Over Time:%s\n", COLOR_WHITE, COLOR_RESET);
+    for (int level = 0; level < TS_RESOLUTIONS; level++) {
+        const ts_bucket_t *peak = &ts->tiers[level].peak;
+        uint32_t fn_count, unit_count;
+        uint8_t fn = bucket_top(peak->functions, peak->function_used, peak->by_function,
+                                &fn_count);
+        uint8_t unit = bucket_top(peak->units, peak->unit_used, peak->by_unit, &unit_count);
+        char when[32];
+
+        format_local(peak->start, peak_formats[level], when, sizeof(when));
+        printf("  %-14s %s%s%s  %u frames, %u exceptions, %u writes\n",
+               labels[level], COLOR_CYAN, when, COLOR_RESET,
+               peak->frames, peak->exceptions, peak->writes);
+        printf("  %-14s %s (%u), unit %u (%u)\n", "", modbus_get_function_name(fn), fn_count,
+               unit, unit_count);
+    }
+    printf("  Active Seconds:  %llu, minutes: %llu, hours: %llu\n",
+           (unsigned long long)ts->tiers[TS_SECOND].closed,
+           (unsigned long long)ts->tiers[TS_MINUTE].closed,
+           (unsigned long long)ts->tiers[TS_HOUR].closed);
+    if (ts->late_frames > 0) {
+        printf("  Out-of-order:    %llu frames counted in a later second\n",
+               (unsigned long long)ts->late_frames);
+    }
+}
+
+
+/**
+ * timeseries_write_report() - Append peaks and hourly rollups to the report
+ * @ts: Aggregator after timeseries_finish()
+ * @f: Open report file (no-op if NULL)
+ */
+
+void timeseries_write_report(const timeseries_t *ts, FILE *f) {
+    static const char *const labels[TS_RESOLUTIONS] = {
+        "Peak second", "Peak minute", "Peak hour"
+    };
+
+    if (!f || ts->tiers[TS_SECOND].closed == 0) return;
+
+    fprintf(f, "\n### Traffic Over Time\n\n");
+    for (int level = 0; level < TS_RESOLUTIONS; level++) {
+        const ts_bucket_t *peak = &ts->tiers[level].peak;
+        uint32_t fn_count, unit_count;
+        uint8_t fn = bucket_top(peak->functions, peak->function_used, peak->by_function,
+                                &fn_count);
+        uint8_t unit = bucket_top(peak->units, peak->unit_used, peak->by_unit, &unit_count);
+        char when[32];
+
+        format_local(peak->start, peak_formats[level], when, sizeof(when));
+        fprintf(f, "- **%s:** %s — %u frames (%u exceptions, %u writes); "
+                   "top function %s (%u), top unit %u (%u)\n",
+                labels[level], when, peak->frames, peak->exceptions, peak->writes,
+                modbus_get_function_name(fn), fn_count, unit, unit_count);
+    }
+    fprintf(f, "- **Active seconds / minutes / hours:** %llu / %llu / %llu\n",
+            (unsigned long long)ts->tiers[TS_SECOND].closed,
+            (unsigned long long)ts->tiers[TS_MINUTE].closed,
+            (unsigned long long)ts->tiers[TS_HOUR].closed);
+    if (ts->late_frames > 0) {
+        fprintf(f, "- **Out-of-order frames:** %llu (counted in a later second)\n",
+                (unsigned long long)ts->late_frames);
+    }
+
+    // Hourly rollups, oldest first
+    const ts_tier_t *hours = &ts->tiers[TS_HOUR];
+    uint32_t first = hours->filled < hours->slots ? 0 : (hours->head + 1) % hours->slots;
+
+    fprintf(f, "\n");
+    if (hours->closed > hours->filled) {
+        fprintf(f, "Last %u of %llu hours with traffic:\n\n", hours->filled,
+                (unsigned long long)hours->closed);
+    }
+    fprintf(f, "| Hour | Frames | Exceptions | Writes | Top Function | Top Unit |\n");
+    fprintf(f, "|------|--------|------------|--------|--------------|----------|\n");
+    for (uint32_t i = 0; i < hours->filled; i++) {
+        const ts_bucket_t *b = &hours->ring[(first + i) % hours->slots];
+        uint32_t fn_count, unit_count;
+        uint8_t fn = bucket_top(b->functions, b->function_used, b->by_function, &fn_count);
+        uint8_t unit = bucket_top(b->units, b->unit_used, b->by_unit, &unit_count);
+        char when[32];
+
+        format_local(b->start, peak_formats[TS_HOUR], when, sizeof(when));
+        fprintf(f, "| %s | %u | %u | %u | %s (%u) | %u (%u) |\n", when, b->frames,
+                b->exceptions, b->writes, modbus_get_function_name(fn), fn_count, unit,
+                unit_count);
+    }
+}
+
+
+/**
+ * timeseries_free() - Release the rings
+ * @ts: Aggregator
+ */
+
+void timeseries_free(timeseries_t *ts) {
+    for (int level = 0; level < TS_RESOLUTIONS; level++) {
+        free(ts->tiers[level].ring);
+        ts->tiers[level].ring = NULL;
+    }
+    if (ts->export_file) {
+        fclose(ts->export_file);
+        ts->export_file = NULL;
+    }
+}
@@ -0,0 +1,214 @@
+/*
+ * timeseries.h - Per-second traffic counts with minute and hour rollups
+ *
+ * attack_stats_t only keeps the first and last packet time and one
+ * average rate, which hides short bursts in a long capture. The
+ * aggregator counts frames, exception responses, write requests and
+ * per-function and per-unit frames for every second of capture time.
+ * Each completed second is folded into its minute, each minute into its
+ * hour; every resolution keeps its most recent buckets in a ring and
+ * remembers its busiest bucket (peak second, minute and hour).
+ *
+ * Per-frame cost is O(1): counters are bumped in the current second,
+ * and closing a bucket only visits the function codes and units seen in
+ * it. Seconds without traffic are skipped, so rings hold the most
+ * recent non-empty buckets. Completed buckets can be streamed to a CSV
+ * file as they close.
+ *
+ * Copyright (C) 2025 Marty
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef TIMESERIES_H
+#define TIMESERIES_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "modbus_parser.h"
+
+
+/* Buckets kept per resolution */
+#define TIMESERIES_SECOND_SLOTS 120
+#define TIMESERIES_MINUTE_SLOTS 120
+#define TIMESERIES_HOUR_SLOTS 48
+
+
+/**
+ * enum ts_resolution_t - Bucket width
+ * @TS_SECOND: One second
+ * @TS_MINUTE: One minute
+ * @TS_HOUR: One hour
+ * @TS_RESOLUTIONS: Number of resolutions
+ */
+
+typedef enum {
+    TS_SECOND = 0,
+    TS_MINUTE,
+    TS_HOUR,
+    TS_RESOLUTIONS
+} ts_resolution_t;
+
+
+/**
+ * struct ts_bucket_t - Counts of one time interval
+ * @start: Interval start, seconds since epoch (capture clock)
+ * @frames: Frames in the interval
+ * @exceptions: Exception responses
+ * @writes: Write requests (FC 0x05, 0x06, 0x0F, 0x10, 0x15, 0x16, 0x17)
+ * @function_used: Entries in @functions
+ * @unit_used: Entries in @units
+ * @functions: Function codes with a non-zero @by_function, first seen first
+ * @units: Unit ids with a non-zero @by_unit
+ * @by_function: Frames per function code
+ * @by_unit: Frames per unit id
+ */
+
+typedef struct {
+    int64_t start;
+    uint32_t frames;
+    uint32_t exceptions;
+    uint32_t writes;
+    uint16_t function_used;
+    uint16_t unit_used;
+    uint8_t functions[256];
+    uint8_t units[256];
+    uint32_t by_function[256];
+    uint32_t by_unit[256];
+} ts_bucket_t;
+
+
+/**
+ * struct ts_tier_t - Ring of buckets of one resolution
+ * @width: Bucket width in seconds
+ * @slots: Ring size
+ * @ring: Buckets; @ring[@head] is the open one
+ * @head: Index of the open bucket
+ * @filled: Buckets in use (at most @slots)
+ * @open: @ring[@head] is still being filled
+ * @closed: Buckets completed so far
+ * @peak: Completed bucket with the most frames
+ */
+
+typedef struct {
+    uint32_t width;
+    uint32_t slots;
+    ts_bucket_t *ring;
+    uint32_t head;
+    uint32_t filled;
+    bool open;
+    uint64_t closed;
+    ts_bucket_t peak;
+} ts_tier_t;
+
+
+/**
+ * struct timeseries_t - Time-bucketed aggregator
+ * @tiers: Second, minute and hour rings
+ * @late_frames: Frames older than the open second (counted in it)
+ * @export_file: CSV output for completed buckets (NULL = none)
+ */
+
+typedef struct {
+    ts_tier_t tiers[TS_RESOLUTIONS];
+    uint64_t late_frames;
+    FILE *export_file;
+} timeseries_t;
+
+
+/**
+ * timeseries_init() - Allocate empty rings
+ * @ts: Aggregator
+ *
+ * Return: false on allocation failure (prints an error)
+ */
+
+bool timeseries_init(timeseries_t *ts);
+
+
+/**
+ * timeseries_export() - Stream completed buckets to a CSV file
+ * @ts: Aggregator
+ * @path: Output file (created, header written)
+ *
+ * Columns: resolution, start (epoch seconds), time (UTC), frames,
+ * exceptions, writes, functions and units as "code=count;..." lists.
+ *
+ * Return: false if the file could not be created (prints an error)
+ */
+
+bool timeseries_export(timeseries_t *ts, const char *path);
+
+
+/**
+ * timeseries_update() - Count one frame
+ * @ts: Aggregator
+ * @frame: Parsed frame
+ * @is_request: true if sent to the server
+ * @timestamp_ns: Capture time in nanoseconds since epoch
+ */
+
+void timeseries_update(timeseries_t *ts, const modbus_tcp_frame_t *frame, bool is_request,
+                       int64_t timestamp_ns);
+
+
+/**
+ * timeseries_finish() - Close the open buckets at the end of the capture
+ * @ts: Aggregator
+ *
+ * The last second, minute and hour then count towards the peaks and are
+ * exported. Closes the export file.
+ *
+ * Return: false if the export file lost data (prints a warning)
+ */
+
+bool timeseries_finish(timeseries_t *ts);
+
+
+/**
+ * timeseries_save() - Write aggregator state to a checkpoint
+ * @ts: Aggregator
+ * @f: Open binary file
+ *
+ * Return: false on write error
+ */
+
+bool timeseries_save(const timeseries_t *ts, FILE *f);
+
+
+/**
+ * timeseries_restore() - Load state written by timeseries_save()
+ * @ts: Aggregator from timeseries_init()
+ * @f: Open binary file
+ *
+ * Return: false on a short or inconsistent checkpoint
+ */
+
+bool timeseries_restore(timeseries_t *ts, FILE *f);
+
+
+/**
+ * timeseries_display_summary() - Print peak second, minute and hour
+ * @ts: Aggregator after timeseries_finish()
+ */
+
+void timeseries_display_summary(const timeseries_t *ts);
+
+
+/**
+ * timeseries_write_report() - Append peaks and hourly rollups to the report
+ * @ts: Aggregator after timeseries_finish()
+ * @f: Open report file (no-op if NULL)
+ */
+
+void timeseries_write_report(const timeseries_t *ts, FILE *f);
+
+
+/**
+ * timeseries_free() - Release the rings
+ * @ts: Aggregator
+ */
+
+void timeseries_free(timeseries_t *ts);
+
+#endif /* TIMESERIES_H */
@@ -0,0 +1,271 @@
+/*
+ * sketch_merge.c - Check that merged sketches match one full pass
+ *
+ * Usage: sketch_merge
+ *
+ * Feeds a synthetic request stream (40 masters, skewed tuple frequencies
+ * plus a few hot polling tuples)
+ * to three sketch layers: one over the whole stream and one over each
+ * half, then folds the second half into the first with
+ * sketch_stats_merge() and checks the result:
+ *
+ * - HyperLogLog and count-min: merging is exact, so every register and
+ *   counter equals the full pass; estimates are within 3 standard errors
+ * - space-saving: every monitored count brackets the true count
+ *   (count - error <= true <= count) and every tuple above N / k is
+ *   monitored, i.e. the min-count charge kept the guarantee
+ * - layers with different budgets are refused
+ *
+ * The smallest budget is used so the summaries are full and the merge
+ * has to charge missing keys. Registered with CTest as sketch_merge.
+ *
+ * Copyright (C) 2025 Marty
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "sketch.h"
+
+
+/* Synthetic stream shape */
+#define TEST_MASTERS 40
+#define TEST_FRAMES 200000
+#define TEST_ADDRESSES 1024
+
+/* Share of frames (percent) spread over a few hot tuples */
+#define TEST_HOT_PERCENT 30
+#define TEST_HOT_TUPLES 6
+
+/* Function codes used, with the data table each one reads */
+static const uint8_t test_functions[] = { 0x03, 0x04 };
+#define TEST_FUNCTIONS (sizeof(test_functions) / sizeof(test_functions[0]))
+
+/* True tuple counts, indexed by tuple_index() */
+static uint32_t true_counts[TEST_MASTERS * TEST_FUNCTIONS * TEST_ADDRESSES];
+
+/* Units addressed; registers stay below 2 * TEST_ADDRESSES */
+#define TEST_UNITS 4
+#define TEST_REGISTER_SPAN (2 * TEST_ADDRESSES)
+
+/* True distinct (unit, table, register) per master, one bit each */
+static uint64_t true_registers[TEST_MASTERS]
+                             [TEST_UNITS * TEST_FUNCTIONS * TEST_REGISTER_SPAN / 64];
+
+static int failures;
+
+
+/*
+ * check() - Count and report a failed condition
+ */
+
+static void check(int ok, const char *what, double got, double want) {
+    if (!ok) {
+        fprintf(stderr, "FAIL %s: got %.1f, want %.1f\n", what, got, want);
+        failures++;
+    }
+}
+
+
+/*
+ * next_random() - 64-bit LCG, deterministic across platforms
+ */
+
+static uint32_t next_random(uint64_t *state) {
+    *state = *state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (uint32_t)(*state >> 33);
+}
+
+
+/*
+ * tuple_index() - Slot of a (master, function, address) tuple
+ */
+
+static uint32_t tuple_index(uint32_t master, uint32_t function, uint32_t address) {
+    return (master * TEST_FUNCTIONS + function) * TEST_ADDRESSES + address;
+}
+
+
+/*
+ * make_master() - Endpoint of synthetic master n (10.1.0.n)
+ */
+
+static void make_master(endpoint_t *ep, uint32_t n) {
+    endpoint_from_ipv4(ep, (10u << 24) | (1u << 16) | n);
+}
+
+
+/*
+ * feed() - Account frames [from, to) of the stream in one or two layers
+ */
+
+static void feed(sketch_stats_t *a, sketch_stats_t *b, uint32_t from, uint32_t to,
+                 bool record) {
+    uint64_t state = 42;
+    uint8_t data[4];
+    modbus_tcp_frame_t frame = { .data = data, .data_length = sizeof(data) };
+
+    for (uint32_t i = 0; i < to; i++) {
+        // Skewed: squaring a uniform value favours low masters and addresses
+        uint32_t r = next_random(&state);
+        uint32_t master = (uint32_t)((uint64_t)r * r / ((uint64_t)UINT32_MAX * UINT32_MAX /
+                                                       TEST_MASTERS));
+        uint32_t u = next_random(&state) % TEST_ADDRESSES;
+        uint32_t address = u * u / TEST_ADDRESSES;
+        uint32_t function = next_random(&state) % TEST_FUNCTIONS;
+        uint32_t quantity = 1 + next_random(&state) % 8;
+        uint8_t unit = (uint8_t)(1 + next_random(&state) % TEST_UNITS);
+        uint32_t hot = next_random(&state) % 100;
+
+        if (master >= TEST_MASTERS) master = TEST_MASTERS - 1;
+        if (hot < TEST_HOT_PERCENT) {
+            // A few polling loops dominate: these tuples are above N / k
+            master = hot % TEST_HOT_TUPLES;
+            function = 0;
+            address = 100 + hot % TEST_HOT_TUPLES;
+        }
+        if (i < from) continue;
+
+        endpoint_t src;
+        make_master(&src, master);
+        frame.mbap.unit_id = unit;
+        frame.function_code = test_functions[function];
+        data[0] = (uint8_t)(address >> 8);
+        data[1] = (uint8_t)address;
+        data[2] = (uint8_t)(quantity >> 8);
+        data[3] = (uint8_t)quantity;
+
+        sketch_stats_update(a, &frame, &src, 40000);
+        if (b) sketch_stats_update(b, &frame, &src, 40000);
+
+        if (record) {
+            true_counts[tuple_index(master, function, address)]++;
+            for (uint32_t q = 0; q < quantity; q++) {
+                uint32_t bit = ((unit - 1) * TEST_FUNCTIONS + function) * TEST_REGISTER_SPAN +
+                               address + q;
+                true_registers[master][bit / 64] |= 1ULL << (bit % 64);
+            }
+        }
+    }
+}
+
+
+/*
+ * find_slot() - Sketch slot of synthetic master n, or NULL
+ */
+
+static const sketch_master_t *find_slot(const sketch_stats_t *sk, uint32_t n) {
+    endpoint_t ep;
+    make_master(&ep, n);
+    for (int i = 0; i < SKETCH_MAX_MASTERS; i++) {
+        if (endpoint_equal(&sk->masters[i].master, &ep)) {
+            return &sk->masters[i];
+        }
+    }
+    return NULL;
+}
+
+
+/*
+ * check_cardinality() - Merged HLLs equal the full pass and are in bounds
+ */
+
+static void check_cardinality(const sketch_stats_t *full, const sketch_stats_t *merged) {
+    for (uint32_t n = 0; n < TEST_MASTERS; n++) {
+        const sketch_master_t *f = find_slot(full, n);
+        const sketch_master_t *m = find_slot(merged, n);
+        if (!f || !m) {
+            check(f == m, "master present in both layers", m != NULL, f != NULL);
+            continue;
+        }
+
+        size_t bytes = (size_t)1 << f->registers.precision;
+        check(memcmp(f->registers.registers, m->registers.registers, bytes) == 0,
+              "HLL registers equal after merge", 0, 0);
+        check(m->requests == f->requests, "requests", (double)m->requests,
+              (double)f->requests);
+
+        double truth = 0;
+        for (size_t w = 0; w < sizeof(true_registers[n]) / 8; w++) {
+            truth += __builtin_popcountll(true_registers[n][w]);
+        }
+        double est = hll_estimate(&m->registers);
+        double bound = 3.0 * hll_relative_error(&m->registers) * truth + 1.0;
+        check(fabs(est - truth) <= bound, "distinct registers within 3 sigma", est, truth);
+    }
+}
+
+
+/*
+ * check_heavy_hitters() - Space-saving bounds after the merge
+ */
+
+static void check_heavy_hitters(const sketch_stats_t *merged) {
+    const spacesaving_t *ss = &merged->heavy;
+    ss_entry_t *top = malloc(ss->capacity * sizeof(ss_entry_t));
+    uint32_t k = ss_top(ss, top, ss->capacity);
+    static uint8_t monitored[TEST_MASTERS * TEST_FUNCTIONS * TEST_ADDRESSES];
+
+    check(ss->total == TEST_FRAMES, "space-saving N", (double)ss->total, TEST_FRAMES);
+    memset(monitored, 0, sizeof(monitored));
+
+    for (uint32_t i = 0; i < k; i++) {
+        uint32_t master = endpoint_ipv4(&top[i].tuple.master) & 0xFF;
+        uint32_t function = top[i].tuple.function_code == test_functions[0] ? 0 : 1;
+        uint32_t idx = tuple_index(master, function, top[i].tuple.address);
+        uint64_t truth = true_counts[idx];
+
+        monitored[idx] = 1;
+        check(top[i].count >= truth, "count >= true count", (double)top[i].count,
+              (double)truth);
+        check(top[i].count - top[i].error <= truth, "count - error <= true count",
+              (double)(top[i].count - top[i].error), (double)truth);
+    }
+
+    for (uint32_t idx = 0; idx < TEST_MASTERS * TEST_FUNCTIONS * TEST_ADDRESSES; idx++) {
+        if ((uint64_t)true_counts[idx] * ss->capacity > ss->total) {
+            check(monitored[idx], "tuple above N/k monitored", true_counts[idx],
+                  (double)ss->total / ss->capacity);
+        }
+    }
+    free(top);
+}
+
+
+int main(void) {
+    static sketch_stats_t full, first, second, other;
+
+    if (!sketch_stats_init(&full, SKETCH_MIN_BUDGET) ||
+        !sketch_stats_init(&first, SKETCH_MIN_BUDGET) ||
+        !sketch_stats_init(&second, SKETCH_MIN_BUDGET) ||
+        !sketch_stats_init(&other, SKETCH_MIN_BUDGET * 2)) {
+        fprintf(stderr, "sketch_merge: out of memory\n");
+        return 1;
+    }
+
+    feed(&full, NULL, 0, TEST_FRAMES, true);
+    feed(&first, NULL, 0, TEST_FRAMES / 2, false);
+    feed(&second, NULL, TEST_FRAMES / 2, TEST_FRAMES, false);
+
+    check(sketch_stats_merge(&first, &second), "merge of equal layouts", 0, 1);
+    check(!sketch_stats_merge(&first, &other), "merge of different budgets refused", 1, 0);
+
+    check_cardinality(&full, &first);
+    check(first.tuples.total == full.tuples.total, "count-min N",
+          (double)first.tuples.total, (double)full.tuples.total);
+    check(memcmp(first.tuples.counters, full.tuples.counters,
+                 (size_t)full.tuples.width * full.tuples.depth * sizeof(uint32_t)) == 0,
+          "count-min counters equal after merge", 0, 0);
+    check_heavy_hitters(&first);
+
+    sketch_stats_free(&full);
+    sketch_stats_free(&first);
+    sketch_stats_free(&second);
+    sketch_stats_free(&other);
+
+    printf("sketch_merge: %s (%d failures)\n", failures ? "FAIL" : "ok", failures);
+    return failures ? 1 : 0;
+}
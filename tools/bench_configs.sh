@@ -0,0 +1,86 @@
+#!/bin/sh
+#
+# bench_configs.sh - Build every optimisation configuration and time it
+#
+# Usage: tools/bench_configs.sh [capture.pcap] [runs]
+#
+# Builds Debug, RelWithDebInfo, Release without and with LTO, Release
+# with -march=native, and the PGO build (portable and native) under
+# _bench/, then times each on the capture (default: the synthetic corpus
+# generated by the first build) in table and verbose mode. Prints a
+# markdown table of the best wall-clock time of [runs] (default 5).
+# Extra CMake arguments (e.g. libpcap paths) can be passed in
+# $BENCH_CMAKE_ARGS.
+#
+# Copyright (C) 2025 Marty
+# SPDX-License-Identifier: GPL-3.0-or-later
+#
+
+set -e
+
+SRC=$(cd "$(dirname "$0")/.." && pwd)
+OUT=$SRC/_bench
+CAPTURE=$1
+RUNS=${2:-5}
+JOBS=$(nproc 2>/dev/null || echo 4)
+
+mkdir -p "$OUT"
+
+# build NAME [cmake args...] - configure and build one variant
+build() {
+    name=$1
+    shift
+    cmake -S "$SRC" -B "$OUT/$name" $BENCH_CMAKE_ARGS "$@" > "$OUT/$name.log"
+    cmake --build "$OUT/$name" -j"$JOBS" --target modbus_parser corpus >> "$OUT/$name.log"
+}
+
+# best_ms EXE ARGS... - best wall time over $RUNS runs, in milliseconds
+best_ms() {
+    best=
+    i=0
+    while [ $i -lt "$RUNS" ]; do
+        start=$(date +%s%N)
+        "$@" > /dev/null 2>&1
+        end=$(date +%s%N)
+        ms=$(( (end - start) / 1000000 ))
+        if [ -z "$best" ] || [ $ms -lt "$best" ]; then
+            best=$ms
+        fi
+        i=$((i + 1))
+    done
+    echo "$best"
+}
+
+build debug -DCMAKE_BUILD_TYPE=Debug
+build relwithdebinfo -DCMAKE_BUILD_TYPE=RelWithDebInfo
+build release-nolto -DCMAKE_BUILD_TYPE=Release -DMODBUS_ENABLE_LTO=OFF
+build release -DCMAKE_BUILD_TYPE=Release
+build release-native -DCMAKE_BUILD_TYPE=Release -DMODBUS_NATIVE=ON
+build pgo -DCMAKE_BUILD_TYPE=Release
+cmake --build "$OUT/pgo" --target pgo >> "$OUT/pgo.log"
+build pgo-native -DCMAKE_BUILD_TYPE=Release -DMODBUS_NATIVE=ON
+cmake --build "$OUT/pgo-native" --target pgo >> "$OUT/pgo-native.log"
+
+if [ -z "$CAPTURE" ]; then
+    CAPTURE=$OUT/release/corpus/synthetic.pcap
+fi
+
+echo "Capture: $CAPTURE ($(wc -c < "$CAPTURE") bytes), best of $RUNS"
+echo
+echo "| Configuration | Table (ms) | Verbose (ms) | Speedup vs Debug |"
+echo "|---------------|-----------:|-------------:|-----------------:|"
+
+base=
+for name in debug relwithdebinfo release-nolto release release-native pgo pgo-native; do
+    exe=$OUT/$name/modbus_parser
+    case $name in
+        pgo*) exe=$OUT/$name/pgo/modbus_parser ;;
+    esac
+    table=$(best_ms "$exe" "$CAPTURE")
+    verbose=$(best_ms "$exe" -v "$CAPTURE")
+    if [ -z "$base" ]; then
+        base=$table
+    fi
+    speedup=$(awk "BEGIN { printf \"%.2fx\", $base / ($table > 0 ? $table : 1) }")
+    echo "| $name | $table | $verbose | $speedup |"
+done
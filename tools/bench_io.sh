@@ -0,0 +1,101 @@
+#!/bin/sh
+#
+# bench_io.sh - Time the capture I/O backends on warm and cold page cache
+#
+# Usage: tools/bench_io.sh [capture.pcap] [runs]
+#
+# Builds the Release configuration under _bench/release, then times
+# modbus_parser on the capture (default: the synthetic corpus) with
+# --io-backend libpcap, mmap and uring at several queue depths. Prints a
+# markdown table of the best wall-clock time of [runs] (default 5).
+# Warm runs read from the page cache; cold runs drop it before every run
+# and are only measured when run as root (Linux). Put the capture on the
+# storage being evaluated. Extra CMake arguments can be passed in
+# $BENCH_CMAKE_ARGS.
+#
+# Copyright (C) 2025 Marty
+# SPDX-License-Identifier: GPL-3.0-or-later
+#
+
+set -e
+
+SRC=$(cd "$(dirname "$0")/.." && pwd)
+OUT=$SRC/_bench
+CAPTURE=$1
+RUNS=${2:-5}
+JOBS=$(nproc 2>/dev/null || echo 4)
+EXE=$OUT/release/modbus_parser
+
+mkdir -p "$OUT"
+cmake -S "$SRC" -B "$OUT/release" $BENCH_CMAKE_ARGS -DCMAKE_BUILD_TYPE=Release > "$OUT/release.log"
+cmake --build "$OUT/release" -j"$JOBS" --target modbus_parser corpus >> "$OUT/release.log"
+
+if [ -z "$CAPTURE" ]; then
+    CAPTURE=$OUT/release/corpus/synthetic.pcap
+fi
+
+COLD=no
+if [ -w /proc/sys/vm/drop_caches ]; then
+    COLD=yes
+fi
+
+# drop_cache - evict the capture from the page cache
+drop_cache() {
+    sync
+    echo 3 > /proc/sys/vm/drop_caches
+}
+
+# best_ms COLD ARGS... - best wall time over $RUNS runs, in milliseconds
+best_ms() {
+    cold=$1
+    shift
+    best=
+    i=0
+    while [ $i -lt "$RUNS" ]; do
+        if [ "$cold" = yes ]; then
+            drop_cache
+        fi
+        start=$(date +%s%N)
+        "$@" > /dev/null 2>&1
+        end=$(date +%s%N)
+        ms=$(( (end - start) / 1000000 ))
+        if [ -z "$best" ] || [ $ms -lt "$best" ]; then
+            best=$ms
+        fi
+        i=$((i + 1))
+    done
+    echo "$best"
+}
+
+echo "Capture: $CAPTURE ($(wc -c < "$CAPTURE") bytes), best of $RUNS"
+echo
+echo "| Backend | Warm (ms) | Cold (ms) |"
+echo "|---------|----------:|----------:|"
+
+for variant in libpcap mmap uring:1 uring:8 uring:32 uring:32:4096; do
+    backend=${variant%%:*}
+    args="--io-backend $backend"
+    case $variant in
+        uring:*:*)
+            depth=$(echo "$variant" | cut -d: -f2)
+            kib=$(echo "$variant" | cut -d: -f3)
+            args="$args --io-depth $depth --io-buffer $kib"
+            ;;
+        uring:*)
+            args="$args --io-depth ${variant#uring:}"
+            ;;
+    esac
+
+    # Skip backends this system cannot run (e.g. io_uring disabled)
+    if ! "$EXE" $args "$CAPTURE" > /dev/null 2>&1; then
+        echo "| $variant | unavailable | unavailable |"
+        continue
+    fi
+
+    warm=$(best_ms no "$EXE" $args "$CAPTURE")
+    cold=-
+    if [ "$COLD" = yes ]; then
+        cold=$(best_ms yes "$EXE" $args "$CAPTURE")
+    fi
+    echo "| $variant | $warm | $cold |"
+done
@@ -0,0 +1,171 @@
+#!/usr/bin/env python3
+#
+# gen_corpus.py - Synthetic Modbus TCP capture for training and benchmarks
+#
+# Usage: gen_corpus.py [--frames N] [--seed S] output.pcap
+#
+# Writes a classic little-endian pcap (Ethernet, microsecond timestamps)
+# that exercises the decoder the way plant traffic does: several masters
+# polling slaves on fixed cycles with matching responses, occasional
+# writes, exception responses, a function-code/unit-id scanner and a few
+# malformed payloads. Output is deterministic for a given seed. Only the
+# Python standard library is used so it runs wherever CMake finds Python.
+#
+# Copyright (C) 2025 Marty
+# SPDX-License-Identifier: GPL-3.0-or-later
+#
+
+import argparse
+import random
+import struct
+
+PCAP_MAGIC = 0xa1b2c3d4
+LINKTYPE_ETHERNET = 1
+START_TIME = 1700000000.0
+
+
+def ipv4(addr):
+    return bytes(int(x) for x in addr.split("."))
+
+
+class Writer:
+    def __init__(self, path):
+        self.f = open(path, "wb")
+        self.f.write(struct.pack("<IHHiIII", PCAP_MAGIC, 2, 4, 0, 0, 65535, LINKTYPE_ETHERNET))
+        self.count = 0
+
+    def packet(self, ts, src, dst, sport, dport, payload, snap=None):
+        tcp = struct.pack("!HHIIBBHHH", sport, dport, self.count, 1, 0x50, 0x18, 65535, 0, 0)
+        ip = struct.pack("!BBHHHBBH4s4s", 0x45, 0, 20 + len(tcp) + len(payload), self.count & 0xFFFF,
+                         0, 64, 6, 0, ipv4(src), ipv4(dst))
+        frame = b"\x02\x00\x00\x00\x00\x02" + b"\x02\x00\x00\x00\x00\x01" + b"\x08\x00" + ip + tcp + payload
+        cap = frame if snap is None else frame[:snap]
+        usec = int(round((ts % 1) * 1e6))
+        self.f.write(struct.pack("<IIII", int(ts) + usec // 1000000, usec % 1000000, len(cap), len(frame)))
+        self.f.write(cap)
+        self.count += 1
+
+    def close(self):
+        self.f.close()
+
+
+def mbap(tid, unit, pdu, protocol=0, length=None):
+    return struct.pack("!HHHB", tid, protocol, len(pdu) + 1 if length is None else length, unit) + pdu
+
+
+def request_pdu(rng, fc, addr, qty):
+    if fc in (0x01, 0x02, 0x03, 0x04):
+        return struct.pack("!BHH", fc, addr, qty)
+    if fc == 0x05:
+        return struct.pack("!BHH", fc, addr, rng.choice((0x0000, 0xFF00)))
+    if fc == 0x06:
+        return struct.pack("!BHH", fc, addr, rng.randrange(65536))
+    if fc == 0x0F:
+        nbytes = (qty + 7) // 8
+        return struct.pack("!BHHB", fc, addr, qty, nbytes) + bytes(rng.randrange(256) for _ in range(nbytes))
+    if fc == 0x10:
+        return struct.pack("!BHHB", fc, addr, qty, qty * 2) + \
+            b"".join(struct.pack("!H", rng.randrange(65536)) for _ in range(qty))
+    if fc == 0x17:
+        return struct.pack("!BHHHHB", fc, addr, qty, addr + 100, 1, 2) + b"\x00\x01"
+    return struct.pack("!B", fc)
+
+
+def response_pdu(rng, fc, addr, qty, req):
+    if fc in (0x01, 0x02):
+        nbytes = (qty + 7) // 8
+        return struct.pack("!BB", fc, nbytes) + bytes(rng.randrange(256) for _ in range(nbytes))
+    if fc in (0x03, 0x04, 0x17):
+        return struct.pack("!BB", fc, qty * 2) + \
+            b"".join(struct.pack("!H", rng.randrange(65536)) for _ in range(qty))
+    if fc in (0x05, 0x06):
+        return req
+    if fc in (0x0F, 0x10):
+        return struct.pack("!BHH", fc, addr, qty)
+    return struct.pack("!BB", fc | 0x80, 0x01)
+
+
+class Poller:
+    """One master/slave poll loop over a fixed list of register blocks."""
+
+    def __init__(self, rng, index):
+        self.master = "10.1.%d.%d" % (index // 200, 10 + index % 200)
+        self.slave = "10.2.0.%d" % (10 + index % 20)
+        self.port = 49152 + index
+        self.unit = 1 + index % 4
+        self.period = rng.choice((0.1, 0.25, 0.5, 1.0))
+        self.blocks = [(rng.choice((0x03, 0x03, 0x04, 0x01, 0x02)),
+                        rng.randrange(0, 4000, 10), rng.randrange(1, 40))
+                       for _ in range(rng.randrange(1, 5))]
+        self.next_time = START_TIME + rng.random() * self.period
+        self.tid = rng.randrange(65536)
+        self.step = 0
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Generate a synthetic Modbus TCP capture")
+    ap.add_argument("--frames", type=int, default=200000, help="approximate frame count")
+    ap.add_argument("--seed", type=int, default=502)
+    ap.add_argument("--pollers", type=int, default=24, help="master/slave poll loops")
+    ap.add_argument("output")
+    args = ap.parse_args()
+
+    rng = random.Random(args.seed)
+    out = Writer(args.output)
+    pollers = [Poller(rng, i) for i in range(args.pollers)]
+    scan_unit = 0
+    scan_fc = 0
+
+    while out.count < args.frames:
+        p = min(pollers, key=lambda q: q.next_time)
+        t = p.next_time
+        fc, addr, qty = p.blocks[p.step % len(p.blocks)]
+        p.step += 1
+        p.tid = (p.tid + 1) & 0xFFFF
+
+        # Mostly reads; the odd setpoint write
+        roll = rng.random()
+        if roll < 0.03:
+            fc, qty = rng.choice(((0x06, 1), (0x10, min(qty, 8)), (0x05, 1), (0x0F, 16), (0x17, 4)))
+
+        req = request_pdu(rng, fc, addr, qty)
+        out.packet(t, p.master, p.slave, p.port, 502, mbap(p.tid, p.unit, req))
+
+        latency = 0.0005 + rng.random() * 0.004
+        if roll > 0.995:
+            rsp = struct.pack("!BB", fc | 0x80, rng.choice((0x02, 0x03, 0x04, 0x06)))
+        else:
+            rsp = response_pdu(rng, fc, addr, qty, req)
+        out.packet(t + latency, p.slave, p.master, 502, p.port, mbap(p.tid, p.unit, rsp))
+
+        # Scanner sweeping function codes and unit ids, answered with exceptions
+        if rng.random() < 0.01:
+            scan_fc = (scan_fc + 1) % 128
+            scan_unit = (scan_unit + 7) % 256
+            out.packet(t + 0.0001, "10.9.9.9", p.slave, 31337, 502,
+                       mbap(scan_fc, scan_unit, struct.pack("!BHH", scan_fc, 0, 1)))
+            out.packet(t + 0.0002, p.slave, "10.9.9.9", 502, 31337,
+                       mbap(scan_fc, scan_unit, struct.pack("!BB", scan_fc | 0x80, 0x01)))
+
+        # Malformed payloads the parser must classify, not crash on
+        if rng.random() < 0.002:
+            kind = rng.randrange(4)
+            good = mbap(p.tid, p.unit, request_pdu(rng, 0x03, 0, 10))
+            if kind == 0:
+                out.packet(t + 0.0003, p.master, p.slave, p.port, 502,
+                           mbap(p.tid, p.unit, b"\x03\x00\x00\x00\x0a", protocol=7))
+            elif kind == 1:
+                out.packet(t + 0.0003, p.master, p.slave, p.port, 502, good, snap=14 + 20 + 20 + 9)
+            elif kind == 2:
+                out.packet(t + 0.0003, p.master, p.slave, p.port, 502,
+                           mbap(p.tid, p.unit, b"\x03\x00\x00\x00\x0a", length=60))
+            else:
+                out.packet(t + 0.0003, p.master, p.slave, p.port, 502, b"GET / HTTP/1.1\r\n\r\n")
+
+        p.next_time += p.period * (1.0 + (rng.random() - 0.5) * 0.02)
+
+    out.close()
+
+
+if __name__ == "__main__":
+    main()